@@ -177,6 +177,19 @@ example_t* pylist_to_example(PyObject*input)
     }
     return e;
 }
+PyObject* variable_to_pyobject(variable_t*v)
+{
+    if(v->type == TEXT)
+        return pystring_fromstring(v->text);
+    else if(v->type == CATEGORICAL)
+        return pyint_fromlong(v->category);
+    else if(v->type == CONTINUOUS)
+        return PyFloat_FromDouble(v->value);
+    else if(v->type == MISSING)
+        return PY_NONE;
+    else
+        return PY_ERROR("internal error: bad variable type %d", v->type);
+}
 //---------------------------------------------------------------------
 static void model_dealloc(PyObject* _self) {
     ModelObject* self = (ModelObject*)_self;
@@ -241,16 +254,65 @@ static PyObject* py_model_predict(PyObject* _self, PyObject* args, PyObject* kwa
     row_destroy(row);
     example_destroy(e);
 
-    if(i.type == TEXT)
-        return pystring_fromstring(i.text);
-    else if(i.type == CATEGORICAL)
-        return pyint_fromlong(i.category);
-    else if(i.type == CONTINUOUS)
-        return PyFloat_FromDouble(i.value);
-    else if(i.type == MISSING)
-        return PY_NONE;
-    else
-        return PY_ERROR("internal error: bad variable type %d", i.type);
+    return variable_to_pyobject(&i);
+}
+PyDoc_STRVAR(model_predict_batch_doc, \
+"predict_batch([{feature1:value1,...},{feature1:value1,...},...])\n\n"
+"Evaluate the model for a list of inputs, and return the list of predictions."
+);
+static PyObject* py_model_predict_batch(PyObject* _self, PyObject* args, PyObject* kwargs)
+{
+    ModelObject* self = (ModelObject*)_self;
+    PyObject*data = 0;
+    static char *kwlist[] = {"data", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O", kwlist, &data))
+        return NULL;
+    if(!PyList_Check(data))
+        return PY_ERROR("first argument must be a list");
+
+    int num_rows = PyList_Size(data);
+    int num_inputs = self->model->sig->num_inputs;
+    variable_t**columns = (variable_t**)malloc(sizeof(variable_t*)*num_inputs);
+    int x,y;
+    for(x=0;x<num_inputs;x++) {
+        columns[x] = (variable_t*)malloc(sizeof(variable_t)*num_rows);
+    }
+    PyObject*ret = NULL;
+    for(y=0;y<num_rows;y++) {
+        example_t*e = pylist_to_example(PyList_GetItem(data, y));
+        if(!e)
+            goto cleanup;
+        if(e->num_inputs != num_inputs) {
+            PY_ERROR("You supplied %d inputs for a model with %d inputs", e->num_inputs, num_inputs);
+            example_destroy(e);
+            goto cleanup;
+        }
+        row_t*row = example_to_row(e, self->model->sig->column_names);
+        example_destroy(e);
+        if(!row) {
+            PY_ERROR("Can't create row from data");
+            goto cleanup;
+        }
+        for(x=0;x<num_inputs;x++) {
+            columns[x][y] = row->inputs[x];
+        }
+        row_destroy(row);
+    }
+
+    variable_t*results = (variable_t*)malloc(sizeof(variable_t)*num_rows);
+    model_predict_batch(self->model, columns, num_rows, results);
+    ret = PyList_New(num_rows);
+    for(y=0;y<num_rows;y++) {
+        PyList_SetItem(ret, y, variable_to_pyobject(&results[y]));
+    }
+    free(results);
+
+cleanup:
+    for(x=0;x<num_inputs;x++) {
+        free(columns[x]);
+    }
+    free(columns);
+    return ret;
 }
 PyDoc_STRVAR(model_generate_code_doc, \
 "generate_code(language)\n\n"
@@ -295,6 +357,7 @@ static PyMethodDef model_methods[] =
     /* Model functions */
     {"save", (PyCFunction)py_model_save, METH_KEYWORDS, model_save_doc},
     {"predict", (PyCFunction)py_model_predict, METH_KEYWORDS, model_predict_doc},
+    {"predict_batch", (PyCFunction)py_model_predict_batch, METH_KEYWORDS, model_predict_batch_doc},
     {"generate_code", (PyCFunction)py_model_generate_code, METH_KEYWORDS, model_generate_code_doc},
     {0,0,0,0}
 };
@@ -306,6 +306,18 @@ static VALUE rb_load_dataset(VALUE module, VALUE _filename)
     return cls;
 }
 
+static VALUE variable_to_value(variable_t*v)
+{
+    if(v->type == CONTINUOUS)
+        return rb_float_new(v->value);
+    else if(v->type == CATEGORICAL)
+        return INT2FIX(v->category);
+    else if(v->type == TEXT)
+        return rb_str_new2(v->text);
+    else
+        return T_NIL;
+}
+
 /* call-seq:
  *   model.predict({feature1=>value1,feature2=>value2}) -> prediction
  *
@@ -328,14 +340,76 @@ static VALUE rb_model_predict(VALUE cls, VALUE input)
     variable_t prediction = model_predict(model->model, row);
     row_destroy(row);
 
-    if(prediction.type == CONTINUOUS)
-        return rb_float_new(prediction.value);
-    else if(prediction.type == CATEGORICAL)
-        return INT2FIX(prediction.category);
-    else if(prediction.type == TEXT)
-        return rb_str_new2(prediction.text);
-    else
-        return T_NIL;
+    return variable_to_value(&prediction);
+}
+
+/* call-seq:
+ *   model.predict_batch([{feature1=>value1,...},{feature1=>value1,...},...]) -> array
+ *
+ * Use the model to classify a list of feature sets. Returns an array with
+ * one prediction per entry.
+ */
+static void free_columns(variable_t**columns, int num_inputs)
+{
+    int x;
+    for(x=0;x<num_inputs;x++) {
+        free(columns[x]);
+    }
+    free(columns);
+}
+static VALUE rb_model_predict_batch(VALUE cls, VALUE input)
+{
+    Get_Model(model,cls);
+    Check_Type(input, T_ARRAY);
+
+    int num_rows = RARRAY(input)->len;
+    int num_inputs = model->model->sig->num_inputs;
+    int x,y;
+
+    /* rb_raise() doesn't return, so check what we can before allocating
+       anything */
+    for(y=0;y<num_rows;y++) {
+        VALUE item = RARRAY(input)->ptr[y];
+        if(TYPE(item) != T_ARRAY && TYPE(item) != T_HASH) {
+            rb_raise(rb_eArgError, "Entries of predict_batch() argument must be arrays or hashes");
+        }
+    }
+
+    variable_t**columns = (variable_t**)malloc(sizeof(variable_t*)*num_inputs);
+    for(x=0;x<num_inputs;x++) {
+        columns[x] = (variable_t*)malloc(sizeof(variable_t)*num_rows);
+    }
+    for(y=0;y<num_rows;y++) {
+        VALUE item = RARRAY(input)->ptr[y];
+        example_t*e = value_to_example(item);
+        if(e->num_inputs != num_inputs) {
+            int num = e->num_inputs;
+            example_destroy(e);
+            free_columns(columns, num_inputs);
+            rb_raise(rb_eArgError, "You supplied %d inputs for a model with %d inputs", num, num_inputs);
+        }
+        row_t*row = example_to_row(e, model->model->sig->column_names);
+        example_destroy(e);
+        if(!row) {
+            free_columns(columns, num_inputs);
+            rb_raise(rb_eArgError, "Can't create row from data");
+        }
+        for(x=0;x<num_inputs;x++) {
+            columns[x][y] = row->inputs[x];
+        }
+        row_destroy(row);
+    }
+
+    variable_t*results = (variable_t*)malloc(sizeof(variable_t)*num_rows);
+    model_predict_batch(model->model, columns, num_rows, results);
+
+    volatile VALUE list = rb_ary_new2(num_rows);
+    for(y=0;y<num_rows;y++) {
+        rb_ary_store(list, y, variable_to_value(&results[y]));
+    }
+    free(results);
+    free_columns(columns, num_inputs);
+    return list;
 }
 static void rb_model_mark(model_internal_t*model)
 {
@@ -416,6 +490,7 @@ void Init_mrscake()
     Model = rb_define_class_under(mrscake, "Model", rb_cObject);
     rb_define_alloc_func(Model, rb_model_allocate);
     rb_define_method(Model, "predict", rb_model_predict, 1);
+    rb_define_method(Model, "predict_batch", rb_model_predict_batch, 1);
     rb_define_method(Model, "generate_code", rb_model_generate_code, 1);
     rb_define_method(Model, "print", rb_model_print, 0);
     rb_define_method(Model, "save", rb_model_save, 1);
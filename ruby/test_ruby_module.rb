@@ -25,6 +25,7 @@ p model.predict([0.1,0.0,:bli])
 p model.predict([0.2,0.5,:bla])
 p model.predict([0.1,1.0,:bli])
 p model.predict([0.1,1.0,:blo])
+p model.predict_batch([[0.3,1.0,:bla], [0.1,0.0,:bli]])
 
 puts model.generate_code("python")
 
@@ -57,6 +57,13 @@ array_t* array_create(int size, ...)
     return array;
 }
 
+array_t* array_duplicate(array_t*a)
+{
+    array_t*d = array_new(a->size);
+    memcpy(d->entries, a->entries, sizeof(constant_t)*a->size);
+    return d;
+}
+
 void array_destroy(array_t*a)
 {
     free(a);
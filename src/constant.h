@@ -92,6 +92,7 @@ struct _array {
 array_t* array_new(int size);
 array_t* array_create(int size, ...);
 void array_fill(array_t*a, constant_t c);
+array_t* array_duplicate(array_t*a);
 void array_destroy(array_t*a);
 constant_type_t constant_array_subtype(constant_t*c);
 
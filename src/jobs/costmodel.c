@@ -0,0 +1,245 @@
+/* costmodel.c
+   Expected training times of model factories
+
+   Part of the data prediction package.
+   
+   Copyright (c) 2010-2011 Matthias Kramm <kramm@quiss.org> 
+ 
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "costmodel.h"
+#include "dict.h"
+#include "util.h"
+#include "settings.h"
+#include "transform.h"
+
+/* older observations are gradually forgotten once a factory has this
+   many, so the model follows changes in hardware and trainers */
+#define COST_MAX_OBSERVATIONS 200
+
+/* running sums for the least squares fit of y=log(time) over
+   x=log(work) */
+typedef struct _cost_entry {
+    double n;
+    double sx, sy;
+    double sxx, sxy;
+} cost_entry_t;
+
+static pthread_mutex_t cost_mutex = PTHREAD_MUTEX_INITIALIZER;
+static dict_t*cost_entries = 0;
+static bool cost_entries_changed = false;
+
+static void costmodel_load()
+{
+    if(cost_entries)
+        return;
+    cost_entries = dict_new(&charptr_type);
+    if(!config_cost_model_file)
+        return;
+    FILE*fi = fopen(config_cost_model_file, "rb");
+    if(!fi)
+        return;
+    char line[1024];
+    while(fgets(line, sizeof(line), fi)) {
+        cost_entry_t e;
+        int pos = 0;
+        if(sscanf(line, "%lf %lf %lf %lf %lf %n", &e.n, &e.sx, &e.sy, &e.sxx, &e.sxy, &pos) < 5 || !pos)
+            continue;
+        char*name = line+pos;
+        char*end = name+strlen(name);
+        while(end>name && (end[-1]=='\n' || end[-1]=='\r'))
+            *--end = 0;
+        if(!*name || e.n < 1)
+            continue;
+        dict_put(cost_entries, name, memdup(&e, sizeof(e)));
+    }
+    fclose(fi);
+}
+
+static double job_work(job_t*job)
+{
+    dataset_t*data = job->data;
+    double rows = data->num_rows;
+    double columns = data->num_columns;
+    double classes = data->desired_response->num_classes;
+
+    int fold, num_folds;
+    const char*transforms = parse_fold_transform(job->transforms, &fold, &num_folds);
+    if(num_folds)
+        rows = rows * (num_folds - 1) / num_folds;
+    const char*pick = transforms ? strstr(transforms, "pick_columns(") : NULL;
+    if(pick) {
+        columns = 1;
+        const char*c;
+        for(c=pick;*c && *c!=')';c++) {
+            if(*c == ',')
+                columns++;
+        }
+    }
+    double work = rows * columns * (classes > 2 ? classes : 2);
+    return work > 1 ? work : 1;
+}
+
+void costmodel_record(job_t*job, double seconds)
+{
+    double x = log(job_work(job));
+    double y = log(seconds > 0.001 ? seconds : 0.001);
+
+    pthread_mutex_lock(&cost_mutex);
+    costmodel_load();
+    cost_entry_t*e = dict_lookup(cost_entries, job->factory->name);
+    if(!e) {
+        e = calloc(1, sizeof(cost_entry_t));
+        dict_put(cost_entries, job->factory->name, e);
+    }
+    if(e->n >= COST_MAX_OBSERVATIONS) {
+        double scale = (COST_MAX_OBSERVATIONS - 1) / e->n;
+        e->n *= scale;
+        e->sx *= scale;
+        e->sy *= scale;
+        e->sxx *= scale;
+        e->sxy *= scale;
+    }
+    e->n++;
+    e->sx += x;
+    e->sy += y;
+    e->sxx += x*x;
+    e->sxy += x*y;
+    cost_entries_changed = true;
+    pthread_mutex_unlock(&cost_mutex);
+}
+
+static double cost_entry_predict(cost_entry_t*e, double x)
+{
+    double mx = e->sx / e->n;
+    double my = e->sy / e->n;
+    double var = e->sxx / e->n - mx*mx;
+    /* with observations for only one dataset size, assume that time
+       grows linearly with the work */
+    double b = 1.0;
+    if(var > 0.01) {
+        b = (e->sxy / e->n - mx*my) / var;
+        if(b < 0.5)
+            b = 0.5;
+        if(b > 3.0)
+            b = 3.0;
+    }
+    return exp(my + b*(x - mx));
+}
+
+double costmodel_expected_time(job_t*job)
+{
+    double x = log(job_work(job));
+    pthread_mutex_lock(&cost_mutex);
+    costmodel_load();
+    cost_entry_t*e = dict_lookup(cost_entries, job->factory->name);
+    double t = e ? cost_entry_predict(e, x) : -1;
+    pthread_mutex_unlock(&cost_mutex);
+    return t;
+}
+
+typedef struct _scheduled_job {
+    job_t*job;
+    double time;
+} scheduled_job_t;
+
+static int compare_expected_times(const void*_a, const void*_b)
+{
+    const scheduled_job_t*a = (const scheduled_job_t*)_a;
+    const scheduled_job_t*b = (const scheduled_job_t*)_b;
+    bool a_unknown = a->time < 0;
+    bool b_unknown = b->time < 0;
+    if(a_unknown != b_unknown)
+        return a_unknown ? -1 : 1;
+    if(a->time != b->time)
+        return a->time > b->time ? -1 : 1;
+    return a->job->nr - b->job->nr;
+}
+
+job_t** jobqueue_schedule(jobqueue_t*jobs, int*_num)
+{
+    scheduled_job_t*s = malloc(sizeof(scheduled_job_t)*(jobs->num+1));
+    int num = 0;
+    job_t*job;
+    for(job=jobs->first;job;job=job->next) {
+        if(job->flags & JOB_CACHED)
+            continue;
+        s[num].job = job;
+        s[num].time = costmodel_expected_time(job);
+        num++;
+    }
+    qsort(s, num, sizeof(scheduled_job_t), compare_expected_times);
+
+    job_t**order = malloc(sizeof(job_t*)*(num+1));
+    int i;
+    for(i=0;i<num;i++) {
+        order[i] = s[i].job;
+    }
+    free(s);
+    *_num = num;
+    return order;
+}
+
+static void save_entry(void*data, const void*key, void*value)
+{
+    cost_entry_t*e = (cost_entry_t*)value;
+    fprintf((FILE*)data, "%.17g %.17g %.17g %.17g %.17g %s\n", e->n, e->sx, e->sy, e->sxx, e->sxy, (const char*)key);
+}
+
+void costmodel_save()
+{
+    pthread_mutex_lock(&cost_mutex);
+    if(!cost_entries || !cost_entries_changed || !config_cost_model_file) {
+        pthread_mutex_unlock(&cost_mutex);
+        return;
+    }
+    char*dir = strdup(config_cost_model_file);
+    char*slash = strrchr(dir, '/');
+    if(slash && slash != dir) {
+        *slash = 0;
+        mkdir_p(dir);
+    }
+    free(dir);
+
+    /* write to a temporary file first, so that readers never see a
+       half written model */
+    char*tmpname = malloc(strlen(config_cost_model_file) + 8);
+    sprintf(tmpname, "%s.XXXXXX", config_cost_model_file);
+    int fd = mkstemp(tmpname);
+    FILE*fi = fd >= 0 ? fdopen(fd, "wb") : NULL;
+    if(!fi) {
+        perror(tmpname);
+        if(fd >= 0) {
+            close(fd);
+            unlink(tmpname);
+        }
+    } else {
+        dict_foreach_keyvalue(cost_entries, save_entry, fi);
+        fclose(fi);
+        if(rename(tmpname, config_cost_model_file)) {
+            perror(config_cost_model_file);
+            unlink(tmpname);
+        }
+        cost_entries_changed = false;
+    }
+    free(tmpname);
+    pthread_mutex_unlock(&cost_mutex);
+}
@@ -0,0 +1,58 @@
+/* costmodel.h
+   Expected training times of model factories
+
+   Part of the data prediction package.
+   
+   Copyright (c) 2010-2011 Matthias Kramm <kramm@quiss.org> 
+ 
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+
+#ifndef __costmodel_h__
+#define __costmodel_h__
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "job.h"
+
+/* The cost model predicts how long a job will train, from how long
+   earlier jobs of the same factory took. For every factory, it fits
+   log(time) = a + b * log(work), with work = rows * columns * classes.
+
+   If config_cost_model_file is set, observations are kept there, so that
+   the model improves from run to run. */
+
+/* remember that the job trained in the given number of (wall clock)
+   seconds */
+void costmodel_record(job_t*job, double seconds);
+
+/* expected training time of the job in seconds, or a negative value if
+   nothing is known about its factory yet */
+double costmodel_expected_time(job_t*job);
+
+/* Returns the jobs in the order in which they should be started:
+   longest expected first, with jobs of unknown factories in front.
+   Handing the next job to whichever worker becomes free then packs
+   the jobs onto the workers. Cached jobs are left out. The array has
+   *num entries and must be freed by the caller. */
+job_t** jobqueue_schedule(jobqueue_t*jobs, int*num);
+
+/* write the observations to config_cost_model_file */
+void costmodel_save();
+
+#ifdef __cplusplus
+}
+#endif
+#endif //__costmodel_h__
@@ -24,7 +24,7 @@
 
 #include "dataset.h"
 
-type_t dataset_hash_type;
+extern type_t dataset_hash_type;
 
 typedef struct _datacache_entry {
     dataset_t*dataset;
@@ -26,6 +26,8 @@
 #include <errno.h>
 #include <assert.h>
 #include <limits.h>
+#include <time.h>
+#include <poll.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include "config.h"
@@ -33,23 +35,105 @@
 #include <sys/timeb.h>
 #endif
 #include "job.h"
+#include "costmodel.h"
+#include "resultcache.h"
 #include "io.h"
 #include "settings.h"
 #include "net/distribute.h"
 #include "serialize.h"
 #include "transform.h"
+#include "ast_transforms.h"
+#include "util.h"
 
 void job_train_and_score(job_t*job)
 {
     assert(!job->data->transform); // we're transforming previously untransformed data
 
-    dataset_t* dataset = dataset_apply_transformations(job->data, job->transforms);
+    int fold, num_folds;
+    const char*transforms = parse_fold_transform(job->transforms, &fold, &num_folds);
+    dataset_t*data = job->data;
+    if(num_folds) {
+        data = dataset_fold(job->data, fold, num_folds, false);
+    }
+
+    dataset_t* dataset = dataset_apply_transformations(data, transforms);
+
+    /* trainers build their program node by node, so allocate
+       the nodes from an arena */
+    arena_t*arena = arena_new();
+    arena_t*old = node_select_arena(arena);
     node_t*code = job->factory->train(job->factory, dataset);
     dataset = dataset_revert_all_transformations(dataset, &code);
+    if(code) {
+        code = node_recognize_kernels(code);
+        code = node_compile_sets(code);
+    }
+    node_select_arena(old);
+    arena_release(arena);
+
     job->score = INT32_MAX;
     if(code) {
         job->code = code;
-        job->score = code_score(job->code, job->data);
+        /* folds share the columns of job->data, so the program only
+           needs to be specialized and compiled once */
+        compiled_code_t*compiled = code_compile(code, job->data);
+        if(num_folds) {
+            /* score on the rows the model didn't see. The scores of all
+               folds add up to the equivalent of code_score() */
+            dataset_t*held_out = dataset_fold(job->data, fold, num_folds, true);
+            job->score = code_size(code) / num_folds + compiled_code_errors(compiled, held_out) * 100;
+            dataset_destroy(held_out);
+        } else {
+            job->score = code_size(code) + compiled_code_errors(compiled, job->data) * 100;
+        }
+        compiled_code_destroy(compiled);
+    }
+    if(num_folds) {
+        dataset_destroy(data);
+    }
+}
+
+/* train in a child process, which sends back score and code through a
+   pipe. Returns the child's pid, and the read end of the pipe in
+   *read_fd. */
+static pid_t job_fork(job_t*job, int*read_fd)
+{
+    int p[2];
+    int ret = pipe(p);
+    if(ret) {
+        perror("create pipe");
+        exit(-1);
+    }
+    int write_fd = p[1];
+    *read_fd = p[0];
+    pid_t pid = fork();
+    if(!pid) {
+        //child
+        close(*read_fd); // close read
+
+        close(1); // close stdout
+        close(2); // close stderr
+
+        job_train_and_score(job);
+
+        writer_t*w = filewriter_new(write_fd);
+        write_compressed_int(w, job->score);
+        node_write(job->code, w, SERIALIZE_DEFAULTS);
+        w->finish(w);
+        close(write_fd); // close write
+        _exit(0);
+    }
+    //parent
+    close(write_fd); // close write
+    return pid;
+}
+
+static void job_read_result(job_t*job, reader_t*r)
+{
+    job->score = read_compressed_int(r);
+    job->code = node_read(r);
+    if(r->error || !job->code) {
+        job->score = INT32_MAX;
     }
 }
 
@@ -58,42 +142,23 @@ void job_process(job_t*job)
     if(!config_fork_for_training || (job->flags & JOB_NO_FORK)) {
         job_train_and_score(job);
     } else {
-        int p[2];
-        int ret = pipe(p);
-        int read_fd = p[0];
-        int write_fd = p[1];
-        if(ret) {
-            perror("create pipe");
-            exit(-1);
-        }
-        pid_t pid = fork();
-        if(!pid) {
-            //child
-            close(read_fd); // close read
-
-            close(1); // close stdout
-            close(2); // close stderr
-
-            job_train_and_score(job);
-
-            writer_t*w = filewriter_new(write_fd);
-            write_compressed_int(w, job->score);
-            node_write(job->code, w, SERIALIZE_DEFAULTS);
-            w->finish(w);
-            close(write_fd); // close write
-            _exit(0);
-        } else {
-            //parent
-            close(write_fd); // close write
-            reader_t*r = filereader_with_timeout_new(read_fd, config_job_wait_timeout);
-            job->score = read_compressed_int(r);
-            job->code = node_read(r);
-            r->dealloc(r);
-            close(read_fd); // close read
-
-            kill(pid, SIGKILL);
-            ret = waitpid(pid, NULL, WNOHANG);
-        }
+        int read_fd;
+        pid_t pid = job_fork(job, &read_fd);
+        reader_t*r = filereader_with_timeout_new(read_fd, config_job_wait_timeout);
+        job_read_result(job, r);
+        r->dealloc(r);
+        close(read_fd); // close read
+
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, WNOHANG);
+    }
+}
+
+static void print_progress(int count, int num)
+{
+    if(config_verbosity > 0) {
+        printf("\rJob %d / %d", count, num);
+        fflush(stdout);
     }
 }
 
@@ -102,22 +167,228 @@ static void process_jobs(jobqueue_t*jobs)
     job_t*job;
     int count = 0;
     for(job=jobs->first;job;job=job->next) {
-        if(config_verbosity > 0)
-            printf("\rJob %d / %d", count, jobs->num);fflush(stdout);
+        if(job->flags & JOB_CACHED)
+            continue;
+        print_progress(count, jobs->num);
+        double start = seconds_now();
         job_process(job);
+        if(job->code)
+            costmodel_record(job, seconds_now() - start);
         count++;
     }
     if(config_verbosity > 0)
         printf("\n");
 }
 
-void jobqueue_process(dataset_t*data, jobqueue_t*jobs)
+// --------------------------- local workers -------------------------------
+
+typedef struct _local_worker {
+    job_t*job;
+    pid_t pid;
+    int fd;
+    /* what the child sent so far */
+    writer_t*result;
+    time_t last_activity;
+    double start;
+} local_worker_t;
+
+static int number_of_local_workers(int num_jobs)
+{
+    int num = config_number_of_local_workers;
+    if(num <= 0) {
+        num = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if(num > num_jobs)
+        num = num_jobs;
+    return num < 1 ? 1 : num;
+}
+
+static void local_worker_start(local_worker_t*w, job_t*job)
+{
+    w->job = job;
+    w->pid = job_fork(job, &w->fd);
+    fcntl(w->fd, F_SETFL, fcntl(w->fd, F_GETFL) | O_NONBLOCK);
+    w->result = growingmemwriter_new2(65536);
+    w->last_activity = time(0);
+    w->start = seconds_now();
+}
+
+static void local_worker_finish(local_worker_t*w, bool complete)
+{
+    close(w->fd);
+    kill(w->pid, SIGKILL);
+    waitpid(w->pid, NULL, 0);
+
+    reader_t*r = growingmemwriter_getreader(w->result);
+    w->result->finish(w->result);
+    if(complete) {
+        job_read_result(w->job, r);
+        if(w->job->code)
+            costmodel_record(w->job, seconds_now() - w->start);
+    } else {
+        w->job->code = NULL;
+        w->job->score = INT32_MAX;
+    }
+    r->dealloc(r);
+    w->job = NULL;
+}
+
+/* Returns false if the worker is done with its job. Like in
+   job_process(), a job fails if its child doesn't send anything for
+   config_job_wait_timeout seconds. */
+static bool local_worker_poll(local_worker_t*w, bool readable, time_t now)
+{
+    if(!readable) {
+        if(now - w->last_activity > config_job_wait_timeout) {
+            local_worker_finish(w, false);
+            return false;
+        }
+        return true;
+    }
+    char buffer[65536];
+    while(1) {
+        ssize_t ret = read(w->fd, buffer, sizeof(buffer));
+        if(ret > 0) {
+            w->result->write(w->result, buffer, ret);
+            w->last_activity = now;
+            continue;
+        }
+        if(ret < 0 && errno == EINTR)
+            continue;
+        if(ret < 0 && errno == EAGAIN)
+            return true;
+        /* end of file, or error */
+        local_worker_finish(w, ret == 0);
+        return false;
+    }
+}
+
+/* Keeps num_workers forked trainers busy, starting the next job as soon
+   as one of them finishes. Jobs are started longest expected first, so
+   that no long job is left to run alone at the end. */
+static void process_jobs_in_parallel(jobqueue_t*jobs, int num_workers)
+{
+    local_worker_t*workers = (local_worker_t*)calloc(num_workers, sizeof(local_worker_t));
+    struct pollfd*fds = (struct pollfd*)calloc(num_workers, sizeof(struct pollfd));
+
+    int num_jobs;
+    job_t**order = jobqueue_schedule(jobs, &num_jobs);
+    int next = 0;
+    int running = 0;
+    int count = 0;
+    print_progress(count, num_jobs);
+    while(next < num_jobs || running) {
+        int t;
+        for(t=0;t<num_workers && next < num_jobs;t++) {
+            job_t*job = order[next];
+            if(job->flags & JOB_NO_FORK) {
+                job_train_and_score(job);
+                next++;
+                print_progress(++count, num_jobs);
+                continue;
+            }
+            if(!workers[t].job) {
+                local_worker_start(&workers[t], job);
+                next++;
+                running++;
+            }
+        }
+
+        int num_fds = 0;
+        for(t=0;t<num_workers;t++) {
+            if(workers[t].job) {
+                fds[num_fds].fd = workers[t].fd;
+                fds[num_fds].events = POLLIN;
+                fds[num_fds].revents = 0;
+                num_fds++;
+            }
+        }
+        int ret = poll(fds, num_fds, 1000);
+        if(ret < 0 && errno != EINTR) {
+            perror("poll");
+            exit(-1);
+        }
+
+        time_t now = time(0);
+        int i = 0;
+        for(t=0;t<num_workers;t++) {
+            local_worker_t*w = &workers[t];
+            if(!w->job)
+                continue;
+            bool readable = ret > 0 && fds[i++].revents;
+            if(!local_worker_poll(w, readable, now)) {
+                running--;
+                print_progress(++count, num_jobs);
+            }
+        }
+    }
+    if(config_verbosity > 0)
+        printf("\n");
+    free(order);
+    free(fds);
+    free(workers);
+}
+
+static void process_jobs_locally(jobqueue_t*jobs, int num_jobs)
 {
-    if(config_do_remote_processing) {
-        process_jobs_remotely(data, jobs);
+    int num_workers = number_of_local_workers(num_jobs);
+    if(num_workers > 1 && config_fork_for_training) {
+        process_jobs_in_parallel(jobs, num_workers);
     } else {
         process_jobs(jobs);
     }
+    costmodel_save();
+}
+
+/* Expand the columns of the (untransformed) data in advance, which most
+   trainers start with, so that forked workers inherit the expanded
+   columns instead of each computing their own. Trainers running in
+   this process find them in the cache as well. Jobs on column subsets
+   expand their subset themselves: warming all of those here would
+   keep a copy of the expanded columns per subset. */
+static void prepare_transformations(dataset_t*data, jobqueue_t*jobs)
+{
+    job_t*job;
+    for(job=jobs->first;job;job=job->next) {
+        if(!(job->flags & JOB_CACHED) && job->data == data &&
+           (!job->transforms || !*job->transforms))
+            break;
+    }
+    if(!job)
+        return;
+    node_t*code = NULL;
+    dataset_t*d = expand_categorical_columns(expand_text_columns(data));
+    dataset_revert_all_transformations(d, &code);
+}
+
+void jobqueue_process(dataset_t*data, jobqueue_t*jobs)
+{
+    job_t*job;
+    int num_jobs = 0;
+    for(job=jobs->first;job;job=job->next) {
+        job->flags &= ~JOB_CACHED;
+        if(resultcache_lookup(job)) {
+            job->flags |= JOB_CACHED;
+        } else {
+            num_jobs++;
+        }
+    }
+
+    if(num_jobs) {
+        if(config_do_remote_processing) {
+            process_jobs_remotely(data, jobs);
+        } else {
+            if(num_jobs > 1)
+                prepare_transformations(data, jobs);
+            process_jobs_locally(jobs, num_jobs);
+            transform_cache_release_unused();
+        }
+    }
+
+    for(job=jobs->first;job;job=job->next) {
+        if(!(job->flags & JOB_CACHED))
+            resultcache_store(job);
+    }
 }
 
 void job_destroy(job_t*j)
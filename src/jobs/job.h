@@ -29,6 +29,8 @@ extern "C" {
 #include "dataset.h"
 
 #define JOB_NO_FORK 1
+/* score and code were read from the result cache */
+#define JOB_CACHED 2
 
 typedef struct _job {
     int nr;
@@ -38,6 +40,9 @@ typedef struct _job {
     node_t*code;
 
     int32_t score;
+    /* with cross validation, the sum of the fold scores. Unlike score,
+       it isn't replaced when the job is retrained on all rows. */
+    int32_t cv_score;
     uint32_t flags;
 
     struct _job*prev;
@@ -54,6 +59,30 @@ jobqueue_t*jobqueue_new();
 void jobqueue_append(jobqueue_t*queue, job_t*job);
 void jobqueue_delete_job(jobqueue_t*queue, job_t*job);
 void jobqueue_process(dataset_t*data, jobqueue_t*jobs);
+/* successive halving, see config_successive_halving (in model_select.c) */
+void jobqueue_process_racing(dataset_t*data, jobqueue_t*jobs);
+
+/* what a model search did. Rounds are only recorded by forward
+   selection (see config_forward_selection). */
+#define SEARCH_MAX_ROUNDS 32
+typedef struct _search_round {
+    int num_columns;
+    int num_jobs;
+    /* best score (see job_selection_score()) of the round's jobs */
+    int32_t best_score;
+} search_round_t;
+
+typedef struct _search_stats {
+    /* jobs generated, not counting cross validation folds */
+    int num_jobs;
+    int num_rounds;
+    search_round_t rounds[SEARCH_MAX_ROUNDS];
+} search_stats_t;
+
+/* generate and process the jobs for training on data (in model_select.c).
+   stats, if not NULL, is filled in. */
+jobqueue_t* jobqueue_search(dataset_t*data, const char*pick_model, search_stats_t*stats);
+model_t* jobqueue_extract_best_and_destroy(jobqueue_t*jobs);
 void jobqueue_print(jobqueue_t*);
 jobqueue_t*jobqueue_destroy();
 void job_destroy(job_t*j);
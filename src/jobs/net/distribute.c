@@ -45,6 +45,7 @@
 #include "serialize.h"
 #include "settings.h"
 #include "job.h"
+#include "costmodel.h"
 #include "util.h"
 
 dataset_t* dataset_read_from_server(const char*host, int port, uint8_t*hash)
@@ -364,22 +365,26 @@ void distribute_jobs_to_servers(dataset_t*dataset, jobqueue_t*jobs, server_array
        will now only return an error, not halt the program */
     sig_t old_sigpipe = signal(SIGPIPE, SIG_IGN);
 
-    job_t*job = jobs->first;
-    int open_jobs = jobs->num;
+    /* start the longest jobs first */
+    int num_jobs;
+    job_t**order = jobqueue_schedule(jobs, &num_jobs);
+    int next = 0;
+    int open_jobs = num_jobs;
     int i;
     printf("%d open jobs\n", open_jobs);
     int32_t best_score = INT_MAX;
-    float total_cpu_time = 0.0;
+    float total_training_time = 0.0;
 
     int num = 0;
     int pos = 0;
     do {
-        if(job) {
+        if(next < num_jobs) {
+            job_t*job = order[next];
             r[num] = remote_job_try_to_start(job, job->factory->name, job->transforms, job->data, servers);
             if(r[num]) {
                 job->code = NULL;
                 num++;
-                job = job->next;
+                next++;
             }
         }
 
@@ -391,8 +396,11 @@ void distribute_jobs_to_servers(dataset_t*dataset, jobqueue_t*jobs, server_array
                     ftime(&j->profile_time[3]);
                     remote_job_read_result(j, &best_score);
                     if(j->response == RESPONSE_OK) {
-                        printf("Finished: %s (%.2f s)\n", job->factory->name, j->cpu_time);
-                        total_cpu_time += j->cpu_time;
+                        printf("Finished: %s (%.2f s%s)\n", job->factory->name, j->training_time, j->cached ? ", cached" : "");
+                        total_training_time += j->training_time;
+                        /* a cache hit says nothing about how long training takes */
+                        if(!j->cached)
+                            costmodel_record(job, j->training_time);
                     } else {
                         printf("Failed (%s, 0x%02x): %s\n", j->server->name, j->response, job->factory->name);
                     }
@@ -400,7 +408,7 @@ void distribute_jobs_to_servers(dataset_t*dataset, jobqueue_t*jobs, server_array
                     ftime(&j->profile_time[4]);
                     j->done = true;
                     close(j->socket);
-                } else if(num == jobs->num && remote_job_age(j) > config_remote_worker_timeout) {
+                } else if(num == num_jobs && remote_job_age(j) > config_remote_worker_timeout) {
                     ftime(&j->profile_time[3]);
                     printf("Failed (%s, timeout): %s\n", j->server->name, job->factory->name);
                     open_jobs--;
@@ -413,7 +421,8 @@ void distribute_jobs_to_servers(dataset_t*dataset, jobqueue_t*jobs, server_array
         }
     } while(open_jobs);
 
-    printf("total cpu time: %.2f\n", total_cpu_time);
+    printf("total training time: %.2f\n", total_training_time);
+    costmodel_save();
 
     for(i=0;i<num;i++) {
         remote_job_t*j = r[i];
@@ -424,6 +433,7 @@ void distribute_jobs_to_servers(dataset_t*dataset, jobqueue_t*jobs, server_array
     }
 
     free(r);
+    free(order);
 
     signal(SIGPIPE, old_sigpipe);
 }
@@ -42,7 +42,11 @@ typedef struct _remote_job {
 
     int response;
 
-    double cpu_time;
+    /* wall clock seconds the server spent training (or looking up the
+       result), as recorded in the cost model */
+    double training_time;
+    /* the server had the result in its result cache */
+    bool cached;
     time_t start_time;
 
 #ifdef HAVE_SYS_TIMEB
@@ -1,6 +1,5 @@
 #include <sys/types.h>
 #include <unistd.h>
-#include <sys/times.h>
 #include <arpa/inet.h>
 #include <signal.h>
 #include <stdlib.h>
@@ -13,6 +12,9 @@
 #include "protocol.h"
 #include "serialize.h"
 #include "io.h"
+#include "resultcache.h"
+#include "settings.h"
+#include "util.h"
 
 void make_request_TRAIN_MODEL(writer_t*w, const char*model_name, const char*transforms, dataset_t*dataset)
 {
@@ -51,8 +53,7 @@ void process_request_TRAIN_MODEL(datacache_t*cache, reader_t*r, writer_t*w)
 
     printf("worker %d: %d rows of data\n", getpid(), dataset->num_rows);
 
-    struct tms tms_before, tms_after;
-    times(&tms_before);
+    double start = seconds_now();
 
     job_t j;
     memset(&j, 0, sizeof(j));
@@ -61,14 +62,22 @@ void process_request_TRAIN_MODEL(datacache_t*cache, reader_t*r, writer_t*w)
     j.code = 0;
     j.transforms = transforms;
     j.flags = JOB_NO_FORK;
-    job_process(&j);
+    bool cached = resultcache_lookup(&j);
+    if(cached) {
+        if(config_verbosity > 1)
+            printf("worker %d: using cached result\n", getpid());
+    } else {
+        job_process(&j);
+        resultcache_store(&j);
+    }
 
-    times(&tms_after);
+    double seconds = seconds_now() - start;
 
-    printf("worker %d: finished training (time: %.2f)\n", getpid(), (tms_after.tms_utime - tms_before.tms_utime) /  (float)sysconf(_SC_CLK_TCK));
+    printf("worker %d: finished training (time: %.2f)\n", getpid(), seconds);
     write_uint8(w, RESPONSE_OK);
-    write_compressed_int(w, (tms_after.tms_utime - tms_before.tms_utime) * 1000ll / sysconf(_SC_CLK_TCK));
+    write_compressed_int(w, (int32_t)(seconds * 1000));
     write_compressed_int(w, j.score);
+    write_uint8(w, cached);
 
     uint8_t want_data = read_uint8(r);
     if(want_data == REQUEST_SEND_CODE) {
@@ -87,14 +96,16 @@ void finish_request_TRAIN_MODEL(reader_t*r, writer_t*w, remote_job_t*rjob, int32
     job_t*dest = rjob->job;
     rjob->response = read_uint8(r);
     if(rjob->response != RESPONSE_OK) {
-        rjob->cpu_time = 0.0;
+        rjob->training_time = 0.0;
+        rjob->cached = false;
         dest->score = INT32_MAX;
         dest->code = NULL;
         return;
     }
 
-    rjob->cpu_time = read_compressed_int(r) / 1000.0;
+    rjob->training_time = read_compressed_int(r) / 1000.0;
     dest->score = read_compressed_int(r);
+    rjob->cached = read_uint8(r);
 
     if(dest->score >= cutoff) {
         write_uint8(w, REQUEST_DISCARD_CODE);
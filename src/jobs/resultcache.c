@@ -0,0 +1,166 @@
+/* resultcache.c
+   Persistent cache of trained jobs
+
+   Part of the data prediction package.
+   
+   Copyright (c) 2010-2011 Matthias Kramm <kramm@quiss.org> 
+ 
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "resultcache.h"
+#include "datacache.h"
+#include "io.h"
+#include "util.h"
+#include "settings.h"
+#include "serialize.h"
+
+/* Every key contains the build id, the node format and this number.
+   Results are only ever reused by the same binary, so changes to
+   trainers, scoring or serialization don't need a bump. Only change
+   it if the layout of the cache files (see resultcache_store()) changes,
+   or if a change has to take effect for binaries whose build id can't
+   be determined. */
+#define RESULT_CACHE_VERSION 2
+
+static uint8_t build_id[HASH_SIZE];
+static pthread_once_t build_id_once = PTHREAD_ONCE_INIT;
+
+/* a hash of the file this code was loaded from (the executable, or the
+   library of the python resp. ruby module). If that can't be read,
+   the build id is the same for all builds. */
+static void build_id_init()
+{
+    writer_t*w = sha1writer_new();
+    Dl_info info;
+    FILE*fi = NULL;
+    if(dladdr((void*)build_id_init, &info) && info.dli_fname) {
+        fi = fopen(info.dli_fname, "rb");
+    }
+    if(!fi) {
+        fi = fopen("/proc/self/exe", "rb");
+    }
+    if(fi) {
+        char buf[65536];
+        size_t len;
+        while((len = fread(buf, 1, sizeof(buf), fi)) > 0) {
+            w->write(w, buf, len);
+        }
+        fclose(fi);
+    }
+    uint8_t*hash = writer_sha1_get(w);
+    w->finish(w);
+    memcpy(build_id, hash, HASH_SIZE);
+    free(hash);
+}
+
+static void write_version(writer_t*w)
+{
+    pthread_once(&build_id_once, build_id_init);
+    write_compressed_uint(w, RESULT_CACHE_VERSION);
+    w->write(w, build_id, HASH_SIZE);
+    /* opcodes of all node types, in case the build id is unknown */
+#define NODE(opcode, name) write_uint8(w, opcode); write_string(w, #name);
+    LIST_NODES
+    LIST_DATA_NODES
+#undef NODE
+}
+
+static char* result_filename(job_t*job)
+{
+    if(!config_cache_job_results || !job->data->hash)
+        return NULL;
+
+    writer_t*w = sha1writer_new();
+    write_version(w);
+    w->write(w, job->data->hash, HASH_SIZE);
+    write_string(w, job->factory->name);
+    write_string(w, job->transforms ? job->transforms : "");
+    uint8_t*hash = writer_sha1_get(w);
+    w->finish(w);
+
+    char*dir = concat_paths(config_dataset_cache_directory, "results");
+    char*basename = hash_to_string(hash);
+    char*filename = concat_paths(dir, basename);
+    free(basename);
+    free(dir);
+    free(hash);
+    return filename;
+}
+
+bool resultcache_lookup(job_t*job)
+{
+    char*filename = result_filename(job);
+    if(!filename)
+        return false;
+    reader_t*r = filereader_new2(filename);
+    if(!r) {
+        free(filename);
+        return false;
+    }
+    int32_t score = read_compressed_int(r);
+    node_t*code = node_read(r);
+    bool ok = code && !r->error;
+    r->dealloc(r);
+    if(!ok) {
+        if(code)
+            node_destroy(code);
+        unlink(filename);
+    } else {
+        job->score = score;
+        job->code = code;
+    }
+    free(filename);
+    return ok;
+}
+
+void resultcache_store(job_t*job)
+{
+    if(!job->code)
+        return;
+    char*filename = result_filename(job);
+    if(!filename)
+        return;
+
+    char*dir = concat_paths(config_dataset_cache_directory, "results");
+    mkdir_p(dir);
+    free(dir);
+
+    /* write to a temporary file first, so that concurrent lookups never
+       see a half written result */
+    char*tmpname = malloc(strlen(filename) + 8);
+    sprintf(tmpname, "%s.XXXXXX", filename);
+    int fd = mkstemp(tmpname);
+    if(fd < 0) {
+        perror(tmpname);
+    } else {
+        writer_t*w = filewriter_new(fd);
+        write_compressed_int(w, job->score);
+        node_write(job->code, w, SERIALIZE_DEFAULTS);
+        bool ok = !w->error;
+        w->finish(w);
+        close(fd);
+        if(!ok || rename(tmpname, filename))
+            unlink(tmpname);
+    }
+    free(tmpname);
+    free(filename);
+}
@@ -0,0 +1,45 @@
+/* resultcache.h
+   Persistent cache of trained jobs
+
+   Part of the data prediction package.
+   
+   Copyright (c) 2010-2011 Matthias Kramm <kramm@quiss.org> 
+ 
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+
+#ifndef __resultcache_h__
+#define __resultcache_h__
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "job.h"
+
+/* The result cache stores the score and code of trained jobs in
+   config_dataset_cache_directory, keyed by dataset hash, factory name,
+   transformations and library version. Retraining on an unchanged
+   dataset then only reads back the earlier results.
+   Nothing is cached unless config_cache_job_results is set. */
+
+/* fill in score and code of the job, if it's cached */
+bool resultcache_lookup(job_t*job);
+
+/* store score and code of a trained job */
+void resultcache_store(job_t*job);
+
+#ifdef __cplusplus
+}
+#endif
+#endif //__resultcache_h__
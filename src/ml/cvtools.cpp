@@ -74,13 +74,14 @@ CvMLDataFromExamples::CvMLDataFromExamples(dataset_t*dataset)
 
     for(i=0;i<dataset->num_rows;i++) {
         float* ddata = values->data.fl + total_columns*i;
+        int y = dataset_row(dataset, i);
         for(j=0;j<input_columns;j++) {
             column_t*c = dataset->columns[j];
             ddata[j] = (c->type == CATEGORICAL)?
-                    c->entries[i].c :
-                    c->entries[i].f;
+                    c->entries[y].c :
+                    c->entries[y].f;
         }
-        ddata[response_idx] = dataset->desired_response->entries[i].c;
+        ddata[response_idx] = dataset->desired_response->entries[y].c;
     }
 
     train_sample_count = dataset->num_rows;
@@ -147,14 +148,14 @@ CvMat*cvmat_from_row(dataset_t*dataset, row_t*row, bool add_one)
     return matrix_row;
 }
 
-int set_column_in_matrix(column_t*column, CvMat*mat, int xpos, int rows)
+int set_column_in_matrix(dataset_t*d, column_t*column, CvMat*mat, int xpos, int rows)
 {
     int y;
     int x = 0;
     if(column->type != CATEGORICAL) {
         for(y=0;y<rows;y++) {
             float*e = (float*)(CV_MAT_ELEM_PTR(*mat, y, xpos+x));
-            *e =  column->entries[y].f;
+            *e =  column->entries[dataset_row(d, y)].f;
         }
         x++;
     } else {
@@ -162,7 +163,7 @@ int set_column_in_matrix(column_t*column, CvMat*mat, int xpos, int rows)
         for(c=0;c<column->num_classes;c++) {
             for(y=0;y<rows;y++) {
                 float*e = (float*)(CV_MAT_ELEM_PTR(*mat, y, xpos+x));
-                if(column->entries[y].c == c) {
+                if(column->entries[dataset_row(d, y)].c == c) {
                     *e = 1.0;
                 } else {
                     *e = 0.0;
@@ -195,18 +196,18 @@ void make_ml_multicolumn(dataset_t*d, CvMat**in, CvMat**out, int num_rows, bool
     *in = cvCreateMat(num_rows, width, CV_32FC1);
     int xpos = 0;
     for(x=0;x<d->num_columns;x++) {
-        xpos += set_column_in_matrix(d->columns[x], *in, xpos, num_rows);
+        xpos += set_column_in_matrix(d, d->columns[x], *in, xpos, num_rows);
     }
     assert(xpos == width);
     if(multicolumn_response) {
         *out = cvCreateMat(num_rows, d->desired_response->num_classes, CV_32FC1);
-        set_column_in_matrix(d->desired_response, *out, 0, num_rows);
+        set_column_in_matrix(d, d->desired_response, *out, 0, num_rows);
     } else {
         *out = cvCreateMat(num_rows, 1, CV_32SC1);
         int y;
         for(y=0;y<num_rows;y++) {
             int32_t*e = (int32_t*)(CV_MAT_ELEM_PTR(**out, y, 0));
-            *e =  d->desired_response->entries[y].c;
+            *e =  d->desired_response->entries[dataset_row(d, y)].c;
         }
     }
 }
@@ -45,7 +45,7 @@ class CvMLDataFromExamples: public CvMLData
 CvMat*cvmat_from_row(dataset_t*dataset, row_t*row, bool add_one);
 int cvmat_get_max_index(CvMat*mat);
 void cvmat_print(CvMat*mat);
-int set_column_in_matrix(column_t*column, CvMat*mat, int xpos, int rows);
+int set_column_in_matrix(dataset_t*d, column_t*column, CvMat*mat, int xpos, int rows);
 int count_multiclass_columns(dataset_t*d);
 void make_ml_multicolumn(dataset_t*d, CvMat**in, CvMat**out, int num_rows, bool multicolumn_response);
 
@@ -31,6 +31,7 @@
 #include "stringpool.h"
 #include "serialize.h"
 #include "settings.h"
+#include "transform.h"
 
 trainingdata_t* trainingdata_new()
 {
@@ -300,75 +301,93 @@ static column_t* convert_to_category_column(column_t*column, int num_rows)
 }
 
 
-#define DATASET_SHUFFLE 1
-#define DATASET_EVEN_OUT_CLASS_COUNT 2
-
-example_t**example_list_to_array(trainingdata_t*d, int*_num_examples, int flags)
+int* dataset_row_order(column_t*response, int num_rows, int flags, int*_num)
 {
-    int pos = 0;
-    int num_examples = 0;
-    example_t**examples = 0;
+    int num = 0;
+    int*order = 0;
+    int y;
     if(!(flags&DATASET_EVEN_OUT_CLASS_COUNT)) {
-        example_t*i = d->first_example;
-        num_examples = d->num_examples;
-        examples = (example_t**)malloc(sizeof(example_t*)*num_examples);
-        while(i) {
-            examples[pos++] = i;
-            i = i->next;
+        num = num_rows;
+        order = (int*)malloc(sizeof(int)*num);
+        for(y=0;y<num_rows;y++) {
+            order[y] = y;
         }
     } else {
-        /* build a column out of the response column, thus making
-           the column build process count the classes for us */
-        int num_columns = d->first_example->num_inputs;
-        column_t*c = column_new(d->num_examples, CATEGORICAL);
-        columnbuilder_t*b = columnbuilder_new(c);
-        int y;
-        example_t*i = d->first_example;
-        for(y=0;y<d->num_examples;y++) {
-            columnbuilder_add(b,y,variable_to_constant(&i->desired_response));
-            i = i->next;
-        }
-        columnbuilder_destroy(b);
-
         int t;
-        int max = c->class_occurence_count[0];
-        int*multiply = malloc(sizeof(int)*c->num_classes);
+        int*count = calloc(response->num_classes, sizeof(int));
+        for(y=0;y<num_rows;y++) {
+            count[response->entries[y].c]++;
+        }
+        int max = count[0];
+        int*multiply = malloc(sizeof(int)*response->num_classes);
 
-        for(t=1;t<c->num_classes;t++) {
-            if(c->class_occurence_count[t] > max) {
-                max = c->class_occurence_count[t];
+        for(t=1;t<response->num_classes;t++) {
+            if(count[t] > max) {
+                max = count[t];
             }
         }
-        for(t=0;t<c->num_classes;t++) {
-            multiply[t] = max / c->class_occurence_count[t];
-            num_examples += multiply[t]*c->class_occurence_count[t];
-            assert(multiply);
+        for(t=0;t<response->num_classes;t++) {
+            multiply[t] = max / count[t];
+            num += multiply[t]*count[t];
         }
-        examples = (example_t**)malloc(sizeof(example_t*)*num_examples);
-        i = d->first_example;
+        order = (int*)malloc(sizeof(int)*num);
         int pos = 0;
-        for(y=0;y<d->num_examples;y++) {
-            int cls = c->entries[y].c;
-            int t;
+        for(y=0;y<num_rows;y++) {
+            int cls = response->entries[y].c;
             for(t=0;t<multiply[cls];t++) {
-                examples[pos++] = i;
+                order[pos++] = y;
             }
-            i = i->next;
         }
-        assert(pos == num_examples);
+        assert(pos == num);
         free(multiply);
-        column_destroy(c);
+        free(count);
     }
 
     if(flags&DATASET_SHUFFLE) {
         int t;
-        for(t=0;t<num_examples;t++) {
-            example_t*old = examples[t];
-            int from = t+lrand48()%(num_examples-t);
-            examples[t] = examples[from];
-            examples[from] = old;
+        for(t=0;t<num;t++) {
+            int old = order[t];
+            int from = t+lrand48()%(num-t);
+            order[t] = order[from];
+            order[from] = old;
         }
     }
+    *_num = num;
+    return order;
+}
+
+example_t**example_list_to_array(trainingdata_t*d, int*_num_examples, int flags)
+{
+    example_t**list = (example_t**)malloc(sizeof(example_t*)*d->num_examples);
+    column_t*c = NULL;
+    if(flags&DATASET_EVEN_OUT_CLASS_COUNT) {
+        /* build a column out of the response column, thus making
+           the column build process count the classes for us */
+        c = column_new(d->num_examples, CATEGORICAL);
+    }
+    columnbuilder_t*b = c ? columnbuilder_new(c) : NULL;
+    int y;
+    example_t*i = d->first_example;
+    for(y=0;y<d->num_examples;y++) {
+        list[y] = i;
+        if(b) {
+            columnbuilder_add(b,y,variable_to_constant(&i->desired_response));
+        }
+        i = i->next;
+    }
+
+    int num_examples = 0;
+    int*order = dataset_row_order(c, d->num_examples, flags, &num_examples);
+    example_t**examples = (example_t**)malloc(sizeof(example_t*)*num_examples);
+    for(y=0;y<num_examples;y++) {
+        examples[y] = list[order[y]];
+    }
+    free(order);
+    free(list);
+    if(b) {
+        columnbuilder_destroy(b);
+        column_destroy(c);
+    }
     *_num_examples = num_examples;
     return examples;
 }
@@ -505,23 +524,24 @@ void dataset_print(dataset_t*s)
     }
 
     for(y=0;y<s->num_rows;y++) {
+        int r = dataset_row(s, y);
         for(x=0;x<s->num_columns;x++) {
             column_t*column = s->columns[x];
             if(column->type == CATEGORICAL) {
-                constant_t c = column->classes[column->entries[y].c];
-                printf("C%d(", column->entries[y].c);
+                constant_t c = column->classes[column->entries[r].c];
+                printf("C%d(", column->entries[r].c);
                 constant_print(&c);
                 printf(")\t");
             } else if(column->type == TEXT) {
-                char*text = escape_string(column->entries[y].text);
+                char*text = escape_string(column->entries[r].text);
                 printf("\"%s\"\t", text);
                 free(text);
             } else {
-                printf("%.2f\t", column->entries[y].f);
+                printf("%.2f\t", column->entries[r].f);
             }
         }
         printf("| ");
-        constant_t c = s->desired_response->classes[s->desired_response->entries[y].c];
+        constant_t c = s->desired_response->classes[s->desired_response->entries[r].c];
         constant_print(&c);
         printf("\n");
     }
@@ -549,6 +569,14 @@ constant_t dataset_map_response_class(dataset_t*dataset, int i)
 
 void dataset_destroy(dataset_t*s)
 {
+    transform_cache_purge(s);
+    if(s->parent) {
+        free(s->columns);
+        free(s->rows);
+        free(s->hash);
+        free(s);
+        return;
+    }
     int t;
     for(t=0;t<s->num_columns;t++) {
         column_destroy(s->columns[t]);
@@ -561,6 +589,147 @@ void dataset_destroy(dataset_t*s)
     free(s);
 }
 
+static column_t* column_select_rows(column_t*column, int*rows, int num_rows)
+{
+    column_t*c = column_new(num_rows, column->type);
+    c->name = column->name;
+    c->num_classes = column->num_classes;
+    if(column->classes) {
+        c->classes = memdup(column->classes, sizeof(constant_t)*column->num_classes);
+        c->class_occurence_count = calloc(column->num_classes, sizeof(c->class_occurence_count[0]));
+    }
+    int y;
+    for(y=0;y<num_rows;y++) {
+        c->entries[y] = column->entries[rows[y]];
+        if(c->class_occurence_count)
+            c->class_occurence_count[c->entries[y].c]++;
+    }
+    return c;
+}
+
+static dataset_t* dataset_select_rows(dataset_t*data, int*rows, int num_rows)
+{
+    dataset_t*s = calloc(1,sizeof(dataset_t));
+    s->sig = data->sig;
+    s->num_columns = data->num_columns;
+    s->num_rows = num_rows;
+    s->columns = malloc(sizeof(column_t*)*s->num_columns);
+    int x;
+    for(x=0;x<s->num_columns;x++) {
+        s->columns[x] = column_select_rows(data->columns[x], rows, num_rows);
+    }
+    s->desired_response = column_select_rows(data->desired_response, rows, num_rows);
+    s->hash = dataset_hash(s);
+    return s;
+}
+
+dataset_t* dataset_sample(dataset_t*data, int num_rows)
+{
+    column_t*response = data->desired_response;
+    int num_classes = response->num_classes;
+    if(num_rows >= data->num_rows) {
+        num_rows = data->num_rows;
+    }
+
+    /* how many rows of each class to take. Every class which is present
+       in the dataset is present in the sample, too. */
+    int*count = calloc(num_classes, sizeof(int));
+    int*want = calloc(num_classes, sizeof(int));
+    int y,c;
+    for(y=0;y<data->num_rows;y++) {
+        count[response->entries[dataset_row(data, y)].c]++;
+    }
+    int total = 0;
+    for(c=0;c<num_classes;c++) {
+        want[c] = (int)((int64_t)count[c] * num_rows / data->num_rows);
+        if(!want[c] && count[c])
+            want[c] = 1;
+        total += want[c];
+    }
+
+    /* rows were shuffled by trainingdata_sanitize(), so taking the first
+       rows of each class is as good as taking random ones */
+    int*rows = malloc(sizeof(int)*total);
+    int pos = 0;
+    for(y=0;y<data->num_rows;y++) {
+        int r = dataset_row(data, y);
+        category_t cls = response->entries[r].c;
+        if(want[cls]) {
+            want[cls]--;
+            rows[pos++] = r;
+        }
+    }
+    assert(pos == total);
+
+    dataset_t*s = dataset_select_rows(data, rows, total);
+    free(rows);
+    free(want);
+    free(count);
+    return s;
+}
+
+static uint32_t row_hash(dataset_t*data, int y)
+{
+    uint32_t h = 5381;
+    int x;
+    y = dataset_row(data, y);
+    for(x=0;x<=data->num_columns;x++) {
+        column_t*column = x<data->num_columns ? data->columns[x] : data->desired_response;
+        if(column->type == TEXT) {
+            const char*c;
+            for(c=column->entries[y].text;*c;c++) {
+                h = h*33 + (uint8_t)*c;
+            }
+        } else {
+            uint32_t v;
+            memcpy(&v, &column->entries[y], sizeof(v));
+            h = h*33 + v;
+        }
+    }
+    /* mix, so that the low bits depend on all columns */
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+    return h;
+}
+
+dataset_t* dataset_fold(dataset_t*data, int fold, int num_folds, bool held_out)
+{
+    /* trainingdata_sanitize() duplicates examples to even out the class
+       count, so assign rows to folds by content, not position. Otherwise
+       copies of held-out rows would end up in the training rows. */
+    int*rows = malloc(sizeof(int)*(data->num_rows+1));
+    int num = 0;
+    int y;
+    for(y=0;y<data->num_rows;y++) {
+        bool in_fold = row_hash(data, y) % num_folds == fold;
+        if(in_fold == held_out)
+            rows[num++] = dataset_row(data, y);
+    }
+
+    dataset_t*s = calloc(1,sizeof(dataset_t));
+    s->sig = data->sig;
+    s->num_columns = data->num_columns;
+    s->num_rows = num;
+    s->columns = memdup(data->columns, sizeof(column_t*)*data->num_columns);
+    s->desired_response = data->desired_response;
+    s->rows = rows;
+    s->parent = data;
+    return s;
+}
+
+bool dataset_rows_ascending(dataset_t*data)
+{
+    int y;
+    for(y=1;data->rows && y<data->num_rows;y++) {
+        if(data->rows[y-1] >= data->rows[y])
+            return false;
+    }
+    return true;
+}
+
 array_t* dataset_classes_as_array(dataset_t*dataset)
 {
     array_t*classes = array_new(dataset->desired_response->num_classes);
@@ -573,6 +742,7 @@ array_t* dataset_classes_as_array(dataset_t*dataset)
 void dataset_fill_row(dataset_t*s, row_t*row, int y)
 {
     int x;
+    y = dataset_row(s, y);
     for(x=0;x<row->num_inputs;x++) {
         row->inputs[x].type = MISSING;
     }
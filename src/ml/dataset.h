@@ -49,9 +49,32 @@ typedef struct _dataset {
        to target said untransformed version */
     transform_t* transform;
 
+    /* if set, row y of this dataset is row rows[y] of its columns (the
+       indices are ascending). Transformations which only remove rows
+       use this instead of copying the columns. */
+    int* rows;
+
+    /* if set, the columns belong to this dataset (see dataset_fold()),
+       which has to outlive this one */
+    struct _dataset* parent;
+
+    /* SHA1 of the serialized dataset. NULL for row views (see
+       dataset_fold()), which can't be serialized. */
     uint8_t* hash;
 } dataset_t;
 
+static inline int dataset_row(dataset_t*d, int y)
+{
+    return d->rows ? d->rows[y] : y;
+}
+
+/* how many entries the columns of a dataset have (at least), which
+   relies on the row index being ascending */
+static inline int dataset_num_entries(dataset_t*d)
+{
+    return d->rows && d->num_rows ? d->rows[d->num_rows-1]+1 : d->num_rows;
+}
+
 
 struct _column {
     const char*name;
@@ -70,10 +93,20 @@ struct _column {
 
 bool trainingdata_check_format(trainingdata_t*trainingdata);
 dataset_t* trainingdata_sanitize(trainingdata_t*dataset);
+dataset_t* datatable_to_dataset(datatable_t*table);
+signature_t* signature_from_columns(column_t**columns, int num_columns, bool has_column_names);
 void dataset_print(dataset_t*s);
 constant_t dataset_map_response_class(dataset_t*dataset, int i);
 void dataset_destroy(dataset_t*dataset);
+/* a copy of (about) num_rows rows of the dataset, with the classes of
+   the response in the same proportion as in the full dataset */
+dataset_t* dataset_sample(dataset_t*dataset, int num_rows);
+/* the rows of the dataset which are (held_out=true) or aren't
+   (held_out=false) in the given fold. The result shares the columns of
+   the dataset, and only stores the indices of its rows. */
+dataset_t* dataset_fold(dataset_t*dataset, int fold, int num_folds, bool held_out);
 bool dataset_has_categorical_columns(dataset_t*data);
+bool dataset_rows_ascending(dataset_t*data);
 uint8_t* dataset_hash(dataset_t*s);
 void column_destroy(column_t*c);
 
@@ -90,6 +123,13 @@ struct _transform
 column_t*column_new(int num_rows, columntype_t columntype);
 
 model_t* model_new(dataset_t*dataset);
+void model_predict_dataset(model_t*m, dataset_t*dataset, variable_t*out);
+#define DATASET_SHUFFLE 1
+#define DATASET_EVEN_OUT_CLASS_COUNT 2
+/* the rows, in the order they go into a dataset: shuffled, and with the
+   rows of rarer classes repeated if DATASET_EVEN_OUT_CLASS_COUNT is set
+   (the response is only used for that) */
+int* dataset_row_order(column_t*response, int num_rows, int flags, int*_num);
 example_t**example_list_to_array(trainingdata_t*d, int*_num_examples, int flags);
 node_t* parameter_code(dataset_t*d, int num);
 array_t* dataset_classes_as_array(dataset_t*d);
@@ -0,0 +1,366 @@
+/* datatable.c
+   Columnar construction of training data.
+
+   Part of the data prediction package.
+
+   Copyright (c) 2011 Matthias Kramm <kramm@quiss.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "mrscake.h"
+#include "dataset.h"
+#include "dict.h"
+#include "stringpool.h"
+#include "settings.h"
+
+/* category ids below this are mapped to classes through an array,
+   larger ones through a dictionary */
+#define DIRECT_CATEGORY_IDS 65536
+
+#define WHITESPACE " \n\t\r\f"
+
+typedef struct _tablecolumn {
+    const char*name;
+    column_t*column;
+    int size;
+    int num_rows;
+
+    /* categories, in the order they were first added */
+    constant_t*classes;
+    int num_classes;
+    int classes_size;
+
+    int*id2pos;
+    int id2pos_size;
+    dict_t*int2pos;
+    dict_t*string2pos;
+
+    /* text columns without whitespace end up as categorical columns (like
+       in trainingdata_sanitize()), so as long as there isn't any, text is
+       interned as well */
+    category_t*text_classes;
+    bool has_whitespace;
+} tablecolumn_t;
+
+struct _datatable {
+    int num_inputs;
+    tablecolumn_t*inputs;
+    tablecolumn_t response;
+};
+
+datatable_t* datatable_new(int num_inputs)
+{
+    datatable_t*t = (datatable_t*)calloc(1, sizeof(datatable_t));
+    t->num_inputs = num_inputs;
+    t->inputs = (tablecolumn_t*)calloc(num_inputs, sizeof(tablecolumn_t));
+    return t;
+}
+
+static bool tablecolumn_grow(tablecolumn_t*c, columntype_t type, int num)
+{
+    if(!c->column) {
+        c->column = column_new(0, type);
+    } else if(c->column->type != type) {
+        fprintf(stderr, "Can't add %s values to %s column\n", variable_type_name(type), variable_type_name(c->column->type));
+        return false;
+    }
+    if(c->num_rows + num > c->size) {
+        int size = c->size ? c->size : 64;
+        while(size < c->num_rows + num) {
+            size *= 2;
+        }
+        c->column = (column_t*)realloc(c->column, sizeof(column_t)+sizeof(c->column->entries[0])*size);
+        if(type == TEXT && !c->has_whitespace) {
+            c->text_classes = (category_t*)realloc(c->text_classes, sizeof(category_t)*size);
+        }
+        c->size = size;
+    }
+    return true;
+}
+
+static tablecolumn_t* datatable_column(datatable_t*t, int x, columntype_t type, int num)
+{
+    if(x < 0 || x >= t->num_inputs) {
+        fprintf(stderr, "Column %d out of range (table has %d columns)\n", x, t->num_inputs);
+        return NULL;
+    }
+    if(!tablecolumn_grow(&t->inputs[x], type, num)) {
+        return NULL;
+    }
+    return &t->inputs[x];
+}
+
+static int add_class(tablecolumn_t*c, constant_t e)
+{
+    if(c->num_classes == c->classes_size) {
+        c->classes_size = c->classes_size ? c->classes_size*2 : 16;
+        c->classes = (constant_t*)realloc(c->classes, sizeof(constant_t)*c->classes_size);
+    }
+    c->classes[c->num_classes] = e;
+    return c->num_classes++;
+}
+
+static int intern_category(tablecolumn_t*c, category_t id)
+{
+    if(id >= 0 && id < DIRECT_CATEGORY_IDS) {
+        if(id >= c->id2pos_size) {
+            int size = c->id2pos_size ? c->id2pos_size : 64;
+            while(size <= id) {
+                size *= 2;
+            }
+            c->id2pos = (int*)realloc(c->id2pos, sizeof(int)*size);
+            memset(&c->id2pos[c->id2pos_size], 0, sizeof(int)*(size - c->id2pos_size));
+            c->id2pos_size = size;
+        }
+        if(!c->id2pos[id]) {
+            c->id2pos[id] = add_class(c, category_constant(id)) + 1;
+        }
+        return c->id2pos[id] - 1;
+    }
+    if(!c->int2pos) {
+        c->int2pos = dict_new(&int_type);
+    }
+    int pos = dict_lookup_int(c->int2pos, INT_TO_PTR(id)) - 1;
+    if(pos < 0) {
+        pos = add_class(c, category_constant(id));
+        dict_put_int(c->int2pos, INT_TO_PTR(id), pos + 1);
+    }
+    return pos;
+}
+
+static int intern_string(tablecolumn_t*c, const char*s)
+{
+    if(!c->string2pos) {
+        c->string2pos = dict_new(&charptr_type);
+    }
+    int pos = dict_lookup_int(c->string2pos, s) - 1;
+    if(pos < 0) {
+        constant_t e = string_constant(s);
+        pos = add_class(c, e);
+        dict_put_int(c->string2pos, e.s, pos + 1);
+    }
+    return pos;
+}
+
+static void forget_classes(tablecolumn_t*c)
+{
+    if(c->string2pos) {
+        dict_destroy(c->string2pos);
+        c->string2pos = NULL;
+    }
+    free(c->classes);
+    c->classes = NULL;
+    c->num_classes = c->classes_size = 0;
+    free(c->text_classes);
+    c->text_classes = NULL;
+}
+
+bool datatable_set_column_name(datatable_t*t, int column, const char*name)
+{
+    if(column < 0 || column >= t->num_inputs) {
+        fprintf(stderr, "Column %d out of range (table has %d columns)\n", column, t->num_inputs);
+        return false;
+    }
+    t->inputs[column].name = register_string(name);
+    return true;
+}
+
+bool datatable_add_continuous(datatable_t*t, int column, const float*values, int num)
+{
+    tablecolumn_t*c = datatable_column(t, column, CONTINUOUS, num);
+    if(!c)
+        return false;
+    int y;
+    for(y=0;y<num;y++) {
+        c->column->entries[c->num_rows+y].f = values[y];
+    }
+    c->num_rows += num;
+    return true;
+}
+
+bool datatable_add_categorical(datatable_t*t, int column, const category_t*values, int num)
+{
+    tablecolumn_t*c = datatable_column(t, column, CATEGORICAL, num);
+    if(!c)
+        return false;
+    int y;
+    for(y=0;y<num;y++) {
+        c->column->entries[c->num_rows+y].c = intern_category(c, values[y]);
+    }
+    c->num_rows += num;
+    return true;
+}
+
+bool datatable_add_text(datatable_t*t, int column, const char**values, int num)
+{
+    tablecolumn_t*c = datatable_column(t, column, TEXT, num);
+    if(!c)
+        return false;
+    int y;
+    for(y=0;y<num;y++) {
+        const char*s = values[y];
+        if(!c->has_whitespace && strpbrk(s, WHITESPACE)) {
+            c->has_whitespace = true;
+            forget_classes(c);
+        }
+        if(!c->has_whitespace) {
+            int pos = intern_string(c, s);
+            c->text_classes[c->num_rows] = pos;
+            c->column->entries[c->num_rows].text = c->classes[pos].s;
+        } else {
+            c->column->entries[c->num_rows].text = register_string(s);
+        }
+        c->num_rows++;
+    }
+    return true;
+}
+
+bool datatable_add_responses(datatable_t*t, const category_t*values, int num)
+{
+    tablecolumn_t*c = &t->response;
+    if(!tablecolumn_grow(c, CATEGORICAL, num))
+        return false;
+    int y;
+    for(y=0;y<num;y++) {
+        c->column->entries[c->num_rows+y].c = intern_category(c, values[y]);
+    }
+    c->num_rows += num;
+    return true;
+}
+
+bool datatable_add_text_responses(datatable_t*t, const char**values, int num)
+{
+    tablecolumn_t*c = &t->response;
+    if(!tablecolumn_grow(c, CATEGORICAL, num))
+        return false;
+    int y;
+    for(y=0;y<num;y++) {
+        c->column->entries[c->num_rows+y].c = intern_string(c, values[y]);
+    }
+    c->num_rows += num;
+    return true;
+}
+
+static column_t* tablecolumn_select_rows(tablecolumn_t*c, int*order, int num_rows)
+{
+    column_t*from = c->column;
+    bool categorical = from->type == CATEGORICAL || (from->type == TEXT && !c->has_whitespace);
+    column_t*to = column_new(num_rows, categorical ? CATEGORICAL : from->type);
+    to->name = c->name;
+    int y;
+    if(!categorical) {
+        for(y=0;y<num_rows;y++) {
+            to->entries[y] = from->entries[order[y]];
+        }
+        return to;
+    }
+
+    /* number the classes in the order in which they appear in the
+       shuffled rows, like trainingdata_sanitize() does */
+    int*map = (int*)malloc(sizeof(int)*c->num_classes);
+    int t;
+    for(t=0;t<c->num_classes;t++) {
+        map[t] = -1;
+    }
+    to->classes = (constant_t*)malloc(sizeof(constant_t)*c->num_classes);
+    to->class_occurence_count = (int*)calloc(c->num_classes, sizeof(int));
+    for(y=0;y<num_rows;y++) {
+        int r = order[y];
+        int old = from->type == TEXT ? c->text_classes[r] : from->entries[r].c;
+        int pos = map[old];
+        if(pos < 0) {
+            pos = map[old] = to->num_classes++;
+            to->classes[pos] = c->classes[old];
+        }
+        to->class_occurence_count[pos]++;
+        to->entries[y].c = pos;
+    }
+    free(map);
+    return to;
+}
+
+dataset_t* datatable_to_dataset(datatable_t*t)
+{
+    int num_rows = t->response.num_rows;
+    if(!num_rows) {
+        fprintf(stderr, "No responses in table\n");
+        return NULL;
+    }
+    int num_names = 0;
+    int x;
+    for(x=0;x<t->num_inputs;x++) {
+        tablecolumn_t*c = &t->inputs[x];
+        if(c->num_rows != num_rows) {
+            fprintf(stderr, "Column %d has %d rows, but there are %d responses\n", x, c->num_rows, num_rows);
+            return NULL;
+        }
+        if(c->name) {
+            num_names++;
+        }
+    }
+    if(num_names && num_names != t->num_inputs) {
+        fprintf(stderr, "Only %d of %d columns have names\n", num_names, t->num_inputs);
+        return NULL;
+    }
+
+    int flags = DATASET_SHUFFLE;
+    if(config_even_out_class_count)
+        flags |= DATASET_EVEN_OUT_CLASS_COUNT;
+    t->response.column->num_classes = t->response.num_classes;
+    int num = 0;
+    int*order = dataset_row_order(t->response.column, num_rows, flags, &num);
+
+    dataset_t*s = calloc(1,sizeof(dataset_t));
+    s->num_columns = t->num_inputs;
+    s->num_rows = num;
+    s->columns = malloc(sizeof(column_t*)*s->num_columns);
+    for(x=0;x<s->num_columns;x++) {
+        s->columns[x] = tablecolumn_select_rows(&t->inputs[x], order, num);
+        if(!num_names) {
+            char name[80];
+            sprintf(name, "data[%d]", x);
+            s->columns[x]->name = register_string(name);
+        }
+    }
+    s->desired_response = tablecolumn_select_rows(&t->response, order, num);
+    free(order);
+
+    s->sig = signature_from_columns(s->columns, s->num_columns, num_names > 0);
+    s->hash = dataset_hash(s);
+    return s;
+}
+
+static void tablecolumn_destroy(tablecolumn_t*c)
+{
+    forget_classes(c);
+    if(c->int2pos)
+        dict_destroy(c->int2pos);
+    free(c->id2pos);
+    free(c->column);
+}
+
+void datatable_destroy(datatable_t*t)
+{
+    int x;
+    for(x=0;x<t->num_inputs;x++) {
+        tablecolumn_destroy(&t->inputs[x]);
+    }
+    tablecolumn_destroy(&t->response);
+    free(t->inputs);
+    free(t);
+}
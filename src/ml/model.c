@@ -23,8 +23,13 @@
 #include <memory.h>
 #include "mrscake.h"
 #include "ast.h"
+#include "predictor.h"
+#include "dataset.h"
 #include "io.h"
 #include "stringpool.h"
+#include "serialize.h"
+#include "profile.h"
+#include "ast_transforms.h"
 
 variable_t variable_new_categorical(category_t c)
 {
@@ -234,16 +239,116 @@ void signature_destroy(signature_t*s)
 
 variable_t model_predict(model_t*m, row_t*row)
 {
-    node_t*code = (node_t*)m->code;
-    environment_t*e = environment_new(code, row);
-    constant_t c = node_eval(code, e);
-    environment_destroy(e);
+    predictor_t*p = model_acquire_predictor(m);
+    input_t input;
+    input_init_row(&input, row);
+    constant_t c = predictor_eval(p, &input);
+    model_release_predictor(m, p);
     return constant_to_variable(&c);
 }
+static void predict_batch(model_t*m, predictor_t*p, input_t*input, int num_rows, variable_t*out)
+{
+    int y;
+    for(y=0;y<num_rows;y++) {
+        input_set_position(input, y);
+        constant_t c = predictor_eval(p, input);
+        out[y] = constant_to_variable(&c);
+    }
+    input_clear(input);
+    model_release_predictor(m, p);
+}
+void model_predict_batch(model_t*m, variable_t**columns, int num_rows, variable_t*out)
+{
+    predictor_t*p = model_acquire_predictor(m);
+    input_t input;
+    input_init_columns(&input, columns, p->row);
+    predict_batch(m, p, &input, num_rows, out);
+}
+void model_predict_dataset(model_t*m, dataset_t*d, variable_t*out)
+{
+    predictor_t*p = model_acquire_predictor(m);
+    input_t input;
+    input_init_dataset(&input, d, p->row);
+    predict_batch(m, p, &input, d->num_rows, out);
+}
+void model_profile_start(model_t*m)
+{
+    if(m->profile) {
+        profile_reset((profile_t*)m->profile);
+    } else {
+        m->profile = profile_new((node_t*)m->code);
+    }
+}
+variable_t model_predict_profiled(model_t*m, row_t*row)
+{
+    if(!m->profile) {
+        model_profile_start(m);
+    }
+    constant_t c = profile_eval((profile_t*)m->profile, row);
+    return constant_to_variable(&c);
+}
+void model_profile_print(model_t*m, FILE*fi)
+{
+    if(m->profile) {
+        profile_print((profile_t*)m->profile, fi);
+    }
+}
+bool model_profile_save(model_t*m, const char*filename)
+{
+    if(!m->profile) {
+        fprintf(stderr, "No profile to save\n");
+        return false;
+    }
+    writer_t*w = filewriter_new2(filename);
+    if(!w) {
+        return false;
+    }
+    profile_write((profile_t*)m->profile, w);
+    w->finish(w);
+    return true;
+}
+void model_profile_stop(model_t*m)
+{
+    if(m->profile) {
+        profile_destroy((profile_t*)m->profile);
+        m->profile = NULL;
+    }
+}
+
+bool model_reorder_branches(model_t*m)
+{
+    if(!m->profile) {
+        fprintf(stderr, "No profile to reorder branches by\n");
+        return false;
+    }
+    m->code = node_reorder_branches((node_t*)m->code, (profile_t*)m->profile);
+    model_profile_stop(m);
+
+    /* everything compiled from the old code is out of date now */
+    model_destroy_predictors(m);
+    if(m->bytecode) {
+        bytecode_destroy(m->bytecode);
+        m->bytecode = NULL;
+    }
+    if(m->native) {
+        native_destroy(m->native);
+        m->native = NULL;
+    }
+    return true;
+}
+
 void model_destroy(model_t*m)
 {
+    model_profile_stop(m);
+    model_destroy_predictors(m);
+    if(m->bytecode)
+        bytecode_destroy(m->bytecode);
+    if(m->native)
+        native_destroy(m->native);
     if(m->code)
         node_destroy(m->code);
+    if(m->mapping)
+        model_mapping_destroy(m->mapping);
     free(m);
     /* FIXME: since the signature is originally part of the dataset,
        we can't destroy it here. */
@@ -44,6 +44,7 @@ void signature_print(signature_t*sig);
 void model_print(model_t*m);
 void signature_destroy(signature_t*s);
 variable_t model_predict(model_t*m, row_t*row);
+void model_predict_batch(model_t*m, variable_t**columns, int num_rows, variable_t*out);
 void model_destroy(model_t*m);
 
 #endif
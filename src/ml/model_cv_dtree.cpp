@@ -22,9 +22,9 @@
 #include "cvtools.h"
 #include "mrscake.h"
 #include "dataset.h"
-#include "easy_ast.h"
 #include "model_select.h"
 #include "transform.h"
+#include "forest.h"
 
 //#define VERIFY 1
 
@@ -81,64 +81,68 @@ array_t*parse_bitfield(CvDTreeTrainData* data, dataset_t*dataset, int column, in
     return a;
 }
 
-static void walk_dtree_node(CvDTreeTrainData* data, int pruned_tree_idx, dataset_t*dataset, CvDTreeNode*node, node_t*current_node, bool resolve_classes, bool as_float)
+static int walk_dtree_node(CvDTreeTrainData* data, int pruned_tree_idx, dataset_t*dataset, CvDTreeNode*node, forest_t*forest, bool as_float)
 {
     const int*vtype = data->var_type->data.i;
-    node_t**current_program = 0;
 
     if(node->Tn <= pruned_tree_idx || !node->left) {
         assert(dataset->desired_response->type == CATEGORICAL);
-        category_t c = (int)floor(node->value+FLT_EPSILON);
-        if(resolve_classes) {
-            if(c<0 || c>=dataset->desired_response->num_classes) {
-                MISSING_CONSTANT;
-            } else {
-                GENERIC_CONSTANT(dataset->desired_response->classes[c]);
-            }
+        if(as_float) {
+            return forest_add_float_leaf(forest, node->value);
         } else {
-            if(as_float) {
-                FLOAT_CONSTANT(node->value);
-            } else {
-                INT_CONSTANT(c);
-            }
+            return forest_add_int_leaf(forest, (int)floor(node->value+FLT_EPSILON));
         }
-        return;
     }
 
     CvDTreeSplit* split = node->split;
     int ci = vtype[split->var_idx];
     /* TODO: a split contains multiple variables we can use (iterate
-             over a split by using split->next). We could wrap an
-             additional if-statement around the code below which will
-             test all possible variables for existence first. The original
+             over a split by using split->next). We could add additional
+             tests for all possible variables for existence first. The original
              dtree code also contained a final fallback (which moves to
              the node with more samples) in case we don't have *any* of the 
              variables in this split.
      */
-    IF
-        if(split->inversed) {
-            NOT
-        }
-        if(ci<0) { // ordered
-                LTE
-                    PARAM(split->var_idx);
-                    FLOAT_CONSTANT(split->ord.c);
-                END;
-        } else { //categorical
-            array_t*a = parse_bitfield(data, dataset, split->var_idx, ci, split->subset);
-                IN
-                    PARAM(split->var_idx);
-                    ARRAY_CONSTANT(a);
-                END;
-        }
-        if(split->inversed) {
-            END;
-        }
-    THEN
-        walk_dtree_node(data, pruned_tree_idx, dataset, node->left, current_node, resolve_classes, as_float);
-    ELSE
-        walk_dtree_node(data, pruned_tree_idx, dataset, node->right, current_node, resolve_classes, as_float);
-    END;
+    int pos;
+    if(ci<0) { // ordered
+        pos = forest_add_lte(forest, split->var_idx, split->ord.c);
+    } else { //categorical
+        array_t*a = parse_bitfield(data, dataset, split->var_idx, ci, split->subset);
+        pos = forest_add_in(forest, split->var_idx, constset_new(a));
+    }
+    /* trees are stored in preorder, with the branch more training samples
+       took first. If that's the one where the test fails, the test is
+       negated. */
+    CvDTreeNode*if_true = split->inversed ? node->right : node->left;
+    CvDTreeNode*if_false = split->inversed ? node->left : node->right;
+    if(if_false->sample_count > if_true->sample_count) {
+        CvDTreeNode*tmp = if_true;
+        if_true = if_false;
+        if_false = tmp;
+        forest_negate(forest, pos);
+    }
+    forest_set_frequencies(forest, pos, if_true->sample_count, if_false->sample_count);
+    int left = walk_dtree_node(data, pruned_tree_idx, dataset, if_true, forest, as_float);
+    int right = walk_dtree_node(data, pruned_tree_idx, dataset, if_false, forest, as_float);
+    forest_set_branches(forest, pos, left, right);
+    return pos;
+}
+
+static node_t* trees_to_program(CvForestTree**trees, int ntrees, dataset_t*dataset)
+{
+    forest_t*forest;
+    if(ntrees == 1) {
+        // optimization: if it's just a single tree, we don't need voting
+        forest = forest_new(FOREST_SINGLE, dataset_classes_as_array(dataset));
+    } else {
+        forest = forest_new(FOREST_VOTE, dataset_classes_as_array(dataset));
+    }
+    int k;
+    for(k=0; k<ntrees; k++) {
+        forest_start_tree(forest, 0);
+        walk_dtree_node(trees[k]->data,trees[k]->pruned_tree_idx,dataset,trees[k]->root,forest,false);
+    }
+    return node_new_forest(forest);
 }
 
 class CodeGeneratingDTree: public CvDTree
@@ -164,12 +168,10 @@ class CodeGeneratingDTree: public CvDTree
             assert(!"The tree has not been trained yet");
         }
 
-        START_CODE(code);
-          BLOCK
-            walk_dtree_node(data,pruned_tree_idx,dataset,root,code, true, false);
-          END;
-        END_CODE;
-        return code;
+        forest_t*forest = forest_new(FOREST_SINGLE, dataset_classes_as_array(dataset));
+        forest_start_tree(forest, 0);
+        walk_dtree_node(data,pruned_tree_idx,dataset,root,forest,false);
+        return node_new_forest(forest);
     }
     dataset_t*dataset;
 };
@@ -185,40 +187,7 @@ class CodeGeneratingRTrees: public CvRTrees
     
     node_t* get_program() const
     {
-        START_CODE(code);
-        BLOCK;
-
-        if(ntrees == 1) {
-            // optimization: if it's just a single tree, we don't need voting
-            walk_dtree_node(trees[0]->data,trees[0]->pruned_tree_idx,dataset,trees[0]->root,current_node,true,false);
-        } else {
-            SETLOCAL(0)
-                NEW_ZERO_INT_ARRAY(dataset->desired_response->num_classes);
-            END;
-
-            int k;
-            for(k=0; k<ntrees; k++)
-            {
-                SETLOCAL(k+1)
-                    walk_dtree_node(trees[k]->data,trees[k]->pruned_tree_idx,dataset,trees[k]->root,current_node,false,false);
-                END;
-                INC_ARRAY_AT_POS
-                    GETLOCAL(0);
-                    GETLOCAL(k+1);
-                END;
-            }
-
-            ARRAY_AT_POS
-                ARRAY_CONSTANT(dataset_classes_as_array(dataset));
-                ARRAY_ARG_MAX_I;
-                    GETLOCAL(0);
-                END;
-            END;
-        }
-
-        END;
-        END_CODE;
-        return code;
+        return trees_to_program(trees, ntrees, dataset);
     }
 
 
@@ -236,38 +205,7 @@ class CodeGeneratingERTrees: public CvERTrees
 
     node_t* get_program() const
     {
-        START_CODE(code);
-        BLOCK;
-
-        if(ntrees == 1) {
-            walk_dtree_node(trees[0]->data,trees[0]->pruned_tree_idx,dataset,trees[0]->root,current_node,true,false);
-        } else {
-            SETLOCAL(0)
-                NEW_ZERO_INT_ARRAY(dataset->desired_response->num_classes);
-            END;
-
-            int k;
-            for(k=0; k<ntrees; k++)
-            {
-                SETLOCAL(k+1)
-                    walk_dtree_node(trees[k]->data,trees[k]->pruned_tree_idx,dataset,trees[k]->root,current_node,false,false);
-                END;
-                INC_ARRAY_AT_POS
-                    GETLOCAL(0);
-                    GETLOCAL(k+1);
-                END;
-            }
-
-            ARRAY_AT_POS
-                ARRAY_CONSTANT(dataset_classes_as_array(dataset));
-                ARRAY_ARG_MAX_I;
-                    GETLOCAL(0);
-                END;
-            END;
-        }
-        END;
-        END_CODE;
-        return code;
+        return trees_to_program(trees, ntrees, dataset);
     }
 
 
@@ -285,46 +223,28 @@ class CodeGeneratingGBTrees: public CvGBTrees
 
     node_t* get_program() const
     {
-        START_CODE(code)
-        BLOCK
         assert(weak);
 
+        forest_t*forest = forest_new(FOREST_SUM, dataset_classes_as_array(dataset));
+        forest->shrinkage = params.shrinkage;
+
         CvSeqReader reader;
         int weak_count = cvSliceLength( CV_WHOLE_SEQ, weak[class_count-1] );
         CvDTree* tree;
-        int var_index = 0;
         for(int i=0; i<class_count; ++i) {
 	    int orig_class_label = class_labels->data.i[i];
-            SETLOCAL(orig_class_label)
-                ADD
-                    if ((weak[i]) && (weak_count)) {
-                        cvStartReadSeq( weak[i], &reader );
-                        cvSetSeqReaderPos( &reader, CV_WHOLE_SEQ.start_index );
-                        for (int j=0; j<weak_count; ++j)
-                        {
-                            CV_READ_SEQ_ELEM( tree, reader );
-                            MUL
-                                walk_dtree_node(tree->data, tree->pruned_tree_idx, dataset, tree->root, current_node, false, true);
-                                FLOAT_CONSTANT(params.shrinkage);
-                            END;
-                        }
-                    }
-                END;
-            END;
-        }
-        ARRAY_AT_POS
-            ARRAY_CONSTANT(dataset_classes_as_array(dataset));
-            ARG_MAX_F;
-                for(int i=0; i<dataset->desired_response->num_classes; ++i) {
-                    GETLOCAL(i);
+            if ((weak[i]) && (weak_count)) {
+                cvStartReadSeq( weak[i], &reader );
+                cvSetSeqReaderPos( &reader, CV_WHOLE_SEQ.start_index );
+                for (int j=0; j<weak_count; ++j)
+                {
+                    CV_READ_SEQ_ELEM( tree, reader );
+                    forest_start_tree(forest, orig_class_label);
+                    walk_dtree_node(tree->data, tree->pruned_tree_idx, dataset, tree->root, forest, true);
                 }
-            END;
-        END;
-
-        END;
-        END_CODE;
-
-        return code;
+            }
+        }
+        return node_new_forest(forest);
     }
 
     dataset_t*dataset;
@@ -20,9 +20,10 @@
    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
 
 #include <stdlib.h>
+#include <assert.h>
 #include "mrscake.h"
 #include "dataset.h"
-#include "easy_ast.h"
+#include "neighbors.h"
 #include "model_select.h"
 #include "transform.h"
 
@@ -38,115 +39,25 @@ static node_t*knearest_train(knearest_model_factory_t*factory, dataset_t*d)
 
     int * class_count = d->desired_response->class_occurence_count;
     int num_classes = d->desired_response->num_classes;
-    int * class_pos = calloc(num_classes, sizeof(int));
-    int k = factory->k;
-    
-    START_CODE(code)
-    BLOCK
-        int cls;
-        for(cls=0;cls<num_classes;cls++) {
-            assert(class_count[cls]>0);
-            SETLOCAL(cls);
-                NEW_ZERO_FLOAT_ARRAY(class_count[cls]);
-            END;
-        }
-        int i,j;
-        for(i=0;i<d->num_rows;i++) {
-            int cls = d->desired_response->entries[i].c;
-            SET_ARRAY_AT_POS
-                GETLOCAL(cls); 
-                INT_CONSTANT(class_pos[cls]);
-                ADD
-                for(j=0;j<d->num_columns;j++) {
-                    SQR
-                        SUB
-                            FLOAT_CONSTANT(d->columns[j]->entries[i].f);
-                            PARAM(j);
-                        END;
-                    END;
-                }
-                END;
-            END;
-            class_pos[cls]++;
-        }
-        for(cls=0;cls<num_classes;cls++) {
-            /* FIXME: we might want to only pick the k*num_classes best entries,
-                      not sort the entire array */
-            SORT_FLOAT_ARRAY_ASC
-                GETLOCAL(cls);
-            END;
+    int cls;
+    for(cls=0;cls<num_classes;cls++) {
+        assert(class_count[cls]>0);
+    }
+
+    knn_t*knn = knn_new(factory->k, d->num_columns, dataset_classes_as_array(d));
+    float*row = malloc(sizeof(float)*(d->num_columns+1));
+    int i,j;
+    for(i=0;i<d->num_rows;i++) {
+        int y = dataset_row(d, i);
+        for(j=0;j<d->num_columns;j++) {
+            row[j] = d->columns[j]->entries[y].f;
         }
-        int position_var = num_classes;
-        int class_count_minus_one_var = num_classes+1;
-        int best_class = num_classes+2;
-        int loop_counter = num_classes+3;
+        knn_add_row(knn, d->desired_response->entries[y].c, row);
+    }
+    free(row);
+    knn_build(knn);
+    node_t*code = node_new_knearest(knn);
 
-        SETLOCAL(position_var);
-            NEW_ZERO_INT_ARRAY(num_classes);
-        END;
-        SETLOCAL(class_count_minus_one_var);
-            array_t*a = array_new(num_classes);
-            for(cls=0;cls<num_classes;cls++) {
-                a->entries[cls] = int_constant(class_count[cls]-1);
-            }
-            ARRAY_CONSTANT(a);
-        END;
-        FOR_LOCAL_FROM_N_TO_M(loop_counter)
-            INT_CONSTANT(0);
-            INT_CONSTANT(k);
-            BLOCK
-                SETLOCAL(best_class);
-                    ARG_MIN_F
-                        for(cls=0;cls<num_classes;cls++) {
-                            ARRAY_AT_POS
-                                GETLOCAL(cls);
-                                ARRAY_AT_POS
-                                    GETLOCAL(position_var);
-                                    INT_CONSTANT(cls);
-                                END;
-                            END;
-                        }
-                    END;
-                END;
-                /* we do a simplification here: if any given category c is maxed out (i.e.,
-                   *all* the examples of that category are within the k nearest entries), we
-                   keep the worst example around for further comparisons. That means that
-                   this class will potentially shadow other classes that have more entries
-                   in the nearest neighbors, but less entries that are better than the worst
-                   entry of class c. This is usually what you want, anyway.
-                */
-                IF
-                    LT_I
-                        ARRAY_AT_POS
-                            GETLOCAL(position_var);
-                            GETLOCAL(best_class);
-                        END;
-                        ARRAY_AT_POS
-                            GETLOCAL(class_count_minus_one_var);
-                            GETLOCAL(best_class);
-                        END;
-                    END;
-                THEN
-                    INC_ARRAY_AT_POS
-                        GETLOCAL(position_var);
-                        GETLOCAL(best_class);
-                    END;
-                ELSE
-                    NOP;
-                END;
-            END;
-        END;
-        RETURN
-            ARRAY_AT_POS
-                ARRAY_CONSTANT(dataset_classes_as_array(d));
-                ARRAY_ARG_MAX_I
-                    GETLOCAL(position_var);
-                END;
-            END;
-        END;
-    END;
-    END_CODE;
-            
     d = dataset_revert_one_transformation(d, &code);
     d = dataset_revert_one_transformation(d, &code);
     return code;
@@ -46,7 +46,7 @@ static double category_score(perceptron_t*p, category_t c, dataset_t*d, int row)
         if(p->disabled[i])
             continue;
         column_t*column = d->columns[i];
-        double v = column->entries[row].f;
+        double v = column->entries[dataset_row(d, row)].f;
         result += p->weights[c][i]*v;
     }
     result += p->weights[c][p->intercept];
@@ -83,7 +83,7 @@ static category_t perceptron_predict(perceptron_t*p, dataset_t*d, int row)
 
 static void perceptron_update_weights(perceptron_t*p, dataset_t*d, int row)
 {
-    category_t label = d->desired_response->entries[row].c;
+    category_t label = d->desired_response->entries[dataset_row(d, row)].c;
     category_t guess = perceptron_predict(p, d, row);
     if(label == guess)
         return;
@@ -94,9 +94,9 @@ static void perceptron_update_weights(perceptron_t*p, dataset_t*d, int row)
         if(p->disabled[x])
             continue;
         column_t*column = d->columns[x];
-        double d = column->entries[row].f;
-        p->weights[label][x] += d;
-        p->weights[guess][x] -= d;
+        double v = column->entries[dataset_row(d, row)].f;
+        p->weights[label][x] += v;
+        p->weights[guess][x] -= v;
     }
     p->weights[label][p->intercept] += 1;
     p->weights[guess][p->intercept] -= 1;
@@ -109,7 +109,7 @@ void perceptron_train(perceptron_t*p, dataset_t*d)
     for(i=0;i<num_iterations;i++)
     {
         int row = lrand48() % d->num_rows;
-        if(perceptron_predict(p, d, row) != d->desired_response->entries[row].c) {
+        if(perceptron_predict(p, d, row) != d->desired_response->entries[dataset_row(d, row)].c) {
             perceptron_update_weights(p, d, row);
         }
     }
@@ -125,7 +125,7 @@ void perceptron_train_halfsided(perceptron_t*p, dataset_t*d, int sign)
         for(i=0;i<num_iterations;i++)
         {
             int row = lrand48() % d->num_rows;
-            if(perceptron_predict(p, d, row) != d->desired_response->entries[row].c) {
+            if(perceptron_predict(p, d, row) != d->desired_response->entries[dataset_row(d, row)].c) {
                 perceptron_update_weights(p, d, row);
             }
         }
@@ -134,7 +134,7 @@ void perceptron_train_halfsided(perceptron_t*p, dataset_t*d, int sign)
 #ifdef DEBUG
         int right = 0;
         for(i=0;i<d->num_rows;i++) {
-            if(perceptron_predict(p, d, i) == d->desired_response->entries[i].c) {
+            if(perceptron_predict(p, d, i) == d->desired_response->entries[dataset_row(d, i)].c) {
                 right++;
             }
         }
@@ -38,6 +38,8 @@
 #include "dataset.h"
 #include "codegen.h"
 #include "serialize.h"
+#include "specialize.h"
+#include "bytecode.h"
 #include "net/distribute.h"
 #include "settings.h"
 #include "transform.h"
@@ -124,6 +126,16 @@ model_factory_t* model_factory_get_by_name(const char*name)
     return 0;
 }
 
+static void add_job(jobqueue_t*queue, dataset_t*data, model_factory_t*factory, char*transforms)
+{
+    job_t* job = job_new();
+    job->factory = factory;
+    job->code = NULL;
+    job->data = data;
+    job->transforms = transforms? strdup(transforms) : NULL;
+    jobqueue_append(queue,job);
+}
+
 static void add_jobs_with_transforms(jobqueue_t*queue, dataset_t*data, const char*pick_model, char*transforms)
 {
     int s;
@@ -134,12 +146,7 @@ static void add_jobs_with_transforms(jobqueue_t*queue, dataset_t*data, const cha
             model_factory_t*factory = collection->models[t];
             if(pick_model && strcmp(factory->name, pick_model))
                 continue;
-            job_t* job = job_new();
-            job->factory = factory;
-            job->code = NULL;
-            job->data = data;
-            job->transforms = transforms? strdup(transforms) : NULL;
-            jobqueue_append(queue,job);
+            add_job(queue, data, factory, transforms);
         }
     }
 }
@@ -172,6 +179,14 @@ model_t* job_to_model(job_t*job)
     return model;
 }
 
+/* what jobs are ranked by. With cross validation, score is what the
+   final model scores on the rows it was trained on, so use the total
+   of the folds instead. */
+static int32_t job_selection_score(job_t*job)
+{
+    return config_cross_validation_folds > 1 ? job->cv_score : job->score;
+}
+
 model_t* jobqueue_extract_best_and_destroy(jobqueue_t*jobs)
 {
     if(!jobs)
@@ -182,7 +197,7 @@ model_t* jobqueue_extract_best_and_destroy(jobqueue_t*jobs)
     job_t*job;
     for(job=jobs->first;job;job=job->next) {
         if(job->code) {
-            if(!best_job || job->score < best_job->score) {
+            if(!best_job || job_selection_score(job) < job_selection_score(best_job)) {
                 if(best_job) {
                     node_destroy(best_job->code);
                     best_job->code = 0;
@@ -201,20 +216,260 @@ model_t* jobqueue_extract_best_and_destroy(jobqueue_t*jobs)
     return model;
 }
 
-model_t* model_select(dataset_t*data)
+static int compare_job_scores(const void*_a, const void*_b)
 {
-#ifdef DEBUG
-    printf("# %d classes, %d rows of examples (%d columns)\n", data->desired_response->num_classes, data->num_rows,
-            data->num_columns);
-#endif
+    job_t*a = *(job_t**)_a;
+    job_t*b = *(job_t**)_b;
+    int32_t score_a = job_selection_score(a);
+    int32_t score_b = job_selection_score(b);
+    if(score_a != score_b)
+        return score_a < score_b ? -1 : 1;
+    return a->nr - b->nr;
+}
+
+/* keep the num best jobs, and clear them for retraining */
+static void jobqueue_keep_best(jobqueue_t*jobs, int num)
+{
+    job_t**sorted = malloc(sizeof(job_t*)*jobs->num);
+    int count = 0;
+    job_t*job;
+    for(job=jobs->first;job;job=job->next) {
+        sorted[count++] = job;
+    }
+    qsort(sorted, count, sizeof(job_t*), compare_job_scores);
+    int i;
+    for(i=0;i<count;i++) {
+        job = sorted[i];
+        if(job->code) {
+            node_destroy(job->code);
+            job->code = NULL;
+        }
+        if(i >= num) {
+            jobqueue_delete_job(jobs, job);
+        }
+    }
+    free(sorted);
+}
 
+/* Successive halving: train all jobs on a small sample of the data,
+   keep the best 1/config_halving_factor of them, and repeat with a
+   config_halving_factor times larger sample, until the remaining jobs
+   are trained on the full dataset. */
+void jobqueue_process_racing(dataset_t*data, jobqueue_t*jobs)
+{
+    int factor = config_halving_factor < 2 ? 2 : config_halving_factor;
+
+    int rounds = 0;
+    int64_t scale = 1;
+    int survivors = jobs->num;
+    while(data->num_rows / (scale*factor) >= config_halving_min_rows && survivors > 1) {
+        scale *= factor;
+        survivors = (survivors + factor - 1) / factor;
+        rounds++;
+    }
+
+    while(rounds-- > 0) {
+        dataset_t*sample = dataset_sample(data, data->num_rows / scale);
+        if(config_verbosity > 0)
+            printf("Training %d models on %d rows\n", jobs->num, sample->num_rows);
+        job_t*job;
+        for(job=jobs->first;job;job=job->next) {
+            job->data = sample;
+        }
+        jobqueue_process(sample, jobs);
+        /* score on the full dataset, since on their own training rows
+           models like knearest are always right */
+        for(job=jobs->first;job;job=job->next) {
+            job->data = data;
+            job->score = code_score(job->code, data);
+        }
+        jobqueue_keep_best(jobs, (jobs->num + factor - 1) / factor);
+        dataset_destroy(sample);
+        scale /= factor;
+    }
+    if(config_verbosity > 0 && jobs->num)
+        printf("Training %d models on %d rows\n", jobs->num, data->num_rows);
+    jobqueue_process(data, jobs);
+}
+
+/* k-fold cross validation: every job is trained k times, each time
+   without the rows of one fold, which it's then scored on. The folds are
+   ordinary jobs, so they run in parallel like any others. Only the job
+   with the best total score is then trained on the full dataset. */
+static void jobqueue_process_cross_validation(dataset_t*data, jobqueue_t*jobs, int num_folds)
+{
+    jobqueue_t*folds = jobqueue_new();
+    job_t*job;
+    for(job=jobs->first;job;job=job->next) {
+        int i;
+        for(i=0;i<num_folds;i++) {
+            job_t*f = job_new();
+            f->factory = job->factory;
+            f->data = data;
+            f->transforms = fold_transform(i, num_folds, job->transforms);
+            jobqueue_append(folds, f);
+        }
+    }
+    if(config_verbosity > 0)
+        printf("Cross-validating %d models with %d folds\n", jobs->num, num_folds);
+    jobqueue_process(data, folds);
+
+    job_t*f = folds->first;
+    for(job=jobs->first;job;job=job->next) {
+        int64_t score = 0;
+        int i;
+        for(i=0;i<num_folds;i++) {
+            /* remote workers only send code if it's the best so far, so
+               the code might be missing even though the fold succeeded */
+            score += f->score;
+            if(f->code)
+                node_destroy(f->code);
+            f = f->next;
+        }
+        job->cv_score = score < INT32_MAX ? score : INT32_MAX;
+    }
+    jobqueue_destroy(folds);
+
+    jobqueue_keep_best(jobs, 1);
+    jobqueue_process(data, jobs);
+}
+
+static void process_jobs(dataset_t*data, jobqueue_t*jobs)
+{
+    static bool warned = false;
+    if(config_cross_validation_folds > 1 && config_successive_halving && !warned) {
+        fprintf(stderr, "successive_halving is ignored with cross_validation_folds\n");
+        warned = true;
+    }
+    if(config_cross_validation_folds > 1) {
+        jobqueue_process_cross_validation(data, jobs, config_cross_validation_folds);
+    } else if(config_successive_halving) {
+        jobqueue_process_racing(data, jobs);
+    } else {
+        jobqueue_process(data, jobs);
+    }
+}
+
+static void jobqueue_move_jobs(jobqueue_t*to, jobqueue_t*from)
+{
+    job_t*job = from->first;
+    while(job) {
+        job_t*next = job->next;
+        jobqueue_append(to, job);
+        job = next;
+    }
+    free(from);
+}
+
+/* Forward selection: instead of trying every prefix of the variable
+   order, start with the best column and double the number of columns
+   as long as that improves the best score. A widening which doesn't
+   improve it counts against config_forward_selection_patience. After
+   every round, only the config_forward_selection_beam best models (0:
+   all) are trained on the wider column sets. (With cross validation
+   or successive halving, that's just the winner of the round.) */
+static jobqueue_t* jobqueue_forward_selection(varorder_t*order, dataset_t*data, const char*pick_model, search_stats_t*stats)
+{
+    jobqueue_t*all = jobqueue_new();
+    jobqueue_t*round = jobqueue_new();
+    int num_columns = 1;
+    char*transform = num_columns < order->num ? pick_columns_transform(order->order, num_columns) : NULL;
+    add_jobs_with_transforms(round, data, pick_model, transform);
+    free(transform);
+
+    int32_t best_score = INT32_MAX;
+    int misses = 0;
+    int patience = config_forward_selection_patience > 0 ? config_forward_selection_patience : 1;
+    while(round->num) {
+        int round_columns = num_columns < order->num ? num_columns : data->num_columns;
+        int round_jobs = round->num;
+        if(config_verbosity > 0)
+            printf("Training %d models on %d columns\n", round_jobs, round_columns);
+        process_jobs(data, round);
+
+        job_t**sorted = malloc(sizeof(job_t*)*round->num);
+        int count = 0;
+        job_t*job;
+        for(job=round->first;job;job=job->next) {
+            sorted[count++] = job;
+        }
+        qsort(sorted, count, sizeof(job_t*), compare_job_scores);
+
+        bool improved = false;
+        int32_t round_score = INT32_MAX;
+        int i;
+        for(i=0;i<count;i++) {
+            if(sorted[i]->code && job_selection_score(sorted[i]) < round_score) {
+                round_score = job_selection_score(sorted[i]);
+            }
+        }
+        if(round_score < best_score) {
+            best_score = round_score;
+            improved = true;
+        }
+        misses = improved ? 0 : misses + 1;
+
+        if(stats) {
+            assert(stats->num_rounds < SEARCH_MAX_ROUNDS);
+            search_round_t*r = &stats->rounds[stats->num_rounds++];
+            r->num_columns = round_columns;
+            r->num_jobs = round_jobs;
+            r->best_score = round_score;
+            stats->num_jobs += round_jobs;
+        }
+
+        jobqueue_t*next = jobqueue_new();
+        if(num_columns < order->num && misses < patience) {
+            num_columns *= 2;
+            transform = num_columns < order->num ? pick_columns_transform(order->order, num_columns) : NULL;
+            int beam = config_forward_selection_beam > 0 ? config_forward_selection_beam : count;
+            for(i=0;i<count && i<beam;i++) {
+                add_job(next, data, sorted[i]->factory, transform);
+            }
+            free(transform);
+        }
+        free(sorted);
+
+        jobqueue_move_jobs(all, round);
+        round = next;
+    }
+    jobqueue_destroy(round);
+    return all;
+}
+
+jobqueue_t* jobqueue_search(dataset_t*data, const char*pick_model, search_stats_t*stats)
+{
+    if(stats)
+        memset(stats, 0, sizeof(search_stats_t));
     varorder_t*order = NULL;
     if(config_subset_variables) {
         order = dtree_var_order(data);
     }
 
-    jobqueue_t*jobs = generate_jobs(order, data, NULL);
-    jobqueue_process(data, jobs);
+    jobqueue_t*jobs;
+    if(order && config_forward_selection) {
+        jobs = jobqueue_forward_selection(order, data, pick_model, stats);
+    } else {
+        jobs = generate_jobs(order, data, pick_model);
+        if(stats)
+            stats->num_jobs = jobs->num;
+        process_jobs(data, jobs);
+    }
+    if(order) {
+        free(order->order);
+        free(order);
+    }
+    return jobs;
+}
+
+model_t* model_select(dataset_t*data)
+{
+#ifdef DEBUG
+    printf("# %d classes, %d rows of examples (%d columns)\n", data->desired_response->num_classes, data->num_rows,
+            data->num_columns);
+#endif
+
+    jobqueue_t*jobs = jobqueue_search(data, NULL, NULL);
     model_t*best_model = jobqueue_extract_best_and_destroy(jobs);
     if(!best_model) {
         return NULL;
@@ -234,14 +489,8 @@ model_t* model_select(dataset_t*data)
 
 model_t* model_train_specific_model(dataset_t*data, const char*name)
 {
-    varorder_t*order = NULL;
-    if(config_subset_variables) {
-        order = dtree_var_order(data);
-    }
-
-    jobqueue_t*jobs = generate_jobs(order, data, name);
     config_verbosity = 0;
-    jobqueue_process(data, jobs);
+    jobqueue_t*jobs = jobqueue_search(data, name, NULL);
     config_verbosity = 1;
 
     model_t*best_model = jobqueue_extract_best_and_destroy(jobs);
@@ -313,34 +562,156 @@ void confusion_matrix_print(confusion_matrix_t*m)
     }
     printf("\n");
 }
-confusion_matrix_t* code_get_confusion_matrix(node_t*code, dataset_t*s)
+/* returns a copy of the code which evaluates float arithmetic on the
+   dataset's continuous columns unboxed. The copy is private to the
+   caller, so that code shared with other threads (or with the model
+   it belongs to) never sees specialized node types. */
+static node_t* code_specialize_for_dataset(node_t*code, dataset_t*s)
+{
+    node_t*copy = node_duplicate(code);
+    constant_type_t*types = (constant_type_t*)malloc(sizeof(constant_type_t)*s->num_columns);
+    int x;
+    for(x=0;x<s->num_columns;x++) {
+        types[x] = s->columns[x]->type == CONTINUOUS ? CONSTANT_FLOAT : CONSTANT_MISSING;
+    }
+    node_specialize(copy, types, s->num_columns);
+    free(types);
+    return copy;
+}
+
+/* Maps the predictions of a program to the class indices of a dataset's
+   response column, without hashing. Category predictions are looked up
+   in a table. Strings are compared once, and their pointers remembered:
+   programs return the same few class constants over and over. */
+#define CLASS_MAP_MAX_STRINGS 64
+typedef struct _class_map {
+    column_t*response;
+
+    /* category -> class index, or -1 */
+    int*category_index;
+    int num_categories;
+
+    const char*strings[CLASS_MAP_MAX_STRINGS];
+    int string_index[CLASS_MAP_MAX_STRINGS];
+    int num_strings;
+} class_map_t;
+
+static class_map_t* class_map_new(column_t*response)
 {
-    dict_t*d = dict_new(&constant_hash_type);
+    class_map_t*m = (class_map_t*)calloc(1, sizeof(class_map_t));
+    m->response = response;
     int t;
-    for(t=0;t<s->desired_response->num_classes;t++) {
-        dict_put(d, &s->desired_response->classes[t], INT_TO_PTR(t));
+    for(t=0;t<response->num_classes;t++) {
+        constant_t*c = &response->classes[t];
+        if(c->type == CONSTANT_CATEGORY && c->c >= m->num_categories)
+            m->num_categories = c->c+1;
+    }
+    m->category_index = (int*)malloc(sizeof(int)*(m->num_categories+1));
+    for(t=0;t<m->num_categories;t++) {
+        m->category_index[t] = -1;
+    }
+    /* in reverse, so that the first of two equal classes wins */
+    for(t=response->num_classes-1;t>=0;t--) {
+        constant_t*c = &response->classes[t];
+        if(c->type == CONSTANT_CATEGORY)
+            m->category_index[c->c] = t;
+    }
+    return m;
+}
+
+static int class_map_lookup_slow(class_map_t*m, constant_t*c)
+{
+    int index = -1;
+    int t;
+    for(t=0;t<m->response->num_classes;t++) {
+        if(constant_equals(c, &m->response->classes[t])) {
+            index = t;
+            break;
+        }
+    }
+    if(c->type == CONSTANT_STRING && m->num_strings < CLASS_MAP_MAX_STRINGS) {
+        m->strings[m->num_strings] = c->s;
+        m->string_index[m->num_strings] = index;
+        m->num_strings++;
     }
-    
+    return index;
+}
+
+static inline int class_map_lookup(class_map_t*m, constant_t*c)
+{
+    if(c->type == CONSTANT_CATEGORY) {
+        if(c->c >= 0 && c->c < m->num_categories)
+            return m->category_index[c->c];
+        return -1;
+    } else if(c->type == CONSTANT_STRING) {
+        int t;
+        for(t=0;t<m->num_strings;t++) {
+            if(m->strings[t] == c->s)
+                return m->string_index[t];
+        }
+    }
+    return class_map_lookup_slow(m, c);
+}
+
+static void class_map_destroy(class_map_t*m)
+{
+    free(m->category_index);
+    free(m);
+}
+
+compiled_code_t* code_compile(node_t*code, dataset_t*s)
+{
+    compiled_code_t*c = (compiled_code_t*)calloc(1, sizeof(compiled_code_t));
+    /* the subtrees the bytecode leaves to the tree walker are those of
+       the specialized copy, so it lives as long as the bytecode */
+    c->specialized = code_specialize_for_dataset(code, s);
+    c->bytecode = bytecode_compile(c->specialized);
+    return c;
+}
+
+void compiled_code_destroy(compiled_code_t*c)
+{
+    bytecode_destroy(c->bytecode);
+    node_destroy(c->specialized);
+    free(c);
+}
+
+confusion_matrix_t* compiled_code_get_confusion_matrix(compiled_code_t*c, dataset_t*s)
+{
+    class_map_t*map = class_map_new(s->desired_response);
+
+    /* run the program as bytecode, straight from the dataset's columns */
+    bytecode_t*b = c->bytecode;
+    constant_t*registers = bytecode_registers_new(b);
     row_t* row = row_new(s->num_columns);
-    environment_t*env = environment_new(code, row);
+    input_t input;
+    input_init_dataset(&input, s, row);
 
     confusion_matrix_t*matrix = confusion_matrix_new(s);
 
     int y;
     for(y=0;y<s->num_rows;y++) {
-        dataset_fill_row(s, row, y);
-        constant_t prediction = node_eval(code, env);
-        constant_t* desired = &s->desired_response->classes[s->desired_response->entries[y].c];
-        if(!dict_contains(d, desired) || !dict_contains(d, &prediction)) {
+        input_set_position(&input, y);
+        constant_t prediction = bytecode_run(b, registers, &input);
+        int row = class_map_lookup(map, &prediction);
+        if(row < 0) {
             continue;
         }
-        int column = PTR_TO_INT(dict_lookup(d, desired));
-        int row = PTR_TO_INT(dict_lookup(d, &prediction));
+        int column = s->desired_response->entries[dataset_row(s, y)].c;
         matrix->entries[row][column]++;
     }
-    dict_destroy(d);
+    input_clear(&input);
     row_destroy(row);
-    environment_destroy(env);
+    bytecode_registers_destroy(b, registers);
+    class_map_destroy(map);
+    return matrix;
+}
+
+confusion_matrix_t* code_get_confusion_matrix(node_t*code, dataset_t*s)
+{
+    compiled_code_t*c = code_compile(code, s);
+    confusion_matrix_t*matrix = compiled_code_get_confusion_matrix(c, s);
+    compiled_code_destroy(c);
     return matrix;
 }
 
@@ -354,7 +725,7 @@ int code_errors_old(node_t*code, dataset_t*s)
     for(y=0;y<s->num_rows;y++) {
         dataset_fill_row(s, row, y);
         constant_t prediction = node_eval(code, env);
-        constant_t* desired = &s->desired_response->classes[s->desired_response->entries[y].c];
+        constant_t* desired = &s->desired_response->classes[s->desired_response->entries[dataset_row(s, y)].c];
         if(!constant_equals(&prediction, desired)) {
             error++;
         }
@@ -364,9 +735,8 @@ int code_errors_old(node_t*code, dataset_t*s)
     return error;
 }
 
-int code_errors(node_t*code, dataset_t*s)
+static int confusion_matrix_errors(confusion_matrix_t*c)
 {
-    confusion_matrix_t* c = code_get_confusion_matrix(code, s);
     int x,y,t;
     double error = 0;
     int total = 0;
@@ -392,18 +762,28 @@ int code_errors(node_t*code, dataset_t*s)
         }
         total += correct + row_error; // add row sum
     }
-    int cn = c->n;
-    confusion_matrix_destroy(c);
-    return (int)(error * total / cn / 2);
+    return (int)(error * total / c->n / 2);
+}
+
+int compiled_code_errors(compiled_code_t*c, dataset_t*s)
+{
+    confusion_matrix_t*m = compiled_code_get_confusion_matrix(c, s);
+    int errors = confusion_matrix_errors(m);
+    confusion_matrix_destroy(m);
+    return errors;
+}
+
+int code_errors(node_t*code, dataset_t*s)
+{
+    confusion_matrix_t*m = code_get_confusion_matrix(code, s);
+    int errors = confusion_matrix_errors(m);
+    confusion_matrix_destroy(m);
+    return errors;
 }
 
 int code_size(node_t*code)
 {
-    writer_t *w = nullwriter_new();
-    node_write(code, w, SERIALIZE_FLAG_OMIT_STRINGS);
-    int size = w->pos;
-    w->finish(w);
-    return size;
+    return node_serialized_size(code, SERIALIZE_FLAG_OMIT_STRINGS);
 }
 
 int code_score(node_t*code, dataset_t*data)
@@ -61,6 +61,19 @@ void confusion_matrix_destroy(confusion_matrix_t*m);
 void confusion_matrix_print(confusion_matrix_t*m);
 confusion_matrix_t* code_get_confusion_matrix(node_t*code, dataset_t*s);
 
+/* A program specialized for the column types of a dataset and compiled
+   to bytecode, for scoring it on that dataset (or on views of it)
+   without preparing it again every time. */
+typedef struct _compiled_code {
+    node_t*specialized;
+    struct _bytecode*bytecode;
+} compiled_code_t;
+
+compiled_code_t* code_compile(node_t*code, dataset_t*s);
+confusion_matrix_t* compiled_code_get_confusion_matrix(compiled_code_t*c, dataset_t*s);
+int compiled_code_errors(compiled_code_t*c, dataset_t*s);
+void compiled_code_destroy(compiled_code_t*c);
+
 #ifdef __cplusplus
 }
 #endif
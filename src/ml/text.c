@@ -5,7 +5,7 @@
 #include "text.h"
 #include "stringpool.h"
 
-textcolumn_t* textcolumn_from_column(column_t*column, int num_rows)
+textcolumn_t* textcolumn_from_column(column_t*column, const int*rows, int num_rows)
 {
     assert(column->type == TEXT);
     int y;
@@ -21,7 +21,7 @@ textcolumn_t* textcolumn_from_column(column_t*column, int num_rows)
         sentence_t*sentence = &textcolumn->entries[y];
 
         dict_t*occurences = dict_new(&charptr_type);
-        const char*text = column->entries[y].text;
+        const char*text = column->entries[rows ? rows[y] : y].text;
         const char*p = text;
         int word_count = 0;
         while(*p) {
@@ -119,7 +119,7 @@ int compare_abs_word_score(const void*_score1, const void*_score2)
 }
 
 
-relevant_words_t* textcolumn_get_relevant_words(textcolumn_t*t, column_t*desired_response, category_t category, int max_words)
+relevant_words_t* textcolumn_get_relevant_words(textcolumn_t*t, column_t*desired_response, const int*rows, category_t category, int max_words)
 {
     relevant_words_t*r = calloc(1, sizeof(relevant_words_t));
     r->textcolumn = t;
@@ -133,7 +133,7 @@ relevant_words_t* textcolumn_get_relevant_words(textcolumn_t*t, column_t*desired
     int y;
     for(y=0;y<t->num_rows;y++)
     {
-        int sign = (desired_response->entries[y].c == category)? 1 : -1;
+        int sign = (desired_response->entries[rows ? rows[y] : y].c == category)? 1 : -1;
         int i;
         sentence_t*sentence = &t->entries[y];
         for(i=0;i<sentence->num_word_counts;i++) {
@@ -157,10 +157,10 @@ relevant_words_t* textcolumn_get_relevant_words(textcolumn_t*t, column_t*desired
     return r;
 }
 
-column_t*textcolumn_expand(relevant_words_t*r, column_t*desired_response, category_t category)
+column_t*textcolumn_expand(relevant_words_t*r, column_t*desired_response, const int*rows, int num_entries, category_t category)
 {
     textcolumn_t*t = r->textcolumn;
-    column_t*column = column_new(r->textcolumn->num_rows, CONTINUOUS);
+    column_t*column = column_new(num_entries, CONTINUOUS);
     int y;
     for(y=0;y<t->num_rows;y++)
     {
@@ -175,7 +175,7 @@ column_t*textcolumn_expand(relevant_words_t*r, column_t*desired_response, catego
             }
 
         }
-        column->entries[y].f = value;
+        column->entries[rows ? rows[y] : y].f = value;
     }
     return column;
 }
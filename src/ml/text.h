@@ -45,9 +45,13 @@ typedef struct _relevant_words {
     textcolumn_t*textcolumn;
 } relevant_words_t;
 
-textcolumn_t* textcolumn_from_column(column_t*column, int num_rows);
+/* rows: row y of the textcolumn is entry rows[y] of the column, like
+   dataset_t.rows (NULL: entry y) */
+textcolumn_t* textcolumn_from_column(column_t*column, const int*rows, int num_rows);
 void textcolumn_print(textcolumn_t*t);
-relevant_words_t* textcolumn_get_relevant_words(textcolumn_t*t, column_t*desired_response, category_t category, int max_words);
-column_t*textcolumn_expand(relevant_words_t*r, column_t*desired_response, category_t category);
+relevant_words_t* textcolumn_get_relevant_words(textcolumn_t*t, column_t*desired_response, const int*rows, category_t category, int max_words);
+/* the returned column has num_entries entries, and only those in rows
+   are set */
+column_t*textcolumn_expand(relevant_words_t*r, column_t*desired_response, const int*rows, int num_entries, category_t category);
 
 #endif
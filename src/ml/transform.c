@@ -20,14 +20,166 @@
    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
 
 #include <stdlib.h>
+#include <stdio.h>
 #include <string.h>
 #include <assert.h>
 #include <alloca.h>
+#include <pthread.h>
 #include "transform.h"
 #include "easy_ast.h"
 #include "util.h"
 #include "text.h"
 
+// ----------------------- transformed dataset cache ---------------------------
+
+/* Most trainers start out by calling expand_text_columns() and
+   expand_categorical_columns(), so within one model selection, the same
+   transformations are computed over and over on the same data. Hence,
+   transformed datasets are cached, keyed by source dataset and
+   transformation name. Since the source of a transformation is again
+   cached, that also covers whole transformation chains.
+
+   Every lookup adds a reference, and dataset_revert_one_transformation()
+   drops it. Unreferenced entries stay around for the next job until
+   transform_cache_release_unused() is called, or their source dataset is
+   destroyed. */
+
+typedef struct _cached_transform {
+    dataset_t*source;
+    char*name;
+    dataset_t*dataset;
+    int refcount;
+    struct _cached_transform*next;
+} cached_transform_t;
+
+static pthread_mutex_t transform_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static cached_transform_t*transform_cache = 0;
+
+static dataset_t* transform_cache_get(dataset_t*source, const char*name)
+{
+    pthread_mutex_lock(&transform_cache_mutex);
+    cached_transform_t*e;
+    for(e=transform_cache;e;e=e->next) {
+        if(e->source == source && !strcmp(e->name, name)) {
+            e->refcount++;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&transform_cache_mutex);
+    return e ? e->dataset : NULL;
+}
+
+static dataset_t* transform_cache_put(dataset_t*source, const char*name, dataset_t*dataset)
+{
+    pthread_mutex_lock(&transform_cache_mutex);
+    cached_transform_t*e;
+    for(e=transform_cache;e;e=e->next) {
+        if(e->source == source && !strcmp(e->name, name))
+            break;
+    }
+    if(e) {
+        /* another thread was faster */
+        e->refcount++;
+        pthread_mutex_unlock(&transform_cache_mutex);
+        dataset->transform->destroy(dataset);
+        return e->dataset;
+    }
+    e = calloc(1, sizeof(cached_transform_t));
+    e->source = source;
+    e->name = strdup(name);
+    e->dataset = dataset;
+    e->refcount = 1;
+    e->next = transform_cache;
+    transform_cache = e;
+    pthread_mutex_unlock(&transform_cache_mutex);
+    return dataset;
+}
+
+/* returns false if the dataset isn't in the cache */
+static bool transform_cache_release(dataset_t*dataset)
+{
+    pthread_mutex_lock(&transform_cache_mutex);
+    cached_transform_t*e;
+    for(e=transform_cache;e;e=e->next) {
+        if(e->dataset == dataset) {
+            assert(e->refcount > 0);
+            e->refcount--;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&transform_cache_mutex);
+    return e != NULL;
+}
+
+static bool is_transform_source(dataset_t*dataset)
+{
+    cached_transform_t*e;
+    for(e=transform_cache;e;e=e->next) {
+        if(e->source == dataset)
+            return true;
+    }
+    return false;
+}
+
+static void cached_transform_destroy(cached_transform_t*e)
+{
+    e->dataset->transform->destroy(e->dataset);
+    free(e->name);
+    free(e);
+}
+
+/* expects the mutex to be held */
+static void transform_cache_remove_derived(dataset_t*source)
+{
+    cached_transform_t**prev = &transform_cache;
+    while(*prev) {
+        cached_transform_t*e = *prev;
+        if(e->source == source) {
+            *prev = e->next;
+            transform_cache_remove_derived(e->dataset);
+            cached_transform_destroy(e);
+        } else {
+            prev = &e->next;
+        }
+    }
+}
+
+void transform_cache_release_unused()
+{
+    pthread_mutex_lock(&transform_cache_mutex);
+    bool removed;
+    do {
+        removed = false;
+        cached_transform_t**prev = &transform_cache;
+        while(*prev) {
+            cached_transform_t*e = *prev;
+            if(!e->refcount && !is_transform_source(e->dataset)) {
+                *prev = e->next;
+                cached_transform_destroy(e);
+                removed = true;
+            } else {
+                prev = &e->next;
+            }
+        }
+    } while(removed);
+    pthread_mutex_unlock(&transform_cache_mutex);
+}
+
+void transform_cache_purge(dataset_t*source)
+{
+    pthread_mutex_lock(&transform_cache_mutex);
+    transform_cache_remove_derived(source);
+    pthread_mutex_unlock(&transform_cache_mutex);
+}
+
+static dataset_t* cached_transform(dataset_t*source, const char*name, dataset_t*(*transform)(dataset_t*))
+{
+    dataset_t*dataset = transform_cache_get(source, name);
+    if(dataset)
+        return dataset;
+    return transform_cache_put(source, name, transform(source));
+}
+
 // ----------------------- expand columns transform ----------------------------
 
 typedef struct _expanded_column {
@@ -142,6 +294,11 @@ static dataset_t* expand_dataset(transform_expand_t*transform, dataset_t*orig_da
     dataset->num_columns = transform->num;
     dataset->sig = 0;
 
+    /* keep the row positions of the source, so that the other columns
+       and the row index stay valid */
+    assert(dataset_rows_ascending(orig_dataset));
+    int size = dataset_num_entries(orig_dataset);
+
     int i;
     for(i=0;i<transform->num;i++) {
         expanded_column_t*e = &transform->ecolumns[i];
@@ -152,9 +309,10 @@ static dataset_t* expand_dataset(transform_expand_t*transform, dataset_t*orig_da
         int y;
         if(orig_dataset->columns[x]->type == CATEGORICAL) {
             assert(e->from_category);
-            column_t*c = column_new(dataset->num_rows, CONTINUOUS);
+            column_t*c = column_new(size, CONTINUOUS);
             for(y=0;y<dataset->num_rows;y++) {
-                c->entries[y].f = (source_column->entries[y].c==cls) ? 1.0 : 0.0;
+                int r = dataset_row(dataset, y);
+                c->entries[r].f = (source_column->entries[r].c==cls) ? 1.0 : 0.0;
             }
             dataset->columns[i] = c;
         } else {
@@ -180,7 +338,7 @@ static void expand_destroy(dataset_t*dataset)
     free(transform);
 }
 
-dataset_t* expand_categorical_columns(dataset_t*old_dataset)
+static dataset_t* expand_categorical_columns_uncached(dataset_t*old_dataset)
 {
     transform_expand_t*transform = calloc(1, sizeof(transform_expand_t));
     transform->head.revert_in_code = expand_revert_in_code;
@@ -193,6 +351,11 @@ dataset_t* expand_categorical_columns(dataset_t*old_dataset)
     return expand_dataset(transform, old_dataset);
 }
 
+dataset_t* expand_categorical_columns(dataset_t*old_dataset)
+{
+    return cached_transform(old_dataset, "expand_categorical_columns", expand_categorical_columns_uncached);
+}
+
 // ----------------------- pick colummns transform -----------------------------
 
 typedef struct _transform_pick_columns {
@@ -233,7 +396,7 @@ static void pick_columns_destroy(dataset_t*dataset)
     free(transform);
 }
 
-dataset_t* pick_columns(dataset_t*old_dataset, int*index, int num)
+static dataset_t* pick_columns_uncached(dataset_t*old_dataset, int*index, int num)
 {
     dataset_t*newdata = memdup(old_dataset, sizeof(dataset_t));
     transform_pick_columns_t*transform = calloc(1, sizeof(transform_pick_columns_t));
@@ -254,6 +417,16 @@ dataset_t* pick_columns(dataset_t*old_dataset, int*index, int num)
     return newdata;
 }
 
+dataset_t* pick_columns(dataset_t*old_dataset, int*index, int num)
+{
+    char*name = pick_columns_transform(index, num);
+    dataset_t*dataset = transform_cache_get(old_dataset, name);
+    if(!dataset)
+        dataset = transform_cache_put(old_dataset, name, pick_columns_uncached(old_dataset, index, num));
+    free(name);
+    return dataset;
+}
+
 // ----------------------- remove text columns transform ----------------------
 
 dataset_t* remove_text_columns(dataset_t*old_dataset)
@@ -350,40 +523,24 @@ static node_t* find_clear_cut_columns_revert_in_code(dataset_t*dataset, node_t*n
 static void find_clear_cut_columns_destroy(dataset_t*dataset)
 {
     transform_find_clear_cut_columns_t* transform = (transform_find_clear_cut_columns_t*)dataset->transform;
+    if(dataset->rows != transform->head.original->rows) {
+        free(dataset->rows);
+    }
     free(dataset->columns);
     free(dataset);
     free(transform->index);
+    free(transform->ccol);
     free(transform);
 }
 
-static void remove_rows(dataset_t*dataset, bool*remove_row)
-{
-    int i;
-    int pos = 0;
-    for(i=0;i<=dataset->num_columns;i++) {
-        int j;
-        column_t*column;
-
-        bool response_column = (i == dataset->num_columns);
-        column = response_column? dataset->desired_response : dataset->columns[i];
-
-        pos = 0;
-        for(j=0;j<dataset->num_rows;j++) {
-            if(!remove_row[j]) {
-                column->entries[pos++] = column->entries[j];
-            }
-        }
-    }
-    dataset->num_rows = pos;
-}
-
 dataset_t* find_clear_cut_columns(dataset_t*old_dataset)
 {
     transform_find_clear_cut_columns_t*transform = calloc(1, sizeof(transform_find_clear_cut_columns_t));
     transform->index = calloc(sizeof(int),old_dataset->num_columns);
-    transform->ccol = calloc(sizeof(void*),old_dataset->num_columns);
+    transform->ccol = calloc(sizeof(clear_cut_column_t),old_dataset->num_columns);
 
     bool*remove_row = calloc(sizeof(bool),old_dataset->num_rows);
+    int num_removed = 0;
 
     int i;
     for(i=0;i<old_dataset->num_columns;i++) {
@@ -395,8 +552,9 @@ dataset_t* find_clear_cut_columns(dataset_t*old_dataset)
         if(old_dataset->columns[i]->type == CONTINUOUS) {
             bool response_differs = false;
             for(j=0;j<old_dataset->num_rows;j++) {
-                if(column->entries[j].f > 0) {
-                    category_t resp = old_dataset->desired_response->entries[j].c;
+                int y = dataset_row(old_dataset, j);
+                if(column->entries[y].f > 0) {
+                    category_t resp = old_dataset->desired_response->entries[y].c;
                     if(old_resp>=0 && resp!=old_resp) {
                         response_differs = true;
                         break;
@@ -423,8 +581,9 @@ dataset_t* find_clear_cut_columns(dataset_t*old_dataset)
 
         if(found_clear_cut) {
             for(j=0;j<old_dataset->num_rows;j++) {
-                if(column->entries[j].f > 0) {
+                if(!remove_row[j] && column->entries[dataset_row(old_dataset, j)].f > 0) {
                     remove_row[j] = true;
+                    num_removed++;
                 }
             }
         }
@@ -443,7 +602,19 @@ dataset_t* find_clear_cut_columns(dataset_t*old_dataset)
         newdata->columns[i] = old_dataset->columns[transform->index[i]];
     }
 
-    remove_rows(newdata, remove_row);
+    /* The columns are shared with the original dataset, so rather than
+       compacting them, keep an index of the remaining rows. */
+    if(num_removed) {
+        newdata->hash = NULL;
+        newdata->rows = malloc(sizeof(int)*(old_dataset->num_rows - num_removed));
+        newdata->num_rows = 0;
+        for(i=0;i<old_dataset->num_rows;i++) {
+            if(!remove_row[i]) {
+                newdata->rows[newdata->num_rows++] = dataset_row(old_dataset, i);
+            }
+        }
+    }
+    free(remove_row);
     return newdata;
 }
 
@@ -515,7 +686,7 @@ static void expand_text_destroy(dataset_t*dataset)
     free(transform);
 }
 
-dataset_t* expand_text_columns(dataset_t*old_dataset)
+static dataset_t* expand_text_columns_uncached(dataset_t*old_dataset)
 {
     transform_expand_text_t*transform = calloc(1, sizeof(transform_expand_t));
     transform->head.revert_in_code = expand_text_revert_in_code;
@@ -546,14 +717,16 @@ dataset_t* expand_text_columns(dataset_t*old_dataset)
     int pos = 0;
     for(i=0;i<old_dataset->num_columns;i++) {
         if(old_dataset->columns[i]->type == TEXT) {
-            textcolumn_t*t = textcolumn_from_column(old_dataset->columns[i], old_dataset->num_rows);
+            /* keep the row positions of the source, like expand_dataset() */
+            assert(dataset_rows_ascending(old_dataset));
+            textcolumn_t*t = textcolumn_from_column(old_dataset->columns[i], old_dataset->rows, old_dataset->num_rows);
             int c;
             int n = old_dataset->desired_response->num_classes;
             if(n==2)
 		n = 1;
             for(c=0;c<n;c++) {
-                relevant_words_t*r = textcolumn_get_relevant_words(t, old_dataset->desired_response, (category_t)c, 4);
-                dataset->columns[pos] = textcolumn_expand(r, old_dataset->desired_response, (category_t)c);
+                relevant_words_t*r = textcolumn_get_relevant_words(t, old_dataset->desired_response, old_dataset->rows, (category_t)c, 4);
+                dataset->columns[pos] = textcolumn_expand(r, old_dataset->desired_response, old_dataset->rows, dataset_num_entries(old_dataset), (category_t)c);
                 transform->ecolumns[pos].source_column = i;
                 transform->ecolumns[pos].source_class = c;
                 transform->ecolumns[pos].from_text = r;
@@ -571,6 +744,11 @@ dataset_t* expand_text_columns(dataset_t*old_dataset)
     return dataset;
 }
 
+dataset_t* expand_text_columns(dataset_t*old_dataset)
+{
+    return cached_transform(old_dataset, "expand_text_columns", expand_text_columns_uncached);
+}
+
 // ----------------------------------------------------------------------------
 
 dataset_t* dataset_revert_one_transformation(dataset_t*dataset, node_t**code)
@@ -582,13 +760,15 @@ dataset_t* dataset_revert_one_transformation(dataset_t*dataset, node_t**code)
     if(*code)
         *code = transform->revert_in_code(dataset, *code);
 
-    //in the presence of variable selection, some transformations are shared
-    //between models (see generate_jobs() in model_select.c)
-    //We need reference counting or instance pooling for transforms in order
-    //to free them properly.
-    //
-    //transform->destroy(dataset);
-    
+    /* transformed datasets are shared between jobs, and only destroyed
+       by transform_cache_release_unused() or transform_cache_purge().
+       Those which aren't cached (from find_clear_cut_columns()) belong
+       to the caller. */
+    if(!transform_cache_release(dataset)) {
+        transform_cache_purge(dataset);
+        transform->destroy(dataset);
+    }
+
     return original;
 }
 
@@ -674,3 +854,31 @@ char* pick_columns_transform(int*index, int num)
     p += sprintf(p, ")");
     return str;
 }
+
+/* "fold(i,k)" isn't a transformation of its own: job_train_and_score()
+   strips it off, and trains on all rows not in fold i (of k). It's part
+   of the transformation string so that it reaches remote workers. */
+char* fold_transform(int fold, int num_folds, const char*transforms)
+{
+    char*str = malloc(30 + (transforms ? strlen(transforms) : 0));
+    char*p = str;
+    p += sprintf(p, "fold(%d,%d)", fold, num_folds);
+    if(transforms)
+        sprintf(p, "|%s", transforms);
+    return str;
+}
+
+const char* parse_fold_transform(const char*transforms, int*fold, int*num_folds)
+{
+    *fold = 0;
+    *num_folds = 0;
+    if(!transforms || !str_starts_with(transforms, "fold("))
+        return transforms;
+    if(sscanf(transforms, "fold(%d,%d)", fold, num_folds) != 2 ||
+       *num_folds <= 1 || *fold < 0 || *fold >= *num_folds) {
+        *fold = 0;
+        *num_folds = 0;
+    }
+    const char*rest = strchr(transforms, '|');
+    return rest ? rest+1 : NULL;
+}
@@ -42,8 +42,20 @@ dataset_t* dataset_apply_transformations(dataset_t*dataset, const char*transform
 dataset_t* dataset_revert_one_transformation(dataset_t*dataset, node_t**code);
 dataset_t* dataset_revert_all_transformations(dataset_t*dataset, node_t**code);
 
+/* Transformations return cached datasets, which are shared by everyone
+   applying the same transformation to the same dataset. Reverting a
+   transformation releases the reference. */
+void transform_cache_release_unused();
+/* remove all datasets derived from source from the cache */
+void transform_cache_purge(dataset_t*source);
+
 /* transformation name generators */
 char* pick_columns_transform(int*index, int num);
+char* fold_transform(int fold, int num_folds, const char*transforms);
+
+/* returns the transformations after a leading "fold(i,k)", and stores
+   i and k (or 0, if there is no fold) */
+const char* parse_fold_transform(const char*transforms, int*fold, int*num_folds);
 
 #ifdef __cplusplus
 }
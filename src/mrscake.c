@@ -42,3 +42,22 @@ model_t* trainingdata_train_specific_model(trainingdata_t*trainingdata, const ch
     return model;
 }
 
+model_t* datatable_train(datatable_t*table)
+{
+    dataset_t*data = datatable_to_dataset(table);
+    if(!data)
+        return NULL;
+    model_t*model = model_select(data);
+    dataset_destroy(data);
+    return model;
+}
+
+model_t* datatable_train_specific_model(datatable_t*table, const char*name)
+{
+    dataset_t*data = datatable_to_dataset(table);
+    if(!data)
+        return NULL;
+    model_t*model = model_train_specific_model(data, name);
+    dataset_destroy(data);
+    return model;
+}
@@ -88,6 +88,22 @@ void trainingdata_destroy(trainingdata_t*dataset);
 void trainingdata_save(trainingdata_t*d, const char*filename);
 trainingdata_t* trainingdata_load(const char*filename);
 
+/* Columnar alternative to trainingdata_t, for large amounts of data:
+   values are added one column at a time, in arrays of any length.
+   Categories are mapped to classes while they're added. Text is copied.
+   For training, all columns need as many rows as there are responses. */
+typedef struct _datatable datatable_t;
+
+datatable_t* datatable_new(int num_inputs);
+/* either all columns or none have names */
+bool datatable_set_column_name(datatable_t*t, int column, const char*name);
+bool datatable_add_continuous(datatable_t*t, int column, const float*values, int num);
+bool datatable_add_categorical(datatable_t*t, int column, const category_t*values, int num);
+bool datatable_add_text(datatable_t*t, int column, const char**values, int num);
+bool datatable_add_responses(datatable_t*t, const category_t*values, int num);
+bool datatable_add_text_responses(datatable_t*t, const char**values, int num);
+void datatable_destroy(datatable_t*t);
+
 typedef struct _signature {
     int num_inputs;
     columntype_t*column_types;
@@ -99,19 +115,70 @@ typedef struct _model {
     const char*name;
     signature_t*sig;
     void*code;
+
+    /* compiled version of code, created on demand by model_predict() */
+    void*bytecode;
+    /* idle evaluation states, borrowed by model_predict() */
+    void*predictor;
+    /* machine code version of code, if config_native_compilation is set */
+    void*native;
+    /* the file mapping of models loaded with model_load_flat() */
+    void*mapping;
+    /* counts collected by model_predict_profiled() */
+    void*profile;
 } model_t;
 
 variable_t model_predict(model_t*m, row_t*row);
+
+/* predict num_rows rows at once. columns[i] is an array holding the values
+   of input i for all rows. Results are stored in out[0..num_rows-1]. */
+void model_predict_batch(model_t*m, variable_t**columns, int num_rows, variable_t*out);
+
+/* Profiling: model_predict_profiled() works like model_predict(), but
+   (more slowly) counts how often every part of the model is evaluated,
+   and how much time is spent in it. model_predict() isn't affected.
+   The counts start from zero again after model_profile_start(), and
+   are discarded by model_profile_stop(). model_profile_print() prints
+   the model's code with the counts, model_profile_save() stores them. */
+void model_profile_start(model_t*m);
+variable_t model_predict_profiled(model_t*m, row_t*row);
+void model_profile_print(model_t*m, FILE*fi);
+bool model_profile_save(model_t*m, const char*filename);
+void model_profile_stop(model_t*m);
+
+/* Rearrange the model's branches so that the ones taken most often in
+   the profile collected by model_predict_profiled() come first. This
+   doesn't change the predictions. The profile is discarded afterwards.
+   Don't call this while other threads are using the model. */
+bool model_reorder_branches(model_t*m);
+
+/* model_predict() and model_predict_batch() can be called from several
+   threads at once. Each call borrows scratch memory from a pool kept in the
+   model, which takes a short lock. Threads that predict a lot can avoid that
+   by creating a predictor of their own.
+   Text results returned by a predictor point to strings owned by the model
+   (or the input), and are only valid as long as those are. */
+typedef struct _predictor predictor_t;
+predictor_t* predictor_new(model_t*m);
+variable_t predictor_predict(predictor_t*p, row_t*row);
+void predictor_predict_batch(predictor_t*p, variable_t**columns, int num_rows, variable_t*out);
+void predictor_destroy(predictor_t*p);
 model_t* model_load(const char*filename);
 void model_save(model_t*m, const char*filename);
+/* like model_load()/model_save(), but for memory-mapped model files, which
+   are faster to load and share memory between processes */
+model_t* model_load_flat(const char*filename);
+bool model_save_flat(model_t*m, const char*filename);
 void model_print(model_t*m);
 void model_destroy(model_t*m);
 char*model_generate_code(model_t*m, const char*language);
 
 model_t* trainingdata_train(trainingdata_t*dataset);
+model_t* datatable_train(datatable_t*table);
 
 const char*const* mrscake_get_model_names();
 model_t* trainingdata_train_specific_model(trainingdata_t*trainingdata, const char*name);
+model_t* datatable_train_specific_model(datatable_t*table, const char*name);
 
 #ifdef __cplusplus
 }
@@ -22,7 +22,17 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <memory.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "ast.h"
+#include "forest.h"
+#include "kernels.h"
+#include "constset.h"
+#include "neighbors.h"
+#include "profile.h"
+#include "ast_transforms.h"
 #include "io.h"
 #include "stringpool.h"
 #include "serialize.h"
@@ -35,6 +45,7 @@ static nodetype_t* opcode_to_node(uint8_t opcode)
         case opcode: \
             return &name;
         LIST_NODES
+        LIST_DATA_NODES
 #       undef NODE
         default:
             return 0;
@@ -74,7 +85,304 @@ constant_t constant_read(reader_t*reader)
     return c;
 }
 
-bool node_read_internal_data(node_t*node, reader_t*reader)
+/* In flat model files, big arrays (forest nodes, knn rows, kernel vectors)
+   aren't part of the node stream, but are stored, in native byte order, in
+   a separate blob section. The stream only contains their offsets. When
+   reading, blobs_t points to the mapped blob section; when writing, to a
+   writer collecting the blobs. */
+typedef struct _blobs {
+    writer_t*writer;
+    const uint8_t*data;
+    size_t size;
+} blobs_t;
+
+#define BLOB_ALIGN 16
+
+static void blob_write(blobs_t*blobs, writer_t*writer, const void*data, size_t size)
+{
+    static const uint8_t zeroes[BLOB_ALIGN] = {0};
+    writer_t*w = blobs->writer;
+    if(w->pos % BLOB_ALIGN) {
+        w->write(w, (void*)zeroes, BLOB_ALIGN - w->pos % BLOB_ALIGN);
+    }
+    write_uint32(writer, w->pos);
+    if(size) {
+        w->write(w, (void*)data, size);
+    }
+}
+
+static const void* blob_read(blobs_t*blobs, reader_t*reader, size_t size)
+{
+    uint32_t offset = read_uint32(reader);
+    if(reader->error)
+        return NULL;
+    if(offset % BLOB_ALIGN || offset > blobs->size || size > blobs->size - offset) {
+        reader->error = "invalid blob offset";
+        return NULL;
+    }
+    return blobs->data + offset;
+}
+
+static array_t* array_read(reader_t*reader)
+{
+    uint32_t len = read_compressed_uint(reader);
+    if(reader->error)
+        return NULL;
+    array_t*a = array_new(len);
+    int t;
+    for(t=0;t<len;t++) {
+        a->entries[t] = constant_read(reader);
+        if(!a->entries[t].type) {
+            array_destroy(a);
+            return NULL;
+        }
+    }
+    return a;
+}
+
+/* bitsets are rebuilt from the entries, hash tables from their seed and
+   displacements, so loading doesn't need to search for a hash function */
+static constset_t* constset_read(reader_t*reader)
+{
+    array_t*a = array_read(reader);
+    if(!a)
+        return NULL;
+    uint8_t kind = read_uint8(reader);
+    if(kind != CONSTSET_HASH) {
+        if(reader->error) {
+            array_destroy(a);
+            return NULL;
+        }
+        return constset_new(a);
+    }
+    uint32_t seed = read_compressed_uint(reader);
+    uint32_t num_buckets = read_compressed_uint(reader);
+    if(reader->error || num_buckets > a->size) {
+        array_destroy(a);
+        return NULL;
+    }
+    uint32_t*displacement = (uint32_t*)malloc(sizeof(uint32_t)*(num_buckets?num_buckets:1));
+    int t;
+    for(t=0;t<num_buckets;t++) {
+        displacement[t] = read_compressed_uint(reader);
+    }
+    if(reader->error) {
+        free(displacement);
+        array_destroy(a);
+        return NULL;
+    }
+    return constset_new_hash(a, seed, num_buckets, displacement);
+}
+
+/* the flattened arrays are used directly from the mapped file, only the
+   sets are decoded */
+static forest_t* forest_read_flat(forest_t*f, reader_t*reader, blobs_t*blobs)
+{
+    f->mapped = true;
+    f->num_trees = read_compressed_uint(reader);
+    f->num_nodes = read_compressed_uint(reader);
+    f->roots = (int32_t*)blob_read(blobs, reader, sizeof(int32_t)*(size_t)f->num_trees);
+    f->tree_class = (int32_t*)blob_read(blobs, reader, sizeof(int32_t)*(size_t)f->num_trees);
+    f->nodes = (forest_node_t*)blob_read(blobs, reader, sizeof(forest_node_t)*(size_t)f->num_nodes);
+    int num_sets = read_compressed_uint(reader);
+    if(reader->error || f->num_trees < 0 || f->num_nodes < 0 || num_sets < 0) {
+        f->num_trees = f->num_nodes = 0;
+        forest_destroy(f);
+        return NULL;
+    }
+    f->sets = (constset_t**)calloc(num_sets?num_sets:1, sizeof(constset_t*));
+    int t;
+    for(t=0;t<num_sets;t++) {
+        f->sets[t] = constset_read(reader);
+        if(!f->sets[t])
+            break;
+        f->num_sets++;
+    }
+    if(reader->error || f->num_sets != num_sets || !forest_verify(f)) {
+        forest_destroy(f);
+        return NULL;
+    }
+    return f;
+}
+
+/* stored in the upper bits of a node's kind */
+#define FOREST_FLAG_INVERSED 0x40
+#define FOREST_FLAG_LIKELY 0x80
+
+static forest_t* forest_read(reader_t*reader, blobs_t*blobs)
+{
+    forest_mode_t mode = read_uint8(reader);
+    array_t*classes = array_read(reader);
+    if(!classes)
+        return NULL;
+    forest_t*f = forest_new(mode, classes);
+    f->shrinkage = read_float(reader);
+    int num_features = read_compressed_uint(reader);
+    if(blobs) {
+        f->num_features = num_features;
+        return forest_read_flat(f, reader, blobs);
+    }
+
+    int num_trees = read_compressed_uint(reader);
+    int t;
+    for(t=0;t<num_trees && !reader->error;t++) {
+        int root = read_compressed_uint(reader);
+        int tree_class = read_compressed_int(reader);
+        forest_start_tree(f, tree_class);
+        f->roots[t] = root;
+    }
+
+    int num_nodes = read_compressed_uint(reader);
+    for(t=0;t<num_nodes && !reader->error;t++) {
+        uint8_t kind = read_uint8(reader);
+        uint8_t node_flags = kind & (FOREST_FLAG_INVERSED|FOREST_FLAG_LIKELY);
+        kind &= ~node_flags;
+        if(kind == FOREST_LEAF) {
+            if(mode == FOREST_SUM) {
+                forest_add_float_leaf(f, read_float(reader));
+            } else {
+                forest_add_int_leaf(f, read_compressed_int(reader));
+            }
+            continue;
+        }
+        int feature = read_compressed_uint(reader);
+        int pos;
+        if(kind == FOREST_LTE) {
+            pos = forest_add_lte(f, 0, read_float(reader));
+        } else if(kind == FOREST_IN) {
+            constset_t*set = constset_read(reader);
+            if(!set)
+                break;
+            pos = forest_add_in(f, 0, set);
+        } else {
+            break;
+        }
+        f->nodes[pos].feature = feature;
+        f->nodes[pos].inversed = !!(node_flags & FOREST_FLAG_INVERSED);
+        f->nodes[pos].likely = !!(node_flags & FOREST_FLAG_LIKELY);
+        /* the "true" branch always directly follows its node */
+        forest_set_branches(f, pos, pos+1, pos+read_compressed_uint(reader));
+    }
+    free(f->params);
+    f->params = 0;
+    f->num_features = num_features;
+
+    if(reader->error || f->num_trees != num_trees || f->num_nodes != num_nodes || !forest_verify(f)) {
+        forest_destroy(f);
+        return NULL;
+    }
+    return f;
+}
+
+/* the byte after a kernel's vector. (1 is what older files have for an
+   offset.) */
+#define KERNEL_NO_OFFSET 0
+#define KERNEL_OFFSET_FIRST 1
+#define KERNEL_OFFSET_LAST 2
+
+static kernel_t* kernel_read(reader_t*reader, blobs_t*blobs)
+{
+    int size = read_compressed_uint(reader);
+    if(reader->error || size <= 0)
+        return NULL;
+    kernel_t*k;
+    if(blobs) {
+        const float*vector = (const float*)blob_read(blobs, reader, sizeof(float)*(size_t)size);
+        if(!vector)
+            return NULL;
+        k = (kernel_t*)calloc(1, sizeof(kernel_t));
+        k->size = size;
+        k->vector = (float*)vector;
+        k->mapped = true;
+    } else {
+        k = kernel_new(size);
+        int t;
+        for(t=0;t<size;t++) {
+            k->vector[t] = read_float(reader);
+        }
+    }
+    uint8_t offset = read_uint8(reader);
+    if(offset > KERNEL_OFFSET_LAST && !reader->error) {
+        reader->error = "invalid kernel offset";
+    }
+    k->has_offset = offset != KERNEL_NO_OFFSET;
+    k->offset_last = offset == KERNEL_OFFSET_LAST;
+    if(k->has_offset) {
+        k->offset = read_float(reader);
+    }
+    if(reader->error) {
+        kernel_destroy(k);
+        return NULL;
+    }
+    return k;
+}
+
+/* flat files store the kd-trees as they are */
+static knn_t* knn_read_flat(knn_t*knn, reader_t*reader, blobs_t*blobs)
+{
+    int num_classes = knn->classes->size;
+    knn->mapped = true;
+    knn->num_rows = read_compressed_uint(reader);
+    knn->class_start = (int32_t*)blob_read(blobs, reader, sizeof(int32_t)*(num_classes+1));
+    knn->split = (int32_t*)blob_read(blobs, reader, sizeof(int32_t)*(size_t)knn->num_rows);
+    knn->rows = (float*)blob_read(blobs, reader, sizeof(float)*(size_t)knn->dim*knn->num_rows);
+    bool ok = !reader->error && num_classes > 0 && knn->num_rows > 0 &&
+              knn->class_start[0] == 0 && knn->class_start[num_classes] == knn->num_rows;
+    int i;
+    for(i=0;i<num_classes && ok;i++) {
+        if(knn->class_start[i+1] <= knn->class_start[i])
+            ok = false;
+    }
+    for(i=0;i<knn->num_rows && ok;i++) {
+        if(knn->split[i] < -1 || knn->split[i] >= knn->dim)
+            ok = false;
+    }
+    if(!ok) {
+        knn_destroy(knn);
+        return NULL;
+    }
+    return knn;
+}
+
+/* only the rows are stored, the kd-trees are rebuilt when loading */
+static knn_t* knn_read(reader_t*reader, blobs_t*blobs)
+{
+    int k = read_compressed_uint(reader);
+    int dim = read_compressed_uint(reader);
+    array_t*classes = array_read(reader);
+    if(!classes)
+        return NULL;
+    knn_t*knn = knn_new(k, dim, classes);
+    if(blobs)
+        return knn_read_flat(knn, reader, blobs);
+    float*row = (float*)malloc(sizeof(float)*(dim+1));
+    int32_t*counts = (int32_t*)malloc(sizeof(int32_t)*(classes->size+1));
+    bool ok = classes->size > 0;
+    int c, i, j;
+    for(c=0;c<classes->size;c++) {
+        counts[c] = read_compressed_uint(reader);
+        if(counts[c] <= 0)
+            ok = false;
+    }
+    for(c=0;c<classes->size && ok && !reader->error;c++) {
+        for(i=0;i<counts[c] && !reader->error;i++) {
+            for(j=0;j<dim;j++) {
+                row[j] = read_float(reader);
+            }
+            knn_add_row(knn, c, row);
+        }
+    }
+    free(row);
+    free(counts);
+    if(reader->error || !ok) {
+        knn_destroy(knn);
+        return NULL;
+    }
+    knn_build(knn);
+    return knn;
+}
+
+static bool node_read_data(node_t*node, reader_t*reader, blobs_t*blobs)
 {
     nodetype_t*type = node->type;
     if(type==&node_mixed_array ||
@@ -125,6 +433,22 @@ bool node_read_internal_data(node_t*node, reader_t*reader)
     } else if(type==&node_string) {
         char*s = read_string(reader);
         node->value = string_constant(s);
+    } else if(type==&node_forest) {
+        node->data = forest_read(reader, blobs);
+        if(!node->data)
+            return false;
+    } else if(type==&node_dot_product || type==&node_squared_distance) {
+        node->data = kernel_read(reader, blobs);
+        if(!node->data)
+            return false;
+    } else if(type==&node_in_set) {
+        node->data = constset_read(reader);
+        if(!node->data)
+            return false;
+    } else if(type==&node_knearest) {
+        node->data = knn_read(reader, blobs);
+        if(!node->data)
+            return false;
     } else if(type==&node_constant || 
 	      type==&node_setlocal || 
 	      type==&node_getlocal || 
@@ -140,6 +464,11 @@ bool node_read_internal_data(node_t*node, reader_t*reader)
     return true;
 }
 
+bool node_read_internal_data(node_t*node, reader_t*reader)
+{
+    return node_read_data(node, reader, NULL);
+}
+
 typedef struct _nodestack {
     struct _nodestack*prev;
     node_t*node;
@@ -162,7 +491,7 @@ nodestack_t*stack_pop(nodestack_t*stack)
     return stack;
 }
 
-node_t* node_read(reader_t*reader)
+static node_t* node_read_tree(reader_t*reader, blobs_t*blobs)
 {
     nodestack_t*stack = 0;
     node_t*top_node = 0;
@@ -177,8 +506,8 @@ node_t* node_read(reader_t*reader)
             return NULL;
         node_t*node = node_new(type, stack?stack->node:0);
         stack = stack_new(node, stack);
-        if(type->flags & NODE_FLAG_HAS_VALUE) {
-            if(!node_read_internal_data(node, reader))
+        if(type->flags & (NODE_FLAG_HAS_VALUE|NODE_FLAG_HAS_DATA)) {
+            if(!node_read_data(node, reader, blobs))
                 return NULL;
         }
         if(type->flags&NODE_FLAG_HAS_CHILDREN) {
@@ -206,6 +535,25 @@ node_t* node_read(reader_t*reader)
     return top_node;
 }
 
+static node_t* node_read_with_blobs(reader_t*reader, blobs_t*blobs)
+{
+    /* the whole tree goes into one arena. It's freed together with
+       the last of its nodes. */
+    arena_t*arena = arena_new();
+    arena_t*old = node_select_arena(arena);
+    node_t*node = node_read_tree(reader, blobs);
+    node_select_arena(old);
+    arena_release(arena);
+    return node;
+}
+
+node_t* node_read(reader_t*reader)
+{
+    return node_read_with_blobs(reader, NULL);
+}
+
+static void array_write(array_t*a, writer_t*writer, unsigned flags);
+
 static void constant_write(constant_t*value, writer_t*writer, unsigned flags)
 {
     write_uint8(writer, value->type);
@@ -239,13 +587,7 @@ static void constant_write(constant_t*value, writer_t*writer, unsigned flags)
         case CONSTANT_FLOAT_ARRAY:
         case CONSTANT_CATEGORY_ARRAY:
         case CONSTANT_STRING_ARRAY: {
-            array_t*a = AS_ARRAY(*value);
-            int t;
-            assert(a->size <= 255);
-            write_compressed_uint(writer, a->size);
-            for(t=0;t<a->size;t++) {
-                constant_write(&a->entries[t], writer, flags);
-            }
+            array_write(AS_ARRAY(*value), writer, flags);
             break;
         }
         case CONSTANT_MISSING: {
@@ -257,20 +599,131 @@ static void constant_write(constant_t*value, writer_t*writer, unsigned flags)
     }
 }
 
-static void node_write_internal_data(node_t*node, writer_t*writer, unsigned flags)
+static void array_write(array_t*a, writer_t*writer, unsigned flags)
+{
+    assert(a->size <= 255);
+    write_compressed_uint(writer, a->size);
+    int t;
+    for(t=0;t<a->size;t++) {
+        constant_write(&a->entries[t], writer, flags);
+    }
+}
+
+static void constset_write(constset_t*s, writer_t*writer, unsigned flags)
+{
+    array_write(s->array, writer, flags);
+    write_uint8(writer, s->kind);
+    if(s->kind == CONSTSET_HASH) {
+        write_compressed_uint(writer, s->seed);
+        write_compressed_uint(writer, s->num_buckets);
+        int t;
+        for(t=0;t<s->num_buckets;t++) {
+            write_compressed_uint(writer, s->displacement[t]);
+        }
+    }
+}
+
+static void forest_write(forest_t*f, writer_t*writer, unsigned flags, blobs_t*blobs)
+{
+    write_uint8(writer, f->mode);
+    array_write(f->classes, writer, flags);
+    write_float(writer, f->shrinkage);
+    write_compressed_uint(writer, f->num_features);
+    int t;
+
+    if(blobs) {
+        write_compressed_uint(writer, f->num_trees);
+        write_compressed_uint(writer, f->num_nodes);
+        blob_write(blobs, writer, f->roots, sizeof(int32_t)*f->num_trees);
+        blob_write(blobs, writer, f->tree_class, sizeof(int32_t)*f->num_trees);
+        blob_write(blobs, writer, f->nodes, sizeof(forest_node_t)*f->num_nodes);
+        write_compressed_uint(writer, f->num_sets);
+        for(t=0;t<f->num_sets;t++) {
+            constset_write(f->sets[t], writer, flags);
+        }
+        return;
+    }
+
+    write_compressed_uint(writer, f->num_trees);
+    for(t=0;t<f->num_trees;t++) {
+        write_compressed_uint(writer, f->roots[t]);
+        write_compressed_int(writer, f->tree_class[t]);
+    }
+
+    write_compressed_uint(writer, f->num_nodes);
+    for(t=0;t<f->num_nodes;t++) {
+        forest_node_t*node = &f->nodes[t];
+        write_uint8(writer, node->kind |
+                            (node->inversed ? FOREST_FLAG_INVERSED : 0) |
+                            (node->likely ? FOREST_FLAG_LIKELY : 0));
+        if(node->kind == FOREST_LEAF) {
+            if(f->mode == FOREST_SUM) {
+                write_float(writer, node->v.f);
+            } else {
+                write_compressed_int(writer, node->v.i);
+            }
+            continue;
+        }
+        write_compressed_uint(writer, node->feature);
+        if(node->kind == FOREST_LTE) {
+            write_float(writer, node->v.threshold);
+        } else {
+            constset_write(f->sets[node->v.set], writer, flags);
+        }
+        /* trees are stored in preorder, so we only need the offset of
+           the "false" branch */
+        assert(node->left == t+1);
+        write_compressed_uint(writer, node->right - t);
+    }
+}
+
+static void kernel_write(kernel_t*k, writer_t*writer, blobs_t*blobs)
+{
+    write_compressed_uint(writer, k->size);
+    if(blobs) {
+        blob_write(blobs, writer, k->vector, sizeof(float)*k->size);
+    } else {
+        int t;
+        for(t=0;t<k->size;t++) {
+            write_float(writer, k->vector[t]);
+        }
+    }
+    write_uint8(writer, !k->has_offset ? KERNEL_NO_OFFSET :
+                        k->offset_last ? KERNEL_OFFSET_LAST : KERNEL_OFFSET_FIRST);
+    if(k->has_offset) {
+        write_float(writer, k->offset);
+    }
+}
+
+static void knn_write(knn_t*knn, writer_t*writer, unsigned flags, blobs_t*blobs)
+{
+    write_compressed_uint(writer, knn->k);
+    write_compressed_uint(writer, knn->dim);
+    array_write(knn->classes, writer, flags);
+    if(blobs) {
+        write_compressed_uint(writer, knn->num_rows);
+        blob_write(blobs, writer, knn->class_start, sizeof(int32_t)*(knn->classes->size+1));
+        blob_write(blobs, writer, knn->split, sizeof(int32_t)*knn->num_rows);
+        blob_write(blobs, writer, knn->rows, sizeof(float)*knn->dim*knn->num_rows);
+        return;
+    }
+    int c, i;
+    for(c=0;c<knn->classes->size;c++) {
+        write_compressed_uint(writer, knn->class_start[c+1] - knn->class_start[c]);
+    }
+    for(i=0;i<knn->num_rows*knn->dim;i++) {
+        write_float(writer, knn->rows[i]);
+    }
+}
+
+static void node_write_internal_data(node_t*node, writer_t*writer, unsigned flags, blobs_t*blobs)
 {
     if(node->type==&node_int_array ||
        node->type==&node_float_array ||
        node->type==&node_category_array ||
        node->type==&node_mixed_array ||
        node->type==&node_string_array) {
-        array_t*a = node->value.a;
-        assert(a->size <= 255);
-        write_compressed_uint(writer, a->size);
-        int t;
-        for(t=0;t<a->size;t++) {
-            constant_write(&a->entries[t], writer, flags);
-        }
+        array_write(node->value.a, writer, flags);
     } else if(node->type==&node_category) {
         category_t c = AS_CATEGORY(node->value);
         write_compressed_uint(writer, c);
@@ -296,12 +749,20 @@ static void node_write_internal_data(node_t*node, writer_t*writer, unsigned flag
     } else if(node->type==&node_zero_float_array) {
         int size = node->value.a->size;
         write_compressed_uint(writer, size);
+    } else if(node->type==&node_forest) {
+        forest_write((forest_t*)node->data, writer, flags, blobs);
+    } else if(node->type==&node_dot_product || node->type==&node_squared_distance) {
+        kernel_write((kernel_t*)node->data, writer, blobs);
+    } else if(node->type==&node_in_set) {
+        constset_write((constset_t*)node->data, writer, flags);
+    } else if(node->type==&node_knearest) {
+        knn_write((knn_t*)node->data, writer, flags, blobs);
     } else if(node->type->flags&NODE_FLAG_HAS_VALUE) {
         constant_write(&node->value, writer, flags);
     }
 }
 
-void node_write(node_t*node, writer_t*writer, unsigned flags)
+static void node_write_tree(node_t*node, writer_t*writer, unsigned flags, blobs_t*blobs)
 {
     if(!node) {
         write_uint8(writer, opcode_node_empty);
@@ -309,7 +770,7 @@ void node_write(node_t*node, writer_t*writer, unsigned flags)
     }
     uint8_t opcode = node_get_opcode(node);
     write_uint8(writer, opcode);
-    node_write_internal_data(node, writer, flags);
+    node_write_internal_data(node, writer, flags, blobs);
 
     if(node->type->flags & NODE_FLAG_HAS_CHILDREN) {
         int t;
@@ -319,11 +780,196 @@ void node_write(node_t*node, writer_t*writer, unsigned flags)
             write_compressed_uint(writer, node->num_children);
         }
         for(t=0;t<node->num_children;t++) {
-            node_write(node->child[t], writer, flags);
+            node_write_tree(node->child[t], writer, flags, blobs);
         }
     }
 }
 
+void node_write(node_t*node, writer_t*writer, unsigned flags)
+{
+    node_write_tree(node, writer, flags, NULL);
+}
+
+/* The number of bytes node_write() would produce, computed without a
+   writer. Mirrors the functions above. */
+
+static inline size_t compressed_uint_size(uint32_t u)
+{
+    return u<0x80 ? 1 : u<0x4000 ? 2 : u<0x200000 ? 3 : u<0x10000000 ? 4 : 5;
+}
+
+static inline size_t compressed_int_size(int32_t i)
+{
+    if(i>=-0x40 && i<0x40)
+        return 1;
+    if(i>=-0x2000 && i<0x2000)
+        return 2;
+    if(i>=-0x100000 && i<0x100000)
+        return 3;
+    if(i>=-0x8000000 && i<0x8000000)
+        return 4;
+    return 5;
+}
+
+static inline size_t string_size(const char*s, unsigned flags)
+{
+    if((flags & SERIALIZE_FLAG_OMIT_STRINGS) || !s)
+        return 1;
+    return strlen(s)+1;
+}
+
+static size_t constant_size(constant_t*value, unsigned flags);
+
+static size_t array_size(array_t*a, unsigned flags)
+{
+    size_t size = compressed_uint_size(a->size);
+    int t;
+    for(t=0;t<a->size;t++) {
+        size += constant_size(&a->entries[t], flags);
+    }
+    return size;
+}
+
+static size_t constant_size(constant_t*value, unsigned flags)
+{
+    size_t size = 1;
+    switch(value->type) {
+        case CONSTANT_CATEGORY:
+            return size + compressed_uint_size(AS_CATEGORY(*value));
+        case CONSTANT_FLOAT:
+            return size + 4;
+        case CONSTANT_INT:
+            return size + compressed_uint_size(AS_INT(*value));
+        case CONSTANT_STRING:
+            return size + string_size(AS_STRING(*value), flags);
+        case CONSTANT_MIXED_ARRAY:
+        case CONSTANT_INT_ARRAY:
+        case CONSTANT_FLOAT_ARRAY:
+        case CONSTANT_CATEGORY_ARRAY:
+        case CONSTANT_STRING_ARRAY:
+            return size + array_size(AS_ARRAY(*value), flags);
+        case CONSTANT_MISSING:
+            return size;
+        default:
+            fprintf(stderr, "Can't serialize constant type %d\n", value->type);
+            exit(1);
+    }
+}
+
+static size_t constset_size(constset_t*s, unsigned flags)
+{
+    size_t size = array_size(s->array, flags) + 1;
+    if(s->kind == CONSTSET_HASH) {
+        size += compressed_uint_size(s->seed);
+        size += compressed_uint_size(s->num_buckets);
+        int t;
+        for(t=0;t<s->num_buckets;t++) {
+            size += compressed_uint_size(s->displacement[t]);
+        }
+    }
+    return size;
+}
+
+static size_t forest_size(forest_t*f, unsigned flags)
+{
+    size_t size = 1 + array_size(f->classes, flags) + 4;
+    size += compressed_uint_size(f->num_features);
+    size += compressed_uint_size(f->num_trees);
+    int t;
+    for(t=0;t<f->num_trees;t++) {
+        size += compressed_uint_size(f->roots[t]);
+        size += compressed_int_size(f->tree_class[t]);
+    }
+    size += compressed_uint_size(f->num_nodes);
+    for(t=0;t<f->num_nodes;t++) {
+        forest_node_t*node = &f->nodes[t];
+        size++;
+        if(node->kind == FOREST_LEAF) {
+            if(f->mode == FOREST_SUM) {
+                size += 4;
+            } else {
+                size += compressed_int_size(node->v.i);
+            }
+            continue;
+        }
+        size += compressed_uint_size(node->feature);
+        if(node->kind == FOREST_LTE) {
+            size += 4;
+        } else {
+            size += constset_size(f->sets[node->v.set], flags);
+        }
+        size += compressed_uint_size(node->right - t);
+    }
+    return size;
+}
+
+static size_t kernel_size(kernel_t*k)
+{
+    return compressed_uint_size(k->size) + 4*(size_t)k->size + 1 + (k->has_offset ? 4 : 0);
+}
+
+static size_t knn_size(knn_t*knn, unsigned flags)
+{
+    size_t size = compressed_uint_size(knn->k);
+    size += compressed_uint_size(knn->dim);
+    size += array_size(knn->classes, flags);
+    int c;
+    for(c=0;c<knn->classes->size;c++) {
+        size += compressed_uint_size(knn->class_start[c+1] - knn->class_start[c]);
+    }
+    return size + 4*(size_t)knn->num_rows*knn->dim;
+}
+
+static size_t node_internal_data_size(node_t*node, unsigned flags)
+{
+    if(node->type==&node_int_array ||
+       node->type==&node_float_array ||
+       node->type==&node_category_array ||
+       node->type==&node_mixed_array ||
+       node->type==&node_string_array) {
+        return array_size(node->value.a, flags);
+    } else if(node->type==&node_category) {
+        return compressed_uint_size(AS_CATEGORY(node->value));
+    } else if(node->type==&node_float) {
+        return 4;
+    } else if(node->type==&node_int || node->type==&node_param) {
+        return compressed_uint_size(AS_INT(node->value));
+    } else if(node->type==&node_string) {
+        return string_size(AS_STRING(node->value), flags);
+    } else if(node->type==&node_zero_int_array ||
+              node->type==&node_zero_float_array) {
+        return compressed_uint_size(node->value.a->size);
+    } else if(node->type==&node_forest) {
+        return forest_size((forest_t*)node->data, flags);
+    } else if(node->type==&node_dot_product || node->type==&node_squared_distance) {
+        return kernel_size((kernel_t*)node->data);
+    } else if(node->type==&node_in_set) {
+        return constset_size((constset_t*)node->data, flags);
+    } else if(node->type==&node_knearest) {
+        return knn_size((knn_t*)node->data, flags);
+    } else if(node->type->flags&NODE_FLAG_HAS_VALUE) {
+        return constant_size(&node->value, flags);
+    }
+    return 0;
+}
+
+size_t node_serialized_size(node_t*node, unsigned flags)
+{
+    if(!node)
+        return 1;
+    size_t size = 1 + node_internal_data_size(node, flags);
+    if(node->type->flags & NODE_FLAG_HAS_CHILDREN) {
+        if(node->type->min_args != node->type->max_args) {
+            size += compressed_uint_size(node->num_children);
+        }
+        int t;
+        for(t=0;t<node->num_children;t++) {
+            size += node_serialized_size(node->child[t], flags);
+        }
+    }
+    return size;
+}
+
 signature_t* signature_read(reader_t*r)
 {
     signature_t*sig = malloc(sizeof(signature_t));
@@ -347,7 +993,7 @@ signature_t* signature_read(reader_t*r)
     return sig;
 }
 
-model_t* model_read(reader_t*r)
+static model_t* model_read_with_blobs(reader_t*r, blobs_t*blobs)
 {
     model_t*m = (model_t*)calloc(1, sizeof(model_t));
     char*name = read_string(r);
@@ -356,13 +1002,19 @@ model_t* model_read(reader_t*r)
     m->name = register_and_free_string(name);
 
     m->sig = signature_read(r);
-    m->code = (void*)node_read(r);
+    m->code = (void*)node_read_with_blobs(r, blobs);
     if(!m->code) {
         free(m);
         return NULL;
     }
+    /* models written before in_set nodes existed */
+    m->code = node_compile_sets((node_t*)m->code);
     return m;
 }
+model_t* model_read(reader_t*r)
+{
+    return model_read_with_blobs(r, NULL);
+}
 model_t* model_load(const char*filename)
 {
     reader_t *r = filereader_new2(filename);
@@ -417,6 +1069,223 @@ void model_save(model_t*m, const char*filename)
     w->finish(w);
 }
 
+/* Flat model files:
+       header   magic, version, a byte order marker, sizeof(forest_node_t),
+                offset and size of the node stream and the blob section
+       stream   name, signature and nodes, like model_write()
+       blobs    arrays referenced from the stream (see blobs_t)
+   The blob section is aligned, so that its arrays can be used straight
+   from a read-only mapping of the file. */
+
+#define FLAT_MAGIC "MRSCAKEM"
+/* bump this whenever the layout of forest_node_t (or of anything else
+   that's stored as a blob) changes */
+#define FLAT_VERSION 2
+#define FLAT_BYTE_ORDER 0x01020304
+#define FLAT_HEADER_SIZE 64
+#define FLAT_ALIGN 64
+
+typedef struct _mapping {
+    void*data;
+    size_t size;
+} mapping_t;
+
+static void write_padding(writer_t*w, int align)
+{
+    static const uint8_t zeroes[FLAT_ALIGN] = {0};
+    if(w->pos % align) {
+        w->write(w, (void*)zeroes, align - w->pos % align);
+    }
+}
+
+bool model_save_flat(model_t*m, const char*filename)
+{
+    if(!m || !m->name || !m->name[0]) {
+        fprintf(stderr, "Can't save empty model\n");
+        return false;
+    }
+    writer_t*stream = growingmemwriter_new();
+    blobs_t blobs;
+    memset(&blobs, 0, sizeof(blobs));
+    blobs.writer = growingmemwriter_new();
+
+    write_string(stream, m->name);
+    signature_write(m->sig, stream);
+    node_write_tree((node_t*)m->code, stream, 0, &blobs);
+
+    int stream_size = 0, blobs_size = 0;
+    void*stream_data = writer_growmemwrite_memptr(stream, &stream_size);
+    void*blobs_data = writer_growmemwrite_memptr(blobs.writer, &blobs_size);
+    uint32_t stream_offset = FLAT_HEADER_SIZE;
+    uint32_t blobs_offset = (stream_offset + stream_size + FLAT_ALIGN-1) & ~(FLAT_ALIGN-1);
+
+    writer_t*w = filewriter_new2(filename);
+    bool ok = w != NULL;
+    if(w) {
+        w->write(w, FLAT_MAGIC, 8);
+        write_uint32(w, FLAT_VERSION);
+        /* written as is, so loading on a machine with a different byte
+           order fails */
+        uint32_t byte_order = FLAT_BYTE_ORDER;
+        w->write(w, &byte_order, sizeof(byte_order));
+        write_uint32(w, sizeof(forest_node_t));
+        write_uint32(w, stream_offset);
+        write_uint32(w, stream_size);
+        write_uint32(w, blobs_offset);
+        write_uint32(w, blobs_size);
+        write_padding(w, FLAT_HEADER_SIZE);
+        w->write(w, stream_data, stream_size);
+        write_padding(w, FLAT_ALIGN);
+        w->write(w, blobs_data, blobs_size);
+        ok = !w->error;
+        w->finish(w);
+    }
+    stream->finish(stream);
+    blobs.writer->finish(blobs.writer);
+    if(!ok && w) {
+        fprintf(stderr, "Couldn't write %s\n", filename);
+    }
+    return ok;
+}
+
+static bool flat_header_read(const uint8_t*data, size_t size, reader_t*r,
+                             uint32_t*stream_offset, uint32_t*stream_size,
+                             uint32_t*blobs_offset, uint32_t*blobs_size)
+{
+    uint32_t byte_order = FLAT_BYTE_ORDER;
+    if(size < FLAT_HEADER_SIZE || memcmp(data, FLAT_MAGIC, 8) ||
+       memcmp(data+12, &byte_order, sizeof(byte_order))) {
+        return false;
+    }
+    r->seek(r, 8);
+    uint32_t version = read_uint32(r);
+    read_uint32(r);
+    uint32_t node_size = read_uint32(r);
+    *stream_offset = read_uint32(r);
+    *stream_size = read_uint32(r);
+    *blobs_offset = read_uint32(r);
+    *blobs_size = read_uint32(r);
+    return !r->error && version == FLAT_VERSION && node_size == sizeof(forest_node_t) &&
+           *stream_offset <= size && *stream_size <= size - *stream_offset &&
+           *blobs_offset % FLAT_ALIGN == 0 &&
+           *blobs_offset <= size && *blobs_size <= size - *blobs_offset;
+}
+
+model_t* model_load_flat(const char*filename)
+{
+    int fi = open(filename, O_RDONLY);
+    if(fi < 0) {
+        perror(filename);
+        return NULL;
+    }
+    struct stat st;
+    if(fstat(fi, &st) < 0 || st.st_size < FLAT_HEADER_SIZE) {
+        fprintf(stderr, "%s: not a flat model file\n", filename);
+        close(fi);
+        return NULL;
+    }
+    size_t size = st.st_size;
+    /* shared, so that processes loading the same model share its pages */
+    void*data = mmap(NULL, size, PROT_READ, MAP_SHARED, fi, 0);
+    close(fi);
+    if(data == MAP_FAILED) {
+        perror(filename);
+        return NULL;
+    }
+
+    uint32_t stream_offset, stream_size, blobs_offset, blobs_size;
+    reader_t*r = memreader_new(data, FLAT_HEADER_SIZE);
+    bool ok = flat_header_read(data, size, r, &stream_offset, &stream_size, &blobs_offset, &blobs_size);
+    r->dealloc(r);
+    if(!ok) {
+        fprintf(stderr, "%s: not a flat model file\n", filename);
+        munmap(data, size);
+        return NULL;
+    }
+
+    blobs_t blobs;
+    memset(&blobs, 0, sizeof(blobs));
+    blobs.data = (const uint8_t*)data + blobs_offset;
+    blobs.size = blobs_size;
+    r = memreader_new((uint8_t*)data + stream_offset, stream_size);
+    model_t*m = model_read_with_blobs(r, &blobs);
+    r->dealloc(r);
+    if(!m) {
+        fprintf(stderr, "%s: invalid model\n", filename);
+        munmap(data, size);
+        return NULL;
+    }
+    mapping_t*mapping = (mapping_t*)malloc(sizeof(mapping_t));
+    mapping->data = data;
+    mapping->size = size;
+    m->mapping = mapping;
+    return m;
+}
+
+void model_mapping_destroy(void*_mapping)
+{
+    mapping_t*mapping = (mapping_t*)_mapping;
+    munmap(mapping->data, mapping->size);
+    free(mapping);
+}
+
+static void write_uint64(writer_t*w, uint64_t v)
+{
+    write_uint32(w, (uint32_t)v);
+    write_uint32(w, (uint32_t)(v>>32));
+}
+static uint64_t read_uint64(reader_t*r)
+{
+    uint64_t lo = read_uint32(r);
+    uint64_t hi = read_uint32(r);
+    return lo | hi<<32;
+}
+
+/* Profiles are stored in preorder, with the opcode of every node, so that
+   reading them back checks they belong to the given program. */
+void profile_write(profile_t*p, writer_t*w)
+{
+    write_compressed_uint(w, p->num_nodes);
+    int t, i;
+    for(t=0;t<p->num_nodes;t++) {
+        node_profile_t*e = &p->nodes[t];
+        write_uint8(w, node_get_opcode(e->node));
+        write_uint64(w, e->count);
+        write_uint64(w, e->cycles);
+        write_compressed_uint(w, e->num_visits);
+        for(i=0;i<e->num_visits;i++) {
+            write_uint64(w, e->visits[i]);
+        }
+    }
+}
+profile_t* profile_read(node_t*code, reader_t*r)
+{
+    profile_t*p = profile_new(code);
+    int num_nodes = read_compressed_uint(r);
+    if(num_nodes != p->num_nodes) {
+        profile_destroy(p);
+        return NULL;
+    }
+    int t, i;
+    for(t=0;t<p->num_nodes && !r->error;t++) {
+        node_profile_t*e = &p->nodes[t];
+        uint8_t opcode = read_uint8(r);
+        e->count = read_uint64(r);
+        e->cycles = read_uint64(r);
+        int num_visits = read_compressed_uint(r);
+        if(opcode != node_get_opcode(e->node) || num_visits != e->num_visits)
+            break;
+        for(i=0;i<num_visits;i++) {
+            e->visits[i] = read_uint64(r);
+        }
+    }
+    if(r->error || t < p->num_nodes) {
+        profile_destroy(p);
+        return NULL;
+    }
+    return p;
+}
+
 variable_t variable_read(reader_t*r)
 {
     char*s;
@@ -588,6 +1457,8 @@ column_t* column_read(int num_rows, reader_t*r)
 }
 void dataset_write(dataset_t*d, writer_t*w)
 {
+    /* row views share the columns (and class counts) of their parent */
+    assert(!d->rows);
     write_compressed_uint(w, d->num_columns);
     write_compressed_uint(w, d->num_rows);
     int t;
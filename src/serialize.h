@@ -24,6 +24,7 @@
 
 #include "io.h"
 #include "ast.h"
+#include "profile.h"
 #include "dataset.h"
 
 #ifdef __cplusplus
@@ -35,12 +36,27 @@ extern "C" {
 
 node_t* node_read(reader_t*read);
 void node_write(node_t*node, writer_t*writer, unsigned flags);
+/* the number of bytes node_write() would write, without writing them */
+size_t node_serialized_size(node_t*node, unsigned flags);
 
 model_t* model_read(reader_t*r);
 model_t* model_load(const char*filename);
 void model_save(model_t*m, const char*filename);
 void model_write(model_t*m, writer_t*w);
 
+/* flat model files are mapped into memory when loading, and the big arrays
+   of forests, kernels and knearest nodes are used directly from the
+   mapping. They're only portable between machines with the same byte
+   order and struct layout. */
+bool model_save_flat(model_t*m, const char*filename);
+model_t* model_load_flat(const char*filename);
+/* called by model_destroy(), after the model code is gone */
+void model_mapping_destroy(void*mapping);
+
+/* profiles can only be read back for the program they were created for */
+void profile_write(profile_t*p, writer_t*w);
+profile_t* profile_read(node_t*code, reader_t*r);
+
 trainingdata_t* trainingdata_read(reader_t*r);
 void trainingdata_write(trainingdata_t*d, writer_t*w);
 void trainingdata_save(trainingdata_t*d, const char*filename);
@@ -34,10 +34,24 @@ int config_num_remote_servers = 0;
 int config_remote_read_timeout = 5;
 bool config_do_remote_processing = false;
 int config_number_of_remote_workers = 2;
+int config_number_of_local_workers = 1;
 int config_num_seeded_hosts = 1;
 int config_remote_worker_timeout = 60;
 char*config_dataset_cache_directory = "/tmp/mrscake";
+bool config_cache_job_results = false;
 bool config_limit_network_io = true;
+bool config_native_compilation = false;
+char*config_native_cache_directory = NULL;
+char*config_native_compiler = "cc";
+char*config_cost_model_file = NULL;
+bool config_early_exit_votes = false;
+bool config_successive_halving = false;
+int config_halving_factor = 3;
+int config_halving_min_rows = 500;
+int config_cross_validation_folds = 0;
+bool config_forward_selection = false;
+int config_forward_selection_beam = 0;
+int config_forward_selection_patience = 1;
 
 remote_server_t*config_remote_servers = 0;
 static int remote_server_size = 0;
@@ -148,8 +162,36 @@ bool config_setparameter(const char*key, const char*value)
         config_fork_for_training = atoi(value);
     } else if(!strcmp(key, "job_wait_timeout")) {
         config_job_wait_timeout = atoi(value);
+    } else if(!strcmp(key, "number_of_local_workers")) {
+        config_number_of_local_workers = atoi(value);
     } else if(!strcmp(key, "verbosity")) {
         config_verbosity = atoi(value);
+    } else if(!strcmp(key, "native_compilation")) {
+        config_native_compilation = atoi(value);
+    } else if(!strcmp(key, "native_cache_directory")) {
+        config_native_cache_directory = strdup(value);
+    } else if(!strcmp(key, "native_compiler")) {
+        config_native_compiler = strdup(value);
+    } else if(!strcmp(key, "cost_model_file")) {
+        config_cost_model_file = *value ? strdup(value) : NULL;
+    } else if(!strcmp(key, "cache_job_results")) {
+        config_cache_job_results = atoi(value);
+    } else if(!strcmp(key, "early_exit_votes")) {
+        config_early_exit_votes = atoi(value);
+    } else if(!strcmp(key, "successive_halving")) {
+        config_successive_halving = atoi(value);
+    } else if(!strcmp(key, "halving_factor")) {
+        config_halving_factor = atoi(value);
+    } else if(!strcmp(key, "halving_min_rows")) {
+        config_halving_min_rows = atoi(value);
+    } else if(!strcmp(key, "cross_validation_folds")) {
+        config_cross_validation_folds = atoi(value);
+    } else if(!strcmp(key, "forward_selection")) {
+        config_forward_selection = atoi(value);
+    } else if(!strcmp(key, "forward_selection_beam")) {
+        config_forward_selection_beam = atoi(value);
+    } else if(!strcmp(key, "forward_selection_patience")) {
+        config_forward_selection_patience = atoi(value);
     } else {
         return false;
     }
@@ -46,13 +46,48 @@ extern int config_remote_read_timeout;
 extern int config_job_wait_timeout;
 extern bool config_do_remote_processing;
 extern int config_number_of_remote_workers;
+/* how many jobs to train at once without remote servers. Defaults to 1,
+   i.e. jobs run one after the other. Set to 0 for one worker per
+   processor. Only used if config_fork_for_training is set. */
+extern int config_number_of_local_workers;
 extern int config_verbosity;
 extern char*config_dataset_cache_directory;
+/* keep the results of training jobs in config_dataset_cache_directory,
+   and reuse them when the same model is trained on the same data */
+extern bool config_cache_job_results;
 extern int config_num_seeded_hosts;
 extern bool config_subset_variables;
 extern bool config_even_out_class_count;
 extern bool config_fork_for_training;
 extern bool config_limit_network_io;
+extern bool config_native_compilation;
+/* NULL: a directory in $XDG_CACHE_HOME or ~/.cache */
+extern char*config_native_cache_directory;
+extern char*config_native_compiler;
+/* where to keep the training times used for scheduling jobs. NULL (the
+   default) keeps them only for the lifetime of the process. */
+extern char*config_cost_model_file;
+/* generated code for random forests returns as soon as a class has the
+   majority of the votes */
+extern bool config_early_exit_votes;
+/* model selection first trains all models on a small sample of the data,
+   and only keeps training the best 1/config_halving_factor of them on
+   larger samples. The smallest sample has at least
+   config_halving_min_rows rows. Not used together with
+   config_cross_validation_folds, which takes precedence. */
+extern bool config_successive_halving;
+extern int config_halving_factor;
+extern int config_halving_min_rows;
+/* if > 1, model selection scores models by k-fold cross validation
+   instead of on the data they were trained on */
+extern int config_cross_validation_folds;
+/* with config_subset_variables, widen the set of columns only while
+   that improves the score (see jobqueue_forward_selection()), instead of
+   trying all of them. config_forward_selection_patience is how many
+   widenings in a row may fail to improve it (values below 1 count as 1). */
+extern bool config_forward_selection;
+extern int config_forward_selection_beam;
+extern int config_forward_selection_patience;
 
 bool config_setparameter(const char*key, const char*value);
 
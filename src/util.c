@@ -4,6 +4,7 @@
 #include <stdarg.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <time.h>
 #include "util.h"
 
 void*memdup(const void*ptr, size_t size)
@@ -111,3 +112,10 @@ bool str_starts_with(const char*str, const char*start)
     int l = strlen(start);
     return strncmp(str, start, l) == 0;
 }
+
+double seconds_now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
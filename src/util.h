@@ -38,6 +38,9 @@ bool str_starts_with(const char*str, const char*start);
 
 int imin(int x, int y);
 
+/* monotonic wall clock time, for measuring durations */
+double seconds_now();
+
 #ifdef __cplusplus
 }
 #endif
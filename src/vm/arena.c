@@ -0,0 +1,91 @@
+/* arena.c
+   Block allocator for ast nodes.
+
+   Part of the data prediction package.
+
+   Copyright (c) 2011 Matthias Kramm <kramm@quiss.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include "arena.h"
+
+#define ARENA_MIN_BLOCK_SIZE 4096
+#define ARENA_MAX_BLOCK_SIZE (1024*1024)
+#define ARENA_ALIGN 16
+
+typedef struct _arena_block {
+    struct _arena_block*next;
+    size_t size;
+    size_t pos;
+    /* keep the data aligned */
+    size_t pad;
+    char data[0];
+} arena_block_t;
+
+struct _arena {
+    arena_block_t*blocks;
+    size_t next_size;
+    int refs;
+};
+
+arena_t* arena_new()
+{
+    arena_t*a = (arena_t*)calloc(1, sizeof(arena_t));
+    a->next_size = ARENA_MIN_BLOCK_SIZE;
+    a->refs = 1;
+    return a;
+}
+
+void* arena_alloc(arena_t*a, size_t size)
+{
+    size = (size + ARENA_ALIGN-1) & ~(size_t)(ARENA_ALIGN-1);
+    arena_block_t*b = a->blocks;
+    if(!b || b->pos + size > b->size) {
+        /* blocks double in size, so that big trees only need a few */
+        size_t block_size = a->next_size;
+        while(block_size < size)
+            block_size *= 2;
+        if(a->next_size < ARENA_MAX_BLOCK_SIZE)
+            a->next_size *= 2;
+        b = (arena_block_t*)malloc(sizeof(arena_block_t) + block_size);
+        b->size = block_size;
+        b->pos = 0;
+        b->next = a->blocks;
+        a->blocks = b;
+    }
+    void*mem = &b->data[b->pos];
+    b->pos += size;
+    return mem;
+}
+
+void arena_retain(arena_t*a)
+{
+    __sync_add_and_fetch(&a->refs, 1);
+}
+
+void arena_release(arena_t*a)
+{
+    if(__sync_sub_and_fetch(&a->refs, 1))
+        return;
+    arena_block_t*b = a->blocks;
+    while(b) {
+        arena_block_t*next = b->next;
+        free(b);
+        b = next;
+    }
+    free(a);
+}
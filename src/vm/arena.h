@@ -0,0 +1,49 @@
+/* arena.h
+   Block allocator for ast nodes.
+
+   Part of the data prediction package.
+
+   Copyright (c) 2011 Matthias Kramm <kramm@quiss.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+
+#ifndef __arena_h__
+#define __arena_h__
+
+#include <stdlib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* An arena hands out memory from a few big blocks, and only frees it all
+   at once. Arenas are reference counted: the creator holds one reference,
+   and everything allocated from the arena should hold another one. Once
+   the last reference is dropped, all blocks are freed.
+
+   Allocating is not thread safe. Releasing references is. */
+
+typedef struct _arena arena_t;
+
+arena_t* arena_new();
+void* arena_alloc(arena_t*a, size_t size);
+void arena_retain(arena_t*a);
+void arena_release(arena_t*a);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -26,8 +26,12 @@
 #include <assert.h>
 #include <math.h>
 #include "ast.h"
+#include "forest.h"
+#include "kernels.h"
+#include "constset.h"
+#include "neighbors.h"
 
-#define EVAL_CHILD(i) ((n)->child[(i)]->type->eval((n)->child[(i)],env))
+#define EVAL_CHILD(i) (node_eval_child((n)->child[(i)],env))
 
 // -------------------------- empty node -------------------------------
 
@@ -50,7 +54,9 @@ constant_t node_block_eval(node_t*n, environment_t* env)
 {
     int t;
     for(t=0;t<n->num_children-1;t++) {
-        EVAL_CHILD(t);
+        constant_t c = EVAL_CHILD(t);
+        if(env->returned)
+            return c;
     }
     return EVAL_CHILD(n->num_children-1);
 }
@@ -244,12 +250,31 @@ min_args:1,
 max_args:1,
 };
 
+// -------------------------- likely(x) ----------------------------------
+
+/* a condition which is usually true. Only a hint for code generation. */
+constant_t node_likely_eval(node_t*n, environment_t* env)
+{
+    return EVAL_CHILD(0);
+}
+nodetype_t node_likely =
+{
+name:"likely",
+flags:NODE_FLAG_HAS_CHILDREN,
+eval: node_likely_eval,
+min_args:1,
+max_args:1,
+};
+
 // -------------------------- return ----------------------------------
 
+/* ends evaluation of the program. Blocks and loops check env->returned
+   and pass the value up. */
 constant_t node_return_eval(node_t*n, environment_t* env)
 {
-    /* FIXME: this should abort evaluation */
-    return EVAL_CHILD(0);
+    constant_t c = EVAL_CHILD(0);
+    env->returned = true;
+    return c;
 }
 nodetype_t node_return =
 {
@@ -745,11 +770,16 @@ constant_t node_float_eval(node_t*n, environment_t* env)
 {
     return n->value;
 }
+float node_float_eval_float(node_t*n, environment_t* env)
+{
+    return n->value.f;
+}
 nodetype_t node_float =
 {
 name:"float",
 flags:NODE_FLAG_HAS_VALUE,
 eval: node_float_eval,
+eval_float: node_float_eval_float,
 min_args:0,
 max_args:0,
 };
@@ -825,6 +855,8 @@ constant_t node_for_local_from_n_to_m_eval(node_t*n, environment_t* env)
     for(i=start;i<end;i++) {
         env->locals[loop_counter] = int_constant(i);
         ret = EVAL_CHILD(2);
+        if(env->returned)
+            return ret;
     }
     return missing_constant();
 }
@@ -943,10 +975,8 @@ max_args:1,
 
 // ---------------------- word_frequency ----------------------------------
 
-constant_t node_term_frequency_eval(node_t*n, environment_t* env)
+float term_frequency(const char*s1, const char*s2)
 {
-    const char*s1 = AS_STRING(EVAL_CHILD(0));
-    const char*s2 = AS_STRING(EVAL_CHILD(1));
     const char*p = s1;
     int frequency = 0;
     while(*p) {
@@ -963,7 +993,13 @@ constant_t node_term_frequency_eval(node_t*n, environment_t* env)
         if(!strncmp(s2, word_start, word_end-word_start))
             frequency++;
     }
-    return float_constant(frequency / (float)strlen(s1));
+    return frequency / (float)strlen(s1);
+}
+constant_t node_term_frequency_eval(node_t*n, environment_t* env)
+{
+    const char*s1 = AS_STRING(EVAL_CHILD(0));
+    const char*s2 = AS_STRING(EVAL_CHILD(1));
+    return float_constant(term_frequency(s1, s2));
 }
 nodetype_t node_term_frequency =
 {
@@ -1054,6 +1090,7 @@ max_args:0,
 nodetype_t* nodes[] = {
 #define NODE(opcode, name) &name,
 LIST_NODES
+LIST_DATA_NODES
 #undef NODE
 };
 
@@ -1064,6 +1101,7 @@ void nodelist_init()
         return;
 #   define NODE(op, name) name._opcode = op;
     LIST_NODES
+    LIST_DATA_NODES
 #   undef NODE
     is_initialized = true;
 }
@@ -1076,14 +1114,31 @@ uint8_t node_get_opcode(node_t*n)
 
 // ======================== node handling ==============================
 
+static __thread arena_t*current_arena = 0;
+
+arena_t* node_select_arena(arena_t*arena)
+{
+    arena_t*old = current_arena;
+    current_arena = arena;
+    return old;
+}
+
 node_t* node_new(nodetype_t*t, node_t*parent)
 {
-    node_t*n = (node_t*)malloc(sizeof(node_t));
+    node_t*n;
+    if(current_arena) {
+        n = (node_t*)arena_alloc(current_arena, sizeof(node_t));
+        arena_retain(current_arena);
+    } else {
+        n = (node_t*)malloc(sizeof(node_t));
+    }
+    n->arena = current_arena;
     n->type = t;
     n->parent = parent;
     n->child = 0;
     n->num_children = 0;
     n->value = missing_constant();
+    n->data = 0;
     return n;
 }
 
@@ -1201,23 +1256,17 @@ void node_append_child(node_t*n, node_t*child)
 
     child->parent = n;
 
-    if(!n->num_children) {
-        // first child
-        n->child = malloc(1*sizeof(node_t*));
-        ((node_t**)n->child)[0] = child;
-        n->num_children++;
-        return;
-    }
-
     int size = n->num_children;
-    int highest_bit;
-    do {
+    int highest_bit = 0;
+    while(size) {
         highest_bit = size;
         size = size&(size-1);
-    } while(size);
-
+    }
     if(n->num_children == highest_bit) {
-        n->child = realloc((void*)n->child, (highest_bit<<1)*sizeof(node_t*));
+        /* grow to the next power of two. Child arrays always live on the
+           heap, as the arena couldn't reuse the ones we outgrow. */
+        int new_size = highest_bit ? highest_bit<<1 : 1;
+        n->child = realloc((void*)n->child, new_size*sizeof(node_t*));
     }
     ((node_t**)n->child)[n->num_children++] = child;
 }
@@ -1229,19 +1278,47 @@ void node_set_child(node_t*n, int num, node_t*child)
     child->parent = n;
 }
 
+static void node_free(node_t*n)
+{
+    if(n->arena) {
+        /* the node's memory goes away together with the arena */
+        arena_release(n->arena);
+    } else {
+        free(n);
+    }
+}
+
+static void node_destroy_data(node_t*n)
+{
+    if(n->type == &node_forest) {
+        forest_destroy((forest_t*)n->data);
+    } else if(n->type == &node_dot_product ||
+              n->type == &node_squared_distance) {
+        kernel_destroy((kernel_t*)n->data);
+    } else if(n->type == &node_in_set) {
+        constset_destroy((constset_t*)n->data);
+    } else if(n->type == &node_knearest) {
+        knn_destroy((knn_t*)n->data);
+    }
+    n->data = 0;
+}
+
 void node_destroy(node_t*n)
 {
     int t;
     if(n->type->flags&NODE_FLAG_HAS_VALUE) {
         constant_clear(&n->value);
     }
+    if((n->type->flags&NODE_FLAG_HAS_DATA) && n->data) {
+        node_destroy_data(n);
+    }
     if((n->type->flags&NODE_FLAG_HAS_CHILDREN) && n->child) {
         for(t=0;t<n->num_children;t++) {
             node_destroy(n->child[t]);((node_t**)n->child)[t] = 0;
         }
         free((void*)n->child);
     }
-    free(n);
+    node_free(n);
 }
 
 void node_destroy_self(node_t*n)
@@ -1250,12 +1327,52 @@ void node_destroy_self(node_t*n)
     if(n->type->flags&NODE_FLAG_HAS_VALUE) {
         constant_clear(&n->value);
     }
-    free(n);
+    if((n->type->flags&NODE_FLAG_HAS_DATA) && n->data) {
+        node_destroy_data(n);
+    }
+    node_free(n);
+}
+
+node_t* node_duplicate(node_t*n)
+{
+    node_t*d = node_new(n->type, 0);
+    d->value = n->value;
+    switch(n->value.type) {
+        case CONSTANT_INT_ARRAY:
+        case CONSTANT_FLOAT_ARRAY:
+        case CONSTANT_CATEGORY_ARRAY:
+        case CONSTANT_MIXED_ARRAY:
+        case CONSTANT_STRING_ARRAY: {
+            /* arrays are owned by their node (see constant_clear()) */
+            array_t*a = n->value.a;
+            d->value.a = array_new(a->size);
+            memcpy(d->value.a->entries, a->entries, sizeof(constant_t)*a->size);
+            break;
+        }
+    }
+    if(n->type == &node_forest) {
+        d->data = forest_duplicate((forest_t*)n->data);
+    } else if(n->type == &node_dot_product ||
+              n->type == &node_squared_distance) {
+        d->data = kernel_duplicate((kernel_t*)n->data);
+    } else if(n->type == &node_in_set) {
+        d->data = constset_duplicate((constset_t*)n->data);
+    } else if(n->type == &node_knearest) {
+        d->data = knn_duplicate((knn_t*)n->data);
+    }
+    int t;
+    for(t=0;t<n->num_children;t++) {
+        node_append_child(d, node_duplicate(n->child[t]));
+    }
+    return d;
 }
 
 constant_t node_eval(node_t*n,environment_t* e)
 {
-    return n->type->eval(n, e);
+    /* some nodes (array initializers) are evaluated without an environment */
+    if(e)
+        e->returned = false;
+    return node_eval_child(n, e);
 }
 
 /*
@@ -1271,15 +1388,31 @@ constant_t node_eval(node_t*n,environment_t* e)
  +-div
 
 */
-void node_print2(node_t*n, const char*p1, const char*p2, FILE*fi)
+static void node_print3(node_t*n, const char*p1, const char*p2, FILE*fi, node_annotate_t annotate, void*data)
 {
     if(n->type->flags & NODE_FLAG_HAS_VALUE) {
         fprintf(fi, "%s%s (", p1, n->type->name);
         constant_print(&n->value);
-        fprintf(fi, ")\n");
+        fprintf(fi, ")");
+    } else if(n->type == &node_forest) {
+        forest_t*f = (forest_t*)n->data;
+        fprintf(fi, "%s%s (%d trees, %d nodes)", p1, n->type->name, f->num_trees, f->num_nodes);
+    } else if(n->type == &node_dot_product ||
+              n->type == &node_squared_distance) {
+        kernel_t*k = (kernel_t*)n->data;
+        fprintf(fi, "%s%s (%d entries)", p1, n->type->name, k->size);
+    } else if(n->type == &node_in_set) {
+        constset_t*s = (constset_t*)n->data;
+        fprintf(fi, "%s%s (%d entries)", p1, n->type->name, s->array->size);
+    } else if(n->type == &node_knearest) {
+        knn_t*knn = (knn_t*)n->data;
+        fprintf(fi, "%s%s (k=%d, %d rows)", p1, n->type->name, knn->k, knn->num_rows);
     } else {
-        fprintf(fi, "%s%s\n", p1, n->type->name);
+        fprintf(fi, "%s%s", p1, n->type->name);
     }
+    if(annotate)
+        annotate(n, fi, data);
+    fprintf(fi, "\n");
     if(n->type->flags&NODE_FLAG_HAS_CHILDREN) {
         int t;
         char*o2 = malloc(strlen(p2)+3);
@@ -1291,7 +1424,7 @@ void node_print2(node_t*n, const char*p1, const char*p2, FILE*fi)
 
         for(t=0;t<n->num_children;t++) {
             fprintf(fi, "%s\n", o2);
-            node_print2(n->child[t], o3, t<n->num_children-1?o2:o4, fi);
+            node_print3(n->child[t], o3, t<n->num_children-1?o2:o4, fi, annotate, data);
         }
         free(o2);
         free(o3);
@@ -1299,6 +1432,16 @@ void node_print2(node_t*n, const char*p1, const char*p2, FILE*fi)
     }
 }
 
+void node_print2(node_t*n, const char*p1, const char*p2, FILE*fi)
+{
+    node_print3(n, p1, p2, fi, NULL, NULL);
+}
+
+void node_print_annotated(node_t*n, FILE*fi, node_annotate_t annotate, void*data)
+{
+    node_print3(n, "", "", fi, annotate, data);
+}
+
 bool node_sanitycheck(node_t*n)
 {
     int t;
@@ -1317,6 +1460,18 @@ bool node_sanitycheck(node_t*n)
             return false;
         node_sanitycheck(n->child[t]);
     }
+    if(n->type == &node_forest) {
+        /* every feature the trees test needs a child */
+        if(((forest_t*)n->data)->num_features != n->num_children)
+            return false;
+    } else if(n->type == &node_dot_product ||
+              n->type == &node_squared_distance) {
+        if(((kernel_t*)n->data)->size != n->num_children)
+            return false;
+    } else if(n->type == &node_knearest) {
+        if(((knn_t*)n->data)->dim != n->num_children)
+            return false;
+    }
     return true;
 }
 
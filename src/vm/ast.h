@@ -25,6 +25,7 @@
 #include <stdbool.h>
 #include "constant.h"
 #include "environment.h"
+#include "arena.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -37,6 +38,7 @@ typedef struct _nodetype nodetype_t;
 #define NODE_FLAG_HAS_VALUE 2
 #define NODE_FLAG_INFIX 4
 #define NODE_FLAG_ARRAY 8
+#define NODE_FLAG_HAS_DATA 16
 
 struct _nodetype {
     char*name;
@@ -45,6 +47,11 @@ struct _nodetype {
     uint8_t _opcode;
     uint8_t flags;
     constant_t (*eval)(node_t*n, environment_t* params);
+
+    /* optional: unboxed evaluation, for node types that always return a
+       float resp. a bool (see specialize.h) */
+    float (*eval_float)(node_t*n, environment_t* params);
+    bool (*eval_bool)(node_t*n, environment_t* params);
 };
 
 struct _node {
@@ -55,6 +62,12 @@ struct _node {
     int num_children;
 
     constant_t value;
+
+    /* private data of NODE_FLAG_HAS_DATA nodes */
+    void*data;
+
+    /* if set, the node lives in this arena (its child array doesn't) */
+    arena_t*arena;
 };
 
 /* all known node types & opcodes */
@@ -114,15 +127,28 @@ struct _node {
     NODE(0x34, node_gt_i) \
     NODE(0x35, node_gte_i) \
     NODE(0x36, node_debug_print) \
-    NODE(0x37, node_term_frequency)
+    NODE(0x37, node_term_frequency) \
+    NODE(0x3d, node_likely)
+
+/* node types which keep their data in a packed, type specific format.
+   These are expanded into generic nodes before code generation, so
+   code generators don't need to know about them. */
+#define LIST_DATA_NODES \
+    NODE(0x38, node_forest) \
+    NODE(0x39, node_dot_product) \
+    NODE(0x3a, node_squared_distance) \
+    NODE(0x3b, node_in_set) \
+    NODE(0x3c, node_knearest)
 
 #define NODE(opcode, name) extern nodetype_t name;
 LIST_NODES
+LIST_DATA_NODES
 #undef NODE
 
 enum opcodes {
 #define NODE(opcode, name) opcode_##name = opcode,
 LIST_NODES
+LIST_DATA_NODES
 #undef NODE
 };
 
@@ -131,6 +157,10 @@ void nodelist_init();
 uint8_t node_get_opcode(node_t*n);
 char*node_name(node_t*n);
 
+/* While an arena is selected (in the current thread), new nodes are
+   allocated from it. Returns the previously selected arena. */
+arena_t* node_select_arena(arena_t*arena);
+
 node_t* node_new(nodetype_t*t, node_t*parent);
 node_t* node_new_with_args(nodetype_t*t,...);
 node_t* node_new_array(array_t*a);
@@ -141,10 +171,34 @@ void node_set_child(node_t*n, int num, node_t*child);
 bool node_sanitycheck(node_t*n);
 void node_destroy(node_t*n);
 void node_destroy_self(node_t*n);
+node_t* node_duplicate(node_t*n);
 constant_t node_eval(node_t*n,environment_t* e);
 void node_remove_child(node_t*n, int num);
 void node_print(node_t*n);
 
+/* like node_print(), but calls annotate() at the end of every node's line */
+typedef void (*node_annotate_t)(node_t*n, FILE*fi, void*data);
+void node_print_annotated(node_t*n, FILE*fi, node_annotate_t annotate, void*data);
+
+/* evaluate a (child) node. Eval functions use this rather than calling
+   node_eval(), which is for the root of a program. */
+static inline constant_t node_eval_child(node_t*n, environment_t* e)
+{
+    return n->type->eval(n, e);
+}
+
+/* like node_eval_child(), for nodes with an eval_float resp. eval_bool */
+static inline float node_eval_float(node_t*n, environment_t* e)
+{
+    return n->type->eval_float(n, e);
+}
+static inline bool node_eval_bool(node_t*n, environment_t* e)
+{
+    return n->type->eval_bool(n, e);
+}
+
+float term_frequency(const char*text, const char*word);
+
 #ifdef __cplusplus
 }
 #endif
@@ -25,6 +25,13 @@
 #include <math.h>
 #include <memory.h>
 #include "ast_transforms.h"
+#include "forest.h"
+#include "kernels.h"
+#include "constset.h"
+#include "neighbors.h"
+#include "profile.h"
+#include "environment.h"
+#include "dataset.h"
 
 bool node_has_consumer_parent(node_t*n)
 {
@@ -56,8 +63,10 @@ node_t* node_find_root(node_t*n)
 int node_highest_local(node_t*node)
 {
     int max = 0;
-    if(node->type == &node_setlocal ||
-       node->type == &node_for_local_from_n_to_m) {
+    /* by opcode, so that this also works for specialized programs */
+    uint8_t opcode = node_get_opcode(node);
+    if(opcode == opcode_node_setlocal ||
+       opcode == opcode_node_for_local_from_n_to_m) {
         max = node->value.i+1;
     }
     int t;
@@ -98,6 +107,8 @@ static void fill_locals(node_t*node, model_t*m, constant_type_t*types)
 {
     if(node->type == &node_setlocal) {
         types[node->value.i] = node_type(node->child[0], m);
+    } else if(node->type == &node_for_local_from_n_to_m) {
+        types[node->value.i] = CONSTANT_INT;
     }
     int t;
     for(t=0;t<node->num_children;t++) {
@@ -113,6 +124,67 @@ constant_type_t*node_local_types(node_t*node, model_t*m, int* num_locals)
     fill_locals(node, m, types);
     return types;
 }
+static int count_setlocals(node_t*node)
+{
+    int count = node->type == &node_setlocal;
+    int t;
+    for(t=0;t<node->num_children;t++) {
+        count += count_setlocals(node->child[t]);
+    }
+    return count;
+}
+typedef struct _local_split {
+    int*map;
+    int*types;
+    int num_locals;
+} local_split_t;
+static void assign_local(node_t*node, int type, local_split_t*split)
+{
+    int l = split->map[node->value.i];
+    if(split->types[l] >= 0 && split->types[l] != type) {
+        l = split->map[node->value.i] = split->num_locals++;
+    }
+    split->types[l] = type;
+    node->value.i = l;
+}
+static void split_locals(node_t*node, model_t*m, local_split_t*split)
+{
+    int t;
+    if(node->type == &node_for_local_from_n_to_m) {
+        split_locals(node->child[0], m, split);
+        split_locals(node->child[1], m, split);
+        assign_local(node, CONSTANT_INT, split);
+        split_locals(node->child[2], m, split);
+        return;
+    }
+    for(t=0;t<node->num_children;t++) {
+        split_locals(node->child[t], m, split);
+    }
+    if(node->type == &node_setlocal) {
+        assign_local(node, node_type(node->child[0], m), split);
+    } else if(node->type == &node_getlocal ||
+              node->type == &node_inclocal) {
+        node->value.i = split->map[node->value.i];
+    }
+}
+/* Models may reuse a local variable for values of different types.
+   For typed languages, give every such use a variable of its own. */
+void node_split_locals_by_type(node_t*node, model_t*m)
+{
+    local_split_t split;
+    split.num_locals = node_highest_local(node);
+    int size = split.num_locals + count_setlocals(node);
+    split.map = (int*)malloc(sizeof(int)*size);
+    split.types = (int*)malloc(sizeof(int)*size);
+    int t;
+    for(t=0;t<size;t++) {
+        split.map[t] = t;
+        split.types[t] = -1;
+    }
+    split_locals(node, m, &split);
+    free(split.map);
+    free(split.types);
+}
 constant_type_t model_param_type(model_t*m, int var)
 {
     if(!m->sig->column_types) {
@@ -135,6 +207,8 @@ constant_type_t node_type(node_t*n, model_t*m)
     switch(node_get_opcode(n)) {
         case opcode_node_arg_max:
         case opcode_node_arg_max_i:
+        case opcode_node_arg_min:
+        case opcode_node_arg_min_i:
         case opcode_node_array_arg_max_i:
         case opcode_node_inc_array_at_pos:
         case opcode_node_int:
@@ -148,6 +222,7 @@ constant_type_t node_type(node_t*n, model_t*m)
             return CONSTANT_MISSING;
         case opcode_node_in:
         case opcode_node_not:
+        case opcode_node_likely:
         case opcode_node_lt:
         case opcode_node_lte:
         case opcode_node_gt:
@@ -208,6 +283,17 @@ constant_type_t node_type(node_t*n, model_t*m)
             return model_param_type(m, n->value.i);
         case opcode_node_getlocal:
             return local_type(node_find_root(n), n->value.i, m);
+        case opcode_node_forest:
+            return forest_type((forest_t*)n->data);
+        case opcode_node_dot_product:
+        case opcode_node_squared_distance:
+            return CONSTANT_FLOAT;
+        case opcode_node_in_set:
+            return CONSTANT_BOOL;
+        case opcode_node_knearest: {
+            array_t*classes = ((knn_t*)n->data)->classes;
+            return classes->size ? classes->entries[0].type : CONSTANT_MISSING;
+        }
         default:
             fprintf(stderr, "Couldn't do type deduction for ast node %s\n", n->type->name);
             return CONSTANT_MISSING;
@@ -419,8 +505,40 @@ node_t* node_clean_arrays(node_t*n)
     }
     return n;
 }
+static node_t* expand_data_nodes(node_t*n, int*next_local)
+{
+    /* children first: the features of a data node may contain data
+       nodes themselves */
+    int t;
+    for(t=0;t<n->num_children;t++) {
+        node_set_child(n, t, expand_data_nodes(n->child[t], next_local));
+    }
+    node_t*code = 0;
+    if(n->type == &node_forest) {
+        code = forest_expand(n, next_local);
+    } else if(n->type == &node_dot_product ||
+              n->type == &node_squared_distance) {
+        code = kernel_expand(n);
+    } else if(n->type == &node_in_set) {
+        code = constset_expand(n);
+    } else if(n->type == &node_knearest) {
+        code = knn_expand(n, next_local);
+    }
+    if(code) {
+        code->parent = n->parent;
+        node_destroy(n);
+        return code;
+    }
+    return n;
+}
+node_t* node_expand_data_nodes(node_t*n)
+{
+    int next_local = node_highest_local(n);
+    return expand_data_nodes(n, &next_local);
+}
 node_t* node_prepare_for_code_generation(node_t*n)
 {
+    n = node_expand_data_nodes(n);
     n = node_clean_arrays(n);
     n = node_optimize(n);
     n = node_do_cascade_returns(n);
@@ -454,6 +572,9 @@ bool node_equals_node(node_t*n1, node_t*n2)
         return false;
     if(n1->num_children != n2->num_children)
         return false;
+    if(n1->type->flags&NODE_FLAG_HAS_DATA) {
+        return n1 == n2;
+    }
     if(n1->type->flags&NODE_FLAG_HAS_VALUE) {
         if(!constant_equals(&n1->value, &n2->value)) {
             return false;
@@ -638,3 +759,186 @@ node_t* node_optimize(node_t*n)
     } while(again);
     return n;
 }
+
+/* sums with less terms than this are faster to evaluate as they are */
+#define MIN_KERNEL_SIZE 4
+
+/* x*c or c*x, with c a float constant. Returns x. */
+static node_t* scaled_term(node_t*n, float*factor)
+{
+    if(n->type != &node_mul)
+        return 0;
+    if(n->child[1]->type == &node_float) {
+        *factor = n->child[1]->value.f;
+        return n->child[0];
+    }
+    if(n->child[0]->type == &node_float) {
+        *factor = n->child[0]->value.f;
+        return n->child[1];
+    }
+    return 0;
+}
+/* (c-x)^2 or (x-c)^2, with c a float constant. Returns x. */
+static node_t* squared_difference_term(node_t*n, float*center)
+{
+    if(n->type != &node_sqr || n->child[0]->type != &node_sub)
+        return 0;
+    node_t*sub = n->child[0];
+    if(sub->child[0]->type == &node_float) {
+        *center = sub->child[0]->value.f;
+        return sub->child[1];
+    }
+    if(sub->child[1]->type == &node_float) {
+        *center = sub->child[1]->value.f;
+        return sub->child[0];
+    }
+    return 0;
+}
+/* The sum may contain one float constant, which becomes the kernel's
+   offset. Since sums are evaluated in order, and rounding depends on
+   that order, it has to be the first or the last term. */
+static node_t* recognize_kernel(node_t*n, nodetype_t*type)
+{
+    int num_constants = 0;
+    int offset_pos = -1;
+    int t;
+    for(t=0;t<n->num_children;t++) {
+        node_t*c = n->child[t];
+        float v;
+        if(c->type == &node_float) {
+            offset_pos = t;
+            num_constants++;
+        } else if(type == &node_dot_product && !scaled_term(c, &v)) {
+            return 0;
+        } else if(type == &node_squared_distance && !squared_difference_term(c, &v)) {
+            return 0;
+        }
+    }
+    int size = n->num_children - num_constants;
+    if(num_constants > 1 || size < MIN_KERNEL_SIZE)
+        return 0;
+    if(num_constants && offset_pos != 0 && offset_pos != n->num_children-1)
+        return 0;
+
+    kernel_t*k = kernel_new(size);
+    k->has_offset = num_constants > 0;
+    k->offset_last = num_constants > 0 && offset_pos > 0;
+    k->offset = num_constants > 0 ? n->child[offset_pos]->value.f : 0;
+    node_t**children = (node_t**)malloc(sizeof(node_t*)*size);
+    int pos = 0;
+    for(t=0;t<n->num_children;t++) {
+        node_t*c = n->child[t];
+        if(c->type == &node_float)
+            continue;
+        node_t*x;
+        if(type == &node_dot_product) {
+            x = scaled_term(c, &k->vector[pos]);
+        } else {
+            x = squared_difference_term(c, &k->vector[pos]);
+        }
+        children[pos++] = node_duplicate(x);
+    }
+    node_t*kernel = node_new_kernel(type, k, children);
+    free(children);
+    return kernel;
+}
+node_t* node_recognize_kernels(node_t*n)
+{
+    /* Replace sums of the form x1*c1 + x2*c2 + ... (linear models)
+       resp. (c1-x1)^2 + (c2-x2)^2 + ... (rbf kernels) with nodes
+       that keep the constants in a packed vector. */
+    int t;
+    for(t=0;t<n->num_children;t++) {
+        node_set_child(n, t, node_recognize_kernels(n->child[t]));
+    }
+    if(n->type == &node_add) {
+        node_t*kernel = recognize_kernel(n, &node_dot_product);
+        if(!kernel)
+            kernel = recognize_kernel(n, &node_squared_distance);
+        if(kernel) {
+            kernel->parent = n->parent;
+            node_destroy(n);
+            return kernel;
+        }
+    }
+    return n;
+}
+node_t* node_compile_sets(node_t*n)
+{
+    /* Replace "x in [a,b,c,...]" with a node that keeps the array in a
+       bitset resp. hash table. */
+    int t;
+    for(t=0;t<n->num_children;t++) {
+        node_set_child(n, t, node_compile_sets(n->child[t]));
+    }
+    if(n->type == &node_in) {
+        node_t*array = n->child[1];
+        if(array->type == &node_int_array ||
+           array->type == &node_category_array ||
+           array->type == &node_string_array ||
+           array->type == &node_float_array ||
+           array->type == &node_mixed_array) {
+            constset_t*s = constset_new(array_duplicate(array->value.a));
+            node_t*in = node_new_in_set(s, node_duplicate(n->child[0]));
+            in->parent = n->parent;
+            node_destroy(n);
+            return in;
+        }
+    }
+    return n;
+}
+static node_t* node_unwrap(node_t*n)
+{
+    node_t*child = n->child[0];
+    child->parent = n->parent;
+    n->num_children = 0;
+    node_destroy(n);
+    return child;
+}
+static void reorder_branches(node_t*n, profile_t*profile)
+{
+    int t;
+    for(t=0;t<n->num_children;t++) {
+        reorder_branches(n->child[t], profile);
+    }
+    if(n->type == &node_forest) {
+        node_profile_t*e = profile_lookup(profile, n);
+        if(e && e->visits)
+            forest_reorder((forest_t*)n->data, e->visits);
+        return;
+    }
+    if(n->type != &node_if || n->child[0]->type == &node_likely)
+        return;
+    node_profile_t*then_profile = profile_lookup(profile, n->child[1]);
+    node_profile_t*else_profile = profile_lookup(profile, n->child[2]);
+    if(!then_profile || !else_profile ||
+       node_is_missing(n->child[1]) || node_is_missing(n->child[2]))
+        return;
+    uint64_t first = then_profile->count;
+    uint64_t second = else_profile->count;
+    if(second > first) {
+        node_t*condition = n->child[0];
+        if(condition->type == &node_not) {
+            condition = node_unwrap(condition);
+        } else {
+            condition = node_new_with_args(&node_not);
+            node_append_child(condition, n->child[0]);
+        }
+        node_t*tmp = n->child[1];
+        node_set_child(n, 1, n->child[2]);
+        node_set_child(n, 2, tmp);
+        node_set_child(n, 0, condition);
+        first = else_profile->count;
+        second = then_profile->count;
+    }
+    if(first + second >= FOREST_LIKELY_MIN_COUNT && first >= FOREST_LIKELY_RATIO * (first + second)) {
+        node_t*likely = node_new_with_args(&node_likely);
+        node_append_child(likely, n->child[0]);
+        node_set_child(n, 0, likely);
+    }
+}
+node_t* node_reorder_branches(node_t*n, profile_t*profile)
+{
+    reorder_branches(n, profile);
+    return n;
+}
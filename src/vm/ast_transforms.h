@@ -23,8 +23,13 @@
 #define __ast_transforms__
 
 #include "ast.h"
+#include "profile.h"
+#include "dataset.h"
 
 node_t* node_prepare_for_code_generation(node_t*n);
+node_t* node_expand_data_nodes(node_t*n);
+node_t* node_recognize_kernels(node_t*n);
+node_t* node_compile_sets(node_t*n);
 node_t* node_insert_brackets(node_t*n) ;
 node_t* node_do_cascade_returns(node_t*n) ;
 bool node_has_consumer_parent(node_t*n);
@@ -39,9 +44,17 @@ int node_array_size(node_t*n);
 
 int node_highest_local(node_t*node);
 constant_type_t*node_local_types(node_t*node, model_t*m, int* num_locals);
+void node_split_locals_by_type(node_t*node, model_t*m);
 constant_type_t model_param_type(model_t*m, int var);
 bool node_has_child(node_t*n, nodetype_t*type);
+bool node_equals_node(node_t*n1, node_t*n2);
 node_t* node_optimize(node_t*n);
 
+/* Put the more frequent branch of every if node and forest test first,
+   and mark branches taken much more often than their alternative as
+   likely. Frequencies come from a profile of the program (which doesn't
+   match the program anymore afterwards). See model_reorder_branches(). */
+node_t* node_reorder_branches(node_t*n, profile_t*profile);
+
 
 #endif
@@ -0,0 +1,1023 @@
+/* bytecode.c
+   Register based bytecode for prediction programs.
+
+   Part of the data prediction package.
+
+   Copyright (c) 2011 Matthias Kramm <kramm@quiss.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+#include "bytecode.h"
+#include "ast_transforms.h"
+#include "dataset.h"
+#include "model.h"
+
+#define LIST_OPS \
+    OP(OP_PARAM) \
+    OP(OP_MOVE) \
+    OP(OP_ZERO_INT_ARRAY) \
+    OP(OP_ZERO_FLOAT_ARRAY) \
+    OP(OP_ADD) \
+    OP(OP_SUB) \
+    OP(OP_MUL) \
+    OP(OP_DIV) \
+    OP(OP_LT) \
+    OP(OP_LTE) \
+    OP(OP_GT) \
+    OP(OP_GTE) \
+    OP(OP_LT_I) \
+    OP(OP_LTE_I) \
+    OP(OP_GT_I) \
+    OP(OP_GTE_I) \
+    OP(OP_EQUALS) \
+    OP(OP_IN) \
+    OP(OP_NOT) \
+    OP(OP_NEG) \
+    OP(OP_EXP) \
+    OP(OP_SQR) \
+    OP(OP_ABS) \
+    OP(OP_BOOL_TO_FLOAT) \
+    OP(OP_ARG_MAX) \
+    OP(OP_ARG_MAX_I) \
+    OP(OP_ARG_MIN) \
+    OP(OP_ARG_MIN_I) \
+    OP(OP_ARRAY_AT_POS) \
+    OP(OP_INC_ARRAY_AT_POS) \
+    OP(OP_SET_ARRAY_AT_POS) \
+    OP(OP_SORT_FLOAT_ARRAY_ASC) \
+    OP(OP_ARRAY_ARG_MAX_I) \
+    OP(OP_INCLOCAL) \
+    OP(OP_TERM_FREQUENCY) \
+    OP(OP_JUMP) \
+    OP(OP_JUMP_IF_FALSE) \
+    OP(OP_JUMP_UNLESS_LT) \
+    OP(OP_JUMP_UNLESS_LTE) \
+    OP(OP_JUMP_UNLESS_GT) \
+    OP(OP_JUMP_UNLESS_GTE) \
+    OP(OP_LOOP_INIT) \
+    OP(OP_LOOP_TEST) \
+    OP(OP_LOOP_NEXT) \
+    OP(OP_EVAL_NODE)
+
+enum ops {
+#define OP(name) name,
+LIST_OPS
+#undef OP
+};
+
+static const char*op_names[] = {
+#define OP(name) #name,
+LIST_OPS
+#undef OP
+};
+
+// ------------------------------ compiler ------------------------------
+
+typedef struct _compiler {
+    bytecode_t*b;
+    int code_size;
+    int nodes_size;
+    int scratch_size;
+    int next_constant;
+    int missing;
+    int top;
+
+    /* register receiving the value of return nodes, and the jumps
+       they end with, which go to the end of the program */
+    int result;
+    int*returns;
+    int num_returns;
+    int returns_size;
+} compiler_t;
+
+/* Node types are compared by opcode throughout, so that specialized
+   programs (see specialize.h) compile like their generic versions. */
+static bool node_is_constant(node_t*n)
+{
+    switch(node_get_opcode(n)) {
+        case opcode_node_zero_int_array:
+        case opcode_node_zero_float_array:
+        case opcode_node_param:
+        case opcode_node_getlocal:
+        case opcode_node_setlocal:
+        case opcode_node_inclocal:
+        case opcode_node_for_local_from_n_to_m:
+            return false;
+    }
+    return (n->type->flags & NODE_FLAG_HAS_VALUE) && !(n->type->flags & NODE_FLAG_HAS_CHILDREN);
+}
+
+static bool node_uses_tree_walker(node_t*n);
+
+static int count_constants(node_t*n)
+{
+    uint8_t opcode = node_get_opcode(n);
+    if(node_is_constant(n) ||
+       opcode == opcode_node_zero_int_array ||
+       opcode == opcode_node_zero_float_array) {
+        return 1;
+    }
+    if(node_uses_tree_walker(n))
+        return 0;
+    int count = 0;
+    int t;
+    for(t=0;t<n->num_children;t++) {
+        count += count_constants(n->child[t]);
+    }
+    return count;
+}
+
+static bool node_writes_locals(node_t*n)
+{
+    uint8_t opcode = node_get_opcode(n);
+    if(opcode == opcode_node_setlocal ||
+       opcode == opcode_node_inclocal ||
+       opcode == opcode_node_for_local_from_n_to_m ||
+       node_uses_tree_walker(n)) {
+        return true;
+    }
+    int t;
+    for(t=0;t<n->num_children;t++) {
+        if(node_writes_locals(n->child[t]))
+            return true;
+    }
+    return false;
+}
+
+static int emit(compiler_t*c, uint8_t op, int dst, int a, int b, int x)
+{
+    bytecode_t*bc = c->b;
+    if(bc->num_instructions == c->code_size) {
+        c->code_size = c->code_size ? c->code_size*2 : 64;
+        bc->code = realloc(bc->code, sizeof(instruction_t)*c->code_size);
+    }
+    instruction_t*i = &bc->code[bc->num_instructions];
+    i->op = op;
+    i->dst = dst;
+    i->a = a;
+    i->b = b;
+    i->c = x;
+    return bc->num_instructions++;
+}
+
+static int add_constant(compiler_t*c, constant_t value)
+{
+    bytecode_t*b = c->b;
+    assert(c->next_constant < b->num_locals + b->num_constants);
+    b->constants[c->next_constant - b->num_locals] = value;
+    return c->next_constant++;
+}
+
+static int add_node(compiler_t*c, node_t*n)
+{
+    bytecode_t*b = c->b;
+    if(b->num_nodes == c->nodes_size) {
+        c->nodes_size = c->nodes_size ? c->nodes_size*2 : 8;
+        b->nodes = realloc(b->nodes, sizeof(node_t*)*c->nodes_size);
+    }
+    b->nodes[b->num_nodes] = n;
+    return b->num_nodes++;
+}
+
+static int add_scratch_array(compiler_t*c, constant_t value)
+{
+    bytecode_t*b = c->b;
+    int r = add_constant(c, value);
+    if(b->num_scratch == c->scratch_size) {
+        c->scratch_size = c->scratch_size ? c->scratch_size*2 : 8;
+        b->scratch = realloc(b->scratch, sizeof(int)*c->scratch_size);
+    }
+    b->scratch[b->num_scratch++] = r;
+    return r;
+}
+
+static int new_temp(compiler_t*c)
+{
+    int r = c->top++;
+    if(c->top > c->b->num_registers)
+        c->b->num_registers = c->top;
+    return r;
+}
+
+static void set_jump_target(compiler_t*c, int pos)
+{
+    c->b->code[pos].c = c->b->num_instructions;
+}
+
+static int compile_node(compiler_t*c, node_t*n);
+
+/* Compile the first num children of n into registers. If a child's value
+   lives in a local, and a later child modifies locals, the value is copied
+   to a temporary first, so that evaluation order matches the tree walker. */
+static void compile_operands(compiler_t*c, node_t*n, int num, int*regs)
+{
+    int t;
+    for(t=0;t<num;t++) {
+        int r = compile_node(c, n->child[t]);
+        if(r < c->b->num_locals) {
+            int s;
+            for(s=t+1;s<num;s++) {
+                if(node_writes_locals(n->child[s])) {
+                    int tmp = new_temp(c);
+                    emit(c, OP_MOVE, tmp, r, 0, 0);
+                    r = tmp;
+                    break;
+                }
+            }
+        }
+        regs[t] = r;
+    }
+}
+
+/* Compile the children of n into consecutive registers */
+static int compile_operand_range(compiler_t*c, node_t*n)
+{
+    int first = c->top;
+    int t;
+    for(t=0;t<n->num_children;t++) {
+        new_temp(c);
+    }
+    for(t=0;t<n->num_children;t++) {
+        int r = compile_node(c, n->child[t]);
+        if(r != first+t) {
+            emit(c, OP_MOVE, first+t, r, 0, 0);
+        }
+        c->top = first+n->num_children;
+    }
+    return first;
+}
+
+static int compile_unary(compiler_t*c, node_t*n, uint8_t op)
+{
+    int mark = c->top;
+    int a = compile_node(c, n->child[0]);
+    c->top = mark;
+    int dst = new_temp(c);
+    emit(c, op, dst, a, 0, 0);
+    return dst;
+}
+
+static int compile_binary(compiler_t*c, node_t*n, uint8_t op)
+{
+    int mark = c->top;
+    int regs[2];
+    compile_operands(c, n, 2, regs);
+    c->top = mark;
+    int dst = new_temp(c);
+    emit(c, op, dst, regs[0], regs[1], 0);
+    return dst;
+}
+
+static int compile_range(compiler_t*c, node_t*n, uint8_t op)
+{
+    int mark = c->top;
+    int first = compile_operand_range(c, n);
+    c->top = mark;
+    int dst = new_temp(c);
+    emit(c, op, dst, first, n->num_children, 0);
+    return dst;
+}
+
+static int compile_if(compiler_t*c, node_t*n)
+{
+    int dst = new_temp(c);
+    int mark = c->top;
+    node_t*cond = n->child[0];
+    int jump_to_else;
+
+    uint8_t op = 0;
+    switch(node_get_opcode(cond)) {
+        case opcode_node_lt: op = OP_JUMP_UNLESS_LT; break;
+        case opcode_node_lte: op = OP_JUMP_UNLESS_LTE; break;
+        case opcode_node_gt: op = OP_JUMP_UNLESS_GT; break;
+        case opcode_node_gte: op = OP_JUMP_UNLESS_GTE; break;
+    }
+
+    if(op) {
+        int regs[2];
+        compile_operands(c, cond, 2, regs);
+        jump_to_else = emit(c, op, 0, regs[0], regs[1], -1);
+    } else {
+        int r = compile_node(c, cond);
+        jump_to_else = emit(c, OP_JUMP_IF_FALSE, 0, r, 0, -1);
+    }
+    c->top = mark;
+
+    int r = compile_node(c, n->child[1]);
+    emit(c, OP_MOVE, dst, r, 0, 0);
+    int jump_to_end = emit(c, OP_JUMP, 0, 0, 0, -1);
+    c->top = mark;
+
+    set_jump_target(c, jump_to_else);
+    r = compile_node(c, n->child[2]);
+    emit(c, OP_MOVE, dst, r, 0, 0);
+    set_jump_target(c, jump_to_end);
+    c->top = mark;
+    return dst;
+}
+
+static int compile_return(compiler_t*c, node_t*n)
+{
+    int mark = c->top;
+    int r = compile_node(c, n->child[0]);
+    emit(c, OP_MOVE, c->result, r, 0, 0);
+    c->top = mark;
+    if(c->num_returns == c->returns_size) {
+        c->returns_size = c->returns_size ? c->returns_size*2 : 8;
+        c->returns = realloc(c->returns, sizeof(int)*c->returns_size);
+    }
+    c->returns[c->num_returns++] = emit(c, OP_JUMP, 0, 0, 0, -1);
+    return c->result;
+}
+
+static int compile_for(compiler_t*c, node_t*n)
+{
+    int local = n->value.i;
+    int regs[2];
+    compile_operands(c, n, 2, regs);
+
+    int counter = new_temp(c);
+    int end = new_temp(c);
+    emit(c, OP_LOOP_INIT, counter, regs[0], 0, 0);
+    emit(c, OP_MOVE, end, regs[1], 0, 0);
+    int loop_start = emit(c, OP_LOOP_TEST, local, counter, end, -1);
+    int mark = c->top;
+    compile_node(c, n->child[2]);
+    c->top = mark;
+    emit(c, OP_LOOP_NEXT, 0, counter, 0, loop_start);
+    set_jump_target(c, loop_start);
+    return c->missing;
+}
+
+/* node types without a dedicated instruction are evaluated
+   by calling their eval function (OP_EVAL_NODE) */
+static bool node_uses_tree_walker(node_t*n)
+{
+    switch(node_get_opcode(n)) {
+        case opcode_node_block:
+        case opcode_node_empty:
+        case opcode_node_nop:
+        case opcode_node_return:
+        case opcode_node_brackets:
+        case opcode_node_likely:
+        case opcode_node_if:
+        case opcode_node_add:
+        case opcode_node_sub:
+        case opcode_node_mul:
+        case opcode_node_div:
+        case opcode_node_lt:
+        case opcode_node_lte:
+        case opcode_node_gt:
+        case opcode_node_gte:
+        case opcode_node_lt_i:
+        case opcode_node_lte_i:
+        case opcode_node_gt_i:
+        case opcode_node_gte_i:
+        case opcode_node_equals:
+        case opcode_node_in:
+        case opcode_node_not:
+        case opcode_node_neg:
+        case opcode_node_exp:
+        case opcode_node_sqr:
+        case opcode_node_abs:
+        case opcode_node_bool_to_float:
+        case opcode_node_param:
+        case opcode_node_getlocal:
+        case opcode_node_setlocal:
+        case opcode_node_inclocal:
+        case opcode_node_for_local_from_n_to_m:
+        case opcode_node_zero_int_array:
+        case opcode_node_zero_float_array:
+        case opcode_node_arg_max:
+        case opcode_node_arg_max_i:
+        case opcode_node_arg_min:
+        case opcode_node_arg_min_i:
+        case opcode_node_array_at_pos:
+        case opcode_node_inc_array_at_pos:
+        case opcode_node_set_array_at_pos:
+        case opcode_node_sort_float_array_asc:
+        case opcode_node_array_arg_max_i:
+        case opcode_node_term_frequency:
+            return false;
+        default:
+            return !node_is_constant(n);
+    }
+}
+
+static int compile_node(compiler_t*c, node_t*n)
+{
+    if(node_is_constant(n)) {
+        if(n->type == &node_category) {
+            return add_constant(c, category_constant(n->value.c));
+        }
+        return add_constant(c, n->value);
+    }
+    if(node_uses_tree_walker(n)) {
+        int dst = new_temp(c);
+        emit(c, OP_EVAL_NODE, dst, add_node(c, n), 0, 0);
+        return dst;
+    }
+
+    switch(node_get_opcode(n)) {
+        case opcode_node_block: {
+            int t;
+            int r = c->missing;
+            int mark = c->top;
+            for(t=0;t<n->num_children;t++) {
+                c->top = mark;
+                r = compile_node(c, n->child[t]);
+            }
+            return r;
+        }
+        case opcode_node_empty:
+        case opcode_node_nop:
+            return c->missing;
+        case opcode_node_return:
+            return compile_return(c, n);
+        case opcode_node_brackets:
+        case opcode_node_likely:
+            return compile_node(c, n->child[0]);
+        case opcode_node_param: {
+            int dst = new_temp(c);
+            emit(c, OP_PARAM, dst, n->value.i, 0, 0);
+            return dst;
+        }
+        case opcode_node_zero_int_array: {
+            int r = add_scratch_array(c, n->value);
+            emit(c, OP_ZERO_INT_ARRAY, r, 0, 0, 0);
+            return r;
+        }
+        case opcode_node_zero_float_array: {
+            int r = add_scratch_array(c, n->value);
+            emit(c, OP_ZERO_FLOAT_ARRAY, r, 0, 0, 0);
+            return r;
+        }
+        case opcode_node_getlocal:
+            return n->value.i;
+        case opcode_node_setlocal: {
+            int mark = c->top;
+            int r = compile_node(c, n->child[0]);
+            emit(c, OP_MOVE, n->value.i, r, 0, 0);
+            c->top = mark;
+            return n->value.i;
+        }
+        case opcode_node_inclocal:
+            emit(c, OP_INCLOCAL, n->value.i, 0, 0, 0);
+            return n->value.i;
+        case opcode_node_if:
+            return compile_if(c, n);
+        case opcode_node_for_local_from_n_to_m: {
+            int mark = c->top;
+            int r = compile_for(c, n);
+            c->top = mark;
+            return r;
+        }
+        case opcode_node_add:
+            return compile_range(c, n, OP_ADD);
+        case opcode_node_arg_max:
+            return compile_range(c, n, OP_ARG_MAX);
+        case opcode_node_arg_max_i:
+            return compile_range(c, n, OP_ARG_MAX_I);
+        case opcode_node_arg_min:
+            return compile_range(c, n, OP_ARG_MIN);
+        case opcode_node_arg_min_i:
+            return compile_range(c, n, OP_ARG_MIN_I);
+        case opcode_node_sub:
+            return compile_binary(c, n, OP_SUB);
+        case opcode_node_mul:
+            return compile_binary(c, n, OP_MUL);
+        case opcode_node_div:
+            return compile_binary(c, n, OP_DIV);
+        case opcode_node_lt:
+            return compile_binary(c, n, OP_LT);
+        case opcode_node_lte:
+            return compile_binary(c, n, OP_LTE);
+        case opcode_node_gt:
+            return compile_binary(c, n, OP_GT);
+        case opcode_node_gte:
+            return compile_binary(c, n, OP_GTE);
+        case opcode_node_lt_i:
+            return compile_binary(c, n, OP_LT_I);
+        case opcode_node_lte_i:
+            return compile_binary(c, n, OP_LTE_I);
+        case opcode_node_gt_i:
+            return compile_binary(c, n, OP_GT_I);
+        case opcode_node_gte_i:
+            return compile_binary(c, n, OP_GTE_I);
+        case opcode_node_equals:
+            return compile_binary(c, n, OP_EQUALS);
+        case opcode_node_in:
+            return compile_binary(c, n, OP_IN);
+        case opcode_node_array_at_pos:
+            return compile_binary(c, n, OP_ARRAY_AT_POS);
+        case opcode_node_inc_array_at_pos:
+            return compile_binary(c, n, OP_INC_ARRAY_AT_POS);
+        case opcode_node_term_frequency:
+            return compile_binary(c, n, OP_TERM_FREQUENCY);
+        case opcode_node_set_array_at_pos: {
+            int mark = c->top;
+            int regs[3];
+            compile_operands(c, n, 3, regs);
+            c->top = mark;
+            int dst = new_temp(c);
+            emit(c, OP_SET_ARRAY_AT_POS, dst, regs[0], regs[1], regs[2]);
+            return dst;
+        }
+        case opcode_node_not:
+            return compile_unary(c, n, OP_NOT);
+        case opcode_node_neg:
+            return compile_unary(c, n, OP_NEG);
+        case opcode_node_exp:
+            return compile_unary(c, n, OP_EXP);
+        case opcode_node_sqr:
+            return compile_unary(c, n, OP_SQR);
+        case opcode_node_abs:
+            return compile_unary(c, n, OP_ABS);
+        case opcode_node_bool_to_float:
+            return compile_unary(c, n, OP_BOOL_TO_FLOAT);
+        case opcode_node_array_arg_max_i:
+            return compile_unary(c, n, OP_ARRAY_ARG_MAX_I);
+        case opcode_node_sort_float_array_asc: {
+            int mark = c->top;
+            int a = compile_node(c, n->child[0]);
+            c->top = mark;
+            emit(c, OP_SORT_FLOAT_ARRAY_ASC, 0, a, 0, 0);
+            return c->missing;
+        }
+        default:
+            fprintf(stderr, "Can't compile node %s\n", n->type->name);
+            assert(0);
+            return c->missing;
+    }
+}
+
+bytecode_t* bytecode_compile(node_t*code)
+{
+    bytecode_t*b = (bytecode_t*)calloc(1, sizeof(bytecode_t));
+    compiler_t c;
+    memset(&c, 0, sizeof(c));
+    c.b = b;
+
+    b->num_locals = node_highest_local(code);
+    b->num_constants = count_constants(code) + 1;
+    b->constants = (constant_t*)calloc(b->num_constants, sizeof(constant_t));
+    b->num_registers = b->num_locals + b->num_constants;
+
+    c.next_constant = b->num_locals;
+    c.missing = add_constant(&c, missing_constant());
+    c.top = b->num_registers;
+
+    if(node_has_child(code, &node_return)) {
+        c.result = new_temp(&c);
+        int r = compile_node(&c, code);
+        emit(&c, OP_MOVE, c.result, r, 0, 0);
+        int t;
+        for(t=0;t<c.num_returns;t++) {
+            set_jump_target(&c, c.returns[t]);
+        }
+        free(c.returns);
+        b->result = c.result;
+    } else {
+        b->result = compile_node(&c, code);
+    }
+    assert(c.next_constant == b->num_locals + b->num_constants);
+    return b;
+}
+
+// ---------------------------- interpreter -----------------------------
+
+constant_t* bytecode_registers_new(bytecode_t*b)
+{
+    constant_t*registers = (constant_t*)calloc(b->num_registers, sizeof(constant_t));
+    memcpy(&registers[b->num_locals], b->constants, sizeof(constant_t)*b->num_constants);
+    int t;
+    for(t=0;t<b->num_scratch;t++) {
+        constant_t*c = &registers[b->scratch[t]];
+        array_t*a = array_new(c->a->size);
+        memcpy(a->entries, c->a->entries, sizeof(constant_t)*a->size);
+        c->a = a;
+    }
+    return registers;
+}
+
+void bytecode_registers_destroy(bytecode_t*b, constant_t*registers)
+{
+    int t;
+    for(t=0;t<b->num_scratch;t++) {
+        array_destroy(registers[b->scratch[t]].a);
+    }
+    free(registers);
+}
+
+static inline constant_t param_to_constant(variable_t*v)
+{
+    if(v->type == CATEGORICAL) {
+        return category_constant(v->category);
+    } else if(v->type == CONTINUOUS) {
+        return float_constant(v->value);
+    } else if(v->type == MISSING) {
+        return missing_constant();
+    } else if(v->type == TEXT) {
+        return string_constant(v->text);
+    } else {
+        assert(!"bad type for input value");
+        return missing_constant();
+    }
+}
+
+void input_init_row(input_t*input, row_t*row)
+{
+    memset(input, 0, sizeof(input_t));
+    input->row = row;
+    input->row_is_current = true;
+}
+
+void input_init_columns(input_t*input, variable_t**columns, row_t*buffer)
+{
+    memset(input, 0, sizeof(input_t));
+    input->columns = columns;
+    input->row = buffer;
+}
+
+void input_init_dataset(input_t*input, dataset_t*dataset, row_t*buffer)
+{
+    memset(input, 0, sizeof(input_t));
+    assert(buffer->num_inputs >= dataset->num_columns);
+    input->dataset = dataset;
+    input->row = buffer;
+    input->class_values = (constant_t**)calloc(dataset->num_columns, sizeof(constant_t*));
+    int x;
+    for(x=0;x<dataset->num_columns;x++) {
+        column_t*c = dataset->columns[x];
+        if(c->type != CATEGORICAL)
+            continue;
+        /* do the same conversion as dataset_fill_row() and node_param */
+        constant_t*values = input->class_values[x] = (constant_t*)malloc(sizeof(constant_t)*c->num_classes);
+        int i;
+        for(i=0;i<c->num_classes;i++) {
+            variable_t v = constant_to_variable(&c->classes[i]);
+            values[i] = param_to_constant(&v);
+        }
+    }
+}
+
+void input_set_position(input_t*input, int pos)
+{
+    input->pos = pos;
+    input->entry = input->dataset ? dataset_row(input->dataset, pos) : pos;
+    input->row_is_current = false;
+}
+
+row_t* input_get_row(input_t*input)
+{
+    if(input->row_is_current)
+        return input->row;
+    if(input->dataset) {
+        dataset_fill_row(input->dataset, input->row, input->pos);
+    } else {
+        int x;
+        for(x=0;x<input->row->num_inputs;x++) {
+            input->row->inputs[x] = input->columns[x][input->pos];
+        }
+    }
+    input->row_is_current = true;
+    return input->row;
+}
+
+static inline constant_t input_param(input_t*input, int x)
+{
+    if(input->columns) {
+        return param_to_constant(&input->columns[x][input->pos]);
+    } else if(input->dataset) {
+        assert(x >= 0 && x < input->dataset->num_columns);
+        column_t*c = input->dataset->columns[x];
+        if(c->type == CATEGORICAL) {
+            return input->class_values[x][c->entries[input->entry].c];
+        } else if(c->type == TEXT) {
+            return string_constant(c->entries[input->entry].text);
+        } else {
+            return float_constant(c->entries[input->entry].f);
+        }
+    } else {
+        assert(x >= 0 && x < input->row->num_inputs);
+        return param_to_constant(&input->row->inputs[x]);
+    }
+}
+
+void input_clear(input_t*input)
+{
+    if(input->class_values) {
+        int x;
+        for(x=0;x<input->dataset->num_columns;x++) {
+            if(input->class_values[x])
+                free(input->class_values[x]);
+        }
+        free(input->class_values);
+    }
+    memset(input, 0, sizeof(input_t));
+}
+
+constant_t bytecode_run(bytecode_t*b, constant_t*r, input_t*input)
+{
+    const instruction_t*code = b->code;
+    const instruction_t*end = &b->code[b->num_instructions];
+    const instruction_t*i = code;
+
+    memset(r, 0, sizeof(constant_t)*b->num_locals);
+
+    while(i < end) {
+        switch(i->op) {
+            case OP_PARAM:
+                r[i->dst] = input_param(input, i->a);
+                break;
+            case OP_MOVE:
+                r[i->dst] = r[i->a];
+                break;
+            case OP_ZERO_INT_ARRAY:
+                array_fill(r[i->dst].a, int_constant(0));
+                break;
+            case OP_ZERO_FLOAT_ARRAY:
+                array_fill(r[i->dst].a, float_constant(0));
+                break;
+            case OP_ADD: {
+                double sum = 0;
+                int t;
+                for(t=0;t<i->b;t++) {
+                    sum += r[i->a+t].f;
+                }
+                r[i->dst] = float_constant(sum);
+                break;
+            }
+            case OP_SUB:
+                r[i->dst] = float_constant(r[i->a].f - r[i->b].f);
+                break;
+            case OP_MUL:
+                r[i->dst] = float_constant(r[i->a].f * r[i->b].f);
+                break;
+            case OP_DIV:
+                r[i->dst] = float_constant(r[i->a].f / r[i->b].f);
+                break;
+            case OP_LT:
+                r[i->dst] = bool_constant(r[i->a].f < r[i->b].f);
+                break;
+            case OP_LTE:
+                r[i->dst] = bool_constant(r[i->a].f <= r[i->b].f);
+                break;
+            case OP_GT:
+                r[i->dst] = bool_constant(r[i->a].f > r[i->b].f);
+                break;
+            case OP_GTE:
+                r[i->dst] = bool_constant(r[i->a].f >= r[i->b].f);
+                break;
+            case OP_LT_I:
+                r[i->dst] = bool_constant(r[i->a].i < r[i->b].i);
+                break;
+            case OP_LTE_I:
+                r[i->dst] = bool_constant(r[i->a].i <= r[i->b].i);
+                break;
+            case OP_GT_I:
+                r[i->dst] = bool_constant(r[i->a].i > r[i->b].i);
+                break;
+            case OP_GTE_I:
+                r[i->dst] = bool_constant(r[i->a].i >= r[i->b].i);
+                break;
+            case OP_EQUALS:
+                r[i->dst] = bool_constant(constant_equals(&r[i->a], &r[i->b]));
+                break;
+            case OP_IN: {
+                array_t*a = r[i->b].a;
+                bool found = false;
+                int t;
+                for(t=0;t<a->size;t++) {
+                    if(constant_equals(&r[i->a], &a->entries[t])) {
+                        found = true;
+                        break;
+                    }
+                }
+                r[i->dst] = bool_constant(found);
+                break;
+            }
+            case OP_NOT:
+                r[i->dst] = bool_constant(!r[i->a].b);
+                break;
+            case OP_NEG:
+                r[i->dst] = float_constant(-r[i->a].f);
+                break;
+            case OP_EXP:
+                r[i->dst] = float_constant(exp(r[i->a].f));
+                break;
+            case OP_SQR: {
+                double v = r[i->a].f;
+                r[i->dst] = float_constant(v*v);
+                break;
+            }
+            case OP_ABS:
+                r[i->dst] = float_constant(fabs(r[i->a].f));
+                break;
+            case OP_BOOL_TO_FLOAT:
+                r[i->dst] = float_constant(r[i->a].b);
+                break;
+            case OP_ARG_MAX: {
+                const constant_t*v = &r[i->a];
+                float max = v[0].f;
+                int index = 0;
+                int t;
+                for(t=1;t<i->b;t++) {
+                    if(v[t].f >= max) {
+                        max = v[t].f;
+                        index = t;
+                    }
+                }
+                r[i->dst] = int_constant(index);
+                break;
+            }
+            case OP_ARG_MAX_I: {
+                const constant_t*v = &r[i->a];
+                int max = v[0].i;
+                int index = 0;
+                int t;
+                for(t=1;t<i->b;t++) {
+                    if(v[t].i >= max) {
+                        max = v[t].i;
+                        index = t;
+                    }
+                }
+                r[i->dst] = int_constant(index);
+                break;
+            }
+            case OP_ARG_MIN: {
+                const constant_t*v = &r[i->a];
+                float min = v[0].f;
+                int index = 0;
+                int t;
+                for(t=1;t<i->b;t++) {
+                    if(v[t].f < min) {
+                        min = v[t].f;
+                        index = t;
+                    }
+                }
+                r[i->dst] = int_constant(index);
+                break;
+            }
+            case OP_ARG_MIN_I: {
+                const constant_t*v = &r[i->a];
+                int min = v[0].i;
+                int index = 0;
+                int t;
+                for(t=1;t<i->b;t++) {
+                    if(v[t].i < min) {
+                        min = v[t].i;
+                        index = t;
+                    }
+                }
+                r[i->dst] = int_constant(index);
+                break;
+            }
+            case OP_ARRAY_AT_POS:
+                r[i->dst] = r[i->a].a->entries[r[i->b].i];
+                break;
+            case OP_INC_ARRAY_AT_POS: {
+                array_t*a = r[i->a].a;
+                int pos = r[i->b].i;
+                a->entries[pos] = int_constant(a->entries[pos].i + 1);
+                r[i->dst] = a->entries[pos];
+                break;
+            }
+            case OP_SET_ARRAY_AT_POS: {
+                constant_t value = r[i->c];
+                r[i->a].a->entries[r[i->b].i] = value;
+                r[i->dst] = value;
+                break;
+            }
+            case OP_SORT_FLOAT_ARRAY_ASC: {
+                array_t*a = r[i->a].a;
+                qsort(&a->entries, a->size, sizeof(a->entries[0]), (int(*)(const void*,const void*))constant_compare);
+                break;
+            }
+            case OP_ARRAY_ARG_MAX_I: {
+                array_t*a = r[i->a].a;
+                int max = a->entries[0].i;
+                int index = 0;
+                int t;
+                for(t=1;t<a->size;t++) {
+                    if(a->entries[t].i >= max) {
+                        max = a->entries[t].i;
+                        index = t;
+                    }
+                }
+                r[i->dst] = int_constant(index);
+                break;
+            }
+            case OP_INCLOCAL:
+                assert(r[i->dst].type == CONSTANT_INT);
+                r[i->dst].i++;
+                break;
+            case OP_TERM_FREQUENCY:
+                r[i->dst] = float_constant(term_frequency(r[i->a].s, r[i->b].s));
+                break;
+            case OP_JUMP:
+                i = &code[i->c];
+                continue;
+            case OP_JUMP_IF_FALSE:
+                if(!r[i->a].b) {
+                    i = &code[i->c];
+                    continue;
+                }
+                break;
+            case OP_JUMP_UNLESS_LT:
+                if(!(r[i->a].f < r[i->b].f)) {
+                    i = &code[i->c];
+                    continue;
+                }
+                break;
+            case OP_JUMP_UNLESS_LTE:
+                if(!(r[i->a].f <= r[i->b].f)) {
+                    i = &code[i->c];
+                    continue;
+                }
+                break;
+            case OP_JUMP_UNLESS_GT:
+                if(!(r[i->a].f > r[i->b].f)) {
+                    i = &code[i->c];
+                    continue;
+                }
+                break;
+            case OP_JUMP_UNLESS_GTE:
+                if(!(r[i->a].f >= r[i->b].f)) {
+                    i = &code[i->c];
+                    continue;
+                }
+                break;
+            case OP_LOOP_INIT:
+                r[i->dst] = int_constant(r[i->a].i);
+                break;
+            case OP_LOOP_TEST:
+                if(r[i->a].i >= r[i->b].i) {
+                    i = &code[i->c];
+                    continue;
+                }
+                r[i->dst] = int_constant(r[i->a].i);
+                break;
+            case OP_LOOP_NEXT:
+                r[i->a].i++;
+                i = &code[i->c];
+                continue;
+            case OP_EVAL_NODE: {
+                environment_t env;
+                env.row = input_get_row(input);
+                env.locals = r;
+                env.num_locals = b->num_locals;
+                r[i->dst] = node_eval(b->nodes[i->a], &env);
+                if(env.returned)
+                    return r[i->dst];
+                break;
+            }
+            default:
+                fprintf(stderr, "Invalid instruction %d\n", i->op);
+                assert(0);
+        }
+        i++;
+    }
+    return r[b->result];
+}
+
+void bytecode_print(bytecode_t*b)
+{
+    int t;
+    printf("locals: %d, constants: %d, registers: %d\n", b->num_locals, b->num_constants, b->num_registers);
+    for(t=0;t<b->num_constants;t++) {
+        printf("r%d = ", b->num_locals+t);
+        constant_print(&b->constants[t]);
+        printf("\n");
+    }
+    for(t=0;t<b->num_instructions;t++) {
+        instruction_t*i = &b->code[t];
+        printf("%04d %-24s %d %d %d %d\n", t, op_names[i->op], i->dst, i->a, i->b, i->c);
+    }
+    printf("result: r%d\n", b->result);
+}
+
+void bytecode_destroy(bytecode_t*b)
+{
+    free(b->code);
+    free(b->constants);
+    free(b->nodes);
+    free(b->scratch);
+    free(b);
+}
@@ -0,0 +1,109 @@
+/* bytecode.h
+   Register based bytecode for prediction programs.
+
+   Part of the data prediction package.
+
+   Copyright (c) 2011 Matthias Kramm <kramm@quiss.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+
+#ifndef __bytecode_h__
+#define __bytecode_h__
+
+#include "ast.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* The register file of a program is laid out as
+
+       [ locals | constants | temporaries ]
+
+   Locals come first, so that the register file can double as the
+   locals array of an environment_t. This allows node types that have
+   no dedicated instruction to be evaluated by the tree walker (see
+   OP_EVAL_NODE), sharing locals with the surrounding bytecode. */
+
+typedef struct _instruction {
+    uint8_t op;
+    int32_t dst;
+    int32_t a;
+    int32_t b;
+    int32_t c;
+} instruction_t;
+
+typedef struct _bytecode {
+    instruction_t*code;
+    int num_instructions;
+
+    int num_locals;
+    int num_constants;
+    int num_registers;
+
+    /* initial contents of the constant registers */
+    constant_t*constants;
+
+    /* register holding the result after the program has run */
+    int result;
+
+    /* constant registers holding arrays the program modifies. Every
+       register file gets its own copy of these. */
+    int*scratch;
+    int num_scratch;
+
+    /* subtrees evaluated by the tree walker */
+    node_t**nodes;
+    int num_nodes;
+} bytecode_t;
+
+/* Where a program reads its parameters from. This is either a single
+   row, or the current position in a set of columns (one variable_t array
+   per input, or the columns of a dataset). For the latter, row is used as
+   a caller supplied buffer, only filled if a node is evaluated by the tree
+   walker. */
+typedef struct _input {
+    row_t*row;
+    bool row_is_current;
+
+    variable_t**columns;
+    struct _dataset*dataset;
+    /* for each categorical dataset column, its classes as parameter values */
+    constant_t**class_values;
+    int pos;
+    /* the position in the dataset's columns, i.e. pos mapped through
+       its row index */
+    int entry;
+} input_t;
+
+void input_init_row(input_t*input, row_t*row);
+void input_init_columns(input_t*input, variable_t**columns, row_t*buffer);
+void input_init_dataset(input_t*input, struct _dataset*dataset, row_t*buffer);
+void input_set_position(input_t*input, int pos);
+row_t* input_get_row(input_t*input);
+void input_clear(input_t*input);
+
+bytecode_t* bytecode_compile(node_t*code);
+constant_t* bytecode_registers_new(bytecode_t*b);
+void bytecode_registers_destroy(bytecode_t*b, constant_t*registers);
+constant_t bytecode_run(bytecode_t*b, constant_t*registers, input_t*input);
+void bytecode_print(bytecode_t*b);
+void bytecode_destroy(bytecode_t*b);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
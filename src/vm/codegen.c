@@ -122,20 +122,27 @@ void dedent(state_t*s)
 
 char*generate_code(codegen_t*codegen, model_t*m)
 {
-    node_t*n = (node_t*)m->code;
+    /* The transformations below rewrite the tree in place. Work on a copy,
+       so that the model (and any compiled form of it) stays intact. */
+    model_t copy = *m;
+    node_t*n = node_duplicate((node_t*)m->code);
+    n = node_prepare_for_code_generation(n);
+    copy.code = n;
+
     state_t s;
-    s.model = m;
+    s.model = &copy;
     s.codegen = codegen;
     s.indent = 0;
+    s.arrays = 0;
     s.writer = growingmemwriter_new();
-    n = node_prepare_for_code_generation(n);
-    codegen->write_header(m, &s);
+    codegen->write_header(&copy, &s);
     write_node(&s, n);
-    codegen->write_footer(m, &s);
+    codegen->write_footer(&copy, &s);
     write_uint8(s.writer, 0);
 
     char*result = writer_growmemwrite_getmem(s.writer, 0);
     s.writer->finish(s.writer);
+    node_destroy(n);
     return result;
 }
 codegen_t* codegen_default = &codegen_python;
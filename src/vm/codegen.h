@@ -24,6 +24,7 @@
 #include <stdarg.h>
 #include "ast.h"
 #include "io.h"
+#include "dict.h"
 
 struct _state;
 typedef struct _state state_t;
@@ -42,6 +43,7 @@ struct _state {
     model_t*model;
     writer_t*writer;
     codegen_t*codegen;
+    dict_t*arrays; // node_t* -> array number, filled in by the C backend
 };
 
 void strf(state_t*s, const char*format, ...);
@@ -50,12 +52,15 @@ void write_node(state_t*s, node_t*n);
 void indent(state_t*s);
 void dedent(state_t*s);
 
-codegen_t codegen_c;
-codegen_t codegen_js;
-codegen_t codegen_ruby;
-codegen_t codegen_python;
+extern codegen_t codegen_c;
+extern codegen_t codegen_js;
+extern codegen_t codegen_ruby;
+extern codegen_t codegen_python;
 
-codegen_t* codegen_default;
+extern codegen_t* codegen_default;
+
+char* c_type_name(constant_type_t c);
+constant_type_t c_param_type(model_t*model, int var);
 
 char*generate_code(codegen_t*codegen, model_t*m);
 
@@ -20,6 +20,8 @@
    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
 
 #include <assert.h>
+#include <string.h>
+#include <math.h>
 #include "codegen.h"
 #include "ast_transforms.h"
 
@@ -35,7 +37,7 @@ char* c_type_name(constant_type_t c)
         case CONSTANT_BOOL:
             return "bool";
         case CONSTANT_STRING:
-            return "char*";
+            return "const char*";
         case CONSTANT_INT_ARRAY:
             return "int*";
         case CONSTANT_FLOAT_ARRAY:
@@ -45,7 +47,7 @@ char* c_type_name(constant_type_t c)
         case CONSTANT_MIXED_ARRAY:
             return "void**";
         case CONSTANT_STRING_ARRAY:
-            return "char**";
+            return "const char**";
         case CONSTANT_MISSING:
             return "void";
         default:
@@ -71,6 +73,60 @@ char* c_printf_type(constant_type_t c)
     }
 }
 
+/* Categorical inputs come in as strings if the model compares them
+   against string constants, and as integers otherwise. */
+static bool c_param_is_compared_to_string(node_t*n, int var)
+{
+    if(n->type == &node_equals || n->type == &node_in) {
+        node_t*param = n->child[0];
+        node_t*value = n->child[1];
+        if(param->type != &node_param) {
+            param = n->child[1];
+            value = n->child[0];
+        }
+        if(param->type == &node_param && param->value.i == var &&
+           (value->value.type == CONSTANT_STRING || value->value.type == CONSTANT_STRING_ARRAY))
+            return true;
+    }
+    int t;
+    for(t=0;t<n->num_children;t++) {
+        if(c_param_is_compared_to_string(n->child[t], var))
+            return true;
+    }
+    return false;
+}
+constant_type_t c_param_type(model_t*model, int var)
+{
+    constant_type_t type = model_param_type(model, var);
+    if(type == CONSTANT_CATEGORY && c_param_is_compared_to_string((node_t*)model->code, var))
+        return CONSTANT_STRING;
+    return type;
+}
+static constant_type_t c_node_type(node_t*n, state_t*s)
+{
+    if(n->type == &node_param)
+        return c_param_type(s->model, n->value.i);
+    return node_type(n, s->model);
+}
+
+/* arrays are named by their position in the tree, so that generating code
+   for the same model twice yields the same program */
+static void c_number_arrays(node_t*n, dict_t*arrays)
+{
+    if(node_is_array(n)) {
+        dict_put_int(arrays, n, dict_count(arrays));
+        return;
+    }
+    int t;
+    for(t=0;t<n->num_children;t++) {
+        c_number_arrays(n->child[t], arrays);
+    }
+}
+static void c_write_array_name(node_t*n, state_t*s)
+{
+    strf(s, "a%d", dict_lookup_int(s->arrays, n));
+}
+
 void c_write_node_empty(node_t*n, state_t*s)
 {
 }
@@ -117,11 +173,14 @@ void c_write_node_if(node_t*n, state_t*s)
 }
 void c_write_node_add(node_t*n, state_t*s)
 {
+    /* sums are accumulated in double precision, like node_add_eval() does */
     int t;
+    strf(s, "(float)((double)");
     for(t=0;t<n->num_children;t++) {
         if(t && !node_has_minus_prefix(n->child[t])) strf(s, "+");
         write_node(s, n->child[t]);
     }
+    strf(s, ")");
 }
 void c_write_node_sub(node_t*n, state_t*s)
 {
@@ -193,35 +252,26 @@ void c_write_node_gte_i(node_t*n, state_t*s)
 }
 void c_write_node_in(node_t*n, state_t*s)
 {
-    if(node_is_array(n->child[1])) {
-        array_t*a = n->child[1]->value.a;
-        if(!a->size) {
-            strf(s, "false");
-            return;
-        } else {
-            constant_type_t etype = constant_array_subtype(&n->child[1]->value);
-            switch(etype) {
-                case CONSTANT_STRING:
-                    strf(s, "!!strstr(\"");
-                    int t;
-                    for(t=0;t<a->size;t++) {
-                        assert(a->entries[t].type == CONSTANT_STRING);
-                        if(t) 
-                            strf(s, "\\x7f");
-                        write_escaped_string(s, a->entries[t].s);
-                    }
-                    strf(s, "\",");
-                    write_node(s, n->child[0]);
-                    strf(s, ")");
-                    return;
-            }
-        }
+    int size = node_array_size(n->child[1]);
+    if(!size) {
+        strf(s, "false");
+        return;
+    }
+    switch(node_array_element_type(n->child[1])) {
+        case CONSTANT_STRING:
+            strf(s, "find_in_string(");
+            break;
+        case CONSTANT_FLOAT:
+            strf(s, "find_in_float(");
+            break;
+        default:
+            strf(s, "find_in_int(");
+            break;
     }
-    strf(s, "find_in(");
     write_node(s, n->child[0]);
-    strf(s, ",");
+    strf(s, ", ");
     write_node(s, n->child[1]);
-    strf(s, ")");
+    strf(s, ", %d)", size);
 }
 void c_write_node_not(node_t*n, state_t*s)
 {
@@ -254,7 +304,7 @@ void c_write_node_abs(node_t*n, state_t*s)
 }
 void c_write_node_param(node_t*n, state_t*s)
 {
-    if(s->model->sig->column_names) {
+    if(s->model->sig->has_column_names) {
         strf(s, "%s", s->model->sig->column_names[n->value.i]);
     } else {
         strf(s, "p%d", n->value.i);
@@ -278,12 +328,28 @@ void c_write_node_debug_print(node_t*n, state_t*s)
     write_node(s, n->child[0]);
     strf(s, ");");
 }
+static void c_write_float(float f, state_t*s)
+{
+    if(isnan(f)) {
+        strf(s, "NAN");
+    } else if(isinf(f)) {
+        strf(s, f<0?"-INFINITY":"INFINITY");
+    } else {
+        /* 9 significant digits are enough to represent any float exactly */
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%.9g", f);
+        strf(s, "%s", buf);
+        if(!strpbrk(buf, ".e"))
+            strf(s, ".0");
+        strf(s, "f");
+    }
+}
 void c_write_constant(constant_t*c, state_t*s)
 {
     int t;
     switch(c->type) {
         case CONSTANT_FLOAT:
-            strf(s, "%f", c->f);
+            c_write_float(c->f, s);
             break;
         case CONSTANT_INT:
         case CONSTANT_CATEGORY:
@@ -291,12 +357,13 @@ void c_write_constant(constant_t*c, state_t*s)
             break;
         case CONSTANT_BOOL:
             if(c->b)
-                strf(s, "True");
+                strf(s, "true");
             else
-                strf(s, "False");
+                strf(s, "false");
+            break;
         case CONSTANT_STRING:
             strf(s, "\"");
-            strf(s, "%s", c->s);
+            write_escaped_string(s, c->s);
             strf(s, "\"");
             break;
         case CONSTANT_MISSING:
@@ -331,31 +398,31 @@ void c_write_node_category(node_t*n, state_t*s)
 }
 void c_write_node_string_array(node_t*n, state_t*s)
 {
-    strf(s, "a%x", (long)n->value.a);
+    c_write_array_name(n, s);
 }
 void c_write_node_int_array(node_t*n, state_t*s)
 {
-    strf(s, "a%x", (long)n->value.a);
+    c_write_array_name(n, s);
 }
 void c_write_node_float_array(node_t*n, state_t*s)
 {
-    strf(s, "a%x", (long)n->value.a);
+    c_write_array_name(n, s);
 }
 void c_write_node_mixed_array(node_t*n, state_t*s)
 {
-    strf(s, "a%x", (long)n->value.a);
+    c_write_array_name(n, s);
 }
 void c_write_node_category_array(node_t*n, state_t*s)
 {
-    strf(s, "a%x", (long)n->value.a);
+    c_write_array_name(n, s);
 }
 void c_write_node_zero_int_array(node_t*n, state_t*s)
 {
-    strf(s, "a%x", (long)n->value.a);
+    c_write_array_name(n, s);
 }
 void c_write_node_zero_float_array(node_t*n, state_t*s)
 {
-    strf(s, "a%x", (long)n->value.a);
+    c_write_array_name(n, s);
 }
 void c_write_node_float(node_t*n, state_t*s)
 {
@@ -394,7 +461,7 @@ void c_write_node_bool_to_float(node_t*n, state_t*s)
 }
 void c_write_node_equals(node_t*n, state_t*s)
 {
-    constant_type_t type = node_type(n->child[0], s->model);
+    constant_type_t type = c_node_type(n->child[0], s);
     if(type==CONSTANT_STRING) {
         strf(s, "!strcmp(");
         write_node(s, n->child[0]);
@@ -487,14 +554,7 @@ void c_write_node_sort_float_array_asc(node_t*n, state_t*s)
 {
     strf(s, "qsort(");
     write_node(s, n->child[0]);
-    strf(s, ";sizeof(");
-    write_node(s, n->child[0]);
-    strf(s, ")/sizeof(");
-    write_node(s, n->child[0]);
-    strf(s, "[0]),sizeof(");
-    write_node(s, n->child[0]);
-    strf(s, "[0]), compare_float_ptr)");
-    strf(s, ");");
+    strf(s, ", %d, sizeof(float), compare_float_ptr)", node_array_size(n->child[0]));
 }
 void c_write_node_for_local_from_n_to_m(node_t*n, state_t*s)
 {
@@ -517,6 +577,13 @@ void c_write_node_brackets(node_t*n, state_t*s)
     write_node(s, n->child[0]);
     strf(s, ")");
 }
+void c_write_node_likely(node_t*n, state_t*s)
+{
+    strf(s, "likely");
+    if(n->child[0]->type!=&node_brackets) strf(s, "(");
+    write_node(s, n->child[0]);
+    if(n->child[0]->type!=&node_brackets) strf(s, ")");
+}
 static void c_write_function_arg_min_or_max(state_t*s, char*min_or_max, char*suffix, char*type, char*cmp)
 {
     strf(s,
@@ -525,11 +592,11 @@ static void c_write_function_arg_min_or_max(state_t*s, char*min_or_max, char*suf
 "    va_list arglist;\n"
 "    va_start(arglist, count);\n"
 "    int i;\n"
-"    double max = va_arg(arglist,%s)\n"
+"    double max = va_arg(arglist,%s);\n"
 "    int best = 0;\n"
 "    for(i=1;i<count;i++) {\n"
-"        double a = va_arg(arglist,%s)\n"
-"        if(a%sbest) {\n"
+"        double a = va_arg(arglist,%s);\n"
+"        if(a%smax) {\n"
 "            best = i;\n"
 "            max = a;\n"
 "        }\n"
@@ -548,7 +615,7 @@ static void c_write_function_array_arg_max_i(state_t*s)
 "    int best = 0;\n"
 "    int i;\n"
 "    for(i=1;i<count;i++) {\n"
-"        if(array[i]>max) {\n"
+"        if(array[i]>=max) {\n"
 "            max = array[i];\n"
 "            best = i;\n"
 "        }\n"
@@ -562,10 +629,20 @@ static void c_write_function_sqr(state_t*s)
     strf(s, "%s",
 "static inline double sqr(const double v)\n"
 "{\n"
-"    return v*v\n"
+"    return v*v;\n"
 "}\n"
     );
 }
+static void c_write_function_likely(state_t*s)
+{
+    strf(s, "%s",
+"#ifdef __GNUC__\n"
+"#define likely(x) __builtin_expect(!!(x), 1)\n"
+"#else\n"
+"#define likely(x) (x)\n"
+"#endif\n"
+    );
+}
 static void c_write_function_compare_float_ptr(state_t*s)
 {
     strf(s, "%s",
@@ -579,14 +656,50 @@ static void c_write_function_compare_float_ptr(state_t*s)
 "}\n"
     );
 }
+static void c_write_function_term_frequency(state_t*s)
+{
+    strf(s, "%s",
+"static float term_frequency(const char*text, const char*word)\n"
+"{\n"
+"    const char*p = text;\n"
+"    int frequency = 0;\n"
+"    while(*p) {\n"
+"        while(*p && strchr(\" \\t\\r\\n\\f\", *p)) {\n"
+"            p++;\n"
+"        }\n"
+"        if(!*p)\n"
+"            break;\n"
+"        const char*word_start = p;\n"
+"        while(*p && !strchr(\" \\t\\r\\n\\f\", *p)) {\n"
+"            p++;\n"
+"        }\n"
+"        if(!strncmp(word, word_start, p-word_start))\n"
+"            frequency++;\n"
+"    }\n"
+"    return frequency / (float)strlen(text);\n"
+"}\n"
+    );
+}
+static void c_write_function_find_in(state_t*s, char*suffix, char*type, char*cmp)
+{
+    strf(s,
+"static bool find_in_%s(%s value, %s*array, int size)\n"
+"{\n"
+"    int i;\n"
+"    for(i=0;i<size;i++) {\n"
+"        if(%s)\n"
+"            return true;\n"
+"    }\n"
+"    return false;\n"
+"}\n", suffix, type, type, cmp
+    );
+}
 void c_enumerate_arrays(node_t*node, state_t*s)
 {
     if(node_is_array(node)) {
-        strf(s, "%s a%x[%d] = ", 
-                c_type_name(constant_array_subtype(&node->value)),
-                (long)(node->value.a),
-                node->value.a->size
-                );
+        strf(s, "%s ", c_type_name(constant_array_subtype(&node->value)));
+        c_write_array_name(node, s);
+        strf(s, "[%d] = ", node->value.a->size);
         c_write_constant(&node->value, s);
         strf(s, ";\n");
     } else {
@@ -600,11 +713,17 @@ void c_write_header(model_t*model, state_t*s)
 {
     node_t*root = (node_t*)model->code;
 
+    strf(s, "#include <stdlib.h>\n");
+    strf(s, "#include <stdarg.h>\n");
+    strf(s, "#include <stdbool.h>\n");
+    strf(s, "#include <string.h>\n");
+    strf(s, "#include <math.h>\n");
+
     if(node_has_child(root, &node_arg_max)) {
-        c_write_function_arg_min_or_max(s, "max", "", "double", ">");
+        c_write_function_arg_min_or_max(s, "max", "", "double", ">=");
     }
     if(node_has_child(root, &node_arg_max_i)) {
-        c_write_function_arg_min_or_max(s, "max", "_i", "int", ">");
+        c_write_function_arg_min_or_max(s, "max", "_i", "int", ">=");
     }
     if(node_has_child(root, &node_arg_min)) {
         c_write_function_arg_min_or_max(s, "min", "", "double", "<");
@@ -621,6 +740,19 @@ void c_write_header(model_t*model, state_t*s)
     if(node_has_child(root, &node_sort_float_array_asc)) {
         c_write_function_compare_float_ptr(s);
     }
+    if(node_has_child(root, &node_likely)) {
+        c_write_function_likely(s);
+    }
+    if(node_has_child(root, &node_term_frequency)) {
+        c_write_function_term_frequency(s);
+    }
+    if(node_has_child(root, &node_in)) {
+        c_write_function_find_in(s, "string", "const char*", "!strcmp(array[i], value)");
+        c_write_function_find_in(s, "int", "int", "array[i] == value");
+        c_write_function_find_in(s, "float", "float", "array[i] == value");
+    }
+
+    node_split_locals_by_type(root, model);
 
     constant_type_t type = node_type(root, model);
     strf(s, "%s predict(", c_type_name(type));
@@ -628,9 +760,9 @@ void c_write_header(model_t*model, state_t*s)
     for(t=0;t<model->sig->num_inputs;t++) {
         if(t) strf(s, ", ");
         if(s->model->sig->has_column_names) {
-            strf(s, "%s %s", c_type_name(model_param_type(s->model,t)), s->model->sig->column_names[t]);
+            strf(s, "%s %s", c_type_name(c_param_type(s->model,t)), s->model->sig->column_names[t]);
         } else {
-            strf(s, "%s p%d", c_type_name(model_param_type(s->model,t)), t);
+            strf(s, "%s p%d", c_type_name(c_param_type(s->model,t)), t);
         }
     }
     strf(s, ")\n");
@@ -643,6 +775,8 @@ void c_write_header(model_t*model, state_t*s)
             strf(s, "%s v%d;\n", c_type_name(types[t]), t);
         }
     }
+    s->arrays = dict_new(&ptr_type);
+    c_number_arrays(root, s->arrays);
     c_enumerate_arrays(root, s);
 
 }
@@ -651,6 +785,8 @@ void c_write_footer(model_t*model, state_t*s)
     node_t*root = model->code;
     dedent(s);
     strf(s, "\n}\n");
+    dict_destroy(s->arrays);
+    s->arrays = 0;
 }
 
 
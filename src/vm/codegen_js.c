@@ -409,6 +409,12 @@ void js_write_node_brackets(node_t*n, state_t*s)
     write_node(s, n->child[0]);
     strf(s, ")");
 }
+/* JavaScript has no branch hints. Likely branches come first, though,
+   which is what engines optimize for. */
+void js_write_node_likely(node_t*n, state_t*s)
+{
+    write_node(s, n->child[0]);
+}
 static void js_write_function_arg_max(state_t*s, char*suffix, char*type)
 {
     strf(s,
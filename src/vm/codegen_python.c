@@ -399,6 +399,11 @@ void python_write_node_brackets(node_t*n, state_t*s)
     write_node(s, n->child[0]);
     strf(s, ")");
 }
+/* Python has no branch hints */
+void python_write_node_likely(node_t*n, state_t*s)
+{
+    write_node(s, n->child[0]);
+}
 static void python_write_function_term_frequency(state_t*s)
 {
     strf(s,
@@ -395,6 +395,11 @@ void ruby_write_node_brackets(node_t*n, state_t*s)
     write_node(s, n->child[0]);
     strf(s, ")");
 }
+/* Ruby has no branch hints */
+void ruby_write_node_likely(node_t*n, state_t*s)
+{
+    write_node(s, n->child[0]);
+}
 static void ruby_write_function_term_frequency(state_t*s)
 {
     strf(s,
@@ -0,0 +1,423 @@
+/* constset.c
+   Constant sets with constant time membership tests.
+
+   Part of the data prediction package.
+
+   Copyright (c) 2011 Matthias Kramm <kramm@quiss.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "constset.h"
+#include "easy_ast.h"
+#include "dict.h"
+
+/* sets with less entries than this aren't worth hashing */
+#define CONSTSET_MIN_HASH_SIZE 4
+/* largest category (resp. int) we store in a bitset */
+#define CONSTSET_MAX_BITS 65536
+#define CONSTSET_MAX_SEEDS 16
+
+static bool bitset_type(constant_type_t type)
+{
+    return type == CONSTANT_CATEGORY || type == CONSTANT_INT;
+}
+
+static bool bitset_build(constset_t*s)
+{
+    array_t*a = s->array;
+    if(!a->size || !bitset_type(a->entries[0].type))
+        return false;
+    int32_t max = 0;
+    int t;
+    for(t=0;t<a->size;t++) {
+        constant_t*c = &a->entries[t];
+        /* c->c and c->i share their storage */
+        if(c->type != a->entries[0].type || c->i < 0 || c->i >= CONSTSET_MAX_BITS)
+            return false;
+        if(c->i > max)
+            max = c->i;
+    }
+    s->kind = CONSTSET_BITSET;
+    s->type = a->entries[0].type;
+    s->num_bits = max+1;
+    s->bits = (uint32_t*)calloc((s->num_bits+31)/32, sizeof(uint32_t));
+    for(t=0;t<a->size;t++) {
+        uint32_t i = a->entries[t].i;
+        s->bits[i>>5] |= 1u<<(i&31);
+    }
+    return true;
+}
+
+// ------------------------------ hashing -----------------------------------
+
+static inline uint32_t mix(uint32_t h)
+{
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+    return h;
+}
+
+/* equal constants (in the sense of constant_equals()) need equal hashes.
+   NaNs, which equal every float, are dealt with separately. */
+static uint32_t key_hash(constant_t*c)
+{
+    uint32_t h;
+    switch(c->type) {
+        case CONSTANT_FLOAT: {
+            float f = c->f == 0 ? 0.0f : c->f;
+            h = hash_block(&f, sizeof(f));
+            break;
+        }
+        case CONSTANT_STRING:
+            h = hash_block(c->s, strlen(c->s));
+            break;
+        case CONSTANT_MISSING:
+            h = 0;
+            break;
+        default:
+            h = constant_hash(c);
+            break;
+    }
+    return h ^ c->type*0x9e3779b9;
+}
+
+static inline uint32_t hash_bucket(constset_t*s, uint32_t h)
+{
+    return mix(h ^ s->seed) & (s->num_buckets-1);
+}
+
+static inline uint32_t hash_slot(constset_t*s, uint32_t h, uint32_t d)
+{
+    /* the step is odd, so trying all displacements visits all slots */
+    return (mix(h + s->seed) + d*(mix(h ^ ~s->seed)|1)) & (s->num_slots-1);
+}
+
+static uint32_t power_of_two(uint32_t n)
+{
+    uint32_t p = 1;
+    while(p < n)
+        p <<= 1;
+    return p;
+}
+
+static bool is_nan(constant_t*c)
+{
+    return c->type == CONSTANT_FLOAT && isnan(c->f);
+}
+
+static void hash_init(constset_t*s)
+{
+    array_t*a = s->array;
+    s->kind = CONSTSET_HASH;
+    s->num_slots = power_of_two(a->size*2);
+    s->slots = (int32_t*)malloc(sizeof(int32_t)*s->num_slots);
+    int t;
+    for(t=0;t<a->size;t++) {
+        if(a->entries[t].type == CONSTANT_FLOAT) {
+            s->has_floats = true;
+            if(isnan(a->entries[t].f))
+                s->has_nan = true;
+        }
+    }
+}
+
+static void hash_clear(constset_t*s)
+{
+    free(s->slots);
+    s->slots = 0;
+    free(s->displacement);
+    s->displacement = 0;
+    s->kind = CONSTSET_LINEAR;
+}
+
+/* fill the slots using the current seed and displacements */
+static bool hash_place(constset_t*s)
+{
+    array_t*a = s->array;
+    memset(s->slots, -1, sizeof(int32_t)*s->num_slots);
+    int t;
+    for(t=0;t<a->size;t++) {
+        constant_t*c = &a->entries[t];
+        if(is_nan(c))
+            continue;
+        uint32_t h = key_hash(c);
+        uint32_t slot = hash_slot(s, h, s->displacement[hash_bucket(s, h)]);
+        if(s->slots[slot] >= 0) {
+            if(constant_equals(c, &a->entries[s->slots[slot]]))
+                continue;
+            return false;
+        }
+        s->slots[slot] = t;
+    }
+    return true;
+}
+
+/* find a displacement for every bucket, biggest buckets first */
+static bool hash_search(constset_t*s, uint32_t*hashes, int32_t*next, int32_t*first, int32_t*order)
+{
+    array_t*a = s->array;
+    uint32_t b;
+    int t;
+    for(b=0;b<s->num_buckets;b++) {
+        first[b] = -1;
+    }
+    for(t=0;t<a->size;t++) {
+        if(is_nan(&a->entries[t]))
+            continue;
+        b = hash_bucket(s, hashes[t]);
+        /* duplicates end up in the same bucket, and only need one slot */
+        int32_t i;
+        for(i=first[b];i>=0;i=next[i]) {
+            if(constant_equals(&a->entries[i], &a->entries[t]))
+                break;
+        }
+        if(i < 0) {
+            next[t] = first[b];
+            first[b] = t;
+        }
+    }
+
+    /* sort buckets by size (descending) */
+    int*sizes = (int*)calloc(s->num_buckets, sizeof(int));
+    int max_size = 0;
+    for(b=0;b<s->num_buckets;b++) {
+        int32_t i;
+        for(i=first[b];i>=0;i=next[i])
+            sizes[b]++;
+        if(sizes[b] > max_size)
+            max_size = sizes[b];
+    }
+    int num = 0;
+    int size;
+    for(size=max_size;size>0;size--) {
+        for(b=0;b<s->num_buckets;b++) {
+            if(sizes[b] == size)
+                order[num++] = b;
+        }
+    }
+    free(sizes);
+
+    memset(s->slots, -1, sizeof(int32_t)*s->num_slots);
+    for(t=0;t<s->num_buckets;t++) {
+        s->displacement[t] = 0;
+    }
+    for(t=0;t<num;t++) {
+        b = order[t];
+        uint32_t d;
+        for(d=0;d<s->num_slots;d++) {
+            int32_t i, j;
+            for(i=first[b];i>=0;i=next[i]) {
+                uint32_t slot = hash_slot(s, hashes[i], d);
+                if(s->slots[slot] >= 0)
+                    break;
+                /* members of this bucket may not collide with each other */
+                for(j=first[b];j!=i;j=next[j]) {
+                    if(hash_slot(s, hashes[j], d) == slot)
+                        break;
+                }
+                if(j != i)
+                    break;
+            }
+            if(i < 0)
+                break;
+        }
+        if(d == s->num_slots)
+            return false;
+        s->displacement[b] = d;
+        int32_t i;
+        for(i=first[b];i>=0;i=next[i]) {
+            s->slots[hash_slot(s, hashes[i], d)] = i;
+        }
+    }
+    return true;
+}
+
+static bool hash_build(constset_t*s)
+{
+    array_t*a = s->array;
+    hash_init(s);
+    s->num_buckets = power_of_two((a->size+1)/2);
+    s->displacement = (uint32_t*)malloc(sizeof(uint32_t)*s->num_buckets);
+
+    uint32_t*hashes = (uint32_t*)malloc(sizeof(uint32_t)*a->size);
+    int32_t*next = (int32_t*)malloc(sizeof(int32_t)*a->size);
+    int32_t*first = (int32_t*)malloc(sizeof(int32_t)*s->num_buckets);
+    int32_t*order = (int32_t*)malloc(sizeof(int32_t)*s->num_buckets);
+    int t;
+    for(t=0;t<a->size;t++) {
+        hashes[t] = key_hash(&a->entries[t]);
+    }
+    bool ok = false;
+    uint32_t seed;
+    for(seed=0;seed<CONSTSET_MAX_SEEDS && !ok;seed++) {
+        s->seed = seed;
+        ok = hash_search(s, hashes, next, first, order);
+    }
+    free(hashes);
+    free(next);
+    free(first);
+    free(order);
+
+    if(!ok) {
+        /* e.g. distinct values with the same hash */
+        hash_clear(s);
+    }
+    return ok;
+}
+
+// ------------------------------ sets --------------------------------------
+
+constset_t* constset_new(array_t*a)
+{
+    constset_t*s = (constset_t*)calloc(1, sizeof(constset_t));
+    s->array = a;
+    s->kind = CONSTSET_LINEAR;
+    if(!bitset_build(s) && a->size >= CONSTSET_MIN_HASH_SIZE) {
+        hash_build(s);
+    }
+    return s;
+}
+
+constset_t* constset_new_hash(array_t*a, uint32_t seed, uint32_t num_buckets, uint32_t*displacement)
+{
+    if(a->size < CONSTSET_MIN_HASH_SIZE || num_buckets != power_of_two((a->size+1)/2)) {
+        free(displacement);
+        return constset_new(a);
+    }
+    constset_t*s = (constset_t*)calloc(1, sizeof(constset_t));
+    s->array = a;
+    hash_init(s);
+    s->seed = seed;
+    s->num_buckets = num_buckets;
+    s->displacement = displacement;
+    uint32_t t;
+    for(t=0;t<num_buckets;t++) {
+        if(displacement[t] >= s->num_slots)
+            break;
+    }
+    if(t < num_buckets || !hash_place(s)) {
+        hash_clear(s);
+        free(s);
+        return constset_new(a);
+    }
+    return s;
+}
+
+bool constset_contains(constset_t*s, constant_t*c)
+{
+    switch(s->kind) {
+        case CONSTSET_BITSET: {
+            uint32_t i = c->i;
+            return c->type == s->type && i < s->num_bits && (s->bits[i>>5] & (1u<<(i&31)));
+        }
+        case CONSTSET_HASH: {
+            if(c->type == CONSTANT_FLOAT) {
+                if(isnan(c->f))
+                    return s->has_floats;
+                if(s->has_nan)
+                    return true;
+            }
+            uint32_t h = key_hash(c);
+            int32_t i = s->slots[hash_slot(s, h, s->displacement[hash_bucket(s, h)])];
+            return i >= 0 && constant_equals(c, &s->array->entries[i]);
+        }
+        default: {
+            array_t*a = s->array;
+            int t;
+            for(t=0;t<a->size;t++) {
+                if(constant_equals(c, &a->entries[t]))
+                    return true;
+            }
+            return false;
+        }
+    }
+}
+
+constset_t* constset_duplicate(constset_t*s)
+{
+    constset_t*d = (constset_t*)malloc(sizeof(constset_t));
+    memcpy(d, s, sizeof(constset_t));
+    d->array = array_duplicate(s->array);
+    if(s->bits) {
+        int size = sizeof(uint32_t)*((s->num_bits+31)/32);
+        d->bits = (uint32_t*)malloc(size);
+        memcpy(d->bits, s->bits, size);
+    }
+    if(s->displacement) {
+        d->displacement = (uint32_t*)malloc(sizeof(uint32_t)*s->num_buckets);
+        memcpy(d->displacement, s->displacement, sizeof(uint32_t)*s->num_buckets);
+    }
+    if(s->slots) {
+        d->slots = (int32_t*)malloc(sizeof(int32_t)*s->num_slots);
+        memcpy(d->slots, s->slots, sizeof(int32_t)*s->num_slots);
+    }
+    return d;
+}
+
+void constset_destroy(constset_t*s)
+{
+    array_destroy(s->array);
+    free(s->bits);
+    free(s->displacement);
+    free(s->slots);
+    free(s);
+}
+
+// ------------------------------ nodes -------------------------------------
+
+node_t* node_new_in_set(constset_t*s, node_t*x)
+{
+    node_t*n = node_new(&node_in_set, 0);
+    n->data = s;
+    node_append_child(n, x);
+    return n;
+}
+
+bool node_in_set_eval_bool(node_t*n, environment_t* env)
+{
+    constant_t c = node_eval_child(n->child[0], env);
+    return constset_contains((constset_t*)n->data, &c);
+}
+constant_t node_in_set_eval(node_t*n, environment_t* env)
+{
+    return bool_constant(node_in_set_eval_bool(n, env));
+}
+nodetype_t node_in_set =
+{
+name:"in_set",
+flags:NODE_FLAG_HAS_CHILDREN|NODE_FLAG_HAS_DATA,
+eval: node_in_set_eval,
+eval_bool: node_in_set_eval_bool,
+min_args:1,
+max_args:1,
+};
+
+node_t* constset_expand(node_t*n)
+{
+    constset_t*s = (constset_t*)n->data;
+    START_CODE(code)
+    IN
+        INSERT_NODE(node_duplicate(n->child[0]));
+        ARRAY_CONSTANT(array_duplicate(s->array));
+    END;
+    END_CODE;
+    return code;
+}
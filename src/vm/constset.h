@@ -0,0 +1,85 @@
+/* constset.h
+   Constant sets with constant time membership tests.
+
+   Part of the data prediction package.
+
+   Copyright (c) 2011 Matthias Kramm <kramm@quiss.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+
+#ifndef __constset_h__
+#define __constset_h__
+
+#include "ast.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* A constset wraps the array of an "x in [a,b,c,...]" test. Sets of small
+   non-negative categories (or ints) are stored as a bitset, other sets in
+   a perfect hash table (hash and displace: the bucket of a value selects a
+   displacement, which, together with the value's hash, selects the one
+   slot the value can be in). Tiny sets, and sets we can't find a perfect
+   hash for, are scanned linearly. Membership tests behave exactly like
+   comparing against every entry with constant_equals(). */
+
+#define CONSTSET_LINEAR 0
+#define CONSTSET_BITSET 1
+#define CONSTSET_HASH 2
+
+typedef struct _constset {
+    array_t*array;
+    uint8_t kind;
+
+    /* CONSTSET_BITSET: entries are of this type, and smaller than num_bits */
+    uint8_t type;
+    uint32_t num_bits;
+    uint32_t*bits;
+
+    /* CONSTSET_HASH */
+    uint32_t seed;
+    uint32_t num_buckets;
+    uint32_t*displacement;
+    uint32_t num_slots;
+    int32_t*slots; /* index into array, or -1 */
+    /* NaNs compare equal to every float */
+    bool has_floats;
+    bool has_nan;
+} constset_t;
+
+/* takes ownership of the array */
+constset_t* constset_new(array_t*a);
+
+/* rebuild a hash table with the given parameters (e.g. from a saved
+   model). Falls back to constset_new() if they don't work for the
+   array. Takes ownership of the array and the displacements. */
+constset_t* constset_new_hash(array_t*a, uint32_t seed, uint32_t num_buckets, uint32_t*displacement);
+
+bool constset_contains(constset_t*s, constant_t*c);
+constset_t* constset_duplicate(constset_t*s);
+void constset_destroy(constset_t*s);
+
+/* "x in set", with x the only child. Takes ownership of the set and x. */
+node_t* node_new_in_set(constset_t*s, node_t*x);
+
+/* the generic "x in array" AST for an in_set node */
+node_t* constset_expand(node_t*n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -90,6 +90,7 @@
 #define EQUALS NODE_BEGIN(&node_equals)
 
 #define NOT NODE_BEGIN(&node_not)
+#define LIKELY NODE_BEGIN(&node_likely)
 #define EXP NODE_BEGIN(&node_exp)
 #define SQR NODE_BEGIN(&node_sqr)
 #define NEG NODE_BEGIN(&node_neg)
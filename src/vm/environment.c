@@ -32,6 +32,7 @@ environment_t* environment_new(void*node, row_t*row)
     e->num_locals = node_highest_local((node_t*)node);
     e->locals = (constant_t*)calloc(sizeof(constant_t), e->num_locals);
     e->row = row;
+    e->returned = false;
     return e;
 }
 
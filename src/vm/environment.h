@@ -29,6 +29,8 @@ typedef struct _environment {
     row_t* row;
     constant_t* locals;
     int num_locals;
+    /* set by a return node, so that blocks and loops stop evaluating */
+    bool returned;
 } environment_t;
 
 environment_t* environment_new(void*node, row_t*row);
@@ -0,0 +1,587 @@
+/* forest.c
+   Flattened decision trees and tree ensembles.
+
+   Part of the data prediction package.
+
+   Copyright (c) 2011 Matthias Kramm <kramm@quiss.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <assert.h>
+#include "forest.h"
+#include "profile.h"
+#include "easy_ast.h"
+#include "settings.h"
+
+/* evaluations with less features resp. classes than this don't
+   need to allocate memory */
+#define FOREST_STACK_SIZE 64
+
+forest_t* forest_new(forest_mode_t mode, array_t*classes)
+{
+    forest_t*f = (forest_t*)calloc(1, sizeof(forest_t));
+    f->mode = mode;
+    f->classes = classes;
+    f->shrinkage = 1.0;
+    return f;
+}
+
+void forest_start_tree(forest_t*f, int tree_class)
+{
+    f->roots = (int32_t*)realloc(f->roots, sizeof(int32_t)*(f->num_trees+1));
+    f->tree_class = (int32_t*)realloc(f->tree_class, sizeof(int32_t)*(f->num_trees+1));
+    f->roots[f->num_trees] = f->num_nodes;
+    f->tree_class[f->num_trees] = tree_class;
+    f->num_trees++;
+}
+
+static int forest_feature(forest_t*f, int param)
+{
+    int i;
+    for(i=0;i<f->num_features;i++) {
+        if(f->params[i] == param)
+            return i;
+    }
+    f->params = (int32_t*)realloc(f->params, sizeof(int32_t)*(f->num_features+1));
+    f->params[f->num_features] = param;
+    return f->num_features++;
+}
+
+static int forest_add_node(forest_t*f, int kind)
+{
+    int size = f->num_nodes;
+    if(!size || !(size&(size-1))) {
+        /* grow to the next power of two */
+        f->nodes = (forest_node_t*)realloc(f->nodes, sizeof(forest_node_t)*(size?size*2:16));
+    }
+    forest_node_t*node = &f->nodes[f->num_nodes];
+    memset(node, 0, sizeof(forest_node_t));
+    node->kind = kind;
+    node->left = node->right = -1;
+    return f->num_nodes++;
+}
+
+int forest_add_lte(forest_t*f, int param, float threshold)
+{
+    int pos = forest_add_node(f, FOREST_LTE);
+    f->nodes[pos].feature = forest_feature(f, param);
+    f->nodes[pos].v.threshold = threshold;
+    return pos;
+}
+
+int forest_add_in(forest_t*f, int param, constset_t*set)
+{
+    int pos = forest_add_node(f, FOREST_IN);
+    f->nodes[pos].feature = forest_feature(f, param);
+    f->sets = (constset_t**)realloc(f->sets, sizeof(constset_t*)*(f->num_sets+1));
+    f->sets[f->num_sets] = set;
+    f->nodes[pos].v.set = f->num_sets++;
+    return pos;
+}
+
+int forest_add_int_leaf(forest_t*f, int32_t value)
+{
+    int pos = forest_add_node(f, FOREST_LEAF);
+    f->nodes[pos].v.i = value;
+    return pos;
+}
+
+int forest_add_float_leaf(forest_t*f, float value)
+{
+    int pos = forest_add_node(f, FOREST_LEAF);
+    f->nodes[pos].v.f = value;
+    return pos;
+}
+
+void forest_set_branches(forest_t*f, int pos, int left, int right)
+{
+    assert(pos >= 0 && pos < f->num_nodes);
+    f->nodes[pos].left = left;
+    f->nodes[pos].right = right;
+}
+
+void forest_negate(forest_t*f, int pos)
+{
+    assert(pos >= 0 && pos < f->num_nodes && f->nodes[pos].kind != FOREST_LEAF);
+    f->nodes[pos].inversed ^= 1;
+}
+
+static bool is_likely(double left, double right)
+{
+    return left + right >= FOREST_LIKELY_MIN_COUNT &&
+           left >= FOREST_LIKELY_RATIO * (left + right);
+}
+
+void forest_set_frequencies(forest_t*f, int pos, double left, double right)
+{
+    assert(pos >= 0 && pos < f->num_nodes);
+    f->nodes[pos].likely = is_likely(left, right);
+}
+
+static int reorder_tree(forest_t*f, const uint64_t*visits, int pos, forest_node_t*nodes, int*num_nodes, bool*seen)
+{
+    if(seen[pos])
+        return -1;
+    seen[pos] = true;
+    int p = (*num_nodes)++;
+    nodes[p] = f->nodes[pos];
+    if(nodes[p].kind == FOREST_LEAF)
+        return p;
+    int first = f->nodes[pos].left;
+    int second = f->nodes[pos].right;
+    if(visits[second] > visits[first]) {
+        first = f->nodes[pos].right;
+        second = f->nodes[pos].left;
+        nodes[p].inversed ^= 1;
+    }
+    nodes[p].likely = is_likely(visits[first], visits[second]);
+    nodes[p].left = reorder_tree(f, visits, first, nodes, num_nodes, seen);
+    nodes[p].right = reorder_tree(f, visits, second, nodes, num_nodes, seen);
+    if(nodes[p].left < 0 || nodes[p].right < 0)
+        return -1;
+    return p;
+}
+
+bool forest_reorder(forest_t*f, const uint64_t*visits)
+{
+    forest_node_t*nodes = (forest_node_t*)malloc(sizeof(forest_node_t)*(f->num_nodes+1));
+    int32_t*roots = (int32_t*)malloc(sizeof(int32_t)*(f->num_trees+1));
+    bool*seen = (bool*)calloc(f->num_nodes+1, sizeof(bool));
+    int num_nodes = 0;
+    int t;
+    for(t=0;t<f->num_trees;t++) {
+        roots[t] = reorder_tree(f, visits, f->roots[t], nodes, &num_nodes, seen);
+        if(roots[t] < 0)
+            break;
+    }
+    free(seen);
+    if(t < f->num_trees) {
+        /* trees share nodes */
+        free(nodes);
+        free(roots);
+        return false;
+    }
+    if(f->mapped) {
+        int32_t*tree_class = (int32_t*)malloc(sizeof(int32_t)*(f->num_trees+1));
+        memcpy(tree_class, f->tree_class, sizeof(int32_t)*f->num_trees);
+        f->tree_class = tree_class;
+        f->mapped = false;
+    } else {
+        free(f->nodes);
+        free(f->roots);
+    }
+    f->nodes = nodes;
+    f->num_nodes = num_nodes;
+    f->roots = roots;
+    return true;
+}
+
+bool forest_verify(forest_t*f)
+{
+    if(!f->classes || (f->mode != FOREST_SINGLE && !f->classes->size))
+        return false;
+    if(f->mode == FOREST_SINGLE && f->num_trees != 1)
+        return false;
+    int t;
+    for(t=0;t<f->num_trees;t++) {
+        if(f->roots[t] < 0 || f->roots[t] >= f->num_nodes)
+            return false;
+        if(f->mode == FOREST_SUM && (f->tree_class[t] < 0 || f->tree_class[t] >= f->classes->size))
+            return false;
+    }
+    for(t=0;t<f->num_nodes;t++) {
+        forest_node_t*node = &f->nodes[t];
+        if(node->kind == FOREST_LEAF) {
+            if(f->mode == FOREST_VOTE && (node->v.i < 0 || node->v.i >= f->classes->size))
+                return false;
+            continue;
+        }
+        if(node->kind != FOREST_LTE && node->kind != FOREST_IN)
+            return false;
+        if(node->feature >= f->num_features)
+            return false;
+        if(node->kind == FOREST_IN && (node->v.set < 0 || node->v.set >= f->num_sets))
+            return false;
+        /* branches always point forward, so every walk terminates */
+        if(node->left <= t || node->left >= f->num_nodes ||
+           node->right <= t || node->right >= f->num_nodes)
+            return false;
+    }
+    return true;
+}
+
+forest_t* forest_duplicate(forest_t*f)
+{
+    forest_t*d = forest_new(f->mode, array_duplicate(f->classes));
+    d->shrinkage = f->shrinkage;
+    d->num_nodes = f->num_nodes;
+    d->nodes = (forest_node_t*)malloc(sizeof(forest_node_t)*f->num_nodes);
+    memcpy(d->nodes, f->nodes, sizeof(forest_node_t)*f->num_nodes);
+    d->num_trees = f->num_trees;
+    d->roots = (int32_t*)malloc(sizeof(int32_t)*f->num_trees);
+    memcpy(d->roots, f->roots, sizeof(int32_t)*f->num_trees);
+    d->tree_class = (int32_t*)malloc(sizeof(int32_t)*f->num_trees);
+    memcpy(d->tree_class, f->tree_class, sizeof(int32_t)*f->num_trees);
+    d->num_sets = f->num_sets;
+    d->sets = (constset_t**)malloc(sizeof(constset_t*)*f->num_sets);
+    int t;
+    for(t=0;t<f->num_sets;t++) {
+        d->sets[t] = constset_duplicate(f->sets[t]);
+    }
+    d->num_features = f->num_features;
+    return d;
+}
+
+void forest_destroy(forest_t*f)
+{
+    int t;
+    for(t=0;t<f->num_sets;t++) {
+        constset_destroy(f->sets[t]);
+    }
+    free(f->sets);
+    if(f->classes)
+        array_destroy(f->classes);
+    if(!f->mapped) {
+        free(f->nodes);
+        free(f->roots);
+        free(f->tree_class);
+    }
+    free(f->params);
+    free(f);
+}
+
+node_t* node_new_forest(forest_t*f)
+{
+    node_t*n = node_new(&node_forest, 0);
+    n->data = f;
+    int t;
+    for(t=0;t<f->num_features;t++) {
+        node_append_child(n, node_new_with_args(&node_param, f->params[t]));
+    }
+    free(f->params);
+    f->params = 0;
+    return n;
+}
+
+constant_type_t forest_type(forest_t*f)
+{
+    if(!f->classes->size)
+        return CONSTANT_MISSING;
+    return f->classes->entries[0].type;
+}
+
+// ------------------------------ evaluation --------------------------------
+
+/* Walk one tree. features[] caches the values of our children, with
+   entries of type 0 not evaluated yet. If we're being profiled, visits[]
+   counts the tree nodes we pass. */
+static inline forest_node_t* forest_walk(node_t*n, forest_t*f, int pos, constant_t*features, environment_t*env, uint64_t*visits)
+{
+    forest_node_t*nodes = f->nodes;
+    while(1) {
+        if(visits)
+            visits[pos]++;
+        if(nodes[pos].kind == FOREST_LEAF)
+            break;
+        forest_node_t*node = &nodes[pos];
+        constant_t*value = &features[node->feature];
+        if(!value->type) {
+            node_t*child = n->child[node->feature];
+            if(child->type->eval_float) {
+                *value = float_constant(node_eval_float(child, env));
+            } else {
+                *value = node_eval_child(child, env);
+            }
+        }
+        bool condition;
+        if(node->kind == FOREST_LTE) {
+            condition = AS_FLOAT(*value) <= node->v.threshold;
+        } else {
+            condition = constset_contains(f->sets[node->v.set], value);
+        }
+        pos = condition != node->inversed ? node->left : node->right;
+    }
+    return &nodes[pos];
+}
+
+/* Stop voting early if even with all remaining votes, no other class
+   could overtake the leader anymore. */
+static inline bool forest_vote_decided(int*counts, int num_classes, int leader, int remaining)
+{
+    if(remaining > counts[leader])
+        return false;
+    int c;
+    for(c=0;c<num_classes;c++) {
+        if(c == leader)
+            continue;
+        int best = counts[c] + remaining;
+        if(best > counts[leader] || (best == counts[leader] && c > leader))
+            return false;
+    }
+    return true;
+}
+
+constant_t node_forest_eval(node_t*n, environment_t* env)
+{
+    forest_t*f = (forest_t*)n->data;
+
+    constant_t _features[FOREST_STACK_SIZE];
+    constant_t*features = _features;
+    if(n->num_children > FOREST_STACK_SIZE) {
+        features = (constant_t*)malloc(sizeof(constant_t)*n->num_children);
+    }
+    memset(features, 0, sizeof(constant_t)*n->num_children);
+
+    uint64_t*visits = n->type != &node_forest ? profile_forest_visits(n) : 0;
+
+    int num_classes = f->classes->size;
+    constant_t result = missing_constant();
+    int index = 0;
+    int t;
+    switch(f->mode) {
+        case FOREST_SINGLE: {
+            forest_node_t*leaf = forest_walk(n, f, f->roots[0], features, env, visits);
+            if(leaf->v.i >= 0 && leaf->v.i < num_classes) {
+                result = f->classes->entries[leaf->v.i];
+            }
+            break;
+        }
+        case FOREST_VOTE: {
+            int _counts[FOREST_STACK_SIZE];
+            int*counts = num_classes > FOREST_STACK_SIZE ? (int*)malloc(sizeof(int)*num_classes) : _counts;
+            memset(counts, 0, sizeof(int)*num_classes);
+            /* the class with the most votes so far. Ties go to the last
+               class, like in array_arg_max_i */
+            index = num_classes-1;
+            for(t=0;t<f->num_trees;t++) {
+                int c = forest_walk(n, f, f->roots[t], features, env, visits)->v.i;
+                counts[c]++;
+                if(counts[c] > counts[index] || (counts[c] == counts[index] && c > index))
+                    index = c;
+                if(forest_vote_decided(counts, num_classes, index, f->num_trees-t-1))
+                    break;
+            }
+            if(counts != _counts)
+                free(counts);
+            result = f->classes->entries[index];
+            break;
+        }
+        case FOREST_SUM: {
+            double _sums[FOREST_STACK_SIZE];
+            double*sums = num_classes > FOREST_STACK_SIZE ? (double*)malloc(sizeof(double)*num_classes) : _sums;
+            memset(sums, 0, sizeof(double)*num_classes);
+            for(t=0;t<f->num_trees;t++) {
+                float value = forest_walk(n, f, f->roots[t], features, env, visits)->v.f;
+                sums[f->tree_class[t]] += (float)(value * f->shrinkage);
+            }
+            float max = (float)sums[0];
+            for(t=1;t<num_classes;t++) {
+                if((float)sums[t]>=max) {
+                    max = (float)sums[t];
+                    index = t;
+                }
+            }
+            if(sums != _sums)
+                free(sums);
+            result = f->classes->entries[index];
+            break;
+        }
+    }
+    if(features != _features)
+        free(features);
+    return result;
+}
+nodetype_t node_forest =
+{
+name:"forest",
+flags:NODE_FLAG_HAS_CHILDREN|NODE_FLAG_HAS_DATA,
+eval: node_forest_eval,
+min_args:0,
+max_args:INT_MAX,
+};
+
+// ------------------------------ expansion ---------------------------------
+
+static void expand_tree(node_t*n, forest_t*f, int pos, node_t*current_node)
+{
+    node_t**current_program = 0;
+    forest_node_t*node = &f->nodes[pos];
+
+    if(node->kind == FOREST_LEAF) {
+        if(f->mode == FOREST_SUM) {
+            FLOAT_CONSTANT(node->v.f);
+        } else if(f->mode == FOREST_VOTE) {
+            INT_CONSTANT(node->v.i);
+        } else if(node->v.i < 0 || node->v.i >= f->classes->size) {
+            MISSING_CONSTANT;
+        } else {
+            GENERIC_CONSTANT(f->classes->entries[node->v.i]);
+        }
+        return;
+    }
+    IF
+        if(node->likely) {
+            LIKELY
+        }
+        if(node->inversed) {
+            NOT
+        }
+        if(node->kind == FOREST_LTE) {
+            LTE
+                INSERT_NODE(node_duplicate(n->child[node->feature]));
+                FLOAT_CONSTANT(node->v.threshold);
+            END;
+        } else {
+            IN
+                INSERT_NODE(node_duplicate(n->child[node->feature]));
+                ARRAY_CONSTANT(array_duplicate(f->sets[node->v.set]->array));
+            END;
+        }
+        if(node->inversed) {
+            END;
+        }
+        if(node->likely) {
+            END;
+        }
+    THEN
+        expand_tree(n, f, node->left, current_node);
+    ELSE
+        expand_tree(n, f, node->right, current_node);
+    END;
+}
+
+/* whether the value of n is what the program returns */
+static bool is_tail(node_t*n)
+{
+    node_t*p;
+    for(p=n->parent;p;n=p,p=p->parent) {
+        if(p->type == &node_block) {
+            if(p->child[p->num_children-1] != n)
+                return false;
+        } else if(p->type == &node_if) {
+            if(p->child[0] == n)
+                return false;
+        } else if(p->type != &node_return && p->type != &node_brackets) {
+            return false;
+        }
+    }
+    return true;
+}
+
+node_t* forest_expand(node_t*n, int*next_local)
+{
+    forest_t*f = (forest_t*)n->data;
+    int num_classes = f->classes->size;
+    int t;
+
+    /* returning early only works if nothing is evaluated after us */
+    bool early_exit = config_early_exit_votes && is_tail(n);
+
+    START_CODE(code)
+    BLOCK
+    switch(f->mode) {
+        case FOREST_SINGLE:
+            expand_tree(n, f, f->roots[0], current_node);
+        break;
+        case FOREST_VOTE: {
+            int counts = (*next_local)++;
+            SETLOCAL(counts)
+                NEW_ZERO_INT_ARRAY(num_classes);
+            END;
+            for(t=0;t<f->num_trees;t++) {
+                int vote = (*next_local)++;
+                SETLOCAL(vote)
+                    expand_tree(n, f, f->roots[t], current_node);
+                END;
+                INC_ARRAY_AT_POS
+                    GETLOCAL(counts);
+                    GETLOCAL(vote);
+                END;
+                /* a class with more than half of all votes wins. Before
+                   tree num_trees/2, none can have that many yet. */
+                if(early_exit && t >= f->num_trees/2 && t < f->num_trees-1) {
+                    IF
+                        GT_I
+                            ARRAY_AT_POS
+                                GETLOCAL(counts);
+                                GETLOCAL(vote);
+                            END;
+                            INT_CONSTANT(f->num_trees/2);
+                        END;
+                    THEN
+                        RETURN
+                            ARRAY_AT_POS
+                                ARRAY_CONSTANT(array_duplicate(f->classes));
+                                GETLOCAL(vote);
+                            END;
+                        END;
+                    ELSE
+                        NOP;
+                    END;
+                }
+            }
+            ARRAY_AT_POS
+                ARRAY_CONSTANT(array_duplicate(f->classes));
+                ARRAY_ARG_MAX_I
+                    GETLOCAL(counts);
+                END;
+            END;
+        }
+        break;
+        case FOREST_SUM: {
+            int sums = *next_local;
+            *next_local += num_classes;
+            int c;
+            for(c=0;c<num_classes;c++) {
+                SETLOCAL(sums+c)
+                    int count = 0;
+                    for(t=0;t<f->num_trees;t++) {
+                        if(f->tree_class[t] == c)
+                            count++;
+                    }
+                    if(!count) {
+                        FLOAT_CONSTANT(0.0);
+                    } else {
+                        ADD
+                            for(t=0;t<f->num_trees;t++) {
+                                if(f->tree_class[t] != c)
+                                    continue;
+                                MUL
+                                    expand_tree(n, f, f->roots[t], current_node);
+                                    FLOAT_CONSTANT(f->shrinkage);
+                                END;
+                            }
+                        END;
+                    }
+                END;
+            }
+            ARRAY_AT_POS
+                ARRAY_CONSTANT(array_duplicate(f->classes));
+                ARG_MAX_F
+                    for(c=0;c<num_classes;c++) {
+                        GETLOCAL(sums+c);
+                    }
+                END;
+            END;
+        }
+        break;
+    }
+    END;
+    END_CODE;
+    return code;
+}
@@ -0,0 +1,133 @@
+/* forest.h
+   Flattened decision trees and tree ensembles.
+
+   Part of the data prediction package.
+
+   Copyright (c) 2011 Matthias Kramm <kramm@quiss.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+
+#ifndef __forest_h__
+#define __forest_h__
+
+#include "ast.h"
+#include "constset.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* A forest node stores all its trees in one array, in preorder, instead of
+   as nested if/lte/in nodes. The children of the node are the features the
+   trees test (usually, params), so that transformations which rewrite params
+   keep working. Features are only evaluated when a tree actually tests them.
+
+   Before code generation, forest nodes are expanded back into the
+   equivalent generic AST (see node_expand_data_nodes()). */
+
+typedef enum {
+    FOREST_SINGLE = 0, /* one tree, returns classes[leaf] */
+    FOREST_VOTE = 1,   /* every tree votes for a class */
+    FOREST_SUM = 2,    /* per class sum of tree outputs (boosting) */
+} forest_mode_t;
+
+/* a branch is likely if at least this fraction of (at least this many)
+   evaluations take it (used for forest tests and if nodes alike) */
+#define FOREST_LIKELY_RATIO 0.8
+#define FOREST_LIKELY_MIN_COUNT 16
+
+#define FOREST_LEAF 0
+#define FOREST_LTE 1
+#define FOREST_IN 2
+
+typedef struct _forest_node {
+    uint32_t kind:2;
+    uint32_t feature:28;
+    /* the test is negated, i.e. left is where it fails */
+    uint32_t inversed:1;
+    /* left is taken much more often than right */
+    uint32_t likely:1;
+    union {
+        float threshold; /* FOREST_LTE */
+        int32_t set;     /* FOREST_IN: index into sets[] */
+        int32_t i;       /* FOREST_LEAF in SINGLE and VOTE mode: class index */
+        float f;         /* FOREST_LEAF in SUM mode */
+    } v;
+    /* where to go if the test succeeds resp. fails */
+    int32_t left;
+    int32_t right;
+} forest_node_t;
+
+typedef struct _forest {
+    forest_mode_t mode;
+
+    forest_node_t*nodes;
+    int num_nodes;
+
+    int32_t*roots;
+    int num_trees;
+
+    /* SUM mode: which class each tree contributes to, and the factor
+       tree outputs are multiplied with */
+    int32_t*tree_class;
+    float shrinkage;
+
+    constset_t**sets;
+    int num_sets;
+
+    array_t*classes;
+
+    /* while building: the param each feature is read from */
+    int32_t*params;
+    int num_features;
+
+    /* nodes, roots and tree_class point into a mapped model file */
+    bool mapped;
+} forest_t;
+
+forest_t* forest_new(forest_mode_t mode, array_t*classes);
+void forest_start_tree(forest_t*f, int tree_class);
+int forest_add_lte(forest_t*f, int param, float threshold);
+int forest_add_in(forest_t*f, int param, constset_t*set);
+int forest_add_int_leaf(forest_t*f, int32_t value);
+int forest_add_float_leaf(forest_t*f, float value);
+void forest_set_branches(forest_t*f, int pos, int left, int right);
+void forest_negate(forest_t*f, int pos);
+/* mark the left branch as likely if it was taken often enough */
+void forest_set_frequencies(forest_t*f, int pos, double left, double right);
+bool forest_verify(forest_t*f);
+
+/* Rearrange the trees such that at every test, the branch taken more
+   often according to visits[] (indexed by tree node) comes first, and
+   mark likely branches. Returns false if the trees can't be rearranged. */
+bool forest_reorder(forest_t*f, const uint64_t*visits);
+forest_t* forest_duplicate(forest_t*f);
+void forest_destroy(forest_t*f);
+
+/* create a forest node, with one param child per feature. Takes ownership
+   of the forest. */
+node_t* node_new_forest(forest_t*f);
+
+constant_type_t forest_type(forest_t*f);
+
+/* the generic AST for a forest node. Allocates new locals starting
+   at *next_local. */
+node_t* forest_expand(node_t*n, int*next_local);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
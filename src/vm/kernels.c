@@ -0,0 +1,206 @@
+/* kernels.c
+   Dot products and squared distances over packed float vectors.
+
+   Part of the data prediction package.
+
+   Copyright (c) 2011 Matthias Kramm <kramm@quiss.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "kernels.h"
+#include "easy_ast.h"
+
+/* nodes with less children than this evaluate them into a stack buffer */
+#define KERNEL_STACK_SIZE 64
+
+kernel_t* kernel_new(int size)
+{
+    kernel_t*k = (kernel_t*)calloc(1, sizeof(kernel_t));
+    k->size = size;
+    k->vector = (float*)calloc(size ? size : 1, sizeof(float));
+    return k;
+}
+
+kernel_t* kernel_duplicate(kernel_t*k)
+{
+    kernel_t*d = kernel_new(k->size);
+    memcpy(d->vector, k->vector, sizeof(float)*k->size);
+    d->has_offset = k->has_offset;
+    d->offset_last = k->offset_last;
+    d->offset = k->offset;
+    return d;
+}
+
+void kernel_destroy(kernel_t*k)
+{
+    if(!k->mapped)
+        free(k->vector);
+    free(k);
+}
+
+node_t* node_new_kernel(nodetype_t*type, kernel_t*k, node_t**children)
+{
+    node_t*n = node_new(type, 0);
+    n->data = k;
+    int t;
+    for(t=0;t<k->size;t++) {
+        node_append_child(n, children[t]);
+    }
+    return n;
+}
+
+// ------------------------------ kernels -----------------------------------
+
+/* Products resp. squares are computed in single precision (which gives the
+   same results as the mul and sqr nodes), and added to sum one after
+   another in double precision, like node_add does. Starting from the
+   offset (or from zero, if it comes last), this sums in the same order as
+   the add node kernel_expand() generates, so all ways of evaluating a
+   kernel agree to the last bit.
+   (Computing only the products with SIMD instructions didn't measurably
+   help, since the additions have to happen one after another anyway.) */
+
+double kernel_dot_product(const float*x, const float*y, int size, double sum)
+{
+    int t;
+    for(t=0;t<size;t++) {
+        float p = x[t]*y[t];
+        sum += p;
+    }
+    return sum;
+}
+
+double kernel_squared_distance(const float*x, const float*y, int size, double sum)
+{
+    int t;
+    for(t=0;t<size;t++) {
+        float d = y[t]-x[t];
+        float p = d*d;
+        sum += p;
+    }
+    return sum;
+}
+
+// ------------------------------ nodes -------------------------------------
+
+typedef double (*kernel_function_t)(const float*x, const float*y, int size, double offset);
+
+static void kernel_eval_children(node_t*n, environment_t* env, float*x)
+{
+    int t;
+    for(t=0;t<n->num_children;t++) {
+        node_t*child = n->child[t];
+        if(child->type->eval_float) {
+            x[t] = node_eval_float(child, env);
+        } else {
+            constant_t c = node_eval_child(child, env);
+            x[t] = AS_FLOAT(c);
+        }
+    }
+}
+
+static double kernel_eval(node_t*n, environment_t* env, kernel_function_t function)
+{
+    kernel_t*k = (kernel_t*)n->data;
+    double offset = k->has_offset && !k->offset_last ? k->offset : 0.0;
+    double sum;
+    if(n->num_children <= KERNEL_STACK_SIZE) {
+        float x[KERNEL_STACK_SIZE];
+        kernel_eval_children(n, env, x);
+        sum = function(x, k->vector, n->num_children, offset);
+    } else {
+        float*x = (float*)malloc(sizeof(float)*n->num_children);
+        kernel_eval_children(n, env, x);
+        sum = function(x, k->vector, n->num_children, offset);
+        free(x);
+    }
+    if(k->has_offset && k->offset_last)
+        sum += k->offset;
+    return sum;
+}
+
+constant_t node_dot_product_eval(node_t*n, environment_t* env)
+{
+    return float_constant(kernel_eval(n, env, kernel_dot_product));
+}
+float node_dot_product_eval_float(node_t*n, environment_t* env)
+{
+    return kernel_eval(n, env, kernel_dot_product);
+}
+nodetype_t node_dot_product =
+{
+name:"dot_product",
+flags:NODE_FLAG_HAS_CHILDREN|NODE_FLAG_HAS_DATA,
+eval: node_dot_product_eval,
+eval_float: node_dot_product_eval_float,
+min_args:0,
+max_args:INT_MAX,
+};
+
+constant_t node_squared_distance_eval(node_t*n, environment_t* env)
+{
+    return float_constant(kernel_eval(n, env, kernel_squared_distance));
+}
+float node_squared_distance_eval_float(node_t*n, environment_t* env)
+{
+    return kernel_eval(n, env, kernel_squared_distance);
+}
+nodetype_t node_squared_distance =
+{
+name:"squared_distance",
+flags:NODE_FLAG_HAS_CHILDREN|NODE_FLAG_HAS_DATA,
+eval: node_squared_distance_eval,
+eval_float: node_squared_distance_eval_float,
+min_args:0,
+max_args:INT_MAX,
+};
+
+// ------------------------------ expansion ---------------------------------
+
+node_t* kernel_expand(node_t*n)
+{
+    kernel_t*k = (kernel_t*)n->data;
+    int t;
+
+    START_CODE(code)
+    ADD
+        if(k->has_offset && !k->offset_last) {
+            FLOAT_CONSTANT(k->offset);
+        }
+        for(t=0;t<k->size;t++) {
+            if(n->type == &node_dot_product) {
+                MUL
+                    INSERT_NODE(node_duplicate(n->child[t]));
+                    FLOAT_CONSTANT(k->vector[t]);
+                END;
+            } else {
+                SQR
+                    SUB
+                        FLOAT_CONSTANT(k->vector[t]);
+                        INSERT_NODE(node_duplicate(n->child[t]));
+                    END;
+                END;
+            }
+        }
+        if(k->has_offset && k->offset_last) {
+            FLOAT_CONSTANT(k->offset);
+        }
+    END;
+    END_CODE;
+    return code;
+}
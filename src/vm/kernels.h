@@ -0,0 +1,74 @@
+/* kernels.h
+   Dot products and squared distances over packed float vectors.
+
+   Part of the data prediction package.
+
+   Copyright (c) 2011 Matthias Kramm <kramm@quiss.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+
+#ifndef __kernels_h__
+#define __kernels_h__
+
+#include "ast.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* node_dot_product computes
+
+       offset + x[0]*v[0] + x[1]*v[1] + ...
+
+   and node_squared_distance
+
+       offset + (v[0]-x[0])^2 + (v[1]-x[1])^2 + ...
+
+   with x[i] the value of the i-th child, and the v[i] packed into a
+   float array. Like node_add, sums are accumulated in double precision,
+   so the offset is added where the sum had it: first, or (offset_last)
+   after the other terms.
+   Both are created by node_recognize_kernels() from the equivalent
+   add/mul/sqr/sub trees, and expanded back into those for code
+   generation. */
+
+typedef struct _kernel {
+    float*vector;
+    int size;
+    bool has_offset;
+    bool offset_last;
+    float offset;
+    /* vector points into a mapped model file */
+    bool mapped;
+} kernel_t;
+
+kernel_t* kernel_new(int size);
+kernel_t* kernel_duplicate(kernel_t*k);
+void kernel_destroy(kernel_t*k);
+
+/* takes ownership of the kernel and the children */
+node_t* node_new_kernel(nodetype_t*type, kernel_t*k, node_t**children);
+
+/* offset + the sum of x[i]*y[i] resp. (y[i]-x[i])^2 */
+double kernel_dot_product(const float*x, const float*y, int size, double offset);
+double kernel_squared_distance(const float*x, const float*y, int size, double offset);
+
+node_t* kernel_expand(node_t*n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,356 @@
+/* native.c
+   Compile models to machine code, using the C code generator and
+   the system compiler.
+
+   Part of the data prediction package.
+
+   Copyright (c) 2011 Matthias Kramm <kramm@quiss.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <dlfcn.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "native.h"
+#include "codegen.h"
+#include "ast_transforms.h"
+#include "datacache.h"
+#include "settings.h"
+#include "util.h"
+#include "io.h"
+
+/* bump this whenever the generated code or the calling convention
+   changes, to invalidate shared objects in the cache */
+#define NATIVE_VERSION "1"
+
+static const char* variable_field(constant_type_t type)
+{
+    switch(type) {
+        case CONSTANT_FLOAT:
+            return "value";
+        case CONSTANT_INT:
+        case CONSTANT_CATEGORY:
+        case CONSTANT_BOOL:
+            return "category";
+        case CONSTANT_STRING:
+            return "text";
+        default:
+            return NULL;
+    }
+}
+
+static bool node_uses_param(node_t*n, int var)
+{
+    if(n->type == &node_param && n->value.i == var)
+        return true;
+    int t;
+    for(t=0;t<n->num_children;t++) {
+        if(node_uses_param(n->child[t], var))
+            return true;
+    }
+    return false;
+}
+
+/* Glue between predict(), which takes one argument per input, and
+   native_predict_func_t. mrscake_variable_t mirrors the layout of
+   variable_t. */
+static char* native_wrapper(native_t*n, model_t*m)
+{
+    state_t s;
+    memset(&s, 0, sizeof(s));
+    s.model = m;
+    s.writer = growingmemwriter_new();
+    strf(&s, "\n");
+    strf(&s, "typedef struct {\n");
+    strf(&s, "    int type;\n");
+    strf(&s, "    union {\n");
+    strf(&s, "        int category;\n");
+    strf(&s, "        float value;\n");
+    strf(&s, "        const char*text;\n");
+    strf(&s, "    } v;\n");
+    strf(&s, "} mrscake_variable_t;\n");
+    strf(&s, "\n");
+    strf(&s, "void mrscake_predict(const mrscake_variable_t*in, mrscake_variable_t*out)\n");
+    strf(&s, "{\n");
+    strf(&s, "    out->v.%s = predict(", variable_field(n->result_type));
+    int i;
+    for(i=0;i<n->num_inputs;i++) {
+        if(i)
+            strf(&s, ", ");
+        strf(&s, "in[%d].v.%s", i, variable_field(c_param_type(m, i)));
+    }
+    strf(&s, ");\n");
+    strf(&s, "}\n");
+    write_uint8(s.writer, 0);
+    char*wrapper = writer_growmemwrite_getmem(s.writer, 0);
+    s.writer->finish(s.writer);
+    return wrapper;
+}
+
+/* config_native_cache_directory, or a directory in the user's cache
+   directory. Returns NULL if there's neither. */
+static char* native_cache_directory()
+{
+    if(config_native_cache_directory) {
+        return strdup(config_native_cache_directory);
+    }
+    const char*xdg = getenv("XDG_CACHE_HOME");
+    if(xdg && *xdg) {
+        return concat_paths(xdg, "mrscake/native");
+    }
+    const char*home = getenv("HOME");
+    if(home && *home) {
+        return concat_paths(home, ".cache/mrscake/native");
+    }
+    fprintf(stderr, "Neither native_cache_directory nor $HOME are set\n");
+    return NULL;
+}
+
+/* Shared objects are executed, so only trust files and directories
+   nobody but us could have put there. */
+static bool is_private(const char*path, bool directory)
+{
+    struct stat sb;
+    if((directory ? stat(path, &sb) : lstat(path, &sb)) != 0) {
+        perror(path);
+        return false;
+    }
+    if(directory ? !S_ISDIR(sb.st_mode) : !S_ISREG(sb.st_mode)) {
+        fprintf(stderr, "%s is not a %s\n", path, directory ? "directory" : "regular file");
+        return false;
+    }
+    if(sb.st_uid != geteuid() || (sb.st_mode & (S_IWGRP|S_IWOTH))) {
+        fprintf(stderr, "Not using %s: it's not owned by us, or writable by others\n", path);
+        return false;
+    }
+    return true;
+}
+
+static bool run_compiler(const char*object, const char*source)
+{
+    const char*argv[] = {config_native_compiler, "-O2", "-w", "-shared", "-fPIC",
+                         "-o", object, source, "-lm", NULL};
+    if(config_verbosity > 1) {
+        int i;
+        for(i=0;argv[i];i++) {
+            printf(i ? " %s" : "%s", argv[i]);
+        }
+        printf("\n");
+    }
+    fflush(stdout);
+    pid_t pid = fork();
+    if(pid < 0) {
+        perror("fork");
+        return false;
+    }
+    if(!pid) {
+        execvp(argv[0], (char*const*)argv);
+        perror(argv[0]);
+        _exit(127);
+    }
+    int status;
+    while(waitpid(pid, &status, 0) < 0) {
+        if(errno != EINTR) {
+            perror("waitpid");
+            return false;
+        }
+    }
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+static char* native_filename(const char*directory, const char*code, const char*wrapper)
+{
+    writer_t*w = sha1writer_new();
+    write_string(w, NATIVE_VERSION);
+    write_string(w, config_native_compiler);
+    write_string(w, code);
+    write_string(w, wrapper);
+    uint8_t*hash = writer_sha1_get(w);
+    w->finish(w);
+
+    char*hash_str = hash_to_string(hash);
+    char*basename = allocprintf("%s.so", hash_str);
+    char*filename = concat_paths(directory, basename);
+    free(basename);
+    free(hash_str);
+    free(hash);
+    return filename;
+}
+
+static bool native_build(const char*filename, const char*code, const char*wrapper)
+{
+    /* compile to a private file first, so that concurrent processes
+       never load a half written shared object */
+    char*source = allocprintf("%s.%d.c", filename, getpid());
+    char*object = allocprintf("%s.%d.tmp", filename, getpid());
+
+    bool ok = false;
+    FILE*fi = fopen(source, "wb");
+    if(!fi) {
+        perror(source);
+    } else {
+        fputs(code, fi);
+        fputs(wrapper, fi);
+        fclose(fi);
+
+        if(!run_compiler(object, source)) {
+            fprintf(stderr, "Couldn't compile %s\n", source);
+        } else if(chmod(object, 0700) != 0 || rename(object, filename) != 0) {
+            perror(filename);
+        } else {
+            ok = true;
+        }
+        unlink(source);
+        unlink(object);
+    }
+    free(source);
+    free(object);
+    return ok;
+}
+
+native_t* native_compile(model_t*m)
+{
+    if(!m->sig->column_types) {
+        return NULL;
+    }
+    /* types have to be derived from the code the way the code
+       generator sees it */
+    model_t prepared = *m;
+    prepared.code = node_prepare_for_code_generation(node_duplicate((node_t*)m->code));
+
+    native_t*n = (native_t*)calloc(1, sizeof(native_t));
+    n->num_inputs = m->sig->num_inputs;
+    n->input_types = (columntype_t*)calloc(n->num_inputs, sizeof(columntype_t));
+    n->result_type = node_type((node_t*)prepared.code, &prepared);
+    if(!variable_field(n->result_type)) {
+        node_destroy((node_t*)prepared.code);
+        native_destroy(n);
+        return NULL;
+    }
+    int i;
+    for(i=0;i<n->num_inputs;i++) {
+        if(!node_uses_param((node_t*)prepared.code, i)) {
+            /* any value will do */
+            n->input_types[i] = MISSING;
+            continue;
+        }
+        switch(c_param_type(&prepared, i)) {
+            case CONSTANT_FLOAT:
+                n->input_types[i] = CONTINUOUS;
+            break;
+            case CONSTANT_CATEGORY:
+                n->input_types[i] = CATEGORICAL;
+            break;
+            case CONSTANT_STRING:
+                n->input_types[i] = TEXT;
+            break;
+            default:
+                node_destroy((node_t*)prepared.code);
+                native_destroy(n);
+                return NULL;
+        }
+    }
+
+    char*directory = native_cache_directory();
+    if(directory) {
+        mkdir_p(directory);
+    }
+    if(!directory || !is_private(directory, true)) {
+        node_destroy((node_t*)prepared.code);
+        native_destroy(n);
+        free(directory);
+        return NULL;
+    }
+
+    char*code = generate_code(&codegen_c, m);
+    char*wrapper = native_wrapper(n, &prepared);
+    node_destroy((node_t*)prepared.code);
+    char*filename = native_filename(directory, code, wrapper);
+    free(directory);
+
+    struct stat sb;
+    if(lstat(filename, &sb) != 0) {
+        native_build(filename, code, wrapper);
+    }
+    free(code);
+    free(wrapper);
+
+    if(!is_private(filename, false)) {
+        free(filename);
+        native_destroy(n);
+        return NULL;
+    }
+    n->handle = dlopen(filename, RTLD_NOW|RTLD_LOCAL);
+    if(!n->handle) {
+        fprintf(stderr, "Couldn't load %s: %s\n", filename, dlerror());
+        free(filename);
+        native_destroy(n);
+        return NULL;
+    }
+    free(filename);
+
+    n->predict = (native_predict_func_t)dlsym(n->handle, "mrscake_predict");
+    if(!n->predict) {
+        fprintf(stderr, "%s\n", dlerror());
+        native_destroy(n);
+        return NULL;
+    }
+    return n;
+}
+
+bool native_run(native_t*n, row_t*row, constant_t*result)
+{
+    int i;
+    for(i=0;i<n->num_inputs;i++) {
+        if(row->inputs[i].type != n->input_types[i] && n->input_types[i] != MISSING)
+            return false;
+    }
+    variable_t out;
+    n->predict(row->inputs, &out);
+    switch(n->result_type) {
+        case CONSTANT_FLOAT:
+            *result = float_constant(out.value);
+        break;
+        case CONSTANT_INT:
+            *result = int_constant(out.category);
+        break;
+        case CONSTANT_CATEGORY:
+            *result = category_constant(out.category);
+        break;
+        case CONSTANT_BOOL:
+            *result = bool_constant(out.category);
+        break;
+        case CONSTANT_STRING:
+            *result = string_constant(out.text);
+        break;
+        default:
+            return false;
+    }
+    return true;
+}
+
+void native_destroy(native_t*n)
+{
+    if(n->handle)
+        dlclose(n->handle);
+    free(n->input_types);
+    free(n);
+}
@@ -0,0 +1,65 @@
+/* native.h
+   Compile models to machine code, using the C code generator and
+   the system compiler.
+
+   Part of the data prediction package.
+
+   Copyright (c) 2011 Matthias Kramm <kramm@quiss.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+
+#ifndef __native_h__
+#define __native_h__
+
+#include "mrscake.h"
+#include "constant.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef void (*native_predict_func_t)(const variable_t*inputs, variable_t*result);
+
+typedef struct _native {
+    void*handle;
+    native_predict_func_t predict;
+
+    /* input types the compiled function was generated for. Rows with
+       other (e.g. missing) values need to go through the interpreter.
+       MISSING marks inputs the model doesn't use. */
+    int num_inputs;
+    columntype_t*input_types;
+
+    constant_type_t result_type;
+} native_t;
+
+/* Generate C code for the model and load it as a shared object. The object
+   is stored in config_native_cache_directory (default:
+   $XDG_CACHE_HOME/mrscake/native or ~/.cache/mrscake/native), under a hash
+   of the code, so that a model is only compiled once. The directory and
+   the object have to belong to the current user and mustn't be writable
+   by anyone else. Returns NULL if the model can't be compiled. */
+native_t* native_compile(model_t*m);
+
+/* Returns false if the row doesn't match the compiled function's signature. */
+bool native_run(native_t*n, row_t*row, constant_t*result);
+
+void native_destroy(native_t*n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,459 @@
+/* neighbors.c
+   k-nearest-neighbor classification over a packed, indexed training set.
+
+   Part of the data prediction package.
+
+   Copyright (c) 2011 Matthias Kramm <kramm@quiss.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <assert.h>
+#include "neighbors.h"
+#include "kernels.h"
+#include "easy_ast.h"
+
+/* ranges with at most this many rows aren't split any further */
+#define KNN_LEAF_SIZE 8
+/* evaluations needing less floats than this don't allocate memory */
+#define KNN_STACK_SIZE 256
+
+knn_t* knn_new(int k, int dim, array_t*classes)
+{
+    knn_t*knn = (knn_t*)calloc(1, sizeof(knn_t));
+    knn->k = k;
+    knn->dim = dim;
+    knn->classes = classes;
+    return knn;
+}
+
+void knn_add_row(knn_t*knn, int cls, float*row)
+{
+    assert(cls >= 0 && cls < knn->classes->size);
+    int size = knn->num_rows;
+    if(!size || !(size&(size-1))) {
+        /* grow to the next power of two */
+        int new_size = size ? size*2 : 16;
+        knn->rows = (float*)realloc(knn->rows, sizeof(float)*knn->dim*new_size + 1);
+        knn->row_class = (int32_t*)realloc(knn->row_class, sizeof(int32_t)*new_size);
+    }
+    memcpy(&knn->rows[knn->num_rows*knn->dim], row, sizeof(float)*knn->dim);
+    knn->row_class[knn->num_rows++] = cls;
+}
+
+// ------------------------------ kd-trees ----------------------------------
+
+static inline float row_value(knn_t*knn, int32_t*order, int i, int d)
+{
+    return knn->rows[order[i]*knn->dim + d];
+}
+
+/* rearrange order[lo...hi-1] such that the row at position m is the one
+   that would be there if the range was sorted by dimension d */
+static void select_row(knn_t*knn, int32_t*order, int lo, int hi, int m, int d)
+{
+    hi--;
+    while(lo < hi) {
+        float pivot = row_value(knn, order, (lo+hi)/2, d);
+        int i = lo, j = hi;
+        while(i <= j) {
+            while(row_value(knn, order, i, d) < pivot)
+                i++;
+            while(row_value(knn, order, j, d) > pivot)
+                j--;
+            if(i <= j) {
+                int32_t tmp = order[i];
+                order[i] = order[j];
+                order[j] = tmp;
+                i++;
+                j--;
+            }
+        }
+        if(m <= j) {
+            hi = j;
+        } else if(m >= i) {
+            lo = i;
+        } else {
+            break;
+        }
+    }
+}
+
+static void build_tree(knn_t*knn, int32_t*order, int lo, int hi)
+{
+    if(hi - lo <= KNN_LEAF_SIZE || !knn->dim)
+        return;
+    int best_dim = 0;
+    float best_spread = -1;
+    int d, i;
+    for(d=0;d<knn->dim;d++) {
+        float min = row_value(knn, order, lo, d);
+        float max = min;
+        for(i=lo+1;i<hi;i++) {
+            float v = row_value(knn, order, i, d);
+            if(v < min) min = v;
+            if(v > max) max = v;
+        }
+        if(max - min > best_spread) {
+            best_spread = max - min;
+            best_dim = d;
+        }
+    }
+    int m = (lo+hi)/2;
+    select_row(knn, order, lo, hi, m, best_dim);
+    knn->split[m] = best_dim;
+    build_tree(knn, order, lo, m);
+    build_tree(knn, order, m+1, hi);
+}
+
+void knn_build(knn_t*knn)
+{
+    int num_classes = knn->classes->size;
+    int dim = knn->dim;
+    knn->class_start = (int32_t*)calloc(num_classes+1, sizeof(int32_t));
+    int i, c;
+    for(i=0;i<knn->num_rows;i++) {
+        knn->class_start[knn->row_class[i]+1]++;
+    }
+    for(c=0;c<num_classes;c++) {
+        knn->class_start[c+1] += knn->class_start[c];
+    }
+
+    /* group rows by class, keeping their order */
+    int32_t*order = (int32_t*)malloc(sizeof(int32_t)*(knn->num_rows+1));
+    int32_t*pos = (int32_t*)malloc(sizeof(int32_t)*(num_classes+1));
+    memcpy(pos, knn->class_start, sizeof(int32_t)*num_classes);
+    for(i=0;i<knn->num_rows;i++) {
+        order[pos[knn->row_class[i]]++] = i;
+    }
+    free(pos);
+
+    knn->split = (int32_t*)malloc(sizeof(int32_t)*(knn->num_rows+1));
+    for(i=0;i<knn->num_rows;i++) {
+        knn->split[i] = -1;
+    }
+    for(c=0;c<num_classes;c++) {
+        build_tree(knn, order, knn->class_start[c], knn->class_start[c+1]);
+    }
+
+    float*rows = (float*)malloc(sizeof(float)*dim*knn->num_rows + 1);
+    for(i=0;i<knn->num_rows;i++) {
+        memcpy(&rows[i*dim], &knn->rows[order[i]*dim], sizeof(float)*dim);
+    }
+    free(order);
+    free(knn->rows);
+    knn->rows = rows;
+    free(knn->row_class);
+    knn->row_class = 0;
+}
+
+knn_t* knn_duplicate(knn_t*knn)
+{
+    int num_classes = knn->classes->size;
+    knn_t*d = knn_new(knn->k, knn->dim, array_duplicate(knn->classes));
+    d->num_rows = knn->num_rows;
+    d->rows = (float*)malloc(sizeof(float)*knn->dim*knn->num_rows + 1);
+    memcpy(d->rows, knn->rows, sizeof(float)*knn->dim*knn->num_rows);
+    d->split = (int32_t*)malloc(sizeof(int32_t)*(knn->num_rows+1));
+    memcpy(d->split, knn->split, sizeof(int32_t)*knn->num_rows);
+    d->class_start = (int32_t*)malloc(sizeof(int32_t)*(num_classes+1));
+    memcpy(d->class_start, knn->class_start, sizeof(int32_t)*(num_classes+1));
+    return d;
+}
+
+void knn_destroy(knn_t*knn)
+{
+    array_destroy(knn->classes);
+    if(!knn->mapped) {
+        free(knn->class_start);
+        free(knn->rows);
+        free(knn->split);
+    }
+    free(knn->row_class);
+    free(knn);
+}
+
+node_t* node_new_knearest(knn_t*knn)
+{
+    node_t*n = node_new(&node_knearest, 0);
+    n->data = knn;
+    int t;
+    for(t=0;t<knn->dim;t++) {
+        node_append_child(n, node_new_with_args(&node_param, t));
+    }
+    return n;
+}
+
+// ------------------------------ search ------------------------------------
+
+/* max-heap of the smallest distances seen so far */
+typedef struct _heap {
+    float*values;
+    int size;
+    int max_size;
+} heap_t;
+
+static void heap_add(heap_t*h, float v)
+{
+    float*values = h->values;
+    int i;
+    if(h->size < h->max_size) {
+        i = h->size++;
+        while(i > 0 && values[(i-1)/2] < v) {
+            values[i] = values[(i-1)/2];
+            i = (i-1)/2;
+        }
+        values[i] = v;
+        return;
+    }
+    if(!(v < values[0]))
+        return;
+    i = 0;
+    while(1) {
+        int child = i*2+1;
+        if(child >= h->size)
+            break;
+        if(child+1 < h->size && values[child+1] > values[child])
+            child++;
+        if(!(values[child] > v))
+            break;
+        values[i] = values[child];
+        i = child;
+    }
+    values[i] = v;
+}
+
+static void heap_sort(heap_t*h)
+{
+    /* heaps are small (k+1 entries), so insertion sort it is */
+    float*values = h->values;
+    int i, j;
+    for(i=1;i<h->size;i++) {
+        float v = values[i];
+        for(j=i;j>0 && values[j-1] > v;j--) {
+            values[j] = values[j-1];
+        }
+        values[j] = v;
+    }
+}
+
+static inline float row_distance(knn_t*knn, int i, const float*x)
+{
+    return kernel_squared_distance(x, &knn->rows[i*knn->dim], knn->dim, 0.0);
+}
+
+static void search_tree(knn_t*knn, const float*x, int lo, int hi, heap_t*h)
+{
+    while(hi - lo > KNN_LEAF_SIZE && knn->dim) {
+        int m = (lo+hi)/2;
+        int d = knn->split[m];
+        heap_add(h, row_distance(knn, m, x));
+        /* rows on the far side of the split are at least diff away in
+           dimension d (and also when calculated in single precision) */
+        float diff = x[d] - knn->rows[m*knn->dim + d];
+        int far_lo, far_hi;
+        if(diff <= 0) {
+            search_tree(knn, x, lo, m, h);
+            far_lo = m+1;
+            far_hi = hi;
+        } else {
+            search_tree(knn, x, m+1, hi, h);
+            far_lo = lo;
+            far_hi = m;
+        }
+        if(h->size == h->max_size && diff*diff > h->values[0])
+            return;
+        lo = far_lo;
+        hi = far_hi;
+    }
+    int i;
+    for(i=lo;i<hi;i++) {
+        heap_add(h, row_distance(knn, i, x));
+    }
+}
+
+constant_t node_knearest_eval(node_t*n, environment_t* env)
+{
+    knn_t*knn = (knn_t*)n->data;
+    int num_classes = knn->classes->size;
+    int k1 = knn->k+1;
+    int size = knn->dim + num_classes*k1;
+
+    float _buffer[KNN_STACK_SIZE];
+    float*buffer = _buffer;
+    if(size > KNN_STACK_SIZE) {
+        buffer = (float*)malloc(sizeof(float)*size);
+    }
+    float*x = buffer;
+    float*distances = buffer + knn->dim;
+
+    int t;
+    for(t=0;t<n->num_children;t++) {
+        constant_t c = node_eval_child(n->child[t], env);
+        x[t] = AS_FLOAT(c);
+    }
+
+    /* the k+1 smallest distances of every class, in ascending order */
+    int c;
+    for(c=0;c<num_classes;c++) {
+        heap_t h = {distances + c*k1, 0, k1};
+        search_tree(knn, x, knn->class_start[c], knn->class_start[c+1], &h);
+        heap_sort(&h);
+    }
+
+    /* vote, by repeatedly taking the nearest row not used yet. A class with
+       no rows left keeps offering its farthest row (like the generic code) */
+    int _pos[64];
+    int*pos = num_classes > 64 ? (int*)malloc(sizeof(int)*num_classes) : _pos;
+    memset(pos, 0, sizeof(int)*num_classes);
+    int i;
+    for(i=0;i<knn->k;i++) {
+        int best = 0;
+        float min = distances[pos[0]];
+        for(c=1;c<num_classes;c++) {
+            float d = distances[c*k1 + pos[c]];
+            if(d < min) {
+                min = d;
+                best = c;
+            }
+        }
+        if(pos[best] < knn->class_start[best+1] - knn->class_start[best] - 1)
+            pos[best]++;
+    }
+    int best = 0;
+    for(c=1;c<num_classes;c++) {
+        if(pos[c] >= pos[best])
+            best = c;
+    }
+
+    if(pos != _pos)
+        free(pos);
+    if(buffer != _buffer)
+        free(buffer);
+    return knn->classes->entries[best];
+}
+nodetype_t node_knearest =
+{
+name:"knearest",
+flags:NODE_FLAG_HAS_CHILDREN|NODE_FLAG_HAS_DATA,
+eval: node_knearest_eval,
+min_args:0,
+max_args:INT_MAX,
+};
+
+// ------------------------------ expansion ---------------------------------
+
+node_t* knn_expand(node_t*n, int*next_local)
+{
+    knn_t*knn = (knn_t*)n->data;
+    int num_classes = knn->classes->size;
+    int base = *next_local;
+    int position_var = base+num_classes;
+    int class_count_minus_one_var = base+num_classes+1;
+    int best_class = base+num_classes+2;
+    int loop_counter = base+num_classes+3;
+    *next_local += num_classes+4;
+    int cls, i, j;
+
+    START_CODE(code)
+    BLOCK
+        for(cls=0;cls<num_classes;cls++) {
+            SETLOCAL(base+cls);
+                NEW_ZERO_FLOAT_ARRAY(knn->class_start[cls+1] - knn->class_start[cls]);
+            END;
+        }
+        for(cls=0;cls<num_classes;cls++) {
+            for(i=knn->class_start[cls];i<knn->class_start[cls+1];i++) {
+                SET_ARRAY_AT_POS
+                    GETLOCAL(base+cls);
+                    INT_CONSTANT(i - knn->class_start[cls]);
+                    ADD
+                    for(j=0;j<knn->dim;j++) {
+                        SQR
+                            SUB
+                                FLOAT_CONSTANT(knn->rows[i*knn->dim + j]);
+                                INSERT_NODE(node_duplicate(n->child[j]));
+                            END;
+                        END;
+                    }
+                    END;
+                END;
+            }
+        }
+        for(cls=0;cls<num_classes;cls++) {
+            SORT_FLOAT_ARRAY_ASC
+                GETLOCAL(base+cls);
+            END;
+        }
+        SETLOCAL(position_var);
+            NEW_ZERO_INT_ARRAY(num_classes);
+        END;
+        SETLOCAL(class_count_minus_one_var);
+            array_t*a = array_new(num_classes);
+            for(cls=0;cls<num_classes;cls++) {
+                a->entries[cls] = int_constant(knn->class_start[cls+1] - knn->class_start[cls] - 1);
+            }
+            ARRAY_CONSTANT(a);
+        END;
+        FOR_LOCAL_FROM_N_TO_M(loop_counter)
+            INT_CONSTANT(0);
+            INT_CONSTANT(knn->k);
+            BLOCK
+                SETLOCAL(best_class);
+                    ARG_MIN_F
+                        for(cls=0;cls<num_classes;cls++) {
+                            ARRAY_AT_POS
+                                GETLOCAL(base+cls);
+                                ARRAY_AT_POS
+                                    GETLOCAL(position_var);
+                                    INT_CONSTANT(cls);
+                                END;
+                            END;
+                        }
+                    END;
+                END;
+                IF
+                    LT_I
+                        ARRAY_AT_POS
+                            GETLOCAL(position_var);
+                            GETLOCAL(best_class);
+                        END;
+                        ARRAY_AT_POS
+                            GETLOCAL(class_count_minus_one_var);
+                            GETLOCAL(best_class);
+                        END;
+                    END;
+                THEN
+                    INC_ARRAY_AT_POS
+                        GETLOCAL(position_var);
+                        GETLOCAL(best_class);
+                    END;
+                ELSE
+                    NOP;
+                END;
+            END;
+        END;
+        ARRAY_AT_POS
+            ARRAY_CONSTANT(array_duplicate(knn->classes));
+            ARRAY_ARG_MAX_I
+                GETLOCAL(position_var);
+            END;
+        END;
+    END;
+    END_CODE;
+    return code;
+}
@@ -0,0 +1,83 @@
+/* neighbors.h
+   k-nearest-neighbor classification over a packed, indexed training set.
+
+   Part of the data prediction package.
+
+   Copyright (c) 2011 Matthias Kramm <kramm@quiss.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+
+#ifndef __neighbors_h__
+#define __neighbors_h__
+
+#include "ast.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* A knearest node keeps the training rows of every class in one float
+   matrix, with each class's rows arranged as an implicit kd-tree
+   (the median row of a range splits it, along the dimension with the
+   biggest spread). The children of the node are the features.
+
+   Prediction only needs the k+1 smallest distances of every class, which
+   are found with a bounded heap while walking the kd-trees. The vote
+   that follows is the same as in the generic AST (see knn_expand()),
+   which is what the node is expanded to for code generation. */
+
+typedef struct _knn {
+    int k;
+    int dim;
+
+    array_t*classes;
+
+    /* rows of class c are rows class_start[c] ... class_start[c+1]-1 */
+    int32_t*class_start;
+    int num_rows;
+    float*rows;
+
+    /* dimension the row at this position splits its range along */
+    int32_t*split;
+
+    /* while building: the class of each row */
+    int32_t*row_class;
+
+    /* class_start, rows and split point into a mapped model file */
+    bool mapped;
+} knn_t;
+
+/* takes ownership of the classes array. Add rows with knn_add_row(),
+   then call knn_build(). */
+knn_t* knn_new(int k, int dim, array_t*classes);
+void knn_add_row(knn_t*knn, int cls, float*row);
+void knn_build(knn_t*knn);
+
+knn_t* knn_duplicate(knn_t*knn);
+void knn_destroy(knn_t*knn);
+
+/* creates the node, with one param child per dimension. Takes ownership
+   of the knn. */
+node_t* node_new_knearest(knn_t*knn);
+
+/* the generic AST for a knearest node. Allocates new locals starting
+   at *next_local. */
+node_t* knn_expand(node_t*n, int*next_local);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
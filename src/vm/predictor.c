@@ -0,0 +1,159 @@
+/* predictor.c
+   Per-thread evaluation state for models.
+
+   Part of the data prediction package.
+
+   Copyright (c) 2011 Matthias Kramm <kramm@quiss.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+
+#include <stdlib.h>
+#include <pthread.h>
+#include "predictor.h"
+#include "model.h"
+#include "settings.h"
+
+static pthread_mutex_t compile_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+bytecode_t* model_get_bytecode(model_t*m)
+{
+    pthread_mutex_lock(&compile_mutex);
+    if(!m->bytecode) {
+        m->bytecode = bytecode_compile((node_t*)m->code);
+    }
+    pthread_mutex_unlock(&compile_mutex);
+    return (bytecode_t*)m->bytecode;
+}
+
+native_t* model_get_native(model_t*m)
+{
+    pthread_mutex_lock(&compile_mutex);
+    if(!m->native) {
+        native_t*n = native_compile(m);
+        /* remember failures, too, so that we don't try again */
+        m->native = n ? n : calloc(1, sizeof(native_t));
+    }
+    pthread_mutex_unlock(&compile_mutex);
+    native_t*n = (native_t*)m->native;
+    return n->predict ? n : NULL;
+}
+
+predictor_t* predictor_new(model_t*m)
+{
+    predictor_t*p = (predictor_t*)calloc(1, sizeof(predictor_t));
+    p->model = m;
+    p->bytecode = model_get_bytecode(m);
+    if(config_native_compilation) {
+        p->native = model_get_native(m);
+    }
+    p->registers = bytecode_registers_new(p->bytecode);
+    p->row = row_new(m->sig->num_inputs);
+    return p;
+}
+
+constant_t predictor_eval(predictor_t*p, input_t*input)
+{
+    /* datasets are only evaluated during training, and would need their
+       categories converted to strings first */
+    if(p->native && !input->dataset) {
+        constant_t c;
+        if(native_run(p->native, input_get_row(input), &c))
+            return c;
+    }
+    return bytecode_run(p->bytecode, p->registers, input);
+}
+
+/* Like constant_to_variable(), but doesn't touch the (global) string pool.
+   Text results point to strings owned by the model or the input. */
+static variable_t result_to_variable(constant_t*c)
+{
+    variable_t v;
+    switch(c->type) {
+        case CONSTANT_STRING:
+            v.type = TEXT;
+            v.text = c->s;
+            return v;
+        case CONSTANT_CATEGORY:
+            return variable_new_categorical(c->c);
+        case CONSTANT_FLOAT:
+            return variable_new_continuous(c->f);
+        case CONSTANT_INT:
+            return variable_new_continuous(c->i);
+        default:
+            return variable_new_missing();
+    }
+}
+
+variable_t predictor_predict(predictor_t*p, row_t*row)
+{
+    input_t input;
+    input_init_row(&input, row);
+    constant_t c = predictor_eval(p, &input);
+    return result_to_variable(&c);
+}
+
+void predictor_predict_batch(predictor_t*p, variable_t**columns, int num_rows, variable_t*out)
+{
+    input_t input;
+    input_init_columns(&input, columns, p->row);
+    int y;
+    for(y=0;y<num_rows;y++) {
+        input_set_position(&input, y);
+        constant_t c = predictor_eval(p, &input);
+        out[y] = result_to_variable(&c);
+    }
+    input_clear(&input);
+}
+
+void predictor_destroy(predictor_t*p)
+{
+    bytecode_registers_destroy(p->bytecode, p->registers);
+    row_destroy(p->row);
+    free(p);
+}
+
+predictor_t* model_acquire_predictor(model_t*m)
+{
+    pthread_mutex_lock(&pool_mutex);
+    predictor_t*p = (predictor_t*)m->predictor;
+    if(p) {
+        m->predictor = p->next;
+    }
+    pthread_mutex_unlock(&pool_mutex);
+    if(!p) {
+        p = predictor_new(m);
+    }
+    return p;
+}
+
+void model_release_predictor(model_t*m, predictor_t*p)
+{
+    pthread_mutex_lock(&pool_mutex);
+    p->next = (predictor_t*)m->predictor;
+    m->predictor = p;
+    pthread_mutex_unlock(&pool_mutex);
+}
+
+void model_destroy_predictors(model_t*m)
+{
+    predictor_t*p = (predictor_t*)m->predictor;
+    while(p) {
+        predictor_t*next = p->next;
+        predictor_destroy(p);
+        p = next;
+    }
+    m->predictor = NULL;
+}
@@ -0,0 +1,64 @@
+/* predictor.h
+   Per-thread evaluation state for models.
+
+   Part of the data prediction package.
+
+   Copyright (c) 2011 Matthias Kramm <kramm@quiss.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+
+#ifndef __predictor_h__
+#define __predictor_h__
+
+#include "mrscake.h"
+#include "bytecode.h"
+#include "native.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct _predictor {
+    model_t*model;
+    bytecode_t*bytecode;
+    native_t*native;
+
+    /* locals, constants (with private copies of scratch arrays) and
+       temporaries */
+    constant_t*registers;
+
+    /* buffer for column input */
+    row_t*row;
+
+    /* next idle predictor of the same model */
+    struct _predictor*next;
+};
+
+bytecode_t* model_get_bytecode(model_t*m);
+native_t* model_get_native(model_t*m);
+constant_t predictor_eval(predictor_t*p, input_t*input);
+
+/* Borrow evaluation state for one call of model_predict() and friends.
+   Every concurrent caller gets its own registers, all of them running the
+   model's shared bytecode. Released predictors are kept for reuse. */
+predictor_t* model_acquire_predictor(model_t*m);
+void model_release_predictor(model_t*m, predictor_t*p);
+void model_destroy_predictors(model_t*m);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
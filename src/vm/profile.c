@@ -0,0 +1,233 @@
+/* profile.c
+   Per-node execution profiles of ast programs.
+
+   Part of the data prediction package.
+
+   Copyright (c) 2011 Matthias Kramm <kramm@quiss.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "profile.h"
+#include "forest.h"
+#include "environment.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#define HAVE_RDTSC
+#endif
+
+static inline uint64_t profile_ticks()
+{
+#ifdef HAVE_RDTSC
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec*1000000000ull + ts.tv_nsec;
+#endif
+}
+
+/* The nodes of the instrumented copy have a profiled_type_t as type,
+   which records each evaluation and passes it on to the original type. */
+typedef struct _profiled_type {
+    nodetype_t type;
+    nodetype_t*original;
+    profile_t*profile;
+} profiled_type_t;
+
+static inline node_profile_t* instrumented_lookup(node_t*n)
+{
+    profiled_type_t*t = (profiled_type_t*)n->type;
+    return (node_profile_t*)dict_lookup(t->profile->instrumented_index, n);
+}
+
+static constant_t profiled_eval(node_t*n, environment_t*env)
+{
+    node_profile_t*e = instrumented_lookup(n);
+    uint64_t start = profile_ticks();
+    constant_t c = ((profiled_type_t*)n->type)->original->eval(n, env);
+    e->cycles += profile_ticks() - start;
+    e->count++;
+    return c;
+}
+static float profiled_eval_float(node_t*n, environment_t*env)
+{
+    node_profile_t*e = instrumented_lookup(n);
+    uint64_t start = profile_ticks();
+    float f = ((profiled_type_t*)n->type)->original->eval_float(n, env);
+    e->cycles += profile_ticks() - start;
+    e->count++;
+    return f;
+}
+static bool profiled_eval_bool(node_t*n, environment_t*env)
+{
+    node_profile_t*e = instrumented_lookup(n);
+    uint64_t start = profile_ticks();
+    bool b = ((profiled_type_t*)n->type)->original->eval_bool(n, env);
+    e->cycles += profile_ticks() - start;
+    e->count++;
+    return b;
+}
+
+static nodetype_t* profiled_type(profile_t*p, nodetype_t*type)
+{
+    profiled_type_t*t = (profiled_type_t*)dict_lookup(p->types, type);
+    if(!t) {
+        t = (profiled_type_t*)calloc(1, sizeof(profiled_type_t));
+        t->type = *type;
+        t->type.eval = profiled_eval;
+        t->type.eval_float = type->eval_float ? profiled_eval_float : NULL;
+        t->type.eval_bool = type->eval_bool ? profiled_eval_bool : NULL;
+        t->original = type;
+        t->profile = p;
+        dict_put(p->types, type, t);
+    }
+    return &t->type;
+}
+
+static int count_nodes(node_t*n)
+{
+    int num = 1;
+    int t;
+    for(t=0;t<n->num_children;t++) {
+        num += count_nodes(n->child[t]);
+    }
+    return num;
+}
+
+static void add_nodes(profile_t*p, node_t*n, node_t*copy)
+{
+    node_profile_t*e = &p->nodes[p->num_nodes++];
+    e->node = n;
+    if(n->type == &node_forest) {
+        forest_t*f = (forest_t*)n->data;
+        e->num_visits = f->num_nodes;
+        e->visits = (uint64_t*)calloc(f->num_nodes ? f->num_nodes : 1, sizeof(uint64_t));
+    }
+    dict_put(p->index, n, e);
+    dict_put(p->instrumented_index, copy, e);
+    copy->type = profiled_type(p, n->type);
+    int t;
+    for(t=0;t<n->num_children;t++) {
+        add_nodes(p, n->child[t], copy->child[t]);
+    }
+}
+
+static void restore_types(node_t*n)
+{
+    n->type = ((profiled_type_t*)n->type)->original;
+    int t;
+    for(t=0;t<n->num_children;t++) {
+        restore_types(n->child[t]);
+    }
+}
+
+profile_t* profile_new(node_t*code)
+{
+    profile_t*p = (profile_t*)calloc(1, sizeof(profile_t));
+    p->code = code;
+    p->nodes = (node_profile_t*)calloc(count_nodes(code), sizeof(node_profile_t));
+    p->index = dict_new(&ptr_type);
+    p->instrumented_index = dict_new(&ptr_type);
+    p->types = dict_new(&ptr_type);
+    p->instrumented = node_duplicate(code);
+    add_nodes(p, code, p->instrumented);
+    return p;
+}
+
+node_profile_t* profile_lookup(profile_t*p, node_t*n)
+{
+    return (node_profile_t*)dict_lookup(p->index, n);
+}
+
+uint64_t* profile_forest_visits(node_t*n)
+{
+    node_profile_t*e = instrumented_lookup(n);
+    return e ? e->visits : NULL;
+}
+
+constant_t profile_eval(profile_t*p, row_t*row)
+{
+    environment_t*env = environment_new(p->instrumented, row);
+    constant_t c = node_eval(p->instrumented, env);
+    environment_destroy(env);
+    return c;
+}
+
+void profile_reset(profile_t*p)
+{
+    int t;
+    for(t=0;t<p->num_nodes;t++) {
+        node_profile_t*e = &p->nodes[t];
+        e->count = 0;
+        e->cycles = 0;
+        if(e->visits)
+            memset(e->visits, 0, sizeof(uint64_t)*e->num_visits);
+    }
+}
+
+static void print_node_profile(node_t*n, FILE*fi, void*data)
+{
+    node_profile_t*e = profile_lookup((profile_t*)data, n);
+    if(!e)
+        return;
+    /* time spent in this node itself, without its children */
+    uint64_t self = e->cycles;
+    int t;
+    for(t=0;t<n->num_children;t++) {
+        node_profile_t*c = profile_lookup((profile_t*)data, n->child[t]);
+        if(c)
+            self -= c->cycles < self ? c->cycles : self;
+    }
+    fprintf(fi, "  [%llu evals, %llu ticks, %llu self]",
+            (unsigned long long)e->count,
+            (unsigned long long)e->cycles,
+            (unsigned long long)self);
+    if(e->visits) {
+        int visited = 0;
+        for(t=0;t<e->num_visits;t++) {
+            if(e->visits[t])
+                visited++;
+        }
+        fprintf(fi, " [%d of %d tree nodes visited]", visited, e->num_visits);
+    }
+}
+
+void profile_print(profile_t*p, FILE*fi)
+{
+    node_print_annotated(p->code, fi, print_node_profile, p);
+}
+
+void profile_destroy(profile_t*p)
+{
+    int t;
+    for(t=0;t<p->num_nodes;t++) {
+        free(p->nodes[t].visits);
+    }
+    free(p->nodes);
+    /* node_destroy() looks at the types to free node data */
+    restore_types(p->instrumented);
+    node_destroy(p->instrumented);
+    DICT_ITERATE_DATA(p->types, profiled_type_t*, type) {
+        free(type);
+    }
+    dict_destroy(p->types);
+    dict_destroy(p->instrumented_index);
+    dict_destroy(p->index);
+    free(p);
+}
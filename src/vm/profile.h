@@ -0,0 +1,92 @@
+/* profile.h
+   Per-node execution profiles of ast programs.
+
+   Part of the data prediction package.
+
+   Copyright (c) 2011 Matthias Kramm <kramm@quiss.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+
+#ifndef __profile_h__
+#define __profile_h__
+
+#include <stdio.h>
+#include "ast.h"
+#include "dict.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* A profile counts, for every node of a program, how often it was
+   evaluated, and how many cycles (or, on machines without a cycle counter,
+   nanoseconds) were spent in it, including its children.
+   Only evaluations through profile_eval() are counted. Those run on an
+   instrumented copy of the program, so the program itself is evaluated
+   without any profiling overhead. */
+
+typedef struct _node_profile {
+    node_t*node;
+    uint64_t count;
+    uint64_t cycles;
+
+    /* forest nodes: how often each node of the flattened trees was
+       visited */
+    uint64_t*visits;
+    int num_visits;
+} node_profile_t;
+
+typedef struct _profile {
+    node_t*code;
+
+    /* in preorder */
+    node_profile_t*nodes;
+    int num_nodes;
+
+    /* node_t* -> node_profile_t* */
+    dict_t*index;
+
+    /* copy of code whose node types count and time evaluations */
+    node_t*instrumented;
+    /* node of instrumented -> node_profile_t* */
+    dict_t*instrumented_index;
+    /* nodetype_t* -> type of instrumented nodes */
+    dict_t*types;
+} profile_t;
+
+/* the program mustn't be modified while the profile is in use */
+profile_t* profile_new(node_t*code);
+
+/* evaluate the program for one row, and count the evaluation */
+constant_t profile_eval(profile_t*p, row_t*row);
+
+/* For forest nodes being evaluated by profile_eval(): the visit counters
+   of the trees' nodes. (Evaluation functions can tell instrumented
+   nodes by their type not being the usual one.) */
+uint64_t* profile_forest_visits(node_t*n);
+
+node_profile_t* profile_lookup(profile_t*p, node_t*n);
+void profile_reset(profile_t*p);
+
+/* prints the program like node_print(), with counts and times */
+void profile_print(profile_t*p, FILE*fi);
+
+void profile_destroy(profile_t*p);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,404 @@
+/* specialize.c
+   Rewrite ast nodes into variants which evaluate without boxing.
+
+   Part of the data prediction package.
+
+   Copyright (c) 2011 Matthias Kramm <kramm@quiss.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+#include "specialize.h"
+#include "ast_transforms.h"
+
+#define EVAL_CHILD(i) (node_eval_child((n)->child[(i)],env))
+#define EVAL_FLOAT(i) (node_eval_float((n)->child[(i)],env))
+#define EVAL_BOOL(i) (node_eval_bool((n)->child[(i)],env))
+
+/* Every typed node computes its result in its eval_float resp. eval_bool
+   function. The boxed eval is only used by parents which aren't
+   specialized. The arithmetic mirrors the generic eval functions in
+   ast.c exactly (including where those compute in double precision). */
+
+#define FLOAT_NODE(node, generic, _name, _flags, _min, _max) \
+    static constant_t node##_eval(node_t*n, environment_t* env) \
+    { \
+        return float_constant(node##_eval_float(n, env)); \
+    } \
+    static nodetype_t node = \
+    { \
+    name:_name, \
+    flags:_flags, \
+    eval:node##_eval, \
+    eval_float:node##_eval_float, \
+    min_args:_min, \
+    max_args:_max, \
+    _opcode:opcode_##generic, \
+    };
+
+#define BOOL_NODE(node, generic, _name, _flags, _min, _max) \
+    static constant_t node##_eval(node_t*n, environment_t* env) \
+    { \
+        return bool_constant(node##_eval_bool(n, env)); \
+    } \
+    static nodetype_t node = \
+    { \
+    name:_name, \
+    flags:_flags, \
+    eval:node##_eval, \
+    eval_bool:node##_eval_bool, \
+    min_args:_min, \
+    max_args:_max, \
+    _opcode:opcode_##generic, \
+    };
+
+// -------------------------- arithmetic --------------------------------
+
+static float node_add_f_eval_float(node_t*n, environment_t* env)
+{
+    double sum = 0;
+    int t;
+    for(t=0;t<n->num_children;t++) {
+        sum += EVAL_FLOAT(t);
+    }
+    return sum;
+}
+FLOAT_NODE(node_add_f, node_add, "add_f", NODE_FLAG_INFIX|NODE_FLAG_HAS_CHILDREN, 1, INT_MAX)
+
+static float node_sub_f_eval_float(node_t*n, environment_t* env)
+{
+    float left = EVAL_FLOAT(0);
+    float right = EVAL_FLOAT(1);
+    return left - right;
+}
+FLOAT_NODE(node_sub_f, node_sub, "minus_f", NODE_FLAG_INFIX|NODE_FLAG_HAS_CHILDREN, 2, 2)
+
+static float node_mul_f_eval_float(node_t*n, environment_t* env)
+{
+    float left = EVAL_FLOAT(0);
+    float right = EVAL_FLOAT(1);
+    return left * right;
+}
+FLOAT_NODE(node_mul_f, node_mul, "mul_f", NODE_FLAG_INFIX|NODE_FLAG_HAS_CHILDREN, 2, 2)
+
+static float node_div_f_eval_float(node_t*n, environment_t* env)
+{
+    float left = EVAL_FLOAT(0);
+    float right = EVAL_FLOAT(1);
+    return left / right;
+}
+FLOAT_NODE(node_div_f, node_div, "div_f", NODE_FLAG_INFIX|NODE_FLAG_HAS_CHILDREN, 2, 2)
+
+static float node_exp_f_eval_float(node_t*n, environment_t* env)
+{
+    return exp(EVAL_FLOAT(0));
+}
+FLOAT_NODE(node_exp_f, node_exp, "exp_f", NODE_FLAG_HAS_CHILDREN, 1, 1)
+
+static float node_sqr_f_eval_float(node_t*n, environment_t* env)
+{
+    double v = EVAL_FLOAT(0);
+    return v*v;
+}
+FLOAT_NODE(node_sqr_f, node_sqr, "sqr_f", NODE_FLAG_HAS_CHILDREN, 1, 1)
+
+static float node_neg_f_eval_float(node_t*n, environment_t* env)
+{
+    return -EVAL_FLOAT(0);
+}
+FLOAT_NODE(node_neg_f, node_neg, "neg_f", NODE_FLAG_HAS_CHILDREN, 1, 1)
+
+static float node_abs_f_eval_float(node_t*n, environment_t* env)
+{
+    return fabs(EVAL_FLOAT(0));
+}
+FLOAT_NODE(node_abs_f, node_abs, "abs_f", NODE_FLAG_HAS_CHILDREN, 1, 1)
+
+static float node_bool_to_float_b_eval_float(node_t*n, environment_t* env)
+{
+    return EVAL_BOOL(0);
+}
+FLOAT_NODE(node_bool_to_float_b, node_bool_to_float, "bool_to_float_b", NODE_FLAG_HAS_CHILDREN, 1, 1)
+
+// -------------------------- comparisons -------------------------------
+
+static bool node_lt_f_eval_bool(node_t*n, environment_t* env)
+{
+    float left = EVAL_FLOAT(0);
+    float right = EVAL_FLOAT(1);
+    return left < right;
+}
+BOOL_NODE(node_lt_f, node_lt, "lt_f", NODE_FLAG_INFIX|NODE_FLAG_HAS_CHILDREN, 2, 2)
+
+static bool node_lte_f_eval_bool(node_t*n, environment_t* env)
+{
+    float left = EVAL_FLOAT(0);
+    float right = EVAL_FLOAT(1);
+    return left <= right;
+}
+BOOL_NODE(node_lte_f, node_lte, "lte_f", NODE_FLAG_INFIX|NODE_FLAG_HAS_CHILDREN, 2, 2)
+
+static bool node_gt_f_eval_bool(node_t*n, environment_t* env)
+{
+    float left = EVAL_FLOAT(0);
+    float right = EVAL_FLOAT(1);
+    return left > right;
+}
+BOOL_NODE(node_gt_f, node_gt, "gt_f", NODE_FLAG_INFIX|NODE_FLAG_HAS_CHILDREN, 2, 2)
+
+static bool node_gte_f_eval_bool(node_t*n, environment_t* env)
+{
+    float left = EVAL_FLOAT(0);
+    float right = EVAL_FLOAT(1);
+    return left >= right;
+}
+BOOL_NODE(node_gte_f, node_gte, "gte_f", NODE_FLAG_INFIX|NODE_FLAG_HAS_CHILDREN, 2, 2)
+
+static bool node_not_b_eval_bool(node_t*n, environment_t* env)
+{
+    return !EVAL_BOOL(0);
+}
+BOOL_NODE(node_not_b, node_not, "not_b", NODE_FLAG_HAS_CHILDREN, 1, 1)
+
+static bool node_likely_b_eval_bool(node_t*n, environment_t* env)
+{
+    return EVAL_BOOL(0);
+}
+BOOL_NODE(node_likely_b, node_likely, "likely_b", NODE_FLAG_HAS_CHILDREN, 1, 1)
+
+// -------------------- if(x) then y else z ----------------------------
+
+/* only the condition is unboxed. The branches are usually category
+   constants or trees. */
+static constant_t node_if_b_eval(node_t*n, environment_t* env)
+{
+    if(EVAL_BOOL(0)) {
+        return EVAL_CHILD(1);
+    } else {
+        return EVAL_CHILD(2);
+    }
+}
+static nodetype_t node_if_b =
+{
+name:"if_b",
+flags:NODE_FLAG_HAS_CHILDREN,
+eval:node_if_b_eval,
+min_args:3,
+max_args:3,
+_opcode:opcode_node_if,
+};
+
+// ---------------------- params and locals ---------------------------
+
+/* the row's value for this param is known to be continuous */
+static float node_param_f_eval_float(node_t*n, environment_t* env)
+{
+    return env->row->inputs[n->value.i].value;
+}
+FLOAT_NODE(node_param_f, node_param, "param_f", NODE_FLAG_HAS_VALUE, 0, 0)
+
+/* the local is only ever assigned floats */
+static float node_getlocal_f_eval_float(node_t*n, environment_t* env)
+{
+    return env->locals[n->value.i].f;
+}
+FLOAT_NODE(node_getlocal_f, node_getlocal, "getlocal_f", NODE_FLAG_HAS_VALUE, 0, 0)
+
+static float node_setlocal_f_eval_float(node_t*n, environment_t* env)
+{
+    float value = EVAL_FLOAT(0);
+    env->locals[n->value.i] = float_constant(value);
+    return value;
+}
+FLOAT_NODE(node_setlocal_f, node_setlocal, "setlocal_f", NODE_FLAG_HAS_CHILDREN|NODE_FLAG_HAS_VALUE, 1, 1)
+
+// ------------------------ specialization ---------------------------
+
+static struct {
+    nodetype_t*typed;
+    nodetype_t*generic;
+} typed_nodes[] = {
+    {&node_add_f, &node_add},
+    {&node_sub_f, &node_sub},
+    {&node_mul_f, &node_mul},
+    {&node_div_f, &node_div},
+    {&node_exp_f, &node_exp},
+    {&node_sqr_f, &node_sqr},
+    {&node_neg_f, &node_neg},
+    {&node_abs_f, &node_abs},
+    {&node_bool_to_float_b, &node_bool_to_float},
+    {&node_lt_f, &node_lt},
+    {&node_lte_f, &node_lte},
+    {&node_gt_f, &node_gt},
+    {&node_gte_f, &node_gte},
+    {&node_not_b, &node_not},
+    {&node_likely_b, &node_likely},
+    {&node_if_b, &node_if},
+    {&node_param_f, &node_param},
+    {&node_getlocal_f, &node_getlocal},
+    {&node_setlocal_f, &node_setlocal},
+};
+#define NUM_TYPED_NODES (sizeof(typed_nodes)/sizeof(typed_nodes[0]))
+
+typedef struct _specialize_state {
+    constant_type_t*param_types;
+    int num_params;
+
+    /* for every local: whether all its assignments are floats */
+    bool*float_locals;
+    int num_locals;
+} specialize_state_t;
+
+static bool all_children_float(node_t*n)
+{
+    int t;
+    for(t=0;t<n->num_children;t++) {
+        if(!n->child[t]->type->eval_float)
+            return false;
+    }
+    return true;
+}
+
+static nodetype_t* typed_type(node_t*n, specialize_state_t*state)
+{
+    nodetype_t*type = n->type;
+    if(type == &node_add) {
+        return all_children_float(n) ? &node_add_f : 0;
+    } else if(type == &node_sub) {
+        return all_children_float(n) ? &node_sub_f : 0;
+    } else if(type == &node_mul) {
+        return all_children_float(n) ? &node_mul_f : 0;
+    } else if(type == &node_div) {
+        return all_children_float(n) ? &node_div_f : 0;
+    } else if(type == &node_exp) {
+        return all_children_float(n) ? &node_exp_f : 0;
+    } else if(type == &node_sqr) {
+        return all_children_float(n) ? &node_sqr_f : 0;
+    } else if(type == &node_neg) {
+        return all_children_float(n) ? &node_neg_f : 0;
+    } else if(type == &node_abs) {
+        return all_children_float(n) ? &node_abs_f : 0;
+    } else if(type == &node_lt) {
+        return all_children_float(n) ? &node_lt_f : 0;
+    } else if(type == &node_lte) {
+        return all_children_float(n) ? &node_lte_f : 0;
+    } else if(type == &node_gt) {
+        return all_children_float(n) ? &node_gt_f : 0;
+    } else if(type == &node_gte) {
+        return all_children_float(n) ? &node_gte_f : 0;
+    } else if(type == &node_setlocal) {
+        return all_children_float(n) ? &node_setlocal_f : 0;
+    } else if(type == &node_bool_to_float) {
+        return n->child[0]->type->eval_bool ? &node_bool_to_float_b : 0;
+    } else if(type == &node_not) {
+        return n->child[0]->type->eval_bool ? &node_not_b : 0;
+    } else if(type == &node_likely) {
+        return n->child[0]->type->eval_bool ? &node_likely_b : 0;
+    } else if(type == &node_if) {
+        return n->child[0]->type->eval_bool ? &node_if_b : 0;
+    } else if(type == &node_param) {
+        int i = n->value.i;
+        if(i >= 0 && i < state->num_params && state->param_types[i] == CONSTANT_FLOAT)
+            return &node_param_f;
+    } else if(type == &node_getlocal) {
+        int i = n->value.i;
+        if(i >= 0 && i < state->num_locals && state->float_locals[i])
+            return &node_getlocal_f;
+    }
+    return 0;
+}
+
+static bool specialize(node_t*n, specialize_state_t*state)
+{
+    bool changed = false;
+    int t;
+    for(t=0;t<n->num_children;t++) {
+        changed |= specialize(n->child[t], state);
+    }
+    nodetype_t*type = typed_type(n, state);
+    if(type) {
+        n->type = type;
+        changed = true;
+    }
+    return changed;
+}
+
+/* A local is a float if every assignment to it is a float, which isn't
+   known before its assignments are specialized. */
+static void find_float_locals(node_t*n, bool*is_float, bool*is_other)
+{
+    if(n->type == &node_setlocal_f) {
+        is_float[n->value.i] = true;
+    } else if(n->type == &node_setlocal ||
+              n->type == &node_inclocal ||
+              n->type == &node_for_local_from_n_to_m) {
+        is_other[n->value.i] = true;
+    }
+    int t;
+    for(t=0;t<n->num_children;t++) {
+        find_float_locals(n->child[t], is_float, is_other);
+    }
+}
+
+void node_specialize(node_t*n, constant_type_t*param_types, int num_params)
+{
+    specialize_state_t state;
+    state.param_types = param_types;
+    state.num_params = num_params;
+    state.num_locals = node_highest_local(n);
+    state.float_locals = (bool*)calloc(state.num_locals+1, sizeof(bool));
+    bool*is_float = (bool*)calloc(state.num_locals+1, sizeof(bool));
+    bool*is_other = (bool*)calloc(state.num_locals+1, sizeof(bool));
+
+    /* every round either finds new float locals (and specializes their
+       uses), or is the last one */
+    while(specialize(n, &state)) {
+        memset(is_float, 0, sizeof(bool)*state.num_locals);
+        memset(is_other, 0, sizeof(bool)*state.num_locals);
+        find_float_locals(n, is_float, is_other);
+        bool new_locals = false;
+        int i;
+        for(i=0;i<state.num_locals;i++) {
+            if(is_float[i] && !is_other[i] && !state.float_locals[i]) {
+                state.float_locals[i] = true;
+                new_locals = true;
+            }
+        }
+        if(!new_locals)
+            break;
+    }
+
+    free(is_float);
+    free(is_other);
+    free(state.float_locals);
+}
+
+void node_despecialize(node_t*n)
+{
+    int i;
+    for(i=0;i<NUM_TYPED_NODES;i++) {
+        if(n->type == typed_nodes[i].typed) {
+            n->type = typed_nodes[i].generic;
+            break;
+        }
+    }
+    int t;
+    for(t=0;t<n->num_children;t++) {
+        node_despecialize(n->child[t]);
+    }
+}
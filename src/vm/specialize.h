@@ -0,0 +1,58 @@
+/* specialize.h
+   Rewrite ast nodes into variants which evaluate without boxing.
+
+   Part of the data prediction package.
+
+   Copyright (c) 2011 Matthias Kramm <kramm@quiss.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+
+#ifndef __specialize_h__
+#define __specialize_h__
+
+#include "ast.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Specialization replaces the types of float arithmetic, float
+   comparisons, boolean logic, continuous params and float locals by
+   typed variants ("add_f", "lt_f", "param_f", ...) whose children are
+   evaluated through eval_float resp. eval_bool, so intermediate results
+   are never boxed into constants nor type checked. The results are bit
+   for bit the same as those of the generic nodes.
+
+   A node is only specialized if the types of its children are known,
+   i.e. if they are specialized themselves, or are float constants,
+   kernels etc.
+
+   Typed variants keep the opcode of their generic type, so serializing,
+   compiling to bytecode and code generation work as before. Transforms
+   which compare node types against the generic ones (node->type ==
+   &node_add) expect a despecialized program, however. */
+
+/* param_types[i] is the type all rows will have in column i. Only params
+   of type CONSTANT_FLOAT are specialized. */
+void node_specialize(node_t*n, constant_type_t*param_types, int num_params);
+
+/* undo node_specialize() */
+void node_despecialize(node_t*n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
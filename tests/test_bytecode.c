@@ -0,0 +1,368 @@
+/* test_bytecode.c
+   Test that bytecode, the tree walker and specialized programs predict
+   the same.
+
+   Part of the data prediction package.
+
+   Copyright (c) 2011 Matthias Kramm <kramm@quiss.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mrscake.h"
+#include "ast.h"
+#include "ast_transforms.h"
+#include "easy_ast.h"
+#include "environment.h"
+#include "bytecode.h"
+#include "forest.h"
+#include "kernels.h"
+#include "constset.h"
+#include "neighbors.h"
+#include "dataset.h"
+#include "model_select.h"
+#include "settings.h"
+#include "test_datasets.h"
+
+#define HEIGHT 200
+#define WIDTH 5
+#define TEST_HEIGHT 500
+
+/* columns 0-2 are continuous, 3 is categorical, 4 is text */
+#define CATEGORY_COLUMN 3
+#define TEXT_COLUMN 4
+
+static char*models[] = {"dtree", "rtrees", "ertrees", "gbtrees", "knearest_2",
+                        "rbf svm", "linear svm", "perceptron",
+                        "neuronal network (sigmoid) with 2 layers"};
+
+/* test rows may have a missing category, which programs have to handle
+   by comparing against categories, not by arithmetic */
+static row_t* random_row()
+{
+    row_t*row = row_new(WIDTH);
+    random_inputs(row->inputs, WIDTH, CATEGORY_COLUMN, TEXT_COLUMN);
+    if(!(lrand48()&3))
+        row->inputs[CATEGORY_COLUMN] = variable_new_missing();
+    return row;
+}
+
+static constant_t eval(node_t*code, row_t*row)
+{
+    environment_t*e = environment_new(code, row);
+    constant_t c = node_eval(code, e);
+    environment_destroy(e);
+    return c;
+}
+
+static int report(const char*name, const char*what, int y, constant_t*c1, constant_t*c2)
+{
+    printf("%s: %s differs in row %d: ", name, what, y);
+    constant_print(c1);printf(" / ");
+    constant_print(c2);printf("\n");
+    return 1;
+}
+
+/* the tree walker against bytecode, row by row, for the program as well
+   as for its expanded version */
+static int compare_rows(const char*name, node_t*code, row_t**rows, int num_rows)
+{
+    node_t*expanded = node_expand_data_nodes(node_duplicate(code));
+    bytecode_t*b = bytecode_compile(code);
+    bytecode_t*b_expanded = bytecode_compile(expanded);
+    constant_t*registers = bytecode_registers_new(b);
+    constant_t*registers_expanded = bytecode_registers_new(b_expanded);
+
+    int errors = 0;
+    int y;
+    for(y=0;y<num_rows;y++) {
+        input_t input;
+        constant_t c1 = eval(code, rows[y]);
+        input_init_row(&input, rows[y]);
+        constant_t c2 = bytecode_run(b, registers, &input);
+        input_clear(&input);
+        constant_t c3 = eval(expanded, rows[y]);
+        input_init_row(&input, rows[y]);
+        constant_t c4 = bytecode_run(b_expanded, registers_expanded, &input);
+        input_clear(&input);
+        if(!constant_equals(&c1, &c2) && !errors++)
+            report(name, "bytecode", y, &c1, &c2);
+        if(!constant_equals(&c1, &c3) && !errors++)
+            report(name, "expanded program", y, &c1, &c3);
+        if(!constant_equals(&c1, &c4) && !errors++)
+            report(name, "expanded bytecode", y, &c1, &c4);
+    }
+    bytecode_registers_destroy(b, registers);
+    bytecode_registers_destroy(b_expanded, registers_expanded);
+    bytecode_destroy(b);
+    bytecode_destroy(b_expanded);
+    node_destroy(expanded);
+    return errors;
+}
+
+/* the tree walker against the program specialized for a dataset, which
+   the bytecode reads straight from the dataset's columns (like
+   model selection does) */
+static int compare_dataset(const char*name, node_t*code, dataset_t*dataset)
+{
+    compiled_code_t*c = code_compile(code, dataset);
+    constant_t*registers = bytecode_registers_new(c->bytecode);
+    row_t*buffer = row_new(dataset->num_columns);
+    input_t input;
+    input_init_dataset(&input, dataset, buffer);
+    row_t*row = row_new(dataset->num_columns);
+
+    int errors = 0;
+    int y;
+    for(y=0;y<dataset->num_rows;y++) {
+        dataset_fill_row(dataset, row, y);
+        constant_t c1 = eval(code, row);
+        constant_t c2 = eval(c->specialized, row);
+        input_set_position(&input, y);
+        constant_t c3 = bytecode_run(c->bytecode, registers, &input);
+        if(!constant_equals(&c1, &c2) && !errors++)
+            report(name, "specialized program", y, &c1, &c2);
+        if(!constant_equals(&c1, &c3) && !errors++)
+            report(name, "specialized bytecode", y, &c1, &c3);
+    }
+    input_clear(&input);
+    row_destroy(row);
+    row_destroy(buffer);
+    bytecode_registers_destroy(c->bytecode, registers);
+    compiled_code_destroy(c);
+    return errors;
+}
+
+static array_t* classes_array(int num_classes)
+{
+    array_t*a = array_new(num_classes);
+    int c;
+    for(c=0;c<num_classes;c++) {
+        a->entries[c] = category_constant(c);
+    }
+    return a;
+}
+
+static node_t* test_forest()
+{
+    forest_t*f = forest_new(FOREST_VOTE, classes_array(3));
+    int t;
+    for(t=0;t<5;t++) {
+        forest_start_tree(f, 0);
+        array_t*a = array_new(2);
+        a->entries[0] = category_constant(t&3);
+        a->entries[1] = category_constant((t+1)&3);
+        int pos = forest_add_in(f, CATEGORY_COLUMN, constset_new(a));
+        int left = forest_add_int_leaf(f, t%3);
+        int lte = forest_add_lte(f, t%3, 64*t);
+        forest_set_branches(f, lte, forest_add_int_leaf(f, 1), forest_add_int_leaf(f, 2));
+        forest_set_branches(f, pos, left, lte);
+    }
+    return node_new_forest(f);
+}
+
+static node_t* test_kernel()
+{
+    kernel_t*k = kernel_new(3);
+    k->vector[0] = 0.5;
+    k->vector[1] = 0.25;
+    k->vector[2] = -0.125;
+    k->has_offset = true;
+    k->offset = -80;
+    node_t*children[3];
+    int t;
+    for(t=0;t<3;t++) {
+        children[t] = node_new_with_args(&node_param, t);
+    }
+    return node_new_kernel(&node_dot_product, k, children);
+}
+
+static node_t* test_knn()
+{
+    knn_t*knn = knn_new(3, 3, classes_array(3));
+    int t;
+    for(t=0;t<50;t++) {
+        float row[3] = {lrand48()&255, lrand48()&255, lrand48()&255};
+        knn_add_row(knn, (row[0]+row[2] > 255) + (row[1] > 200), row);
+    }
+    knn_build(knn);
+    return node_new_knearest(knn);
+}
+
+static node_t* test_set()
+{
+    array_t*a = array_new(2);
+    a->entries[0] = category_constant(1);
+    a->entries[1] = category_constant(3);
+    return node_new_in_set(constset_new(a), node_new_with_args(&node_param, CATEGORY_COLUMN));
+}
+
+/* x0/2 + x1/3 + x2/4 + x0/5, with the constant at the given position of
+   the sum */
+static node_t* linear_sum(int constant_pos)
+{
+    START_CODE(program)
+    ADD
+        int t;
+        int i = 0;
+        for(t=0;t<=4;t++) {
+            if(t == constant_pos) {
+                FLOAT_CONSTANT(-100.5);
+            } else {
+                MUL
+                    PARAM(i%CATEGORY_COLUMN);
+                    FLOAT_CONSTANT(1.0/(i+2));
+                END;
+                i++;
+            }
+        }
+    END;
+    END_CODE;
+    return program;
+}
+
+/* a sum becomes a kernel only if the kernel evaluates it in the same
+   order, i.e. if expanding the kernel gives the sum back */
+static int check_kernel_order(row_t**rows, int num_rows)
+{
+    int errors = 0;
+    int pos;
+    for(pos=0;pos<=4;pos++) {
+        node_t*sum = linear_sum(pos);
+        node_t*kernel = node_recognize_kernels(node_duplicate(sum));
+        bool expect_kernel = pos == 0 || pos == 4;
+        char name[80];
+        sprintf(name, "sum with constant at %d", pos);
+        if((kernel->type == &node_dot_product) != expect_kernel) {
+            printf("%s: %s\n", name, expect_kernel ? "not recognized" : "recognized");
+            errors++;
+        }
+        node_t*expanded = node_expand_data_nodes(node_duplicate(kernel));
+        if(!node_equals_node(sum, expanded)) {
+            printf("%s: expanded kernel differs from the sum\n", name);
+            errors++;
+        }
+        errors += compare_rows(name, kernel, rows, num_rows);
+        node_destroy(expanded);
+        node_destroy(kernel);
+        node_destroy(sum);
+    }
+    return errors;
+}
+
+/* A program mixing nodes the bytecode evaluates itself with nodes it
+   hands to the tree walker (OP_EVAL_NODE), which share locals */
+static node_t* test_program()
+{
+    START_CODE(program)
+    BLOCK
+        SETLOCAL(0)
+            INSERT_NODE(test_kernel());
+        END;
+        IF
+            EQUALS
+                PARAM(CATEGORY_COLUMN);
+                MISSING_CONSTANT;
+            END;
+        THEN
+            IF
+                GT
+                    GETLOCAL(0);
+                    FLOAT_CONSTANT(0.0);
+                END;
+            THEN
+                INSERT_NODE(test_knn());
+            ELSE
+                CATEGORY_CONSTANT(0);
+            END;
+        ELSE
+            IF
+                INSERT_NODE(test_set());
+            THEN
+                INSERT_NODE(test_forest());
+            ELSE
+                IF
+                    LT
+                        GETLOCAL(0);
+                        PARAM(2);
+                    END;
+                THEN
+                    CATEGORY_CONSTANT(1);
+                ELSE
+                    CATEGORY_CONSTANT(2);
+                END;
+            END;
+        END;
+    END;
+    END_CODE;
+    return program;
+}
+
+int main()
+{
+    trainingdata_t*data = trainingdata_new();
+    int t;
+    for(t=0;t<HEIGHT;t++) {
+        trainingdata_add_example(data, random_example(WIDTH, CATEGORY_COLUMN, TEXT_COLUMN));
+    }
+    dataset_t*dataset = trainingdata_sanitize(data);
+    row_t*rows[TEST_HEIGHT];
+    for(t=0;t<TEST_HEIGHT;t++) {
+        rows[t] = random_row();
+    }
+
+    config_verbosity = 0;
+
+    int failed = 0;
+
+    node_t*program = test_program();
+    bytecode_t*b = bytecode_compile(program);
+    if(!b->num_nodes) {
+        printf("test program doesn't use the tree walker\n");
+        failed++;
+    }
+    bytecode_destroy(b);
+    failed += compare_rows("test program", program, rows, TEST_HEIGHT) != 0;
+    node_destroy(program);
+
+    failed += check_kernel_order(rows, TEST_HEIGHT) != 0;
+
+    int i;
+    for(i=0;i<sizeof(models)/sizeof(models[0]);i++) {
+        model_t*m = trainingdata_train_specific_model(data, models[i]);
+        if(!m) {
+            printf("%s: no model\n", models[i]);
+            failed++;
+            continue;
+        }
+        int errors = compare_rows(models[i], m->code, rows, TEST_HEIGHT);
+        errors += compare_dataset(models[i], m->code, dataset);
+        printf("%s: %s\n", models[i], errors ? "differs" : "same");
+        failed += errors != 0;
+        model_destroy(m);
+    }
+
+    for(t=0;t<TEST_HEIGHT;t++) {
+        row_destroy(rows[t]);
+    }
+    dataset_destroy(dataset);
+    trainingdata_destroy(data);
+    if(!failed) {
+        printf("ok\n");
+    }
+    return failed ? 1 : 0;
+}
@@ -1,4 +1,7 @@
+#include <stdio.h>
+#include <string.h>
 #include "test_datasets.h"
+#include "easy_ast.h"
 
 trainingdata_t* trainingdata1(int width, int height)
 {
@@ -52,3 +55,67 @@ dataset_t* dataset2(int width, int height)
     return trainingdata_sanitize(t2);
 }
 
+
+void random_inputs(variable_t*inputs, int width, int category_column, int text_column)
+{
+    int s;
+    for(s=0;s<width;s++) {
+        inputs[s] = variable_new_continuous(lrand48()&255);
+    }
+    if(category_column >= 0) {
+        inputs[category_column] = variable_new_categorical(lrand48()&3);
+    }
+    if(text_column >= 0) {
+        int bits = lrand48();
+        char text[256];
+        sprintf(text, "%s %s %s bravo charlie",
+                (bits&4)?"gamma":"",
+                (bits&2)?"beta":"",
+                (bits&1)?"alpha":"");
+        inputs[text_column] = variable_new_text(text);
+    }
+}
+
+example_t* random_example(int width, int category_column, int text_column)
+{
+    example_t*e = example_new(width);
+    random_inputs(e->inputs, width, category_column, text_column);
+    int cls = e->inputs[0].value + e->inputs[1].value > 255;
+    if(text_column >= 0 && strstr(e->inputs[text_column].text, "alpha"))
+        cls = !cls;
+    if(category_column >= 0 && e->inputs[category_column].category == 2)
+        cls = 2;
+    e->desired_response = variable_new_categorical(cls);
+    return e;
+}
+
+static node_t* threshold_train(model_factory_t*factory, dataset_t*d)
+{
+    threshold_model_t*m = (threshold_model_t*)factory->internal;
+    if(m->num_trained < THRESHOLD_MAX_ROUNDS)
+        m->num_rows[m->num_trained] = d->num_rows;
+    m->num_trained++;
+
+    START_CODE(program)
+    IF
+        GT
+            PARAM(0);
+            FLOAT_CONSTANT(m->threshold);
+        END;
+    THEN
+        CATEGORY_CONSTANT(1);
+    ELSE
+        CATEGORY_CONSTANT(0);
+    END;
+    END_CODE;
+    return program;
+}
+
+void threshold_factory_init(model_factory_t*factory, threshold_model_t*model, const char*name, float threshold)
+{
+    memset(model, 0, sizeof(threshold_model_t));
+    model->threshold = threshold;
+    factory->name = name;
+    factory->train = threshold_train;
+    factory->internal = model;
+}
@@ -3,6 +3,7 @@
 
 #include "mrscake.h"
 #include "dataset.h"
+#include "model_select.h"
 
 trainingdata_t* trainingdata1(int width, int height);
 trainingdata_t* trainingdata2(int width, int height);
@@ -10,4 +11,26 @@ trainingdata_t* trainingdata2(int width, int height);
 dataset_t* dataset1(int width, int height);
 dataset_t* dataset2(int width, int height);
 
+/* continuous values 0-255, except for category_column (categories 0-3)
+   and text_column (some of "alpha", "beta", "gamma", then "bravo
+   charlie"), unless those are -1 */
+void random_inputs(variable_t*inputs, int width, int category_column, int text_column);
+
+/* random_inputs(), of class 1 if the first two add up to more than 255
+   (the other way round if the text contains "alpha"), 0 otherwise, and
+   2 for category 2 */
+example_t* random_example(int width, int category_column, int text_column);
+
+/* A model factory predicting class 1 iff column 0 is larger than a
+   threshold, which counts how often it was trained, and remembers the
+   sizes of the first datasets it was trained on */
+#define THRESHOLD_MAX_ROUNDS 8
+typedef struct _threshold_model {
+    float threshold;
+    int num_rows[THRESHOLD_MAX_ROUNDS];
+    int num_trained;
+} threshold_model_t;
+
+void threshold_factory_init(model_factory_t*factory, threshold_model_t*model, const char*name, float threshold);
+
 #endif
@@ -0,0 +1,106 @@
+/* test_datatable.c
+   Test that columnar training data ends up as the same dataset as
+   training data built from examples.
+
+   Part of the data prediction package.
+   
+   Copyright (c) 2011 Matthias Kramm <kramm@quiss.org> 
+ 
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mrscake.h"
+#include "dataset.h"
+#include "settings.h"
+#include "io.h"
+
+#define HEIGHT 500
+#define WIDTH 5
+
+static const char*words[] = {"red", "green", "blue", "dark red", "light green"};
+static const char*responses[] = {"yes", "no", "maybe"};
+
+int main()
+{
+    float f[HEIGHT];
+    category_t c1[HEIGHT], c2[HEIGHT];
+    const char*t1[HEIGHT], *t2[HEIGHT], *r[HEIGHT];
+    int y;
+    for(y=0;y<HEIGHT;y++) {
+        f[y] = (lrand48()%1000)/10.0;
+        c1[y] = lrand48()%5 * 7;
+        /* ids which don't fit into the direct lookup table */
+        c2[y] = y%3 ? 100000+lrand48()%3 : -2;
+        /* no whitespace, hence categorical */
+        t1[y] = words[lrand48()%3];
+        t2[y] = words[lrand48()%5];
+        r[y] = responses[(f[y] > 50) + (c1[y] == 14)];
+    }
+
+    int failed = 0;
+    int even;
+    for(even=0;even<2;even++) {
+        config_even_out_class_count = even;
+
+        trainingdata_t*data = trainingdata_new();
+        for(y=0;y<HEIGHT;y++) {
+            example_t*e = example_new(WIDTH);
+            e->inputs[0] = variable_new_continuous(f[y]);
+            e->inputs[1] = variable_new_categorical(c1[y]);
+            e->inputs[2] = variable_new_categorical(c2[y]);
+            e->inputs[3] = variable_new_text(t1[y]);
+            e->inputs[4] = variable_new_text(t2[y]);
+            e->desired_response = variable_new_text(r[y]);
+            trainingdata_add_example(data, e);
+        }
+
+        /* add the columns in two chunks, to exercise appending */
+        datatable_t*table = datatable_new(WIDTH);
+        int start;
+        for(start=0;start<HEIGHT;start+=HEIGHT/2) {
+            int num = HEIGHT/2;
+            datatable_add_continuous(table, 0, f+start, num);
+            datatable_add_categorical(table, 1, c1+start, num);
+            datatable_add_categorical(table, 2, c2+start, num);
+            datatable_add_text(table, 3, t1+start, num);
+            datatable_add_text(table, 4, t2+start, num);
+            datatable_add_text_responses(table, r+start, num);
+        }
+
+        /* both shuffle the rows, so start from the same seed */
+        srand48(1);
+        dataset_t*d1 = trainingdata_sanitize(data);
+        srand48(1);
+        dataset_t*d2 = datatable_to_dataset(table);
+
+        bool same = d1 && d2 && d1->num_rows == d2->num_rows &&
+                    !memcmp(d1->hash, d2->hash, HASH_SIZE);
+        printf("even_out_class_count=%d rows=%d/%d: %s\n", even,
+                d1 ? d1->num_rows : -1, d2 ? d2->num_rows : -1,
+                same ? "same" : "DIFFERENT");
+        if(!same)
+            failed++;
+
+        if(d1)
+            dataset_destroy(d1);
+        if(d2)
+            dataset_destroy(d2);
+        datatable_destroy(table);
+        trainingdata_destroy(data);
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,189 @@
+/* test_flat.c
+   Test saving and loading memory-mapped (flat) model files.
+
+   Part of the data prediction package.
+
+   Copyright (c) 2011 Matthias Kramm <kramm@quiss.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "mrscake.h"
+#include "settings.h"
+#include "test_datasets.h"
+
+#define HEIGHT 200
+#define WIDTH 4
+#define TEST_HEIGHT 500
+
+/* two continuous columns decide the class, a categorical one adjusts it */
+#define CATEGORY_COLUMN 3
+
+#define FILENAME "/tmp/test_flat.model"
+#define BROKEN_FILENAME "/tmp/test_flat_broken.model"
+
+/* header fields, see model_save_flat() */
+#define VERSION_OFFSET 8
+#define BYTE_ORDER_OFFSET 12
+#define NODE_SIZE_OFFSET 16
+
+static char*models[] = {"dtree", "rtrees", "gbtrees", "knearest_2", "rbf svm", "linear svm", "perceptron"};
+
+static uint8_t* read_file(const char*filename, size_t*size)
+{
+    FILE*fi = fopen(filename, "rb");
+    if(!fi)
+        return NULL;
+    fseek(fi, 0, SEEK_END);
+    *size = ftell(fi);
+    fseek(fi, 0, SEEK_SET);
+    uint8_t*data = malloc(*size);
+    if(fread(data, 1, *size, fi) != *size) {
+        free(data);
+        data = NULL;
+    }
+    fclose(fi);
+    return data;
+}
+
+static void write_file(const char*filename, uint8_t*data, size_t size)
+{
+    FILE*fi = fopen(filename, "wb");
+    fwrite(data, 1, size, fi);
+    fclose(fi);
+}
+
+/* load a copy of the model file with the header changed at pos, which
+   should fail */
+static int check_rejected(const char*what, int pos, uint8_t xor)
+{
+    size_t size;
+    uint8_t*data = read_file(FILENAME, &size);
+    if(!data) {
+        printf("couldn't read %s\n", FILENAME);
+        return 1;
+    }
+    if(pos >= 0) {
+        data[pos] ^= xor;
+    } else {
+        /* truncate */
+        size = -pos;
+    }
+    write_file(BROKEN_FILENAME, data, size);
+    free(data);
+    model_t*m = model_load_flat(BROKEN_FILENAME);
+    if(m) {
+        printf("model with %s was loaded\n", what);
+        model_destroy(m);
+        return 1;
+    }
+    return 0;
+}
+
+/* the byte order marker read back on a machine with a different byte
+   order */
+static int check_byte_order_rejected()
+{
+    size_t size;
+    uint8_t*data = read_file(FILENAME, &size);
+    if(!data)
+        return 1;
+    uint8_t tmp;
+    tmp = data[BYTE_ORDER_OFFSET+0];
+    data[BYTE_ORDER_OFFSET+0] = data[BYTE_ORDER_OFFSET+3];
+    data[BYTE_ORDER_OFFSET+3] = tmp;
+    tmp = data[BYTE_ORDER_OFFSET+1];
+    data[BYTE_ORDER_OFFSET+1] = data[BYTE_ORDER_OFFSET+2];
+    data[BYTE_ORDER_OFFSET+2] = tmp;
+    write_file(BROKEN_FILENAME, data, size);
+    free(data);
+    model_t*m = model_load_flat(BROKEN_FILENAME);
+    if(m) {
+        printf("model with swapped byte order was loaded\n");
+        model_destroy(m);
+        return 1;
+    }
+    return 0;
+}
+
+int main()
+{
+    trainingdata_t*data = trainingdata_new();
+    int t;
+    for(t=0;t<HEIGHT;t++) {
+        trainingdata_add_example(data, random_example(WIDTH, CATEGORY_COLUMN, -1));
+    }
+    row_t*test[TEST_HEIGHT];
+    for(t=0;t<TEST_HEIGHT;t++) {
+        example_t*e = random_example(WIDTH, CATEGORY_COLUMN, -1);
+        test[t] = example_to_row(e, 0);
+        example_destroy(e);
+    }
+
+    config_verbosity = 0;
+
+    int failed = 0;
+    int i;
+    for(i=0;i<sizeof(models)/sizeof(models[0]);i++) {
+        model_t*m = trainingdata_train_specific_model(data, models[i]);
+        if(!m) {
+            printf("%s: no model\n", models[i]);
+            failed++;
+            continue;
+        }
+        if(!model_save_flat(m, FILENAME)) {
+            printf("%s: couldn't save\n", models[i]);
+            failed++;
+            model_destroy(m);
+            continue;
+        }
+        model_t*loaded = model_load_flat(FILENAME);
+        if(!loaded) {
+            printf("%s: couldn't load\n", models[i]);
+            failed++;
+            model_destroy(m);
+            continue;
+        }
+        int differ = 0;
+        for(t=0;t<TEST_HEIGHT;t++) {
+            variable_t v1 = model_predict(m, test[t]);
+            variable_t v2 = model_predict(loaded, test[t]);
+            if(v1.type != v2.type || v1.category != v2.category)
+                differ++;
+        }
+        printf("%s: %d/%d predictions differ\n", models[i], differ, TEST_HEIGHT);
+        if(differ)
+            failed++;
+        model_destroy(loaded);
+        model_destroy(m);
+    }
+
+    failed += check_rejected("a bad magic", 0, 0xff);
+    failed += check_rejected("another version", VERSION_OFFSET, 0x01);
+    failed += check_rejected("a different node size", NODE_SIZE_OFFSET, 0x80);
+    failed += check_rejected("a truncated header", -32, 0);
+    failed += check_byte_order_rejected();
+
+    remove(FILENAME);
+    remove(BROKEN_FILENAME);
+    for(t=0;t<TEST_HEIGHT;t++) {
+        row_destroy(test[t]);
+    }
+    trainingdata_destroy(data);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,234 @@
+/* test_forest.c
+   Test that flattened forests evaluate like their expanded AST.
+
+   Part of the data prediction package.
+
+   Copyright (c) 2011 Matthias Kramm <kramm@quiss.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "mrscake.h"
+#include "ast.h"
+#include "ast_transforms.h"
+#include "environment.h"
+#include "forest.h"
+#include "profile.h"
+#include "settings.h"
+
+#define ROWS 500
+#define WIDTH 3
+
+/* columns 0 and 1 are continuous, column 2 is categorical (0-3) */
+static row_t* random_row()
+{
+    row_t*row = row_new(WIDTH);
+    row->inputs[0] = variable_new_continuous(lrand48()&255);
+    row->inputs[1] = variable_new_continuous(lrand48()&255);
+    row->inputs[2] = variable_new_categorical(lrand48()&3);
+    return row;
+}
+
+static array_t* classes_array(int num_classes)
+{
+    array_t*a = array_new(num_classes);
+    int c;
+    for(c=0;c<num_classes;c++) {
+        a->entries[c] = category_constant(c*10);
+    }
+    return a;
+}
+
+static int random_tree(forest_t*f, int num_classes, int depth)
+{
+    if(!depth || !(lrand48()%4)) {
+        if(f->mode == FOREST_SUM)
+            return forest_add_float_leaf(f, (lrand48()%200 - 100) / 16.0);
+        return forest_add_int_leaf(f, lrand48()%num_classes);
+    }
+    int pos;
+    if(lrand48()&1) {
+        pos = forest_add_lte(f, lrand48()&1, lrand48()&255);
+    } else {
+        array_t*a = array_new(2);
+        a->entries[0] = category_constant(lrand48()&3);
+        a->entries[1] = category_constant(lrand48()&3);
+        pos = forest_add_in(f, 2, constset_new(a));
+    }
+    if(lrand48()&1) {
+        forest_negate(f, pos);
+    }
+    int left = random_tree(f, num_classes, depth-1);
+    int right = random_tree(f, num_classes, depth-1);
+    forest_set_branches(f, pos, left, right);
+    return pos;
+}
+
+static node_t* random_forest(forest_mode_t mode, int num_trees, int num_classes)
+{
+    forest_t*f = forest_new(mode, classes_array(num_classes));
+    if(mode == FOREST_SUM) {
+        f->shrinkage = 0.5;
+    }
+    int t;
+    for(t=0;t<num_trees;t++) {
+        forest_start_tree(f, t%num_classes);
+        random_tree(f, num_classes, 4);
+    }
+    return node_new_forest(f);
+}
+
+static constant_t eval(node_t*code, row_t*row)
+{
+    environment_t*e = environment_new(code, row);
+    constant_t c = node_eval(code, e);
+    environment_destroy(e);
+    return c;
+}
+
+static node_t* expand(node_t*code, bool early_exit)
+{
+    config_early_exit_votes = early_exit;
+    return node_expand_data_nodes(node_duplicate(code));
+}
+
+/* compare the forest against its expansion, with and without early exit */
+static int compare(const char*name, node_t*forest, row_t**rows, int num_rows)
+{
+    node_t*expanded = expand(forest, false);
+    node_t*expanded_early_exit = expand(forest, true);
+    int errors = 0;
+    int y;
+    for(y=0;y<num_rows;y++) {
+        constant_t c1 = eval(forest, rows[y]);
+        constant_t c2 = eval(expanded, rows[y]);
+        constant_t c3 = eval(expanded_early_exit, rows[y]);
+        if(!constant_equals(&c1, &c2) || !constant_equals(&c1, &c3)) {
+            if(!errors++) {
+                printf("%s: row %d: ", name, y);
+                constant_print(&c1);printf(" / ");
+                constant_print(&c2);printf(" / ");
+                constant_print(&c3);printf("\n");
+            }
+        }
+    }
+    node_destroy(expanded);
+    node_destroy(expanded_early_exit);
+    return errors;
+}
+
+/* a voting forest whose trees are single leaves, voting for votes[t] */
+static node_t* fixed_votes(int num_classes, int*votes, int num_trees)
+{
+    forest_t*f = forest_new(FOREST_VOTE, classes_array(num_classes));
+    int t;
+    for(t=0;t<num_trees;t++) {
+        forest_start_tree(f, 0);
+        forest_add_int_leaf(f, votes[t]);
+    }
+    return node_new_forest(f);
+}
+
+static int check_votes(int num_classes, int*votes, int num_trees, int expected_class, int expected_trees_walked)
+{
+    node_t*forest = fixed_votes(num_classes, votes, num_trees);
+    forest_t*f = (forest_t*)forest->data;
+    row_t*row = random_row();
+    int errors = compare("votes", forest, &row, 1);
+
+    constant_t c = eval(forest, row);
+    if(c.type != CONSTANT_CATEGORY || c.c != expected_class*10) {
+        printf("votes: expected class %d, got ", expected_class*10);
+        constant_print(&c);printf("\n");
+        errors++;
+    }
+
+    profile_t*p = profile_new(forest);
+    profile_eval(p, row);
+    uint64_t*visits = profile_lookup(p, forest)->visits;
+    int walked = 0;
+    int t;
+    for(t=0;t<num_trees;t++) {
+        walked += visits[f->roots[t]] != 0;
+    }
+    if(walked != expected_trees_walked) {
+        printf("votes: expected %d trees to be walked, not %d\n", expected_trees_walked, walked);
+        errors++;
+    }
+    profile_destroy(p);
+
+    row_destroy(row);
+    node_destroy(forest);
+    return errors;
+}
+
+int main()
+{
+    row_t*rows[ROWS];
+    int y;
+    for(y=0;y<ROWS;y++) {
+        rows[y] = random_row();
+    }
+
+    int failed = 0;
+    char*mode_names[] = {"single", "vote", "sum"};
+    int mode;
+    for(mode=FOREST_SINGLE;mode<=FOREST_SUM;mode++) {
+        int num_trees;
+        for(num_trees=1;num_trees<=(mode==FOREST_SINGLE?1:8);num_trees++) {
+            int num_classes;
+            for(num_classes=2;num_classes<=4;num_classes++) {
+                node_t*forest = random_forest(mode, num_trees, num_classes);
+                if(!forest_verify((forest_t*)forest->data)) {
+                    printf("%s: forest doesn't verify\n", mode_names[mode]);
+                    failed++;
+                }
+                int errors = compare(mode_names[mode], forest, rows, ROWS);
+                if(errors) {
+                    printf("%s, %d trees, %d classes: %d/%d rows differ\n", mode_names[mode], num_trees, num_classes, errors, ROWS);
+                    failed++;
+                }
+                node_destroy(forest);
+            }
+        }
+    }
+
+    /* ties go to the last class */
+    int tie2[] = {0, 1};
+    failed += check_votes(2, tie2, 2, 1, 2);
+    int tie3[] = {2, 0, 0, 2};
+    failed += check_votes(3, tie3, 4, 2, 4);
+    int tie4[] = {1, 0, 0, 1, 2};
+    failed += check_votes(3, tie4, 5, 1, 5);
+
+    /* once no other class can catch up, the remaining trees are skipped */
+    int majority[] = {1, 1, 1, 0, 0};
+    failed += check_votes(2, majority, 5, 1, 3);
+    int undecided[] = {0, 0, 1, 1, 1};
+    failed += check_votes(2, undecided, 5, 1, 5);
+    /* the leader wins ties against lower classes, so class 2 can stop
+       as soon as the others can at best draw level */
+    int draw[] = {2, 2, 0, 0};
+    failed += check_votes(3, draw, 4, 2, 2);
+
+    for(y=0;y<ROWS;y++) {
+        row_destroy(rows[y]);
+    }
+    if(!failed) {
+        printf("ok\n");
+    }
+    return failed ? 1 : 0;
+}
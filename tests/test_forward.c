@@ -0,0 +1,201 @@
+/* test_forward.c
+   Test forward selection of columns, with and without cross validation.
+
+   Part of the data prediction package.
+
+   Copyright (c) 2011 Matthias Kramm <kramm@quiss.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "mrscake.h"
+#include "dataset.h"
+#include "model_select.h"
+#include "job.h"
+#include "settings.h"
+#include "test_datasets.h"
+
+#define HEIGHT 200
+#define WIDTH 8
+#define TEST_HEIGHT 1000
+
+/* the number of test errors, or -1 without a model */
+static int test_errors(const char*name, model_t*m, example_t**test)
+{
+    if(!m) {
+        printf("%s: no model\n", name);
+        return -1;
+    }
+    int errors = 0;
+    int t;
+    for(t=0;t<TEST_HEIGHT;t++) {
+        row_t*row = example_to_row(test[t], 0);
+        variable_t v = model_predict(m, row);
+        if(v.type != CATEGORICAL || v.category != test[t]->desired_response.category)
+            errors++;
+        row_destroy(row);
+    }
+    printf("%s: %s, %d/%d test errors\n", name, m->name, errors, TEST_HEIGHT);
+    return errors;
+}
+
+/* The model has to beat guessing, which gets half of them wrong. With
+   cross validation, the winner is retrained on all rows, which can turn
+   out worse than its folds (e.g. a linear svm on a single column), so
+   then we only need a model. */
+static int check_model(const char*name, model_t*m, example_t**test)
+{
+    int errors = test_errors(name, m, test);
+    if(m)
+        model_destroy(m);
+    if(errors < 0)
+        return 1;
+    return config_cross_validation_folds <= 1 && errors > TEST_HEIGHT/3;
+}
+
+/* every round doubles the number of columns, and there's a next round
+   only if fewer than patience rounds in a row failed to improve the best
+   score. Rounds after the first train at most beam models. */
+static int check_rounds(const char*name, search_stats_t*stats, int patience, int beam)
+{
+    int errors = 0;
+    int32_t best_score = INT32_MAX;
+    int misses = 0;
+    int num_jobs = 0;
+    int r;
+    for(r=0;r<stats->num_rounds;r++) {
+        search_round_t*round = &stats->rounds[r];
+        int columns = (1<<r) < WIDTH ? 1<<r : WIDTH;
+        printf("%s: round %d: %d jobs on %d columns, score %d\n", name, r, round->num_jobs, round->num_columns, round->best_score);
+        if(round->num_columns != columns) {
+            printf("%s: round %d has %d columns, not %d\n", name, r, round->num_columns, columns);
+            errors++;
+        }
+        if(r && beam && round->num_jobs > beam) {
+            printf("%s: round %d has %d jobs, beam is %d\n", name, r, round->num_jobs, beam);
+            errors++;
+        }
+        if(r && round->num_jobs > stats->rounds[r-1].num_jobs) {
+            printf("%s: round %d has more jobs than the one before\n", name, r);
+            errors++;
+        }
+        num_jobs += round->num_jobs;
+
+        if(round->best_score < best_score) {
+            best_score = round->best_score;
+            misses = 0;
+        } else {
+            misses++;
+        }
+        bool widen = misses < patience && columns < WIDTH;
+        bool widened = r+1 < stats->num_rounds;
+        if(widen != widened) {
+            printf("%s: %s after round %d (%d rounds without improvement, patience %d)\n",
+                    name, widened ? "widened" : "stopped", r, misses, patience);
+            errors++;
+        }
+    }
+    if(!stats->num_rounds) {
+        printf("%s: no rounds\n", name);
+        errors++;
+    }
+    if(num_jobs != stats->num_jobs) {
+        printf("%s: %d jobs in rounds, %d in total\n", name, num_jobs, stats->num_jobs);
+        errors++;
+    }
+    return errors;
+}
+
+static model_t* search(dataset_t*dataset, search_stats_t*stats)
+{
+    jobqueue_t*jobs = jobqueue_search(dataset, NULL, stats);
+    return jobqueue_extract_best_and_destroy(jobs);
+}
+
+int main()
+{
+    /* only the first two columns matter, the others are noise */
+    trainingdata_t*data = trainingdata_new();
+    int t;
+    for(t=0;t<HEIGHT;t++) {
+        trainingdata_add_example(data, random_example(WIDTH, -1, -1));
+    }
+    example_t*test[TEST_HEIGHT];
+    for(t=0;t<TEST_HEIGHT;t++) {
+        test[t] = random_example(WIDTH, -1, -1);
+    }
+
+    config_verbosity = 0;
+    config_subset_variables = true;
+    dataset_t*dataset = trainingdata_sanitize(data);
+
+    static const struct {
+        int patience;
+        int beam;
+    } settings[] = {
+        {1, 0},
+        {1, 2},
+        {2, 3},
+    };
+
+    int failed = 0;
+    int folds;
+    for(folds=0;folds<=3;folds+=3) {
+        config_cross_validation_folds = folds;
+        char name[80];
+
+        /* every prefix of the column order */
+        search_stats_t all;
+        config_forward_selection = false;
+        sprintf(name, "folds=%d all prefixes", folds);
+        model_t*m = search(dataset, &all);
+        failed += check_model(name, m, test);
+        if(all.num_rounds) {
+            printf("%s: %d rounds\n", name, all.num_rounds);
+            failed++;
+        }
+
+        int i;
+        for(i=0;i<sizeof(settings)/sizeof(settings[0]);i++) {
+            search_stats_t stats;
+            config_forward_selection = true;
+            config_forward_selection_patience = settings[i].patience;
+            config_forward_selection_beam = settings[i].beam;
+            sprintf(name, "folds=%d patience=%d beam=%d", folds, settings[i].patience, settings[i].beam);
+            m = search(dataset, &stats);
+            failed += check_model(name, m, test);
+            failed += check_rounds(name, &stats, settings[i].patience, settings[i].beam);
+
+            /* at most log2(WIDTH)+1 instead of WIDTH rounds, with beam
+               search only one of them full */
+            int limit = settings[i].beam ? all.num_jobs / WIDTH + settings[i].beam * 3 : all.num_jobs / 2;
+            printf("%s: %d jobs, %d for all prefixes\n", name, stats.num_jobs, all.num_jobs);
+            if(stats.num_jobs > limit) {
+                printf("%s: more than %d jobs\n", name, limit);
+                failed++;
+            }
+        }
+    }
+    for(t=0;t<TEST_HEIGHT;t++) {
+        example_destroy(test[t]);
+    }
+    dataset_destroy(dataset);
+    trainingdata_destroy(data);
+    if(!failed) {
+        printf("ok\n");
+    }
+    return failed ? 1 : 0;
+}
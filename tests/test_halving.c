@@ -0,0 +1,229 @@
+/* test_halving.c
+   Test successive halving, and the class proportions of dataset samples.
+
+   Part of the data prediction package.
+
+   Copyright (c) 2011 Matthias Kramm <kramm@quiss.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mrscake.h"
+#include "ast.h"
+#include "dataset.h"
+#include "model_select.h"
+#include "job.h"
+#include "settings.h"
+#include "test_datasets.h"
+
+#define HEIGHT 2000
+#define NUM_THRESHOLDS 9
+
+/* Column 1 numbers the rows, so that their order can be checked. The
+   class is column 0 > 127. Class 2 is rare, class 3 appears only
+   once. */
+static example_t* numbered_example(int nr)
+{
+    example_t*e = example_new(2);
+    random_inputs(e->inputs, 2, -1, -1);
+    e->inputs[1] = variable_new_continuous(nr);
+    int cls = e->inputs[0].value > 127;
+    if(!(nr%50))
+        cls = 2;
+    if(nr == HEIGHT/2)
+        cls = 3;
+    e->desired_response = variable_new_categorical(cls);
+    return e;
+}
+
+static int count_class(dataset_t*d, int cls)
+{
+    int count = 0;
+    int y;
+    for(y=0;y<d->num_rows;y++) {
+        count += d->desired_response->entries[dataset_row(d, y)].c == cls;
+    }
+    return count;
+}
+
+/* every class present in the data is present in the sample, otherwise
+   classes keep their share (rounded down), and rows of a class keep
+   their order */
+static int check_sample(dataset_t*data, int num_rows)
+{
+    dataset_t*sample = dataset_sample(data, num_rows);
+    int expected_rows = num_rows < data->num_rows ? num_rows : data->num_rows;
+    int errors = 0;
+    int c;
+    for(c=0;c<data->desired_response->num_classes;c++) {
+        int count = count_class(data, c);
+        int expected = (int)((int64_t)count * expected_rows / data->num_rows);
+        if(!expected && count)
+            expected = 1;
+        int got = count_class(sample, c);
+        if(got != expected) {
+            printf("sample of %d rows: %d rows of class %d, not %d\n", num_rows, got, c, expected);
+            errors++;
+        }
+
+        int y, pos = 0;
+        for(y=0;y<sample->num_rows;y++) {
+            int r = dataset_row(sample, y);
+            if(sample->desired_response->entries[r].c != c)
+                continue;
+            while(pos < data->num_rows && data->desired_response->entries[dataset_row(data, pos)].c != c)
+                pos++;
+            if(pos == data->num_rows ||
+               sample->columns[1]->entries[r].f != data->columns[1]->entries[dataset_row(data, pos)].f) {
+                printf("sample of %d rows: rows of class %d out of order\n", num_rows, c);
+                errors++;
+                break;
+            }
+            pos++;
+        }
+    }
+    if(sample->num_rows > expected_rows + data->desired_response->num_classes) {
+        printf("sample of %d rows has %d rows\n", num_rows, sample->num_rows);
+        errors++;
+    }
+    dataset_destroy(sample);
+    return errors;
+}
+
+/* race one threshold model per threshold, and check that every round
+   trains the survivors of the previous one on a larger sample, with the
+   best model winning */
+static int check_racing(dataset_t*data, int factor, int min_rows)
+{
+    config_halving_factor = factor;
+    config_halving_min_rows = min_rows;
+    /* factors below 2 are treated as 2 */
+    if(factor < 2)
+        factor = 2;
+
+    threshold_model_t models[NUM_THRESHOLDS];
+    model_factory_t factories[NUM_THRESHOLDS];
+    jobqueue_t*jobs = jobqueue_new();
+    int i;
+    for(i=0;i<NUM_THRESHOLDS;i++) {
+        /* thresholds 31, 63, ..., 287. 127 is the right one. */
+        threshold_factory_init(&factories[i], &models[i], "threshold", (i+1)*32 - 1);
+        job_t*job = job_new();
+        job->factory = &factories[i];
+        job->data = data;
+        jobqueue_append(jobs, job);
+    }
+
+    /* the rounds we expect, see jobqueue_process_racing() */
+    int rounds = 0;
+    int scale = 1;
+    int survivors = NUM_THRESHOLDS;
+    while(data->num_rows / (scale*factor) >= min_rows && survivors > 1) {
+        scale *= factor;
+        survivors = (survivors + factor - 1) / factor;
+        rounds++;
+    }
+
+    jobqueue_process_racing(data, jobs);
+
+    int errors = 0;
+    if(jobs->num != survivors) {
+        printf("factor %d: %d jobs left, not %d\n", factor, jobs->num, survivors);
+        errors++;
+    }
+    bool found_best = false;
+    job_t*job;
+    for(job=jobs->first;job;job=job->next) {
+        if(!job->code || job->data != data) {
+            printf("factor %d: job not trained on the full dataset\n", factor);
+            errors++;
+        }
+        if(job->factory == &factories[3])
+            found_best = true;
+        if(job->code)
+            node_destroy(job->code);
+    }
+    if(!found_best) {
+        printf("factor %d: best model was dropped\n", factor);
+        errors++;
+    }
+
+    /* models which survived a round are trained on a sample of
+       factor times the size in the next */
+    for(i=0;i<NUM_THRESHOLDS;i++) {
+        threshold_model_t*m = &models[i];
+        if(m->num_trained > rounds+1 || m->num_trained < 1) {
+            printf("factor %d: threshold %.0f trained %d times\n", factor, m->threshold, m->num_trained);
+            errors++;
+            continue;
+        }
+        int r;
+        for(r=0;r<m->num_trained;r++) {
+            int s = scale;
+            int k;
+            for(k=0;k<r;k++)
+                s /= factor;
+            int expected = r == rounds ? data->num_rows : data->num_rows / s;
+            int slack = data->desired_response->num_classes;
+            if(m->num_rows[r] > expected + slack || m->num_rows[r] < expected - slack) {
+                printf("factor %d: threshold %.0f trained on %d rows in round %d, expected %d\n",
+                        factor, m->threshold, m->num_rows[r], r, expected);
+                errors++;
+            }
+        }
+    }
+    if(models[3].num_trained != rounds+1) {
+        printf("factor %d: best model trained %d times, not %d\n", factor, models[3].num_trained, rounds+1);
+        errors++;
+    }
+    jobqueue_destroy(jobs);
+    return errors;
+}
+
+int main()
+{
+    trainingdata_t*data = trainingdata_new();
+    int t;
+    for(t=0;t<HEIGHT;t++) {
+        trainingdata_add_example(data, numbered_example(t));
+    }
+
+    config_verbosity = 0;
+    config_even_out_class_count = false;
+    config_fork_for_training = false;
+    dataset_t*dataset = trainingdata_sanitize(data);
+
+    int failed = 0;
+    failed += check_sample(dataset, 10);
+    failed += check_sample(dataset, 222);
+    failed += check_sample(dataset, HEIGHT/3);
+    failed += check_sample(dataset, HEIGHT);
+    failed += check_sample(dataset, HEIGHT*2);
+
+    failed += check_racing(dataset, 3, 100);
+    failed += check_racing(dataset, 2, 100);
+    failed += check_racing(dataset, 1, 100);
+    /* not enough rows for a single round */
+    failed += check_racing(dataset, 3, HEIGHT);
+
+    dataset_destroy(dataset);
+    trainingdata_destroy(data);
+    if(!failed) {
+        printf("ok\n");
+    }
+    return failed ? 1 : 0;
+}
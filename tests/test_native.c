@@ -0,0 +1,159 @@
+/* test_native.c
+   Test that natively compiled models predict like the tree walker and
+   the bytecode.
+
+   Part of the data prediction package.
+
+   Copyright (c) 2011 Matthias Kramm <kramm@quiss.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include "mrscake.h"
+#include "ast.h"
+#include "environment.h"
+#include "bytecode.h"
+#include "native.h"
+#include "predictor.h"
+#include "model.h"
+#include "settings.h"
+#include "test_datasets.h"
+
+#define HEIGHT 200
+#define WIDTH 4
+#define TEST_HEIGHT 300
+
+/* columns 0-2 are continuous, 3 is categorical. Its category 2 decides
+   the class on its own, which makes models start with an early return
+   for it (see find_clear_cut_columns()) */
+#define CATEGORY_COLUMN 3
+
+static char*models[] = {"dtree", "rtrees", "ertrees", "gbtrees", "knearest_2",
+                        "rbf svm", "linear svm", "perceptron",
+                        "neuronal network (sigmoid) with 2 layers"};
+
+static int report(const char*name, const char*what, int y, constant_t*c1, constant_t*c2)
+{
+    printf("%s: %s differs in row %d: ", name, what, y);
+    constant_print(c1);printf(" / ");
+    constant_print(c2);printf("\n");
+    return 1;
+}
+
+static int compare(const char*name, model_t*m, row_t**rows, int num_rows)
+{
+    native_t*native = model_get_native(m);
+    if(!native) {
+        printf("%s: couldn't compile\n", name);
+        return 1;
+    }
+    node_t*code = (node_t*)m->code;
+    bytecode_t*b = model_get_bytecode(m);
+    constant_t*registers = bytecode_registers_new(b);
+    environment_t*env = environment_new(code, 0);
+
+    int errors = 0;
+    int y;
+    for(y=0;y<num_rows;y++) {
+        env->row = rows[y];
+        constant_t c1 = node_eval(code, env);
+        input_t input;
+        input_init_row(&input, rows[y]);
+        constant_t c2 = bytecode_run(b, registers, &input);
+        input_clear(&input);
+        constant_t c3;
+        if(!native_run(native, rows[y], &c3)) {
+            printf("%s: native code rejected row %d\n", name, y);
+            errors++;
+            break;
+        }
+        if(!constant_equals(&c1, &c2) && !errors++)
+            report(name, "bytecode", y, &c1, &c2);
+        if(!constant_equals(&c1, &c3) && !errors++)
+            report(name, "native code", y, &c1, &c3);
+    }
+    environment_destroy(env);
+    bytecode_registers_destroy(b, registers);
+    return errors;
+}
+
+static void remove_directory(const char*dir)
+{
+    DIR*d = opendir(dir);
+    if(!d)
+        return;
+    struct dirent*e;
+    while((e = readdir(d))) {
+        if(e->d_name[0] == '.')
+            continue;
+        char filename[1024];
+        snprintf(filename, sizeof(filename), "%s/%s", dir, e->d_name);
+        unlink(filename);
+    }
+    closedir(d);
+    rmdir(dir);
+}
+
+int main()
+{
+    char cache_dir[] = "/tmp/test_native.XXXXXX";
+    if(!mkdtemp(cache_dir)) {
+        perror(cache_dir);
+        return 1;
+    }
+    config_verbosity = 0;
+    config_native_compilation = true;
+    config_native_cache_directory = cache_dir;
+
+    trainingdata_t*data = trainingdata_new();
+    int t;
+    for(t=0;t<HEIGHT;t++) {
+        trainingdata_add_example(data, random_example(WIDTH, CATEGORY_COLUMN, -1));
+    }
+    row_t*rows[TEST_HEIGHT];
+    for(t=0;t<TEST_HEIGHT;t++) {
+        rows[t] = row_new(WIDTH);
+        random_inputs(rows[t]->inputs, WIDTH, CATEGORY_COLUMN, -1);
+    }
+
+    int failed = 0;
+    int i;
+    for(i=0;i<sizeof(models)/sizeof(models[0]);i++) {
+        model_t*m = trainingdata_train_specific_model(data, models[i]);
+        if(!m) {
+            printf("%s: no model\n", models[i]);
+            failed++;
+            continue;
+        }
+        int errors = compare(models[i], m, rows, TEST_HEIGHT);
+        printf("%s: %s\n", models[i], errors ? "differs" : "same");
+        failed += errors != 0;
+        model_destroy(m);
+    }
+
+    for(t=0;t<TEST_HEIGHT;t++) {
+        row_destroy(rows[t]);
+    }
+    trainingdata_destroy(data);
+    remove_directory(cache_dir);
+    if(!failed) {
+        printf("ok\n");
+    }
+    return failed ? 1 : 0;
+}
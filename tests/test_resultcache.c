@@ -0,0 +1,240 @@
+/* test_resultcache.c
+   Test the cache of trained jobs.
+
+   Part of the data prediction package.
+
+   Copyright (c) 2011 Matthias Kramm <kramm@quiss.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include "mrscake.h"
+#include "ast.h"
+#include "dataset.h"
+#include "model_select.h"
+#include "job.h"
+#include "settings.h"
+#include "test_datasets.h"
+
+#define HEIGHT 200
+#define NUM_MODELS 3
+
+static dataset_t* random_dataset()
+{
+    trainingdata_t*data = trainingdata_new();
+    int t;
+    for(t=0;t<HEIGHT;t++) {
+        trainingdata_add_example(data, random_example(2, -1, -1));
+    }
+    dataset_t*dataset = trainingdata_sanitize(data);
+    trainingdata_destroy(data);
+    return dataset;
+}
+
+/* threshold models (see test_datasets.h), which count how often they
+   were trained */
+static threshold_model_t models[NUM_MODELS];
+static model_factory_t factories[NUM_MODELS];
+static char*names[NUM_MODELS] = {"threshold 63", "threshold 127", "threshold 191"};
+
+static int num_trained()
+{
+    int count = 0;
+    int i;
+    for(i=0;i<NUM_MODELS;i++) {
+        count += models[i].num_trained;
+        models[i].num_trained = 0;
+    }
+    return count;
+}
+
+/* process one job per model, returns how many of them were cached */
+static int process(dataset_t*data, const char*transforms, int32_t*scores)
+{
+    jobqueue_t*jobs = jobqueue_new();
+    int i;
+    for(i=0;i<NUM_MODELS;i++) {
+        job_t*job = job_new();
+        job->factory = &factories[i];
+        job->data = data;
+        job->transforms = transforms ? strdup(transforms) : NULL;
+        jobqueue_append(jobs, job);
+    }
+    jobqueue_process(data, jobs);
+
+    int cached = 0;
+    job_t*job;
+    for(job=jobs->first, i=0;job;job=job->next, i++) {
+        if(job->flags & JOB_CACHED)
+            cached++;
+        if(job->code) {
+            /* whatever we got from the cache has to score like what was
+               stored */
+            int32_t score = code_size(job->code) + code_errors(job->code, data) * 100;
+            if(score != job->score) {
+                printf("%s: score %d, but the code scores %d\n", names[i], job->score, score);
+                cached = -1;
+            }
+            node_destroy(job->code);
+        }
+        if(scores)
+            scores[i] = job->score;
+    }
+    jobqueue_destroy(jobs);
+    return cached;
+}
+
+static int count_results(const char*dir)
+{
+    DIR*d = opendir(dir);
+    if(!d)
+        return 0;
+    int count = 0;
+    struct dirent*e;
+    while((e = readdir(d))) {
+        if(e->d_name[0] != '.')
+            count++;
+    }
+    closedir(d);
+    return count;
+}
+
+/* replace every result file by the given bytes */
+static void corrupt_results(const char*dir, const char*data, int len)
+{
+    DIR*d = opendir(dir);
+    if(!d)
+        return;
+    struct dirent*e;
+    while((e = readdir(d))) {
+        if(e->d_name[0] == '.')
+            continue;
+        char filename[1024];
+        snprintf(filename, sizeof(filename), "%s/%s", dir, e->d_name);
+        FILE*fi = fopen(filename, "wb");
+        fwrite(data, 1, len, fi);
+        fclose(fi);
+    }
+    closedir(d);
+}
+
+static void remove_results(const char*dir)
+{
+    DIR*d = opendir(dir);
+    if(!d)
+        return;
+    struct dirent*e;
+    while((e = readdir(d))) {
+        if(e->d_name[0] == '.')
+            continue;
+        char filename[1024];
+        snprintf(filename, sizeof(filename), "%s/%s", dir, e->d_name);
+        unlink(filename);
+    }
+    closedir(d);
+}
+
+static int expect(const char*what, int cached, int expected_cached, int expected_trained)
+{
+    int trained = num_trained();
+    printf("%s: %d cached, %d trained\n", what, cached, trained);
+    if(cached != expected_cached || trained != expected_trained) {
+        printf("%s: expected %d cached, %d trained\n", what, expected_cached, expected_trained);
+        return 1;
+    }
+    return 0;
+}
+
+int main()
+{
+    char cache_dir[] = "/tmp/test_resultcache.XXXXXX";
+    if(!mkdtemp(cache_dir)) {
+        perror(cache_dir);
+        return 1;
+    }
+    char results_dir[sizeof(cache_dir)+16];
+    sprintf(results_dir, "%s/results", cache_dir);
+
+    config_verbosity = 0;
+    config_fork_for_training = false;
+    config_dataset_cache_directory = cache_dir;
+    config_cache_job_results = true;
+
+    int i;
+    for(i=0;i<NUM_MODELS;i++) {
+        threshold_factory_init(&factories[i], &models[i], names[i], (i+1)*64 - 1);
+    }
+
+    dataset_t*data = random_dataset();
+    int failed = 0;
+
+    int32_t scores[NUM_MODELS];
+    int32_t cached_scores[NUM_MODELS];
+    failed += expect("first run", process(data, NULL, scores), 0, NUM_MODELS);
+    if(count_results(results_dir) != NUM_MODELS) {
+        printf("%d results stored, not %d\n", count_results(results_dir), NUM_MODELS);
+        failed++;
+    }
+
+    failed += expect("same dataset", process(data, NULL, cached_scores), NUM_MODELS, 0);
+    if(memcmp(scores, cached_scores, sizeof(scores))) {
+        printf("cached scores differ\n");
+        failed++;
+    }
+
+    /* other transformations are other jobs */
+    failed += expect("other transforms", process(data, "pick_columns(0)", NULL), 0, NUM_MODELS);
+    failed += expect("other transforms, again", process(data, "pick_columns(0)", NULL), NUM_MODELS, 0);
+
+    /* a different dataset with the same shape */
+    dataset_t*data2 = random_dataset();
+    failed += expect("changed dataset", process(data2, NULL, NULL), 0, NUM_MODELS);
+    failed += expect("changed dataset, again", process(data2, NULL, NULL), NUM_MODELS, 0);
+    dataset_destroy(data2);
+
+    /* row views have no hash, and are never cached */
+    dataset_t*fold = dataset_fold(data, 0, 2, false);
+    failed += expect("fold", process(fold, NULL, NULL), 0, NUM_MODELS);
+    failed += expect("fold, again", process(fold, NULL, NULL), 0, NUM_MODELS);
+    dataset_destroy(fold);
+
+    /* broken entries are retrained and replaced */
+    remove_results(results_dir);
+    process(data, NULL, NULL);
+    num_trained();
+    corrupt_results(results_dir, "\x10", 1);
+    failed += expect("truncated entries", process(data, NULL, NULL), 0, NUM_MODELS);
+    failed += expect("after truncated entries", process(data, NULL, NULL), NUM_MODELS, 0);
+    corrupt_results(results_dir, "\x10\xff\xff\xff\xff", 5);
+    failed += expect("garbage entries", process(data, NULL, NULL), 0, NUM_MODELS);
+    failed += expect("after garbage entries", process(data, NULL, NULL), NUM_MODELS, 0);
+
+    /* nothing is cached unless asked to */
+    config_cache_job_results = false;
+    failed += expect("cache disabled", process(data, NULL, NULL), 0, NUM_MODELS);
+
+    remove_results(results_dir);
+    rmdir(results_dir);
+    rmdir(cache_dir);
+    dataset_destroy(data);
+    if(!failed) {
+        printf("ok\n");
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,287 @@
+/* test_size.c
+   Test that node_serialized_size() agrees with what node_write() writes.
+
+   Part of the data prediction package.
+
+   Copyright (c) 2011 Matthias Kramm <kramm@quiss.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "mrscake.h"
+#include "ast.h"
+#include "ast_transforms.h"
+#include "serialize.h"
+#include "io.h"
+#include "forest.h"
+#include "kernels.h"
+#include "constset.h"
+#include "neighbors.h"
+#include "settings.h"
+#include "test_datasets.h"
+
+#define HEIGHT 200
+#define WIDTH 4
+
+static char*models[] = {"dtree", "rtrees", "ertrees", "gbtrees", "knearest_2",
+                        "rbf svm", "linear svm", "perceptron",
+                        "neuronal network (sigmoid) with 2 layers"};
+
+/* which node types (by opcode) were checked */
+static bool checked[256];
+static int failed = 0;
+
+static void check_node(node_t*n, const char*name)
+{
+    unsigned flags;
+    for(flags=0;flags<=SERIALIZE_FLAG_OMIT_STRINGS;flags++) {
+        writer_t*w = nullwriter_new();
+        node_write(n, w, flags);
+        int written = w->pos;
+        w->finish(w);
+        int size = node_serialized_size(n, flags);
+        if(size != written) {
+            printf("%s: %s node: node_serialized_size()=%d, node_write() wrote %d bytes (flags %d)\n",
+                    name, n->type->name, size, written, flags);
+            failed++;
+        }
+    }
+    checked[node_get_opcode(n)] = true;
+}
+
+static void check_tree(node_t*n, const char*name)
+{
+    check_node(n, name);
+    int t;
+    for(t=0;t<n->num_children;t++) {
+        check_tree(n->child[t], name);
+    }
+}
+
+static node_t* param(int i)
+{
+    return node_new_with_args(&node_param, i);
+}
+
+static array_t* mixed_array()
+{
+    array_t*a = array_new(5);
+    a->entries[0] = int_constant(-100000);
+    a->entries[1] = float_constant(3.5);
+    a->entries[2] = category_constant(20000);
+    a->entries[3] = string_constant("a string");
+    a->entries[4] = missing_constant();
+    return a;
+}
+
+static array_t* array_of(int size, constant_t (*constant)(int i))
+{
+    array_t*a = array_new(size);
+    int t;
+    for(t=0;t<size;t++) {
+        a->entries[t] = constant(t);
+    }
+    return a;
+}
+static constant_t nth_float(int i) {return float_constant(i/7.0);}
+static constant_t nth_int(int i) {return int_constant(i*i*i*100);}
+static constant_t nth_category(int i) {return category_constant(i*1000);}
+static constant_t nth_string(int i)
+{
+    static char*strings[] = {"alpha", "beta", "", "a somewhat longer string"};
+    return string_constant(strings[i%4]);
+}
+
+/* a node of the given (generic) type, with values that don't fit into a
+   single byte, and some children */
+static node_t* example_node(nodetype_t*type)
+{
+    node_t*n;
+    switch(type->_opcode) {
+        case opcode_node_param:
+            return node_new_with_args(type, 1000);
+        case opcode_node_category:
+            return node_new_with_args(type, 70000);
+        case opcode_node_float:
+            return node_new_with_args(type, 1.5);
+        case opcode_node_int:
+            return node_new_with_args(type, -5);
+        case opcode_node_string:
+            return node_new_with_args(type, "a string");
+        case opcode_node_mixed_array:
+            return node_new_with_args(type, mixed_array());
+        case opcode_node_string_array:
+            return node_new_with_args(type, array_of(9, nth_string));
+        case opcode_node_float_array:
+            return node_new_with_args(type, array_of(255, nth_float));
+        case opcode_node_int_array:
+            return node_new_with_args(type, array_of(200, nth_int));
+        case opcode_node_category_array:
+            return node_new_with_args(type, array_of(130, nth_category));
+        case opcode_node_zero_int_array:
+        case opcode_node_zero_float_array:
+            return node_new_with_args(type, 200);
+        case opcode_node_constant:
+            return node_new_with_args(type, string_constant("a constant"));
+        case opcode_node_setlocal:
+        case opcode_node_getlocal:
+        case opcode_node_inclocal:
+        case opcode_node_for_local_from_n_to_m:
+            n = node_new_with_args(type, 300);
+            break;
+        default:
+            n = node_new(type, 0);
+            break;
+    }
+    if(type->flags & NODE_FLAG_HAS_CHILDREN) {
+        int num = type->min_args;
+        if(type->max_args > num)
+            num += type->max_args - num < 200 ? type->max_args - num : 200;
+        int t;
+        for(t=0;t<num;t++) {
+            node_append_child(n, param(t));
+        }
+    }
+    return n;
+}
+
+static node_t* example_forest(forest_mode_t mode)
+{
+    forest_t*f = forest_new(mode, array_of(3, nth_category));
+    int t;
+    for(t=0;t<100;t++) {
+        forest_start_tree(f, t%3);
+        int pos = forest_add_lte(f, t, t*1.5);
+        int left = mode == FOREST_SUM ? forest_add_float_leaf(f, -t/3.0) : forest_add_int_leaf(f, -t*t*t);
+        int set = forest_add_in(f, t+1, constset_new(array_of(t%10+1, nth_string)));
+        int right = forest_add_int_leaf(f, t%3);
+        int right2 = forest_add_int_leaf(f, (t+1)%3);
+        forest_set_branches(f, set, right, right2);
+        forest_set_branches(f, pos, left, set);
+    }
+    return node_new_forest(f);
+}
+
+static node_t* example_kernel(nodetype_t*type, bool offset_last)
+{
+    kernel_t*k = kernel_new(300);
+    int t;
+    node_t*children[300];
+    for(t=0;t<300;t++) {
+        k->vector[t] = t/3.0;
+        children[t] = param(t);
+    }
+    k->has_offset = true;
+    k->offset_last = offset_last;
+    k->offset = 2.0;
+    return node_new_kernel(type, k, children);
+}
+
+static node_t* example_knn()
+{
+    knn_t*knn = knn_new(3, 5, array_of(3, nth_string));
+    int t;
+    for(t=0;t<400;t++) {
+        float row[5] = {t, t*2, t%7, -t, 0};
+        knn_add_row(knn, t%3, row);
+    }
+    knn_build(knn);
+    return node_new_knearest(knn);
+}
+
+static node_t* example_set(array_t*a)
+{
+    return node_new_in_set(constset_new(a), param(1000));
+}
+
+int main()
+{
+    nodelist_init();
+
+    /* every generic node type */
+    nodetype_t*types[] = {
+#define NODE(opcode, name) &name,
+LIST_NODES
+#undef NODE
+    };
+    int i;
+    for(i=0;i<sizeof(types)/sizeof(types[0]);i++) {
+        /* bool constants have no serialized form */
+        if(types[i] == &node_bool) {
+            checked[opcode_node_bool] = true;
+            continue;
+        }
+        node_t*n = example_node(types[i]);
+        check_node(n, "example");
+        node_destroy(n);
+    }
+
+    /* the data nodes */
+    node_t*data_nodes[] = {
+        example_forest(FOREST_SINGLE),
+        example_forest(FOREST_VOTE),
+        example_forest(FOREST_SUM),
+        example_kernel(&node_dot_product, false),
+        example_kernel(&node_dot_product, true),
+        example_kernel(&node_squared_distance, false),
+        example_knn(),
+        example_set(array_of(4, nth_category)),
+        example_set(array_of(100, nth_int)),
+        example_set(array_of(50, nth_string)),
+        example_set(mixed_array()),
+    };
+    for(i=0;i<sizeof(data_nodes)/sizeof(data_nodes[0]);i++) {
+        check_tree(data_nodes[i], "example");
+        node_destroy(data_nodes[i]);
+    }
+
+    /* the programs of trained models, and what code generation makes
+       of them */
+    trainingdata_t*data = trainingdata_new();
+    int t;
+    for(t=0;t<HEIGHT;t++) {
+        trainingdata_add_example(data, random_example(WIDTH, 3, -1));
+    }
+    config_verbosity = 0;
+    for(i=0;i<sizeof(models)/sizeof(models[0]);i++) {
+        model_t*m = trainingdata_train_specific_model(data, models[i]);
+        if(!m) {
+            printf("%s: no model\n", models[i]);
+            failed++;
+            continue;
+        }
+        check_tree((node_t*)m->code, models[i]);
+        node_t*expanded = node_prepare_for_code_generation(node_duplicate((node_t*)m->code));
+        check_tree(expanded, models[i]);
+        node_destroy(expanded);
+        model_destroy(m);
+    }
+    trainingdata_destroy(data);
+
+#define NODE(opcode, name) \
+    if(!checked[opcode]) { \
+        printf("%s wasn't checked\n", #name); \
+        failed++; \
+    }
+LIST_NODES
+LIST_DATA_NODES
+#undef NODE
+
+    if(!failed) {
+        printf("ok\n");
+    }
+    return failed ? 1 : 0;
+}